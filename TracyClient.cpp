@@ -20,11 +20,13 @@
 #endif
 
 #include "common/tracy_lz4.cpp"
+#include "common/tracy_lz4hc.cpp"
 #include "client/TracyProfiler.cpp"
 #include "client/TracyCallstack.cpp"
 #include "client/TracySysTime.cpp"
 #include "client/TracySysTrace.cpp"
 #include "common/TracySocket.cpp"
+#include "common/TracyShm.cpp"
 #include "client/tracy_rpmalloc.cpp"
 #include "client/TracyDxt1.cpp"
 
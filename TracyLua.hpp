@@ -202,6 +202,7 @@ static inline int LuaZoneBeginS( lua_State* L )
 #else
     const auto depth = uint32_t( lua_tointeger( L, 1 ) );
 #endif
+    Profiler::FlushPendingZones();
     SendLuaCallstack( L, depth );
 
     TracyLfqPrepare( QueueType::ZoneBeginAllocSrcLocCallstack );
@@ -230,6 +231,7 @@ static inline int LuaZoneBeginNS( lua_State* L )
 #else
     const auto depth = uint32_t( lua_tointeger( L, 2 ) );
 #endif
+    Profiler::FlushPendingZones();
     SendLuaCallstack( L, depth );
 
     TracyLfqPrepare( QueueType::ZoneBeginAllocSrcLocCallstack );
@@ -259,6 +261,7 @@ static inline int LuaZoneBegin( lua_State* L )
     if( !GetLuaZoneState().active ) return 0;
 #endif
 
+    Profiler::FlushPendingZones();
     TracyLfqPrepare( QueueType::ZoneBeginAllocSrcLoc );
     lua_Debug dbg;
     lua_getstack( L, 1, &dbg );
@@ -283,6 +286,7 @@ static inline int LuaZoneBeginN( lua_State* L )
     if( !GetLuaZoneState().active ) return 0;
 #endif
 
+    Profiler::FlushPendingZones();
     TracyLfqPrepare( QueueType::ZoneBeginAllocSrcLoc );
     lua_Debug dbg;
     lua_getstack( L, 1, &dbg );
@@ -4,6 +4,7 @@
 #  include <unistd.h>
 #endif
 
+#include <algorithm>
 #include <chrono>
 #include <inttypes.h>
 #include <mutex>
@@ -11,6 +12,8 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <string>
 #include <sys/stat.h>
 
 #include "../../common/TracyProtocol.hpp"
@@ -26,18 +29,45 @@
 
 
 bool disconnect = false;
+bool snapshot = false;
 
 void SigInt( int )
 {
     disconnect = true;
 }
 
+#ifndef _WIN32
+void SigUsr1( int )
+{
+    snapshot = true;
+}
+#endif
+
 [[noreturn]] void Usage()
 {
-    printf( "Usage: capture -o output.tracy [-a address] [-p port] [-f]\n" );
+    printf( "Usage: capture -o output.tracy [-a address] [-p port] [-f] [-c none|lz4|lz4hc|zstd] [-l level] [-m] [-j]\n" );
+    printf( "               [-r seconds [-t text] [-T ms]]\n" );
     exit( 1 );
 }
 
+// Snapshots of the recorded window are saved next to the output file, as output.N.tracy.
+std::string SnapshotName( const char* output, int idx )
+{
+    std::string base = output;
+    if( base.size() > 6 && base.compare( base.size() - 6, 6, ".tracy" ) == 0 ) base.resize( base.size() - 6 );
+    return base + "." + std::to_string( idx ) + ".tracy";
+}
+
+bool SaveWindow( tracy::Worker& worker, const char* fn )
+{
+    auto f = std::unique_ptr<tracy::FileWrite>( tracy::FileWrite::Open( fn ) );
+    if( !f ) return false;
+    const auto lastTime = worker.GetLastTime();
+    worker.Write( *f, std::max<int64_t>( 0, lastTime - worker.GetHistoryLimit() ), lastTime );
+    f->Finish();
+    return true;
+}
+
 int main( int argc, char** argv )
 {
 #ifdef _WIN32
@@ -52,9 +82,16 @@ int main( int argc, char** argv )
     const char* address = "127.0.0.1";
     const char* output = nullptr;
     int port = 8086;
+    auto codec = tracy::TransportCodecLz4;
+    int codecLevel = 0;
+    bool shm = true;
+    bool journal = false;
+    int64_t history = 0;
+    const char* trigger = nullptr;
+    int64_t frameThreshold = 0;
 
     int c;
-    while( ( c = getopt( argc, argv, "a:o:p:f" ) ) != -1 )
+    while( ( c = getopt( argc, argv, "a:o:p:fc:l:mjr:t:T:" ) ) != -1 )
     {
         switch( c )
         {
@@ -70,6 +107,34 @@ int main( int argc, char** argv )
         case 'f':
             overwrite = true;
             break;
+        case 'c':
+        {
+            int i = 0;
+            while( i < tracy::NumTransportCodecs && strcmp( optarg, tracy::Worker::GetTransportCodecName( (tracy::TransportCodec)i ) ) != 0 ) i++;
+            if( i == tracy::NumTransportCodecs ) Usage();
+            codec = (tracy::TransportCodec)i;
+            break;
+        }
+        case 'l':
+            codecLevel = atoi( optarg );
+            break;
+        case 'm':
+            shm = false;
+            break;
+        case 'j':
+            journal = true;
+            break;
+        case 'r':
+            history = int64_t( atof( optarg ) * 1000000000ll );
+            if( history <= 0 ) Usage();
+            break;
+        case 't':
+            trigger = optarg;
+            break;
+        case 'T':
+            frameThreshold = int64_t( atof( optarg ) * 1000000ll );
+            if( frameThreshold <= 0 ) Usage();
+            break;
         default:
             Usage();
             break;
@@ -77,6 +142,8 @@ int main( int argc, char** argv )
     }
 
     if( !address || !output ) Usage();
+    if( history != 0 && journal ) Usage();
+    if( history == 0 && ( trigger || frameThreshold != 0 ) ) Usage();
 
     struct stat st;
     if( stat( output, &st ) == 0 && !overwrite )
@@ -94,9 +161,22 @@ int main( int argc, char** argv )
     fclose( test );
     unlink( output );
 
+    // In journal mode the received data is streamed to the output file as is, and
+    // has to be converted to a trace with the update utility afterwards.
+    std::unique_ptr<tracy::FileWrite> jf;
+    if( journal )
+    {
+        jf.reset( tracy::FileWrite::Open( output ) );
+        if( !jf )
+        {
+            printf( "Cannot open output file %s for writing!\n", output );
+            return 5;
+        }
+    }
+
     printf( "Connecting to %s:%i...", address, port );
     fflush( stdout );
-    tracy::Worker worker( address, port );
+    tracy::Worker worker( address, port, codec, codecLevel, jf.get(), history, shm );
     while( !worker.IsConnected() )
     {
         const auto handshake = worker.GetHandshakeStatus();
@@ -117,7 +197,7 @@ int main( int argc, char** argv )
         }
     }
     while( !worker.HasData() ) std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
-    printf( "\nQueue delay: %s\nTimer resolution: %s\n", tracy::TimeToString( worker.GetDelay() ), tracy::TimeToString( worker.GetResolution() ) );
+    printf( "\nQueue delay: %s\nTimer resolution: %s\nTransport: %s (level %i)%s\n", tracy::TimeToString( worker.GetDelay() ), tracy::TimeToString( worker.GetResolution() ), tracy::Worker::GetTransportCodecName( worker.GetTransportCodec() ), worker.GetTransportCodecLevel(), worker.IsTransportShm() ? ", shared memory" : "" );
 
 #ifdef _WIN32
     signal( SIGINT, SigInt );
@@ -126,8 +206,21 @@ int main( int argc, char** argv )
     memset( &sigint, 0, sizeof( sigint ) );
     sigint.sa_handler = SigInt;
     sigaction( SIGINT, &sigint, &oldsigint );
+
+    if( history != 0 )
+    {
+        struct sigaction sigusr1;
+        memset( &sigusr1, 0, sizeof( sigusr1 ) );
+        sigusr1.sa_handler = SigUsr1;
+        sigaction( SIGUSR1, &sigusr1, nullptr );
+    }
 #endif
 
+    int snapshotIdx = 0;
+    int64_t snapshotTime = -1;
+    int64_t lastMessageTime = -1;
+    size_t lastFrame = 1;
+
     auto& lock = worker.GetMbpsDataLock();
 
     const auto t0 = std::chrono::high_resolution_clock::now();
@@ -139,10 +232,52 @@ int main( int argc, char** argv )
             disconnect = false;
         }
 
+        if( history != 0 )
+        {
+            std::lock_guard<std::mutex> lk( worker.GetDataLock() );
+            bool triggered = false;
+            if( trigger )
+            {
+                auto& msgs = worker.GetMessages();
+                auto it = std::upper_bound( msgs.begin(), msgs.end(), lastMessageTime, [] ( const auto& l, const auto& r ) { return l < r->time; } );
+                for( ; it != msgs.end(); ++it )
+                {
+                    if( strstr( worker.GetString( (*it)->ref ), trigger ) ) triggered = true;
+                }
+                if( !msgs.empty() ) lastMessageTime = msgs.back()->time;
+            }
+            if( frameThreshold != 0 )
+            {
+                auto fd = worker.GetFramesBase();
+                const auto cnt = worker.GetFrameCount( *fd );
+                for( ; lastFrame + 1 < cnt; lastFrame++ )
+                {
+                    if( worker.GetFrameTime( *fd, lastFrame ) > frameThreshold ) triggered = true;
+                }
+            }
+            // Triggers following a snapshot are ignored until the window has moved past it.
+            if( triggered && snapshotTime >= 0 && worker.GetLastTime() - snapshotTime < history ) triggered = false;
+            if( snapshot || triggered )
+            {
+                snapshot = false;
+                const auto fn = SnapshotName( output, ++snapshotIdx );
+                if( SaveWindow( worker, fn.c_str() ) )
+                {
+                    printf( "\33[2K\rSnapshot saved to %s\n", fn.c_str() );
+                    snapshotTime = worker.GetLastTime();
+                }
+                else
+                {
+                    printf( "\33[2K\r\033[31;1mCannot open snapshot file %s for writing!\033[0m\n", fn.c_str() );
+                }
+            }
+        }
+
         lock.lock();
         const auto mbps = worker.GetMbpsData().back();
         const auto compRatio = worker.GetCompRatio();
         const auto netTotal = worker.GetDataTransferred();
+        const auto decSpeed = worker.GetDecompressSpeed();
         lock.unlock();
 
         if( mbps < 0.1f )
@@ -153,9 +288,10 @@ int main( int argc, char** argv )
         {
             printf( "\33[2K\r\033[36;1m%7.2f Mbps", mbps );
         }
-        printf( " \033[0m /\033[36;1m%5.1f%% \033[0m=\033[33;1m%7.2f Mbps \033[0m| \033[33mNet: \033[32m%s \033[0m| \033[33mMem: \033[31;1m%s\033[0m | \033[33mTime: %s\033[0m",
+        printf( " \033[0m /\033[36;1m%5.1f%% \033[0m=\033[33;1m%7.2f Mbps \033[0m| \033[33mDec: \033[32m%.0f MB/s \033[0m| \033[33mNet: \033[32m%s \033[0m| \033[33mMem: \033[31;1m%s\033[0m | \033[33mTime: %s\033[0m",
             compRatio * 100.f,
             mbps / compRatio,
+            decSpeed,
             tracy::MemSizeToString( netTotal ),
             tracy::MemSizeToString( tracy::memUsage ),
             tracy::TimeToString( worker.GetLastTime() ) );
@@ -241,6 +377,16 @@ int main( int argc, char** argv )
         }
     }
 
+    if( jf )
+    {
+        jf->Finish();
+        const auto stats = jf->GetCompressionStatistics();
+        printf( "\nElapsed time: %s\nJournal size %s (%.2f%% ratio)\n",
+            tracy::TimeToString( std::chrono::duration_cast<std::chrono::nanoseconds>( t1 - t0 ).count() ),
+            tracy::MemSizeToString( stats.second ), 100.f * stats.second / stats.first );
+        return 0;
+    }
+
     printf( "\nFrames: %" PRIu64 "\nTime span: %s\nZones: %s\nElapsed time: %s\nSaving trace...",
         worker.GetFrameCount( *worker.GetFramesBase() ), tracy::TimeToString( worker.GetLastTime() ), tracy::RealToString( worker.GetZoneCount() ),
         tracy::TimeToString( std::chrono::duration_cast<std::chrono::nanoseconds>( t1 - t0 ).count() ) );
@@ -248,7 +394,15 @@ int main( int argc, char** argv )
     auto f = std::unique_ptr<tracy::FileWrite>( tracy::FileWrite::Open( output ) );
     if( f )
     {
-        worker.Write( *f );
+        if( history != 0 )
+        {
+            const auto lastTime = worker.GetLastTime();
+            worker.Write( *f, std::max<int64_t>( 0, lastTime - history ), lastTime );
+        }
+        else
+        {
+            worker.Write( *f );
+        }
         printf( " \033[32;1mdone!\033[0m\n" );
         f->Finish();
         const auto stats = f->GetCompressionStatistics();
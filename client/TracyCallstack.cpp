@@ -4,6 +4,7 @@
 #include "TracyCallstack.hpp"
 #include "TracyFastVector.hpp"
 #include "../common/TracyAlloc.hpp"
+#include "../common/TracyMutex.hpp"
 
 #ifdef TRACY_HAS_CALLSTACK
 
@@ -30,6 +31,10 @@
 #  include <cxxabi.h>
 #endif
 
+#ifdef TRACY_HAS_FRAMEPOINTER_CALLSTACK
+#  include <pthread.h>
+#endif
+
 #ifdef TRACY_DBGHELP_LOCK
 #  include "TracyProfiler.hpp"
 
@@ -66,6 +71,18 @@ static inline char* CopyString( const char* src )
     return dst;
 }
 
+static TracyMutex s_decodeLock;
+
+void LockCallstackDecode()
+{
+    s_decodeLock.lock();
+}
+
+void UnlockCallstackDecode()
+{
+    s_decodeLock.unlock();
+}
+
 
 #if TRACY_HAS_CALLSTACK == 1
 
@@ -161,12 +178,9 @@ void InitCallstack()
 #endif
 }
 
-TRACY_API uintptr_t* CallTrace( int depth )
+TRACY_API uintptr_t CallTrace( uintptr_t* trace, int depth )
 {
-    auto trace = (uintptr_t*)tracy_malloc( ( 1 + depth ) * sizeof( uintptr_t ) );
-    const auto num = RtlWalkFrameChain( (void**)( trace + 1 ), depth, 0 );
-    *trace = num;
-    return trace;
+    return RtlWalkFrameChain( (void**)trace, depth, 0 );
 }
 
 const char* DecodeCallstackPtrFast( uint64_t ptr )
@@ -762,6 +776,50 @@ CallstackEntryData DecodeCallstackPtr( uint64_t ptr )
 
 #endif
 
+#ifdef TRACY_HAS_FRAMEPOINTER_CALLSTACK
+
+static uintptr_t GetThreadStackTop()
+{
+    pthread_attr_t attr;
+    if( pthread_getattr_np( pthread_self(), &attr ) != 0 ) return 0;
+    void* addr;
+    size_t size;
+    const auto res = pthread_attr_getstack( &attr, &addr, &size );
+    pthread_attr_destroy( &attr );
+    if( res != 0 ) return 0;
+    return uintptr_t( addr ) + size;
+}
+
+// Both on x64 and ARM64 the frame record consists of the caller's frame pointer,
+// followed by the return address. The walk stops at a null frame pointer, or at
+// one that doesn't point further up the thread's stack.
+TRACY_API tracy_no_inline uintptr_t FramePointerTrace( uintptr_t* trace, int depth )
+{
+    static thread_local uintptr_t stackTop = GetThreadStackTop();
+    if( stackTop == 0 ) return 0;
+
+    auto fp = (const uintptr_t*)__builtin_frame_address( 0 );
+    uintptr_t cnt = 0;
+    while( cnt < uintptr_t( depth ) )
+    {
+        const auto pc = fp[1];
+        if( pc == 0 ) break;
+        trace[cnt++] = pc;
+
+        // A bad link right at the caller means it wasn't compiled with frame pointers.
+        const auto next = (const uintptr_t*)fp[0];
+        if( !next || next <= fp || ( uintptr_t( next ) & ( sizeof( uintptr_t ) - 1 ) ) != 0 || uintptr_t( next + 2 ) > stackTop )
+        {
+            if( cnt == 1 ) return 0;
+            break;
+        }
+        fp = next;
+    }
+    return cnt;
+}
+
+#endif
+
 }
 
 #endif
@@ -25,4 +25,8 @@
 #  define TRACY_HAS_CALLSTACK 6
 #endif
 
+#if defined TRACY_CALLSTACK_FRAMEPOINTER && ( TRACY_HAS_CALLSTACK == 2 || TRACY_HAS_CALLSTACK == 3 ) && ( defined __x86_64__ || defined __aarch64__ )
+#  define TRACY_HAS_FRAMEPOINTER_CALLSTACK
+#endif
+
 #endif
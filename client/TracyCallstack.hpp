@@ -51,14 +51,20 @@ const char* DecodeCallstackPtrFast( uint64_t ptr );
 CallstackEntryData DecodeCallstackPtr( uint64_t ptr );
 void InitCallstack();
 
+// Decoding uses a single debug information state (neither libbacktrace state nor dbghelp is
+// thread safe) and returns data kept in static buffers. Callers must hold the decode lock until
+// they are done with the returned data.
+void LockCallstackDecode();
+void UnlockCallstackDecode();
+
 #if TRACY_HAS_CALLSTACK == 1
 
-TRACY_API uintptr_t* CallTrace( int depth );
+TRACY_API uintptr_t CallTrace( uintptr_t* trace, int depth );
 
-static tracy_force_inline void* Callstack( int depth )
+static tracy_force_inline uintptr_t CallstackCapture( uintptr_t* trace, int depth )
 {
     assert( depth >= 1 && depth < 63 );
-    return CallTrace( depth );
+    return CallTrace( trace, depth );
 }
 
 #elif TRACY_HAS_CALLSTACK == 2 || TRACY_HAS_CALLSTACK == 5
@@ -81,34 +87,57 @@ static _Unwind_Reason_Code tracy_unwind_callback( struct _Unwind_Context* ctx, v
     return _URC_NO_REASON;
 }
 
-static tracy_force_inline void* Callstack( int depth )
+static tracy_force_inline uintptr_t CallstackUnwind( uintptr_t* trace, int depth )
 {
     assert( depth >= 1 && depth < 63 );
 
-    auto trace = (uintptr_t*)tracy_malloc( ( 1 + depth ) * sizeof( uintptr_t ) );
-    BacktraceState state = { (void**)(trace+1), (void**)(trace+1+depth) };
+    BacktraceState state = { (void**)trace, (void**)(trace+depth) };
     _Unwind_Backtrace( tracy_unwind_callback, &state );
 
-    *trace = (uintptr_t*)state.current - trace + 1;
-
-    return trace;
+    return (uintptr_t*)state.current - trace;
 }
 
 #elif TRACY_HAS_CALLSTACK == 3 || TRACY_HAS_CALLSTACK == 4 || TRACY_HAS_CALLSTACK == 6
 
-static tracy_force_inline void* Callstack( int depth )
+static tracy_force_inline uintptr_t CallstackUnwind( uintptr_t* trace, int depth )
 {
     assert( depth >= 1 );
+    return (uintptr_t)backtrace( (void**)trace, depth );
+}
 
-    auto trace = (uintptr_t*)tracy_malloc( ( 1 + (size_t)depth ) * sizeof( uintptr_t ) );
-    const auto num = (size_t)backtrace( (void**)(trace+1), depth );
-    *trace = num;
+#endif
 
-    return trace;
+#ifdef TRACY_HAS_FRAMEPOINTER_CALLSTACK
+
+// Walks the frame pointer chain of the calling thread. Returns 0 if the chain
+// is broken right at the caller, which happens when it was compiled without
+// frame pointers.
+TRACY_API uintptr_t FramePointerTrace( uintptr_t* trace, int depth );
+
+static tracy_force_inline uintptr_t CallstackCapture( uintptr_t* trace, int depth )
+{
+    const auto cnt = FramePointerTrace( trace, depth );
+    if( cnt != 0 ) return cnt;
+    return CallstackUnwind( trace, depth );
+}
+
+#elif TRACY_HAS_CALLSTACK != 1
+
+static tracy_force_inline uintptr_t CallstackCapture( uintptr_t* trace, int depth )
+{
+    return CallstackUnwind( trace, depth );
 }
 
 #endif
 
+// Returns allocated trace, with the number of frames stored in the first element.
+static tracy_force_inline void* Callstack( int depth )
+{
+    auto trace = (uintptr_t*)tracy_malloc( ( 1 + (size_t)depth ) * sizeof( uintptr_t ) );
+    *trace = CallstackCapture( trace+1, depth );
+    return trace;
+}
+
 }
 
 #endif
@@ -9,11 +9,9 @@
 #  include <arm_neon.h>
 #endif
 
-#if defined __AVX__ && !defined __SSE4_1__
-#  define __SSE4_1__
-#endif
-
-#if defined __SSE4_1__ || defined __AVX2__
+#if defined __i386 || defined _M_IX86 || defined __x86_64__ || defined _M_X64
+// SSE4.1 and AVX2 encoders are always compiled and selected at runtime, depending on the CPU.
+#  define TRACY_DXT1_X86
 #  ifdef _MSC_VER
 #    include <intrin.h>
 #  else
@@ -22,6 +20,13 @@
 #      define _mm256_cvtsi256_si32( v ) ( _mm_cvtsi128_si32( _mm256_castsi256_si128( v ) ) )
 #    endif
 #  endif
+#  if defined __GNUC__ || defined __clang__
+#    define TRACY_TARGET_SSE41 __attribute__(( target( "sse4.1" ) ))
+#    define TRACY_TARGET_AVX2 __attribute__(( target( "avx2" ) ))
+#  else
+#    define TRACY_TARGET_SSE41
+#    define TRACY_TARGET_AVX2
+#  endif
 #endif
 
 namespace tracy
@@ -144,7 +149,59 @@ static const uint16_t DivTableNEON[255*3+1] = {
 
 static tracy_force_inline uint64_t ProcessRGB( const uint8_t* src )
 {
-#ifdef __SSE4_1__
+    uint32_t ref;
+    memcpy( &ref, src, 4 );
+    uint32_t refMask = ref & 0xF8FCF8;
+    auto stmp = src + 4;
+    for( int i=1; i<16; i++ )
+    {
+        uint32_t px;
+        memcpy( &px, stmp, 4 );
+        if( ( px & 0xF8FCF8 ) != refMask ) break;
+        stmp += 4;
+    }
+    if( stmp == src + 64 )
+    {
+        return uint64_t( to565( ref ) ) << 16;
+    }
+
+    uint8_t min[3] = { src[0], src[1], src[2] };
+    uint8_t max[3] = { src[0], src[1], src[2] };
+    auto tmp = src + 4;
+    for( int i=1; i<16; i++ )
+    {
+        for( int j=0; j<3; j++ )
+        {
+            if( tmp[j] < min[j] ) min[j] = tmp[j];
+            else if( tmp[j] > max[j] ) max[j] = tmp[j];
+        }
+        tmp += 4;
+    }
+
+    const uint32_t range = DivTable[max[0] - min[0] + max[1] - min[1] + max[2] - min[2]];
+    const uint32_t rmin = min[0] + min[1] + min[2];
+    for( int i=0; i<3; i++ )
+    {
+        const uint8_t inset = ( max[i] - min[i] ) >> 4;
+        min[i] += inset;
+        max[i] -= inset;
+    }
+
+    uint32_t data = 0;
+    for( int i=0; i<16; i++ )
+    {
+        const uint32_t c = src[0] + src[1] + src[2] - rmin;
+        const uint8_t idx = ( c * range ) >> 16;
+        data |= idx << (i*2);
+        src += 4;
+    }
+
+    return uint64_t( ( uint64_t( to565( min[0], min[1], min[2] ) ) << 16 ) | to565( max[0], max[1], max[2] ) | ( uint64_t( data ) << 32 ) );
+}
+
+#ifdef TRACY_DXT1_X86
+static tracy_force_inline TRACY_TARGET_SSE41 uint64_t ProcessRGB_SSE( const uint8_t* src )
+{
     __m128i px0 = _mm_loadu_si128(((__m128i*)src) + 0);
     __m128i px1 = _mm_loadu_si128(((__m128i*)src) + 1);
     __m128i px2 = _mm_loadu_si128(((__m128i*)src) + 2);
@@ -235,7 +292,12 @@ static tracy_force_inline uint64_t ProcessRGB( const uint8_t* src )
     uint32_t vp = _mm_cvtsi128_si32( p );
 
     return uint64_t( ( uint64_t( to565( vmin ) ) << 16 ) | to565( vmax ) | ( uint64_t( vp ) << 32 ) );
-#elif defined __ARM_NEON
+}
+#endif
+
+#ifdef __ARM_NEON
+static tracy_force_inline uint64_t ProcessRGB_NEON( const uint8_t* src )
+{
 #  ifdef __aarch64__
     uint8x16x4_t px = vld4q_u8( src );
 
@@ -408,60 +470,11 @@ static tracy_force_inline uint64_t ProcessRGB( const uint8_t* src )
 
     return uint64_t( ( uint64_t( to565( vmin ) ) << 16 ) | to565( vmax ) | ( uint64_t( vp ) << 32 ) );
 #  endif
-#else
-    uint32_t ref;
-    memcpy( &ref, src, 4 );
-    uint32_t refMask = ref & 0xF8FCF8;
-    auto stmp = src + 4;
-    for( int i=1; i<16; i++ )
-    {
-        uint32_t px;
-        memcpy( &px, stmp, 4 );
-        if( ( px & 0xF8FCF8 ) != refMask ) break;
-        stmp += 4;
-    }
-    if( stmp == src + 64 )
-    {
-        return uint64_t( to565( ref ) ) << 16;
-    }
-
-    uint8_t min[3] = { src[0], src[1], src[2] };
-    uint8_t max[3] = { src[0], src[1], src[2] };
-    auto tmp = src + 4;
-    for( int i=1; i<16; i++ )
-    {
-        for( int j=0; j<3; j++ )
-        {
-            if( tmp[j] < min[j] ) min[j] = tmp[j];
-            else if( tmp[j] > max[j] ) max[j] = tmp[j];
-        }
-        tmp += 4;
-    }
-
-    const uint32_t range = DivTable[max[0] - min[0] + max[1] - min[1] + max[2] - min[2]];
-    const uint32_t rmin = min[0] + min[1] + min[2];
-    for( int i=0; i<3; i++ )
-    {
-        const uint8_t inset = ( max[i] - min[i] ) >> 4;
-        min[i] += inset;
-        max[i] -= inset;
-    }
-
-    uint32_t data = 0;
-    for( int i=0; i<16; i++ )
-    {
-        const uint32_t c = src[0] + src[1] + src[2] - rmin;
-        const uint8_t idx = ( c * range ) >> 16;
-        data |= idx << (i*2);
-        src += 4;
-    }
-
-    return uint64_t( ( uint64_t( to565( min[0], min[1], min[2] ) ) << 16 ) | to565( max[0], max[1], max[2] ) | ( uint64_t( data ) << 32 ) );
-#endif
 }
+#endif
 
-#ifdef __AVX2__
-static tracy_force_inline void ProcessRGB_AVX( const uint8_t* src, char*& dst )
+#ifdef TRACY_DXT1_X86
+static tracy_force_inline TRACY_TARGET_AVX2 void ProcessRGB_AVX( const uint8_t* src, char*& dst )
 {
     __m256i px0 = _mm256_loadu_si256(((__m256i*)src) + 0);
     __m256i px1 = _mm256_loadu_si256(((__m256i*)src) + 1);
@@ -579,63 +592,217 @@ static tracy_force_inline void ProcessRGB_AVX( const uint8_t* src, char*& dst )
 }
 #endif
 
-void CompressImageDxt1( const char* src, char* dst, int w, int h )
+static void CompressBlocks( const char* src, char* dst, int w, int h )
 {
-    assert( (w % 4) == 0 && (h % 4) == 0 );
+    uint32_t buf[4*4];
+    int i = 0;
 
-#ifdef __AVX2__
-    if( w%8 == 0 )
+    auto blocks = w * h / 16;
+    do
     {
-        uint32_t buf[8*4];
-        int i = 0;
+        auto tmp = (char*)buf;
+        memcpy( tmp,        src,          4*4 );
+        memcpy( tmp + 4*4,  src + w * 4,  4*4 );
+        memcpy( tmp + 8*4,  src + w * 8,  4*4 );
+        memcpy( tmp + 12*4, src + w * 12, 4*4 );
+        src += 4*4;
+        if( ++i == w/4 )
+        {
+            src += w * 3 * 4;
+            i = 0;
+        }
+
+        const auto c = ProcessRGB( (uint8_t*)buf );
+        memcpy( dst, &c, sizeof( uint64_t ) );
+        dst += sizeof( uint64_t );
+    }
+    while( --blocks );
+}
+
+#ifdef TRACY_DXT1_X86
+static TRACY_TARGET_SSE41 void CompressBlocks_SSE( const char* src, char* dst, int w, int h )
+{
+    uint32_t buf[4*4];
+    int i = 0;
 
-        auto blocks = w * h / 32;
-        do
+    auto blocks = w * h / 16;
+    do
+    {
+        auto tmp = (char*)buf;
+        memcpy( tmp,        src,          4*4 );
+        memcpy( tmp + 4*4,  src + w * 4,  4*4 );
+        memcpy( tmp + 8*4,  src + w * 8,  4*4 );
+        memcpy( tmp + 12*4, src + w * 12, 4*4 );
+        src += 4*4;
+        if( ++i == w/4 )
         {
-            auto tmp = (char*)buf;
-            memcpy( tmp,        src,          8*4 );
-            memcpy( tmp + 8*4,  src + w * 4,  8*4 );
-            memcpy( tmp + 16*4, src + w * 8,  8*4 );
-            memcpy( tmp + 24*4, src + w * 12, 8*4 );
-            src += 8*4;
-            if( ++i == w/8 )
-            {
-                src += w * 3 * 4;
-                i = 0;
-            }
-
-            ProcessRGB_AVX( (uint8_t*)buf, dst );
+            src += w * 3 * 4;
+            i = 0;
         }
-        while( --blocks );
+
+        const auto c = ProcessRGB_SSE( (uint8_t*)buf );
+        memcpy( dst, &c, sizeof( uint64_t ) );
+        dst += sizeof( uint64_t );
     }
-    else
-#endif
+    while( --blocks );
+}
+
+static TRACY_TARGET_AVX2 void CompressBlocks_AVX( const char* src, char* dst, int w, int h )
+{
+    if( w%8 != 0 )
     {
-        uint32_t buf[4*4];
-        int i = 0;
+        CompressBlocks_SSE( src, dst, w, h );
+        return;
+    }
+
+    uint32_t buf[8*4];
+    int i = 0;
+
+    auto blocks = w * h / 32;
+    do
+    {
+        auto tmp = (char*)buf;
+        memcpy( tmp,        src,          8*4 );
+        memcpy( tmp + 8*4,  src + w * 4,  8*4 );
+        memcpy( tmp + 16*4, src + w * 8,  8*4 );
+        memcpy( tmp + 24*4, src + w * 12, 8*4 );
+        src += 8*4;
+        if( ++i == w/8 )
+        {
+            src += w * 3 * 4;
+            i = 0;
+        }
+
+        ProcessRGB_AVX( (uint8_t*)buf, dst );
+    }
+    while( --blocks );
+}
+
+static bool HasSse41()
+{
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuid( regs, 1 );
+    return ( regs[2] & ( 1 << 19 ) ) != 0;
+#else
+    return __builtin_cpu_supports( "sse4.1" );
+#endif
+}
+
+static bool HasAvx2()
+{
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuid( regs, 0 );
+    if( regs[0] < 7 ) return false;
+    __cpuid( regs, 1 );
+    // The OS has to save the AVX registers on context switch.
+    if( ( regs[2] & ( 1 << 27 ) ) == 0 || ( _xgetbv( 0 ) & 6 ) != 6 ) return false;
+    __cpuidex( regs, 7, 0 );
+    return ( regs[1] & ( 1 << 5 ) ) != 0;
+#else
+    return __builtin_cpu_supports( "avx2" );
+#endif
+}
+#endif
 
-        auto ptr = dst;
-        auto blocks = w * h / 16;
-        do
+#ifdef __ARM_NEON
+static void CompressBlocks_NEON( const char* src, char* dst, int w, int h )
+{
+    uint32_t buf[4*4];
+    int i = 0;
+
+    auto blocks = w * h / 16;
+    do
+    {
+        auto tmp = (char*)buf;
+        memcpy( tmp,        src,          4*4 );
+        memcpy( tmp + 4*4,  src + w * 4,  4*4 );
+        memcpy( tmp + 8*4,  src + w * 8,  4*4 );
+        memcpy( tmp + 12*4, src + w * 12, 4*4 );
+        src += 4*4;
+        if( ++i == w/4 )
         {
-            auto tmp = (char*)buf;
-            memcpy( tmp,        src,          4*4 );
-            memcpy( tmp + 4*4,  src + w * 4,  4*4 );
-            memcpy( tmp + 8*4,  src + w * 8,  4*4 );
-            memcpy( tmp + 12*4, src + w * 12, 4*4 );
-            src += 4*4;
-            if( ++i == w/4 )
-            {
-                src += w * 3 * 4;
-                i = 0;
-            }
-
-            const auto c = ProcessRGB( (uint8_t*)buf );
-            memcpy( ptr, &c, sizeof( uint64_t ) );
-            ptr += sizeof( uint64_t );
+            src += w * 3 * 4;
+            i = 0;
         }
-        while( --blocks );
+
+        const auto c = ProcessRGB_NEON( (uint8_t*)buf );
+        memcpy( dst, &c, sizeof( uint64_t ) );
+        dst += sizeof( uint64_t );
+    }
+    while( --blocks );
+}
+#endif
+
+static Dxt1Encoder SelectDxt1Encoder()
+{
+#if defined TRACY_DXT1_X86
+    // The AVX2 path processes two blocks per iteration, but measures slower than SSE4.1 on
+    // current CPUs. It is only used when picked explicitly.
+    if( HasSse41() ) return Dxt1Encoder::Sse41;
+#elif defined __ARM_NEON
+    return Dxt1Encoder::Neon;
+#endif
+    return Dxt1Encoder::Scalar;
+}
+
+Dxt1Encoder GetDxt1Encoder()
+{
+    static const Dxt1Encoder encoder = SelectDxt1Encoder();
+    return encoder;
+}
+
+bool IsDxt1EncoderAvailable( Dxt1Encoder encoder )
+{
+    switch( encoder )
+    {
+    case Dxt1Encoder::Scalar:
+        return true;
+#ifdef TRACY_DXT1_X86
+    case Dxt1Encoder::Sse41:
+        return HasSse41();
+    case Dxt1Encoder::Avx2:
+        return HasAvx2();
+#endif
+#ifdef __ARM_NEON
+    case Dxt1Encoder::Neon:
+        return true;
+#endif
+    default:
+        return false;
     }
 }
 
+void CompressImageDxt1( Dxt1Encoder encoder, const char* src, char* dst, int w, int h )
+{
+    assert( (w % 4) == 0 && (h % 4) == 0 );
+    assert( IsDxt1EncoderAvailable( encoder ) );
+
+    switch( encoder )
+    {
+#ifdef TRACY_DXT1_X86
+    case Dxt1Encoder::Sse41:
+        CompressBlocks_SSE( src, dst, w, h );
+        break;
+    case Dxt1Encoder::Avx2:
+        CompressBlocks_AVX( src, dst, w, h );
+        break;
+#endif
+#ifdef __ARM_NEON
+    case Dxt1Encoder::Neon:
+        CompressBlocks_NEON( src, dst, w, h );
+        break;
+#endif
+    default:
+        CompressBlocks( src, dst, w, h );
+        break;
+    }
+}
+
+void CompressImageDxt1( const char* src, char* dst, int w, int h )
+{
+    CompressImageDxt1( GetDxt1Encoder(), src, dst, w, h );
+}
+
 }
@@ -4,7 +4,20 @@
 namespace tracy
 {
 
+enum class Dxt1Encoder
+{
+    Scalar,
+    Sse41,
+    Avx2,
+    Neon
+};
+
+// Best encoder supported by the CPU, which is used by CompressImageDxt1( src, dst, w, h ).
+Dxt1Encoder GetDxt1Encoder();
+bool IsDxt1EncoderAvailable( Dxt1Encoder encoder );
+
 void CompressImageDxt1( const char* src, char* dst, int w, int h );
+void CompressImageDxt1( Dxt1Encoder encoder, const char* src, char* dst, int w, int h );
 
 }
 
@@ -23,7 +23,7 @@ public:
     {
         assert( m_id != std::numeric_limits<uint32_t>::max() );
 
-        auto item = Profiler::QueueSerial();
+        auto item = Profiler::QueueSerialThread();
         MemWrite( &item->hdr.type, QueueType::LockAnnounce );
         MemWrite( &item->lockAnnounce.id, m_id );
         MemWrite( &item->lockAnnounce.time, Profiler::GetTime() );
@@ -32,7 +32,7 @@ public:
 #ifdef TRACY_ON_DEMAND
         GetProfiler().DeferItem( *item );
 #endif
-        Profiler::QueueSerialFinish();
+        Profiler::QueueSerialThreadFinish();
     }
 
     LockableCtx( const LockableCtx& ) = delete;
@@ -40,14 +40,14 @@ public:
 
     tracy_force_inline ~LockableCtx()
     {
-        auto item = Profiler::QueueSerial();
+        auto item = Profiler::QueueSerialThread();
         MemWrite( &item->hdr.type, QueueType::LockTerminate );
         MemWrite( &item->lockTerminate.id, m_id );
         MemWrite( &item->lockTerminate.time, Profiler::GetTime() );
 #ifdef TRACY_ON_DEMAND
         GetProfiler().DeferItem( *item );
 #endif
-        Profiler::QueueSerialFinish();
+        Profiler::QueueSerialThreadFinish();
     }
 
     tracy_force_inline bool BeforeLock()
@@ -65,23 +65,23 @@ public:
         if( !queue ) return false;
 #endif
 
-        auto item = Profiler::QueueSerial();
+        auto item = Profiler::QueueSerialThread();
         MemWrite( &item->hdr.type, QueueType::LockWait );
         MemWrite( &item->lockWait.thread, GetThreadHandle() );
         MemWrite( &item->lockWait.id, m_id );
         MemWrite( &item->lockWait.time, Profiler::GetTime() );
-        Profiler::QueueSerialFinish();
+        Profiler::QueueSerialThreadFinish();
         return true;
     }
 
     tracy_force_inline void AfterLock()
     {
-        auto item = Profiler::QueueSerial();
+        auto item = Profiler::QueueSerialThread();
         MemWrite( &item->hdr.type, QueueType::LockObtain );
         MemWrite( &item->lockObtain.thread, GetThreadHandle() );
         MemWrite( &item->lockObtain.id, m_id );
         MemWrite( &item->lockObtain.time, Profiler::GetTime() );
-        Profiler::QueueSerialFinish();
+        Profiler::QueueSerialThreadFinish();
     }
 
     tracy_force_inline void AfterUnlock()
@@ -96,12 +96,12 @@ public:
         }
 #endif
 
-        auto item = Profiler::QueueSerial();
+        auto item = Profiler::QueueSerialThread();
         MemWrite( &item->hdr.type, QueueType::LockRelease );
         MemWrite( &item->lockRelease.thread, GetThreadHandle() );
         MemWrite( &item->lockRelease.id, m_id );
         MemWrite( &item->lockRelease.time, Profiler::GetTime() );
-        Profiler::QueueSerialFinish();
+        Profiler::QueueSerialThreadFinish();
     }
 
     tracy_force_inline void AfterTryLock( bool acquired )
@@ -123,12 +123,12 @@ public:
 
         if( acquired )
         {
-            auto item = Profiler::QueueSerial();
+            auto item = Profiler::QueueSerialThread();
             MemWrite( &item->hdr.type, QueueType::LockObtain );
             MemWrite( &item->lockObtain.thread, GetThreadHandle() );
             MemWrite( &item->lockObtain.id, m_id );
             MemWrite( &item->lockObtain.time, Profiler::GetTime() );
-            Profiler::QueueSerialFinish();
+            Profiler::QueueSerialThreadFinish();
         }
     }
 
@@ -145,12 +145,12 @@ public:
         }
 #endif
 
-        auto item = Profiler::QueueSerial();
+        auto item = Profiler::QueueSerialThread();
         MemWrite( &item->hdr.type, QueueType::LockMark );
         MemWrite( &item->lockMark.thread, GetThreadHandle() );
         MemWrite( &item->lockMark.id, m_id );
         MemWrite( &item->lockMark.srcloc, (uint64_t)srcloc );
-        Profiler::QueueSerialFinish();
+        Profiler::QueueSerialThreadFinish();
     }
 
     tracy_force_inline void CustomName( const char* name, size_t size )
@@ -158,7 +158,7 @@ public:
         assert( size < std::numeric_limits<uint16_t>::max() );
         auto ptr = (char*)tracy_malloc( size );
         memcpy( ptr, name, size );
-        auto item = Profiler::QueueSerial();
+        auto item = Profiler::QueueSerialThread();
         MemWrite( &item->hdr.type, QueueType::LockName );
         MemWrite( &item->lockNameFat.id, m_id );
         MemWrite( &item->lockNameFat.name, (uint64_t)ptr );
@@ -166,7 +166,7 @@ public:
 #ifdef TRACY_ON_DEMAND
         GetProfiler().DeferItem( *item );
 #endif
-        Profiler::QueueSerialFinish();
+        Profiler::QueueSerialThreadFinish();
     }
 
 private:
@@ -238,7 +238,7 @@ public:
     {
         assert( m_id != std::numeric_limits<uint32_t>::max() );
 
-        auto item = Profiler::QueueSerial();
+        auto item = Profiler::QueueSerialThread();
         MemWrite( &item->hdr.type, QueueType::LockAnnounce );
         MemWrite( &item->lockAnnounce.id, m_id );
         MemWrite( &item->lockAnnounce.time, Profiler::GetTime() );
@@ -247,7 +247,7 @@ public:
 #ifdef TRACY_ON_DEMAND
         GetProfiler().DeferItem( *item );
 #endif
-        Profiler::QueueSerialFinish();
+        Profiler::QueueSerialThreadFinish();
     }
 
     SharedLockableCtx( const SharedLockableCtx& ) = delete;
@@ -255,14 +255,14 @@ public:
 
     tracy_force_inline ~SharedLockableCtx()
     {
-        auto item = Profiler::QueueSerial();
+        auto item = Profiler::QueueSerialThread();
         MemWrite( &item->hdr.type, QueueType::LockTerminate );
         MemWrite( &item->lockTerminate.id, m_id );
         MemWrite( &item->lockTerminate.time, Profiler::GetTime() );
 #ifdef TRACY_ON_DEMAND
         GetProfiler().DeferItem( *item );
 #endif
-        Profiler::QueueSerialFinish();
+        Profiler::QueueSerialThreadFinish();
     }
 
     tracy_force_inline bool BeforeLock()
@@ -280,23 +280,23 @@ public:
         if( !queue ) return false;
 #endif
 
-        auto item = Profiler::QueueSerial();
+        auto item = Profiler::QueueSerialThread();
         MemWrite( &item->hdr.type, QueueType::LockWait );
         MemWrite( &item->lockWait.thread, GetThreadHandle() );
         MemWrite( &item->lockWait.id, m_id );
         MemWrite( &item->lockWait.time, Profiler::GetTime() );
-        Profiler::QueueSerialFinish();
+        Profiler::QueueSerialThreadFinish();
         return true;
     }
 
     tracy_force_inline void AfterLock()
     {
-        auto item = Profiler::QueueSerial();
+        auto item = Profiler::QueueSerialThread();
         MemWrite( &item->hdr.type, QueueType::LockObtain );
         MemWrite( &item->lockObtain.thread, GetThreadHandle() );
         MemWrite( &item->lockObtain.id, m_id );
         MemWrite( &item->lockObtain.time, Profiler::GetTime() );
-        Profiler::QueueSerialFinish();
+        Profiler::QueueSerialThreadFinish();
     }
 
     tracy_force_inline void AfterUnlock()
@@ -311,12 +311,12 @@ public:
         }
 #endif
 
-        auto item = Profiler::QueueSerial();
+        auto item = Profiler::QueueSerialThread();
         MemWrite( &item->hdr.type, QueueType::LockRelease );
         MemWrite( &item->lockRelease.thread, GetThreadHandle() );
         MemWrite( &item->lockRelease.id, m_id );
         MemWrite( &item->lockRelease.time, Profiler::GetTime() );
-        Profiler::QueueSerialFinish();
+        Profiler::QueueSerialThreadFinish();
     }
 
     tracy_force_inline void AfterTryLock( bool acquired )
@@ -338,12 +338,12 @@ public:
 
         if( acquired )
         {
-            auto item = Profiler::QueueSerial();
+            auto item = Profiler::QueueSerialThread();
             MemWrite( &item->hdr.type, QueueType::LockObtain );
             MemWrite( &item->lockObtain.thread, GetThreadHandle() );
             MemWrite( &item->lockObtain.id, m_id );
             MemWrite( &item->lockObtain.time, Profiler::GetTime() );
-            Profiler::QueueSerialFinish();
+            Profiler::QueueSerialThreadFinish();
         }
     }
 
@@ -362,23 +362,23 @@ public:
         if( !queue ) return false;
 #endif
 
-        auto item = Profiler::QueueSerial();
+        auto item = Profiler::QueueSerialThread();
         MemWrite( &item->hdr.type, QueueType::LockSharedWait );
         MemWrite( &item->lockWait.thread, GetThreadHandle() );
         MemWrite( &item->lockWait.id, m_id );
         MemWrite( &item->lockWait.time, Profiler::GetTime() );
-        Profiler::QueueSerialFinish();
+        Profiler::QueueSerialThreadFinish();
         return true;
     }
 
     tracy_force_inline void AfterLockShared()
     {
-        auto item = Profiler::QueueSerial();
+        auto item = Profiler::QueueSerialThread();
         MemWrite( &item->hdr.type, QueueType::LockSharedObtain );
         MemWrite( &item->lockObtain.thread, GetThreadHandle() );
         MemWrite( &item->lockObtain.id, m_id );
         MemWrite( &item->lockObtain.time, Profiler::GetTime() );
-        Profiler::QueueSerialFinish();
+        Profiler::QueueSerialThreadFinish();
     }
 
     tracy_force_inline void AfterUnlockShared()
@@ -393,12 +393,12 @@ public:
         }
 #endif
 
-        auto item = Profiler::QueueSerial();
+        auto item = Profiler::QueueSerialThread();
         MemWrite( &item->hdr.type, QueueType::LockSharedRelease );
         MemWrite( &item->lockRelease.thread, GetThreadHandle() );
         MemWrite( &item->lockRelease.id, m_id );
         MemWrite( &item->lockRelease.time, Profiler::GetTime() );
-        Profiler::QueueSerialFinish();
+        Profiler::QueueSerialThreadFinish();
     }
 
     tracy_force_inline void AfterTryLockShared( bool acquired )
@@ -420,12 +420,12 @@ public:
 
         if( acquired )
         {
-            auto item = Profiler::QueueSerial();
+            auto item = Profiler::QueueSerialThread();
             MemWrite( &item->hdr.type, QueueType::LockSharedObtain );
             MemWrite( &item->lockObtain.thread, GetThreadHandle() );
             MemWrite( &item->lockObtain.id, m_id );
             MemWrite( &item->lockObtain.time, Profiler::GetTime() );
-            Profiler::QueueSerialFinish();
+            Profiler::QueueSerialThreadFinish();
         }
     }
 
@@ -442,12 +442,12 @@ public:
         }
 #endif
 
-        auto item = Profiler::QueueSerial();
+        auto item = Profiler::QueueSerialThread();
         MemWrite( &item->hdr.type, QueueType::LockMark );
         MemWrite( &item->lockMark.thread, GetThreadHandle() );
         MemWrite( &item->lockMark.id, m_id );
         MemWrite( &item->lockMark.srcloc, (uint64_t)srcloc );
-        Profiler::QueueSerialFinish();
+        Profiler::QueueSerialThreadFinish();
     }
 
     tracy_force_inline void CustomName( const char* name, size_t size )
@@ -455,7 +455,7 @@ public:
         assert( size < std::numeric_limits<uint16_t>::max() );
         auto ptr = (char*)tracy_malloc( size );
         memcpy( ptr, name, size );
-        auto item = Profiler::QueueSerial();
+        auto item = Profiler::QueueSerialThread();
         MemWrite( &item->hdr.type, QueueType::LockName );
         MemWrite( &item->lockNameFat.id, m_id );
         MemWrite( &item->lockNameFat.name, (uint64_t)ptr );
@@ -463,7 +463,7 @@ public:
 #ifdef TRACY_ON_DEMAND
         GetProfiler().DeferItem( *item );
 #endif
-        Profiler::QueueSerialFinish();
+        Profiler::QueueSerialThreadFinish();
     }
 
 private:
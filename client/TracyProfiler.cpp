@@ -54,7 +54,9 @@
 #include <assert.h>
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <limits>
+#include <mutex>
 #include <new>
 #include <stdlib.h>
 #include <string.h>
@@ -62,15 +64,21 @@
 #include <thread>
 
 #include "../common/TracyAlign.hpp"
+#include "../common/TracyShm.hpp"
 #include "../common/TracySocket.hpp"
 #include "../common/TracySystem.hpp"
 #include "../common/tracy_lz4.hpp"
+#include "../common/tracy_lz4hc.hpp"
 #include "tracy_rpmalloc.hpp"
 #include "TracyCallstack.hpp"
 #include "TracyDxt1.hpp"
 #include "TracyScoped.hpp"
 #include "TracyProfiler.hpp"
 #include "TracyThread.hpp"
+
+#ifdef TRACY_ZSTD
+#  include "../zstd/zstd.h"
+#endif
 #include "TracyArmCpuTable.hpp"
 #include "TracySysTrace.hpp"
 #include "../TracyC.h"
@@ -166,7 +174,7 @@ struct InitTimeWrapper
 
 struct ProducerWrapper
 {
-    tracy::moodycamel::ConcurrentQueue<QueueItem>::ExplicitProducer* ptr;
+    tracy::moodycamel::ConcurrentQueue<char>::ExplicitProducer* ptr;
 };
 
 struct ThreadHandleWrapper
@@ -602,6 +610,7 @@ static BroadcastMessage& GetBroadcastMessage( const char* procname, size_t pnsz,
 
 #if defined _WIN32 || defined __CYGWIN__
 static DWORD s_profilerThreadId = 0;
+static DWORD s_symbolThreadId = 0;
 static char s_crashText[1024];
 
 LONG WINAPI CrashFilter( PEXCEPTION_POINTERS pExp )
@@ -681,7 +690,7 @@ LONG WINAPI CrashFilter( PEXCEPTION_POINTERS pExp )
 
     do
     {
-        if( te.th32OwnerProcessID == pid && te.th32ThreadID != tid && te.th32ThreadID != s_profilerThreadId )
+        if( te.th32OwnerProcessID == pid && te.th32ThreadID != tid && te.th32ThreadID != s_profilerThreadId && te.th32ThreadID != s_symbolThreadId )
         {
             HANDLE th = OpenThread( THREAD_SUSPEND_RESUME, FALSE, te.th32ThreadID );
             if( th != INVALID_HANDLE_VALUE )
@@ -711,6 +720,7 @@ LONG WINAPI CrashFilter( PEXCEPTION_POINTERS pExp )
 
 #ifdef __linux__
 static long s_profilerTid = 0;
+static long s_symbolTid = 0;
 static char s_crashText[1024];
 static std::atomic<bool> s_alreadyCrashed( false );
 
@@ -915,7 +925,7 @@ static void CrashHandler( int signal, siginfo_t* info, void* /*ucontext*/ )
     {
         if( ep->d_name[0] == '.' ) continue;
         int tid = atoi( ep->d_name );
-        if( tid != selfTid && tid != s_profilerTid )
+        if( tid != selfTid && tid != s_profilerTid && tid != s_symbolTid )
         {
             syscall( SYS_tkill, tid, SIGPWR );
         }
@@ -936,13 +946,16 @@ static void CrashHandler( int signal, siginfo_t* info, void* /*ucontext*/ )
 #endif
 
 
-enum { QueuePrealloc = 256 * 1024 };
+enum { QueuePrealloc = 256 * 1024 * sizeof( QueueItem ) };
 
 static Profiler* s_instance = nullptr;
 static Thread* s_thread;
 #ifndef TRACY_NO_FRAME_IMAGE
 static Thread* s_compressThread;
 #endif
+#ifdef TRACY_HAS_CALLSTACK
+static Thread* s_symbolThread;
+#endif
 
 #ifdef TRACY_HAS_SYSTEM_TRACING
 static Thread* s_sysTraceThread = nullptr;
@@ -950,6 +963,154 @@ static Thread* s_sysTraceThread = nullptr;
 
 TRACY_API bool ProfilerAvailable() { return s_instance != nullptr; }
 
+SerialQueueWrapper::~SerialQueueWrapper()
+{
+    // Pending events are still drained, the queue is handed over to the next thread that needs one.
+    if( ptr && ProfilerAvailable() ) ptr->active.store( false, std::memory_order_release );
+}
+
+#ifdef TRACY_MIN_ZONE_DURATION
+ZoneFilterWrapper::~ZoneFilterWrapper()
+{
+    // Drop counts below the report threshold are lost with the thread.
+    if( ptr && ProfilerAvailable() ) tracy_free( ptr );
+}
+
+static ZoneFilter* AllocZoneFilter()
+{
+    auto ptr = (ZoneFilter*)tracy_malloc( sizeof( ZoneFilter ) );
+    ptr->threshold = GetProfiler().GetMinZoneDuration();
+    ptr->reportInterval = int64_t( ZoneFilter::DroppedReportInterval / GetProfiler().GetTimerMul() );
+    ptr->reportTime = 0;
+    ptr->pending = 0;
+    ptr->droppedNum = 0;
+    ptr->droppedTotal = 0;
+    return ptr;
+}
+
+void ZoneFilter::Flush()
+{
+#  ifdef TRACY_ON_DEMAND
+    const auto connectionId = GetProfiler().ConnectionId();
+#  endif
+    for( uint32_t i=0; i<pending; i++ )
+    {
+        auto& v = stack[i];
+#  ifdef TRACY_ON_DEMAND
+        if( v.connectionId != connectionId ) continue;
+#  endif
+        TracyLfqPrepare( QueueType::ZoneBegin );
+        MemWrite( &item->zoneBegin.time, v.time );
+        MemWrite( &item->zoneBegin.srcloc, v.srcloc );
+        TracyLfqCommit;
+    }
+    pending = 0;
+}
+
+bool ZoneFilter::EndPending( int64_t time )
+{
+    auto& v = stack[pending-1];
+#  ifdef TRACY_ON_DEMAND
+    if( v.connectionId != GetProfiler().ConnectionId() )
+    {
+        pending--;
+        return false;
+    }
+#  endif
+    if( time - v.time >= threshold )
+    {
+        // Parents of a long enough zone are sent together with it, even if they are still pending.
+        Flush();
+        return true;
+    }
+    pending--;
+
+    uint32_t idx = 0;
+    while( idx < droppedNum && dropped[idx].srcloc != v.srcloc ) idx++;
+    if( idx == droppedNum )
+    {
+        if( droppedNum == MaxDropped ) ReportDropped();
+        idx = droppedNum++;
+        dropped[idx].srcloc = v.srcloc;
+        dropped[idx].count = 0;
+    }
+    dropped[idx].count++;
+    if( ++droppedTotal == DroppedReportThreshold || time - reportTime > reportInterval )
+    {
+        ReportDropped();
+        reportTime = time;
+    }
+    return false;
+}
+
+void ZoneFilter::ReportDropped()
+{
+    for( uint32_t i=0; i<droppedNum; i++ )
+    {
+        TracyLfqPrepare( QueueType::ZonesDropped );
+        MemWrite( &item->zonesDropped.srcloc, dropped[i].srcloc );
+        MemWrite( &item->zonesDropped.count, dropped[i].count );
+        TracyLfqCommit;
+    }
+    droppedNum = 0;
+    droppedTotal = 0;
+}
+#endif
+
+#ifdef TRACY_HAS_CALLSTACK
+struct CallstackCacheEntry
+{
+    uint64_t hash;
+    uint32_t id;
+};
+
+enum { CallstackCacheSize = 4096 };
+
+// Direct mapped per-thread cache of callstack registry lookups.
+struct CallstackCacheWrapper
+{
+    ~CallstackCacheWrapper() { if( ptr && ProfilerAvailable() ) tracy_free( ptr ); }
+    CallstackCacheEntry* ptr;
+};
+
+static CallstackCacheEntry* AllocCallstackCache( size_t size )
+{
+    auto ptr = (CallstackCacheEntry*)tracy_malloc( size * sizeof( CallstackCacheEntry ) );
+    memset( ptr, 0, size * sizeof( CallstackCacheEntry ) );
+    return ptr;
+}
+
+static tracy_force_inline uint64_t HashCallstack( const uintptr_t* trace )
+{
+    const auto sz = *trace++;
+    uint64_t hash = sz;
+    for( uintptr_t i=0; i<sz; i++ )
+    {
+        hash = ( hash ^ uint64_t( trace[i] ) ) * 0x9E3779B97F4A7C15ull;
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+// Resolved symbol data, owned by the symbol worker cache and never evicted.
+struct SymbolCacheEntry
+{
+    uint64_t ptr;
+    const char* file;           // symbol, code location
+    const char* imageName;      // callstack frame
+    CallstackEntry* frames;     // callstack frame
+    uint32_t line;
+    uint8_t size;
+    uint8_t type;
+};
+
+static tracy_force_inline uint32_t HashSymbol( uint64_t ptr, uint8_t type )
+{
+    auto hash = ( ptr ^ type ) * 0x9E3779B97F4A7C15ull;
+    return uint32_t( hash >> 32 );
+}
+#endif
+
 TRACY_API int64_t GetFrequencyQpc()
 {
 #if defined _WIN32 || defined __CYGWIN__
@@ -963,7 +1124,7 @@ TRACY_API int64_t GetFrequencyQpc()
 
 #ifdef TRACY_DELAYED_INIT
 struct ThreadNameData;
-TRACY_API moodycamel::ConcurrentQueue<QueueItem>& GetQueue();
+TRACY_API moodycamel::ConcurrentQueue<char>& GetQueue();
 TRACY_API void InitRPMallocThread();
 
 void InitRPMallocThread()
@@ -974,7 +1135,7 @@ void InitRPMallocThread()
 struct ProfilerData
 {
     int64_t initTime = SetupHwTimer();
-    moodycamel::ConcurrentQueue<QueueItem> queue;
+    moodycamel::ConcurrentQueue<char> queue;
     Profiler profiler;
     std::atomic<uint32_t> lockCounter { 0 };
     std::atomic<uint8_t> gpuCtxCounter { 0 };
@@ -985,18 +1146,25 @@ struct ProducerWrapper
 {
     ProducerWrapper( ProfilerData& data ) : detail( data.queue ), ptr( data.queue.get_explicit_producer( detail ) ) {}
     moodycamel::ProducerToken detail;
-    tracy::moodycamel::ConcurrentQueue<QueueItem>::ExplicitProducer* ptr;
+    tracy::moodycamel::ConcurrentQueue<char>::ExplicitProducer* ptr;
 };
 
 struct ProfilerThreadData
 {
-    ProfilerThreadData( ProfilerData& data ) : token( data ), gpuCtx( { nullptr } ) {}
+    ProfilerThreadData( ProfilerData& data ) : token( data ), gpuCtx( { nullptr } ), serialQueue( { nullptr } ) {}
     RPMallocInit rpmalloc_init;
     ProducerWrapper token;
     GpuCtxWrapper gpuCtx;
+    SerialQueueWrapper serialQueue;
+#  ifdef TRACY_HAS_CALLSTACK
+    CallstackCacheWrapper callstackCache = { nullptr };
+#  endif
 #  ifdef TRACY_ON_DEMAND
     LuaZoneState luaZoneState;
 #  endif
+#  ifdef TRACY_MIN_ZONE_DURATION
+    ZoneFilterWrapper zoneFilter = { nullptr };
+#  endif
 };
 
 #  ifdef TRACY_MANUAL_LIFETIME
@@ -1101,13 +1269,35 @@ static ProfilerThreadData& GetProfilerThreadData()
 }
 #endif
 
-TRACY_API moodycamel::ConcurrentQueue<QueueItem>::ExplicitProducer* GetToken() { return GetProfilerThreadData().token.ptr; }
+TRACY_API moodycamel::ConcurrentQueue<char>::ExplicitProducer* GetToken() { return GetProfilerThreadData().token.ptr; }
 TRACY_API Profiler& GetProfiler() { return GetProfilerData().profiler; }
-TRACY_API moodycamel::ConcurrentQueue<QueueItem>& GetQueue() { return GetProfilerData().queue; }
+TRACY_API moodycamel::ConcurrentQueue<char>& GetQueue() { return GetProfilerData().queue; }
 TRACY_API int64_t GetInitTime() { return GetProfilerData().initTime; }
 TRACY_API std::atomic<uint32_t>& GetLockCounter() { return GetProfilerData().lockCounter; }
 TRACY_API std::atomic<uint8_t>& GetGpuCtxCounter() { return GetProfilerData().gpuCtxCounter; }
 TRACY_API GpuCtxWrapper& GetGpuCtx() { return GetProfilerThreadData().gpuCtx; }
+TRACY_API SerialQueue& GetSerialQueue()
+{
+    auto& wrapper = GetProfilerThreadData().serialQueue;
+    if( !wrapper.ptr ) wrapper.ptr = GetProfiler().AcquireSerialQueue();
+    return *wrapper.ptr;
+}
+#  ifdef TRACY_MIN_ZONE_DURATION
+TRACY_API ZoneFilter& GetZoneFilter()
+{
+    auto& wrapper = GetProfilerThreadData().zoneFilter;
+    if( !wrapper.ptr ) wrapper.ptr = AllocZoneFilter();
+    return *wrapper.ptr;
+}
+#  endif
+#  ifdef TRACY_HAS_CALLSTACK
+static CallstackCacheEntry* GetCallstackCache()
+{
+    auto& wrapper = GetProfilerThreadData().callstackCache;
+    if( !wrapper.ptr ) wrapper.ptr = AllocCallstackCache( CallstackCacheSize );
+    return wrapper.ptr;
+}
+#  endif
 TRACY_API uint64_t GetThreadHandle() { return detail::GetThreadHandleImpl(); }
 std::atomic<ThreadNameData*>& GetThreadNameData() { return GetProfilerData().threadNameData; }
 
@@ -1131,7 +1321,7 @@ TRACY_API void InitRPMallocThread()
 // MSVC static initialization order solution. gcc/clang uses init_order() to avoid all this.
 
 // 1a. But s_queue is needed for initialization of variables in point 2.
-extern moodycamel::ConcurrentQueue<QueueItem> s_queue;
+extern moodycamel::ConcurrentQueue<char> s_queue;
 
 thread_local RPMallocInit init_order(106) s_rpmalloc_thread_init;
 
@@ -1148,11 +1338,15 @@ thread_local ThreadHandleWrapper init_order(104) s_threadHandle { detail::GetThr
 
 static InitTimeWrapper init_order(101) s_initTime { SetupHwTimer() };
 static RPMallocInit init_order(102) s_rpmalloc_init;
-moodycamel::ConcurrentQueue<QueueItem> init_order(103) s_queue( QueuePrealloc );
+moodycamel::ConcurrentQueue<char> init_order(103) s_queue( QueuePrealloc );
 std::atomic<uint32_t> init_order(104) s_lockCounter( 0 );
 std::atomic<uint8_t> init_order(104) s_gpuCtxCounter( 0 );
 
 thread_local GpuCtxWrapper init_order(104) s_gpuCtx { nullptr };
+thread_local SerialQueueWrapper init_order(104) s_serialQueue { nullptr };
+#  ifdef TRACY_HAS_CALLSTACK
+thread_local CallstackCacheWrapper init_order(104) s_callstackCache { nullptr };
+#  endif
 
 struct ThreadNameData;
 static std::atomic<ThreadNameData*> init_order(104) s_threadNameDataInstance( nullptr );
@@ -1161,16 +1355,38 @@ std::atomic<ThreadNameData*>& s_threadNameData = s_threadNameDataInstance;
 #  ifdef TRACY_ON_DEMAND
 thread_local LuaZoneState init_order(104) s_luaZoneState { 0, false };
 #  endif
+#  ifdef TRACY_MIN_ZONE_DURATION
+thread_local ZoneFilterWrapper init_order(104) s_zoneFilter { nullptr };
+#  endif
 
 static Profiler init_order(105) s_profiler;
 
-TRACY_API moodycamel::ConcurrentQueue<QueueItem>::ExplicitProducer* GetToken() { return s_token.ptr; }
+TRACY_API moodycamel::ConcurrentQueue<char>::ExplicitProducer* GetToken() { return s_token.ptr; }
 TRACY_API Profiler& GetProfiler() { return s_profiler; }
-TRACY_API moodycamel::ConcurrentQueue<QueueItem>& GetQueue() { return s_queue; }
+TRACY_API moodycamel::ConcurrentQueue<char>& GetQueue() { return s_queue; }
 TRACY_API int64_t GetInitTime() { return s_initTime.val; }
 TRACY_API std::atomic<uint32_t>& GetLockCounter() { return s_lockCounter; }
 TRACY_API std::atomic<uint8_t>& GetGpuCtxCounter() { return s_gpuCtxCounter; }
 TRACY_API GpuCtxWrapper& GetGpuCtx() { return s_gpuCtx; }
+TRACY_API SerialQueue& GetSerialQueue()
+{
+    if( !s_serialQueue.ptr ) s_serialQueue.ptr = s_profiler.AcquireSerialQueue();
+    return *s_serialQueue.ptr;
+}
+#  ifdef TRACY_MIN_ZONE_DURATION
+TRACY_API ZoneFilter& GetZoneFilter()
+{
+    if( !s_zoneFilter.ptr ) s_zoneFilter.ptr = AllocZoneFilter();
+    return *s_zoneFilter.ptr;
+}
+#  endif
+#  ifdef TRACY_HAS_CALLSTACK
+static CallstackCacheEntry* GetCallstackCache()
+{
+    if( !s_callstackCache.ptr ) s_callstackCache.ptr = AllocCallstackCache( CallstackCacheSize );
+    return s_callstackCache.ptr;
+}
+#  endif
 #  ifdef __CYGWIN__
 // Hackfix for cygwin reporting memory frees without matching allocations. WTF?
 TRACY_API uint64_t GetThreadHandle() { return detail::GetThreadHandleImpl(); }
@@ -1193,22 +1409,52 @@ Profiler::Profiler()
     , m_shutdownManual( false )
     , m_shutdownFinished( false )
     , m_sock( nullptr )
+    , m_shm( nullptr )
     , m_broadcast( nullptr )
     , m_noExit( false )
     , m_userPort( 0 )
     , m_zoneId( 1 )
     , m_samplingPeriod( 0 )
     , m_stream( LZ4_createStream() )
+    , m_streamHC( nullptr )
+#ifdef TRACY_ZSTD
+    , m_zstdCtx( nullptr )
+#endif
+    , m_codec( TransportCodecLz4 )
+    , m_codecLevel( 0 )
     , m_buffer( (char*)tracy_malloc( TargetFrameSize*3 ) )
     , m_bufferOffset( 0 )
     , m_bufferStart( 0 )
     , m_lz4Buf( (char*)tracy_malloc( LZ4Size + sizeof( lz4sz_t ) ) )
     , m_serialQueue( 1024*1024 )
     , m_serialDequeue( 1024*1024 )
+    , m_serialThreadQueues( nullptr )
+    , m_serialMergeQueue( 64*1024 )
+    , m_serialMergeDequeue( 64*1024 )
+    , m_serialMergeGroups( 16*1024 )
+    , m_serialMergeHeld( 1024 )
+#ifdef TRACY_HAS_CALLSTACK
+    , m_callstackCount( 0 )
+    , m_callstackMap( nullptr )
+    , m_callstackMapSize( 0 )
+    , m_symbolStaging( 1024 )
+    , m_symbolQueue( 1024 )
+    , m_symbolDequeue( 1024 )
+    , m_symbolResults( 1024 )
+    , m_symbolResultDequeue( 1024 )
+    , m_symbolEpoch( 0 )
+    , m_symbolCache( nullptr )
+    , m_symbolCacheSize( 0 )
+    , m_symbolCacheCount( 0 )
+#endif
 #ifndef TRACY_NO_FRAME_IMAGE
     , m_fiQueue( 16 )
     , m_fiDequeue( 16 )
+    , m_fiPending( 0 )
 #endif
+    , m_zoneFilter( AllocZoneFilterTable( ZoneFilterInitSize ) )
+    , m_zoneFilterCount( 0 )
+    , m_zoneFilterUsed( 0 )
     , m_frameCount( 0 )
     , m_isConnected( false )
 #ifdef TRACY_ON_DEMAND
@@ -1221,6 +1467,11 @@ Profiler::Profiler()
     assert( !s_instance );
     s_instance = this;
 
+#ifdef TRACY_HAS_CALLSTACK
+    memset( m_callstackRegistry, 0, sizeof( m_callstackRegistry ) );
+    memset( m_callstackSent, 0, sizeof( m_callstackSent ) );
+#endif
+
 #ifndef TRACY_DELAYED_INIT
 #  ifdef _MSC_VER
     // 3. But these variables need to be initialized in main thread within the .CRT$XCB section. Do it here.
@@ -1234,6 +1485,14 @@ Profiler::Profiler()
     CalibrateDelay();
     ReportTopology();
 
+#ifdef TRACY_MIN_ZONE_DURATION
+    // Threshold is given in nanoseconds, zero disables the filter.
+    int64_t minZoneDuration = TRACY_MIN_ZONE_DURATION;
+    const char* minZoneDurationEnv = GetEnvVar( "TRACY_MIN_ZONE_DURATION" );
+    if( minZoneDurationEnv ) minZoneDuration = atoll( minZoneDurationEnv );
+    m_minZoneDuration = minZoneDuration > 0 ? std::max<int64_t>( 1, int64_t( minZoneDuration / m_timerMul ) ) : 0;
+#endif
+
 #ifndef TRACY_NO_EXIT
     const char* noExitEnv = GetEnvVar( "TRACY_NO_EXIT" );
     if( noExitEnv && noExitEnv[0] == '1' )
@@ -1263,6 +1522,11 @@ void Profiler::SpawnWorkerThreads()
     new(s_compressThread) Thread( LaunchCompressWorker, this );
 #endif
 
+#ifdef TRACY_HAS_CALLSTACK
+    s_symbolThread = (Thread*)tracy_malloc( sizeof( Thread ) );
+    new(s_symbolThread) Thread( LaunchSymbolWorker, this );
+#endif
+
 #ifdef TRACY_HAS_SYSTEM_TRACING
     if( SysTraceStart( m_samplingPeriod ) )
     {
@@ -1274,6 +1538,7 @@ void Profiler::SpawnWorkerThreads()
 
 #if defined _WIN32 || defined __CYGWIN__
     s_profilerThreadId = GetThreadId( s_thread->Handle() );
+    s_symbolThreadId = GetThreadId( s_symbolThread->Handle() );
     AddVectoredExceptionHandler( 1, CrashFilter );
 #endif
 
@@ -1321,9 +1586,30 @@ Profiler::~Profiler()
     s_thread->~Thread();
     tracy_free( s_thread );
 
+#ifdef TRACY_HAS_CALLSTACK
+    // Symbol queries are answered until the profiler thread is done.
+    s_symbolThread->~Thread();
+    tracy_free( s_symbolThread );
+#endif
+
+    auto zoneFilter = m_zoneFilter.load( std::memory_order_relaxed );
+    while( zoneFilter )
+    {
+        auto prev = zoneFilter->prev;
+        tracy_free( zoneFilter->data );
+        tracy_free( zoneFilter );
+        zoneFilter = prev;
+    }
+
     tracy_free( m_lz4Buf );
     tracy_free( m_buffer );
     LZ4_freeStream( (LZ4_stream_t*)m_stream );
+    if( m_streamHC ) LZ4_freeStreamHC( (LZ4_streamHC_t*)m_streamHC );
+#ifdef TRACY_ZSTD
+    if( m_zstdCtx ) ZSTD_freeCCtx( (ZSTD_CCtx*)m_zstdCtx );
+#endif
+
+    CloseShm();
 
     if( m_sock )
     {
@@ -1337,6 +1623,38 @@ Profiler::~Profiler()
         tracy_free( m_broadcast );
     }
 
+    auto queue = m_serialThreadQueues.load( std::memory_order_acquire );
+    while( queue )
+    {
+        auto next = queue->next;
+        queue->~SerialQueue();
+        tracy_free( queue );
+        queue = next;
+    }
+
+#ifdef TRACY_HAS_CALLSTACK
+    for( uint32_t i=1; i<=m_callstackCount; i++ ) tracy_free( (void*)CallstackTrace( i ) );
+    for( auto& chunk : m_callstackRegistry ) tracy_free( chunk );
+    for( auto& sent : m_callstackSent ) tracy_free( sent );
+    tracy_free( m_callstackMap );
+
+    for( uint32_t i=0; i<m_symbolCacheSize; i++ )
+    {
+        auto entry = m_symbolCache[i];
+        if( !entry ) continue;
+        for( uint8_t j=0; j<entry->size; j++ )
+        {
+            tracy_free( (void*)entry->frames[j].name );
+            tracy_free( (void*)entry->frames[j].file );
+        }
+        tracy_free( entry->frames );
+        tracy_free( (void*)entry->imageName );
+        tracy_free( (void*)entry->file );
+        tracy_free( entry );
+    }
+    tracy_free( m_symbolCache );
+#endif
+
     assert( s_instance );
     s_instance = nullptr;
 }
@@ -1561,6 +1879,7 @@ void Profiler::Worker()
         }
 
         // Handshake
+        TransportRequestMessage transport;
         {
             char shibboleth[HandshakeShibbolethSize];
             auto res = m_sock->ReadRaw( shibboleth, HandshakeShibbolethSize, 2000 );
@@ -1591,8 +1910,20 @@ void Profiler::Worker()
                 m_sock = nullptr;
                 continue;
             }
+
+            res = m_sock->ReadRaw( &transport, sizeof( transport ), 2000 );
+            if( !res )
+            {
+                m_sock->~Socket();
+                tracy_free( m_sock );
+                m_sock = nullptr;
+                continue;
+            }
         }
 
+        // Zone filter is set up by the server, a new connection starts with all zones enabled.
+        ClearZoneFilter();
+
 #ifdef TRACY_ON_DEMAND
         const auto currentTime = GetTime();
         ClearQueues( token );
@@ -1603,13 +1934,23 @@ void Profiler::Worker()
         HandshakeStatus handshake = HandshakeWelcome;
         m_sock->Send( &handshake, sizeof( handshake ) );
 
-        LZ4_resetStream( (LZ4_stream_t*)m_stream );
+        SetupTransport( transport );
+        MemWrite( &welcome.codec, m_codec );
+        MemWrite( &welcome.codecLevel, m_codecLevel );
+        const auto shm = OfferShm( transport, welcome );
         m_sock->Send( &welcome, sizeof( welcome ) );
+        if( shm ) AcceptShm();
 
         m_threadCtx = 0;
         m_refTimeSerial = 0;
         m_refTimeCtx = 0;
         m_refTimeGpu = 0;
+#ifdef TRACY_HAS_CALLSTACK
+        for( auto& sent : m_callstackSent )
+        {
+            if( sent ) memset( sent, 0, CallstackRegistryChunkSize / 8 );
+        }
+#endif
 
 #ifdef TRACY_ON_DEMAND
         OnDemandPayloadMessage onDemand;
@@ -1656,11 +1997,12 @@ void Profiler::Worker()
             ProcessSysTime();
             const auto status = Dequeue( token );
             const auto serialStatus = DequeueSerial();
-            if( status == DequeueStatus::ConnectionLost || serialStatus == DequeueStatus::ConnectionLost )
+            const auto symbolStatus = DequeueSymbols();
+            if( status == DequeueStatus::ConnectionLost || serialStatus == DequeueStatus::ConnectionLost || symbolStatus == DequeueStatus::ConnectionLost )
             {
                 break;
             }
-            else if( status == DequeueStatus::QueueEmpty && serialStatus == DequeueStatus::QueueEmpty )
+            else if( status == DequeueStatus::QueueEmpty && serialStatus == DequeueStatus::QueueEmpty && symbolStatus == DequeueStatus::QueueEmpty )
             {
                 if( ShouldExit() ) break;
                 if( m_bufferOffset != m_bufferStart )
@@ -1697,6 +2039,8 @@ void Profiler::Worker()
         if( ShouldExit() ) break;
 
         m_isConnected.store( false, std::memory_order_release );
+        ClearSymbols();
+        CloseShm();
 #ifdef TRACY_ON_DEMAND
         m_bufferOffset = 0;
         m_bufferStart = 0;
@@ -1740,6 +2084,11 @@ void Profiler::Worker()
                     m_sock = nullptr;
                     continue;
                 }
+                if( protocolVersion == ProtocolVersion )
+                {
+                    TransportRequestMessage transport;
+                    m_sock->ReadRaw( &transport, sizeof( transport ), 1000 );
+                }
 
                 HandshakeStatus status = HandshakeNotAvailable;
                 m_sock->Send( &status, sizeof( status ) );
@@ -1756,12 +2105,13 @@ void Profiler::Worker()
     {
         const auto status = Dequeue( token );
         const auto serialStatus = DequeueSerial();
-        if( status == DequeueStatus::ConnectionLost || serialStatus == DequeueStatus::ConnectionLost )
+        const auto symbolStatus = DequeueSymbols();
+        if( status == DequeueStatus::ConnectionLost || serialStatus == DequeueStatus::ConnectionLost || symbolStatus == DequeueStatus::ConnectionLost )
         {
             m_shutdownFinished.store( true, std::memory_order_relaxed );
             return;
         }
-        else if( status == DequeueStatus::QueueEmpty && serialStatus == DequeueStatus::QueueEmpty )
+        else if( status == DequeueStatus::QueueEmpty && serialStatus == DequeueStatus::QueueEmpty && symbolStatus == DequeueStatus::QueueEmpty )
         {
             if( m_bufferOffset != m_bufferStart ) CommitData();
             break;
@@ -1788,6 +2138,11 @@ void Profiler::Worker()
     // Handle remaining server queries
     for(;;)
     {
+        if( DequeueSymbols() == DequeueStatus::ConnectionLost )
+        {
+            m_shutdownFinished.store( true, std::memory_order_relaxed );
+            return;
+        }
         if( m_sock->HasData() )
         {
             while( m_sock->HasData() )
@@ -1818,6 +2173,113 @@ void Profiler::Worker()
 }
 
 #ifndef TRACY_NO_FRAME_IMAGE
+// Large frame images are split into stripes of block rows, which are compressed by the DXT1 thread
+// together with a few helper threads.
+class Dxt1Helpers
+{
+    enum { StripeRows = 32 };
+
+public:
+    Dxt1Helpers( int num )
+        : m_num( num )
+        , m_generation( 0 )
+        , m_active( 0 )
+        , m_exit( false )
+    {
+        m_threads = (Thread*)tracy_malloc( sizeof( Thread ) * num );
+        for( int i=0; i<num; i++ ) new(m_threads+i) Thread( LaunchWorker, this );
+    }
+
+    ~Dxt1Helpers()
+    {
+        {
+            std::lock_guard<std::mutex> lock( m_lock );
+            m_exit = true;
+        }
+        m_cv.notify_all();
+        for( int i=0; i<m_num; i++ ) m_threads[i].~Thread();
+        tracy_free( m_threads );
+    }
+
+    static bool ShouldSplit( int h ) { return h / 4 > StripeRows; }
+
+    void Compress( const char* src, char* dst, int w, int h )
+    {
+        {
+            // Helpers which woke up late may still be looking at the previous image.
+            std::unique_lock<std::mutex> lock( m_lock );
+            m_cv.wait( lock, [this] { return m_active == 0; } );
+            m_src = src;
+            m_dst = dst;
+            m_w = w;
+            m_rows = h / 4;
+            m_stripes = ( m_rows + StripeRows - 1 ) / StripeRows;
+            m_next.store( 0, std::memory_order_relaxed );
+            m_done.store( 0, std::memory_order_relaxed );
+            m_generation++;
+        }
+        m_cv.notify_all();
+        Run();
+        while( m_done.load( std::memory_order_acquire ) != m_stripes ) std::this_thread::yield();
+    }
+
+private:
+    static void LaunchWorker( void* ptr ) { ((Dxt1Helpers*)ptr)->Worker(); }
+
+    void Worker()
+    {
+        ThreadExitHandler threadExitHandler;
+        SetThreadName( "Tracy DXT1 Helper" );
+        uint32_t generation = 0;
+        for(;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock( m_lock );
+                m_cv.wait( lock, [this, generation] { return m_exit || m_generation != generation; } );
+                if( m_exit ) return;
+                generation = m_generation;
+                m_active++;
+            }
+            Run();
+            {
+                std::lock_guard<std::mutex> lock( m_lock );
+                m_active--;
+            }
+            m_cv.notify_all();
+        }
+    }
+
+    void Run()
+    {
+        for(;;)
+        {
+            const auto stripe = m_next.fetch_add( 1, std::memory_order_relaxed );
+            if( stripe >= m_stripes ) return;
+            const auto row = stripe * StripeRows;
+            const auto rows = std::min<int>( StripeRows, m_rows - row );
+            CompressImageDxt1( m_src + size_t( row ) * m_w * 16, m_dst + size_t( row ) * m_w * 2, m_w, rows * 4 );
+            m_done.fetch_add( 1, std::memory_order_release );
+        }
+    }
+
+    Thread* m_threads;
+    int m_num;
+
+    std::mutex m_lock;
+    std::condition_variable m_cv;
+    uint32_t m_generation;
+    int m_active;
+    bool m_exit;
+
+    const char* m_src;
+    char* m_dst;
+    int m_w;
+    int m_rows;
+    int m_stripes;
+    std::atomic<int> m_next;
+    std::atomic<int> m_done;
+};
+
 void Profiler::CompressWorker()
 {
     ThreadExitHandler threadExitHandler;
@@ -1825,6 +2287,11 @@ void Profiler::CompressWorker()
     SetThreadName( "Tracy DXT1" );
     while( m_timeBegin.load( std::memory_order_relaxed ) == 0 ) std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
     rpmalloc_thread_initialize();
+
+    // Helper threads are only started when the first large image arrives.
+    const int numHelpers = std::min( int( std::thread::hardware_concurrency() ) - 1, 3 );
+    Dxt1Helpers* helpers = nullptr;
+
     for(;;)
     {
         const auto shouldExit = ShouldExit();
@@ -1857,8 +2324,21 @@ void Profiler::CompressWorker()
                 const auto h = fi->h;
                 const auto csz = size_t( w * h / 2 );
                 auto etc1buf = (char*)tracy_malloc( csz );
-                CompressImageDxt1( (const char*)fi->image, etc1buf, w, h );
+                if( Dxt1Helpers::ShouldSplit( h ) && numHelpers > 0 )
+                {
+                    if( !helpers )
+                    {
+                        helpers = (Dxt1Helpers*)tracy_malloc( sizeof( Dxt1Helpers ) );
+                        new(helpers) Dxt1Helpers( numHelpers );
+                    }
+                    helpers->Compress( (const char*)fi->image, etc1buf, w, h );
+                }
+                else
+                {
+                    CompressImageDxt1( (const char*)fi->image, etc1buf, w, h );
+                }
                 tracy_free( fi->image );
+                m_fiPending.fetch_sub( 1, std::memory_order_relaxed );
 
                 TracyLfqPrepare( QueueType::FrameImage );
                 MemWrite( &item->frameImageFat.image, (uint64_t)etc1buf );
@@ -1878,12 +2358,152 @@ void Profiler::CompressWorker()
             std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
         }
 
+        if( shouldExit )
+        {
+            if( helpers )
+            {
+                helpers->~Dxt1Helpers();
+                tracy_free( helpers );
+            }
+            return;
+        }
+    }
+}
+#endif
+
+#ifdef TRACY_HAS_CALLSTACK
+void Profiler::SymbolWorker()
+{
+#ifdef __linux__
+    s_symbolTid = syscall( SYS_gettid );
+#endif
+
+    ThreadExitHandler threadExitHandler;
+
+    SetThreadName( "Tracy Symbol Worker" );
+    while( m_timeBegin.load( std::memory_order_relaxed ) == 0 ) std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+    rpmalloc_thread_initialize();
+    for(;;)
+    {
+        // The profiler thread may still need answers to server queries while the client is exiting.
+        const auto shouldExit = m_shutdownFinished.load( std::memory_order_relaxed );
+
+        m_symbolLock.lock();
+        if( !m_symbolQueue.empty() ) m_symbolQueue.swap( m_symbolDequeue );
+        m_symbolLock.unlock();
+
+        const auto sz = m_symbolDequeue.size();
+        if( sz > 0 )
+        {
+            // Publish results in small batches, so that the profiler thread can start sending them
+            // while the rest is still being resolved.
+            enum { PublishBatch = 64 };
+            auto item = m_symbolDequeue.data();
+            auto end = item + sz;
+            while( item != end )
+            {
+                auto batchEnd = std::min( item + PublishBatch, end );
+                for( auto it = item; it != batchEnd; it++ ) it->entry = ResolveSymbol( it->type, it->ptr );
+                m_symbolResultLock.lock();
+                while( item != batchEnd ) *m_symbolResults.push_next() = *item++;
+                m_symbolResultLock.unlock();
+            }
+            m_symbolDequeue.clear();
+        }
+        else
+        {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+        }
+
         if( shouldExit )
         {
             return;
         }
     }
 }
+
+const SymbolCacheEntry* Profiler::ResolveSymbol( SymbolQueryType type, uint64_t ptr )
+{
+    if( m_symbolCacheSize == 0 )
+    {
+        m_symbolCacheSize = 1024;
+        m_symbolCache = (SymbolCacheEntry**)tracy_malloc( m_symbolCacheSize * sizeof( SymbolCacheEntry* ) );
+        memset( m_symbolCache, 0, m_symbolCacheSize * sizeof( SymbolCacheEntry* ) );
+    }
+
+    auto idx = HashSymbol( ptr, uint8_t( type ) ) & ( m_symbolCacheSize - 1 );
+    while( m_symbolCache[idx] )
+    {
+        auto entry = m_symbolCache[idx];
+        if( entry->ptr == ptr && entry->type == uint8_t( type ) ) return entry;
+        idx = ( idx + 1 ) & ( m_symbolCacheSize - 1 );
+    }
+
+    auto entry = (SymbolCacheEntry*)tracy_malloc( sizeof( SymbolCacheEntry ) );
+    memset( entry, 0, sizeof( SymbolCacheEntry ) );
+    entry->ptr = ptr;
+    entry->type = uint8_t( type );
+    LockCallstackDecode();
+    switch( type )
+    {
+    case SymbolQueryType::CallstackFrame:
+    {
+        const auto frameData = DecodeCallstackPtr( ptr );
+        const auto imageLen = strlen( frameData.imageName );
+        auto imageName = (char*)tracy_malloc( imageLen + 1 );
+        memcpy( imageName, frameData.imageName, imageLen + 1 );
+        entry->imageName = imageName;
+        entry->size = frameData.size;
+        entry->frames = (CallstackEntry*)tracy_malloc( frameData.size * sizeof( CallstackEntry ) );
+        memcpy( entry->frames, frameData.data, frameData.size * sizeof( CallstackEntry ) );
+        break;
+    }
+    case SymbolQueryType::Symbol:
+    case SymbolQueryType::CodeLocation:
+    {
+        const auto sym = type == SymbolQueryType::Symbol ? DecodeSymbolAddress( ptr ) : DecodeCodeAddress( ptr );
+        // Strings that are not allocated (dbghelp line info) are only valid until the next decode.
+        if( sym.needFree )
+        {
+            entry->file = sym.file;
+        }
+        else
+        {
+            const auto fileLen = strlen( sym.file );
+            auto file = (char*)tracy_malloc( fileLen + 1 );
+            memcpy( file, sym.file, fileLen + 1 );
+            entry->file = file;
+        }
+        entry->line = sym.line;
+        break;
+    }
+    default:
+        assert( false );
+        break;
+    }
+    UnlockCallstackDecode();
+    m_symbolCache[idx] = entry;
+
+    if( ++m_symbolCacheCount * 2 > m_symbolCacheSize )
+    {
+        const auto oldCache = m_symbolCache;
+        const auto oldSize = m_symbolCacheSize;
+        m_symbolCacheSize *= 2;
+        m_symbolCache = (SymbolCacheEntry**)tracy_malloc( m_symbolCacheSize * sizeof( SymbolCacheEntry* ) );
+        memset( m_symbolCache, 0, m_symbolCacheSize * sizeof( SymbolCacheEntry* ) );
+        for( uint32_t i=0; i<oldSize; i++ )
+        {
+            auto e = oldCache[i];
+            if( !e ) continue;
+            auto j = HashSymbol( e->ptr, e->type ) & ( m_symbolCacheSize - 1 );
+            while( m_symbolCache[j] ) j = ( j + 1 ) & ( m_symbolCacheSize - 1 );
+            m_symbolCache[j] = e;
+        }
+        tracy_free( oldCache );
+    }
+
+    return entry;
+}
 #endif
 
 static void FreeAssociatedMemory( const QueueItem& item )
@@ -1967,11 +2587,21 @@ void Profiler::ClearQueues( moodycamel::ConsumerToken& token )
 {
     for(;;)
     {
-        const auto sz = GetQueue().try_dequeue_bulk_single( token, [](const uint64_t&){}, []( QueueItem* item, size_t sz ) { assert( sz > 0 ); while( sz-- > 0 ) FreeAssociatedMemory( *item++ ); } );
-        if( sz == 0 ) break;
-    }
-
-    ClearSerial();
+        const auto sz = GetQueue().try_dequeue_bulk_single( token, [](const uint64_t&){}, []( char* ptr, size_t sz )
+        {
+            assert( sz > 0 );
+            auto end = ptr + sz;
+            while( ptr != end )
+            {
+                auto item = (const QueueItem*)ptr;
+                FreeAssociatedMemory( *item );
+                ptr += QueueFatDataSize[item->hdr.idx];
+            }
+        } );
+        if( sz == 0 ) break;
+    }
+
+    ClearSerial();
 }
 
 void Profiler::ClearSerial()
@@ -1994,6 +2624,21 @@ void Profiler::ClearSerial()
 
     for( auto& v : m_serialDequeue ) FreeAssociatedMemory( v );
     m_serialDequeue.clear();
+
+    auto queue = m_serialThreadQueues.load( std::memory_order_acquire );
+    while( queue )
+    {
+        if( queue->lock.try_lock() )
+        {
+            for( auto& v : queue->items ) FreeAssociatedMemory( v );
+            queue->items.clear();
+            queue->lock.unlock();
+        }
+        queue = queue->next;
+    }
+    for( auto& v : m_serialMergeQueue ) FreeAssociatedMemory( v );
+    m_serialMergeQueue.clear();
+    m_serialMergeHeld.clear();
 }
 
 Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
@@ -2012,18 +2657,21 @@ Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
                 m_refTimeThread = 0;
             }
         },
-        [this, &connectionLost] ( QueueItem* item, size_t sz )
+        [this, &connectionLost] ( char* data, size_t sz )
         {
             if( connectionLost ) return;
             assert( sz > 0 );
             int64_t refThread = m_refTimeThread;
             int64_t refCtx = m_refTimeCtx;
             int64_t refGpu = m_refTimeGpu;
-            while( sz-- > 0 )
+            auto end = data + sz;
+            while( data != end )
             {
                 uint64_t ptr;
                 uint16_t size;
+                auto item = (QueueItem*)data;
                 auto idx = MemRead<uint8_t>( &item->hdr.idx );
+                data += QueueFatDataSize[idx];
                 if( idx < (int)QueueType::Terminate )
                 {
                     switch( (QueueType)idx )
@@ -2071,15 +2719,14 @@ Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
                     }
                     case QueueType::Callstack:
                         ptr = MemRead<uint64_t>( &item->callstackFat.ptr );
-                        SendCallstackPayload( ptr );
-                        tracy_free( (void*)ptr );
+                        SendCallstackCached( ptr, MemRead<uint32_t>( &item->callstackFat.id ) );
                         break;
                     case QueueType::CallstackAlloc:
                         ptr = MemRead<uint64_t>( &item->callstackAllocFat.nativePtr );
                         if( ptr != 0 )
                         {
                             CutCallstack( (void*)ptr, "lua_pcall" );
-                            SendCallstackPayload( ptr );
+                            SendCallstackPayload( ptr, 0 );
                             tracy_free( (void*)ptr );
                         }
                         ptr = MemRead<uint64_t>( &item->callstackAllocFat.ptr );
@@ -2198,7 +2845,7 @@ Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
                         break;
                     }
                 }
-                if( !AppendData( item++, QueueDataSize[idx] ) )
+                if( !AppendItem( item, idx ) )
                 {
                     connectionLost = true;
                     m_refTimeThread = refThread;
@@ -2219,15 +2866,18 @@ Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
 Profiler::DequeueStatus Profiler::DequeueContextSwitches( tracy::moodycamel::ConsumerToken& token, int64_t& timeStop )
 {
     const auto sz = GetQueue().try_dequeue_bulk_single( token, [] ( const uint64_t& ) {},
-        [this, &timeStop] ( QueueItem* item, size_t sz )
+        [this, &timeStop] ( char* data, size_t sz )
         {
             assert( sz > 0 );
             int64_t refCtx = m_refTimeCtx;
-            while( sz-- > 0 )
+            auto end = data + sz;
+            while( data != end )
             {
+                auto item = (QueueItem*)data;
                 FreeAssociatedMemory( *item );
                 if( timeStop < 0 ) return;
                 const auto idx = MemRead<uint8_t>( &item->hdr.idx );
+                data += QueueFatDataSize[idx];
                 if( idx == (uint8_t)QueueType::ContextSwitch )
                 {
                     const auto csTime = MemRead<int64_t>( &item->contextSwitch.time );
@@ -2266,7 +2916,6 @@ Profiler::DequeueStatus Profiler::DequeueContextSwitches( tracy::moodycamel::Con
                         return;
                     }
                 }
-                item++;
             }
             m_refTimeCtx = refCtx;
         }
@@ -2276,6 +2925,233 @@ Profiler::DequeueStatus Profiler::DequeueContextSwitches( tracy::moodycamel::Con
     return ( timeStop == -1 || sz > 0 ) ? DequeueStatus::DataDequeued : DequeueStatus::QueueEmpty;
 }
 
+SerialQueue* Profiler::AcquireSerialQueue()
+{
+    auto queue = m_serialThreadQueues.load( std::memory_order_acquire );
+    while( queue )
+    {
+        bool expected = false;
+        if( !queue->active.load( std::memory_order_relaxed ) && queue->active.compare_exchange_strong( expected, true, std::memory_order_acquire, std::memory_order_relaxed ) ) return queue;
+        queue = queue->next;
+    }
+
+    InitRPMallocThread();
+    queue = (SerialQueue*)tracy_malloc( sizeof( SerialQueue ) );
+    new(queue) SerialQueue();
+    auto head = m_serialThreadQueues.load( std::memory_order_relaxed );
+    do
+    {
+        queue->next = head;
+    }
+    while( !m_serialThreadQueues.compare_exchange_weak( head, queue, std::memory_order_release, std::memory_order_relaxed ) );
+    return queue;
+}
+
+static bool GetSerialItemTime( const QueueItem& item, int64_t& time )
+{
+    switch( (QueueType)MemRead<uint8_t>( &item.hdr.idx ) )
+    {
+    case QueueType::MemAlloc:
+    case QueueType::MemAllocNamed:
+    case QueueType::MemAllocCallstack:
+    case QueueType::MemAllocCallstackNamed:
+        time = MemRead<int64_t>( &item.memAlloc.time );
+        return true;
+    case QueueType::MemFree:
+    case QueueType::MemFreeNamed:
+    case QueueType::MemFreeCallstack:
+    case QueueType::MemFreeCallstackNamed:
+        time = MemRead<int64_t>( &item.memFree.time );
+        return true;
+    case QueueType::LockAnnounce:
+        time = MemRead<int64_t>( &item.lockAnnounce.time );
+        return true;
+    case QueueType::LockTerminate:
+        time = MemRead<int64_t>( &item.lockTerminate.time );
+        return true;
+    case QueueType::LockWait:
+    case QueueType::LockSharedWait:
+        time = MemRead<int64_t>( &item.lockWait.time );
+        return true;
+    case QueueType::LockObtain:
+    case QueueType::LockSharedObtain:
+        time = MemRead<int64_t>( &item.lockObtain.time );
+        return true;
+    case QueueType::LockRelease:
+    case QueueType::LockSharedRelease:
+        time = MemRead<int64_t>( &item.lockRelease.time );
+        return true;
+    default:
+        return false;
+    }
+}
+
+void Profiler::CollectSerialThreadQueues()
+{
+    // Events held back by the previous pass go first, so that ties keep their order.
+    m_serialMergeQueue.swap( m_serialMergeDequeue );
+    m_serialMergeGroups.swap( m_serialMergeHeld );
+    m_serialMergeHeld.clear();
+
+    auto queue = m_serialThreadQueues.load( std::memory_order_acquire );
+    while( queue )
+    {
+        queue->lock.lock();
+        if( !queue->items.empty() )
+        {
+            auto base = uint32_t( m_serialMergeDequeue.size() );
+            uint32_t begin = base;
+            for( auto& item : queue->items )
+            {
+                memcpy( m_serialMergeDequeue.push_next(), &item, sizeof( QueueItem ) );
+                const auto type = (QueueType)MemRead<uint8_t>( &item.hdr.idx );
+                if( type == QueueType::CallstackSerial || type == QueueType::MemNamePayload ) continue;
+                // Keep program order within a thread even if the timer drifts between cores.
+                // Lock marks and names carry no time and stay behind the thread's previous event.
+                int64_t time;
+                if( GetSerialItemTime( item, time ) && time > queue->time ) queue->time = time;
+                auto group = m_serialMergeGroups.push_next();
+                group->time = queue->time;
+                group->begin = begin;
+                group->end = uint32_t( m_serialMergeDequeue.size() );
+                begin = group->end;
+            }
+            queue->items.clear();
+            assert( begin == m_serialMergeDequeue.size() );
+        }
+        queue->lock.unlock();
+        queue = queue->next;
+    }
+
+    std::sort( m_serialMergeGroups.begin(), m_serialMergeGroups.end(), []( const SerialMergeGroup& l, const SerialMergeGroup& r ) { return l.time < r.time || ( l.time == r.time && l.begin < r.begin ); } );
+}
+
+bool Profiler::DequeueSerialItem( QueueItem* item, int64_t& refSerial, int64_t& refGpu )
+{
+    uint64_t ptr;
+    auto idx = MemRead<uint8_t>( &item->hdr.idx );
+    if( idx < (int)QueueType::Terminate )
+    {
+        switch( (QueueType)idx )
+        {
+        case QueueType::CallstackSerial:
+            ptr = MemRead<uint64_t>( &item->callstackFat.ptr );
+            SendCallstackCached( ptr, MemRead<uint32_t>( &item->callstackFat.id ) );
+            break;
+        case QueueType::LockWait:
+        case QueueType::LockSharedWait:
+        {
+            int64_t t = MemRead<int64_t>( &item->lockWait.time );
+            int64_t dt = t - refSerial;
+            refSerial = t;
+            MemWrite( &item->lockWait.time, dt );
+            break;
+        }
+        case QueueType::LockObtain:
+        case QueueType::LockSharedObtain:
+        {
+            int64_t t = MemRead<int64_t>( &item->lockObtain.time );
+            int64_t dt = t - refSerial;
+            refSerial = t;
+            MemWrite( &item->lockObtain.time, dt );
+            break;
+        }
+        case QueueType::LockRelease:
+        case QueueType::LockSharedRelease:
+        {
+            int64_t t = MemRead<int64_t>( &item->lockRelease.time );
+            int64_t dt = t - refSerial;
+            refSerial = t;
+            MemWrite( &item->lockRelease.time, dt );
+            break;
+        }
+        case QueueType::LockName:
+        {
+            ptr = MemRead<uint64_t>( &item->lockNameFat.name );
+            uint16_t size = MemRead<uint16_t>( &item->lockNameFat.size );
+            SendSingleString( (const char*)ptr, size );
+#ifndef TRACY_ON_DEMAND
+            tracy_free( (void*)ptr );
+#endif
+            break;
+        }
+        case QueueType::MemAlloc:
+        case QueueType::MemAllocNamed:
+        case QueueType::MemAllocCallstack:
+        case QueueType::MemAllocCallstackNamed:
+        {
+            int64_t t = MemRead<int64_t>( &item->memAlloc.time );
+            int64_t dt = t - refSerial;
+            refSerial = t;
+            MemWrite( &item->memAlloc.time, dt );
+            break;
+        }
+        case QueueType::MemFree:
+        case QueueType::MemFreeNamed:
+        case QueueType::MemFreeCallstack:
+        case QueueType::MemFreeCallstackNamed:
+        {
+            int64_t t = MemRead<int64_t>( &item->memFree.time );
+            int64_t dt = t - refSerial;
+            refSerial = t;
+            MemWrite( &item->memFree.time, dt );
+            break;
+        }
+        case QueueType::GpuZoneBeginSerial:
+        case QueueType::GpuZoneBeginCallstackSerial:
+        {
+            int64_t t = MemRead<int64_t>( &item->gpuZoneBegin.cpuTime );
+            int64_t dt = t - refSerial;
+            refSerial = t;
+            MemWrite( &item->gpuZoneBegin.cpuTime, dt );
+            break;
+        }
+        case QueueType::GpuZoneBeginAllocSrcLocSerial:
+        case QueueType::GpuZoneBeginAllocSrcLocCallstackSerial:
+        {
+            int64_t t = MemRead<int64_t>( &item->gpuZoneBegin.cpuTime );
+            int64_t dt = t - refSerial;
+            refSerial = t;
+            MemWrite( &item->gpuZoneBegin.cpuTime, dt );
+            ptr = MemRead<uint64_t>( &item->gpuZoneBegin.srcloc );
+            SendSourceLocationPayload( ptr );
+            tracy_free( (void*)ptr );
+            break;
+        }
+        case QueueType::GpuZoneEndSerial:
+        {
+            int64_t t = MemRead<int64_t>( &item->gpuZoneEnd.cpuTime );
+            int64_t dt = t - refSerial;
+            refSerial = t;
+            MemWrite( &item->gpuZoneEnd.cpuTime, dt );
+            break;
+        }
+        case QueueType::GpuTime:
+        {
+            int64_t t = MemRead<int64_t>( &item->gpuTime.gpuTime );
+            int64_t dt = t - refGpu;
+            refGpu = t;
+            MemWrite( &item->gpuTime.gpuTime, dt );
+            break;
+        }
+        case QueueType::GpuContextName:
+        {
+            ptr = MemRead<uint64_t>( &item->gpuContextNameFat.ptr );
+            uint16_t size = MemRead<uint16_t>( &item->gpuContextNameFat.size );
+            SendSingleString( (const char*)ptr, size );
+#ifndef TRACY_ON_DEMAND
+            tracy_free( (void*)ptr );
+#endif
+            break;
+        }
+        default:
+            assert( false );
+            break;
+        }
+    }
+    return AppendItem( item, idx );
+}
+
 Profiler::DequeueStatus Profiler::DequeueSerial()
 {
     {
@@ -2295,148 +3171,63 @@ Profiler::DequeueStatus Profiler::DequeueSerial()
         }
     }
 
+    // Memory and lock events recorded before this point in time are already visible in the per-thread queues.
+    // Anything later may still be racing with events not yet committed by other threads.
+    const auto watermark = GetTime();
+    CollectSerialThreadQueues();
+
     const auto sz = m_serialDequeue.size();
+    if( sz == 0 && m_serialMergeGroups.empty() ) return DequeueStatus::QueueEmpty;
+
+    int64_t refSerial = m_refTimeSerial;
+    int64_t refGpu = m_refTimeGpu;
     if( sz > 0 )
     {
-        int64_t refSerial = m_refTimeSerial;
-        int64_t refGpu = m_refTimeGpu;
         auto item = m_serialDequeue.data();
         auto end = item + sz;
         while( item != end )
         {
-            uint64_t ptr;
-            auto idx = MemRead<uint8_t>( &item->hdr.idx );
-            if( idx < (int)QueueType::Terminate )
+            if( !DequeueSerialItem( item, refSerial, refGpu ) ) return DequeueStatus::ConnectionLost;
+            item++;
+        }
+        m_serialDequeue.clear();
+    }
+
+    assert( m_serialMergeQueue.empty() );
+    auto group = m_serialMergeGroups.begin();
+    auto gend = m_serialMergeGroups.end();
+    while( group != gend && group->time <= watermark )
+    {
+        for( uint32_t i=group->begin; i<group->end; i++ )
+        {
+            if( !DequeueSerialItem( &m_serialMergeDequeue[i], refSerial, refGpu ) )
             {
-                switch( (QueueType)idx )
+                m_refTimeSerial = refSerial;
+                m_refTimeGpu = refGpu;
+                for( i++; i<group->end; i++ ) FreeAssociatedMemory( m_serialMergeDequeue[i] );
+                while( ++group != gend )
                 {
-                case QueueType::CallstackSerial:
-                    ptr = MemRead<uint64_t>( &item->callstackFat.ptr );
-                    SendCallstackPayload( ptr );
-                    tracy_free( (void*)ptr );
-                    break;
-                case QueueType::LockWait:
-                case QueueType::LockSharedWait:
-                {
-                    int64_t t = MemRead<int64_t>( &item->lockWait.time );
-                    int64_t dt = t - refSerial;
-                    refSerial = t;
-                    MemWrite( &item->lockWait.time, dt );
-                    break;
-                }
-                case QueueType::LockObtain:
-                case QueueType::LockSharedObtain:
-                {
-                    int64_t t = MemRead<int64_t>( &item->lockObtain.time );
-                    int64_t dt = t - refSerial;
-                    refSerial = t;
-                    MemWrite( &item->lockObtain.time, dt );
-                    break;
-                }
-                case QueueType::LockRelease:
-                case QueueType::LockSharedRelease:
-                {
-                    int64_t t = MemRead<int64_t>( &item->lockRelease.time );
-                    int64_t dt = t - refSerial;
-                    refSerial = t;
-                    MemWrite( &item->lockRelease.time, dt );
-                    break;
-                }
-                case QueueType::LockName:
-                {
-                    ptr = MemRead<uint64_t>( &item->lockNameFat.name );
-                    uint16_t size = MemRead<uint16_t>( &item->lockNameFat.size );
-                    SendSingleString( (const char*)ptr, size );
-#ifndef TRACY_ON_DEMAND
-                    tracy_free( (void*)ptr );
-#endif
-                    break;
-                }
-                case QueueType::MemAlloc:
-                case QueueType::MemAllocNamed:
-                case QueueType::MemAllocCallstack:
-                case QueueType::MemAllocCallstackNamed:
-                {
-                    int64_t t = MemRead<int64_t>( &item->memAlloc.time );
-                    int64_t dt = t - refSerial;
-                    refSerial = t;
-                    MemWrite( &item->memAlloc.time, dt );
-                    break;
-                }
-                case QueueType::MemFree:
-                case QueueType::MemFreeNamed:
-                case QueueType::MemFreeCallstack:
-                case QueueType::MemFreeCallstackNamed:
-                {
-                    int64_t t = MemRead<int64_t>( &item->memFree.time );
-                    int64_t dt = t - refSerial;
-                    refSerial = t;
-                    MemWrite( &item->memFree.time, dt );
-                    break;
-                }
-                case QueueType::GpuZoneBeginSerial:
-                case QueueType::GpuZoneBeginCallstackSerial:
-                {
-                    int64_t t = MemRead<int64_t>( &item->gpuZoneBegin.cpuTime );
-                    int64_t dt = t - refSerial;
-                    refSerial = t;
-                    MemWrite( &item->gpuZoneBegin.cpuTime, dt );
-                    break;
-                }
-                case QueueType::GpuZoneBeginAllocSrcLocSerial:
-                case QueueType::GpuZoneBeginAllocSrcLocCallstackSerial:
-                {
-                    int64_t t = MemRead<int64_t>( &item->gpuZoneBegin.cpuTime );
-                    int64_t dt = t - refSerial;
-                    refSerial = t;
-                    MemWrite( &item->gpuZoneBegin.cpuTime, dt );
-                    ptr = MemRead<uint64_t>( &item->gpuZoneBegin.srcloc );
-                    SendSourceLocationPayload( ptr );
-                    tracy_free( (void*)ptr );
-                    break;
-                }
-                case QueueType::GpuZoneEndSerial:
-                {
-                    int64_t t = MemRead<int64_t>( &item->gpuZoneEnd.cpuTime );
-                    int64_t dt = t - refSerial;
-                    refSerial = t;
-                    MemWrite( &item->gpuZoneEnd.cpuTime, dt );
-                    break;
-                }
-                case QueueType::GpuTime:
-                {
-                    int64_t t = MemRead<int64_t>( &item->gpuTime.gpuTime );
-                    int64_t dt = t - refGpu;
-                    refGpu = t;
-                    MemWrite( &item->gpuTime.gpuTime, dt );
-                    break;
-                }
-                case QueueType::GpuContextName:
-                {
-                    ptr = MemRead<uint64_t>( &item->gpuContextNameFat.ptr );
-                    uint16_t size = MemRead<uint16_t>( &item->gpuContextNameFat.size );
-                    SendSingleString( (const char*)ptr, size );
-#ifndef TRACY_ON_DEMAND
-                    tracy_free( (void*)ptr );
-#endif
-                    break;
-                }
-                default:
-                    assert( false );
-                    break;
+                    for( uint32_t j=group->begin; j<group->end; j++ ) FreeAssociatedMemory( m_serialMergeDequeue[j] );
                 }
+                m_serialMergeDequeue.clear();
+                return DequeueStatus::ConnectionLost;
             }
-            if( !AppendData( item, QueueDataSize[idx] ) ) return DequeueStatus::ConnectionLost;
-            item++;
         }
-        m_refTimeSerial = refSerial;
-        m_refTimeGpu = refGpu;
-        m_serialDequeue.clear();
+        ++group;
     }
-    else
+    while( group != gend )
     {
-        return DequeueStatus::QueueEmpty;
+        auto held = m_serialMergeHeld.push_next();
+        held->time = group->time;
+        held->begin = uint32_t( m_serialMergeQueue.size() );
+        for( uint32_t i=group->begin; i<group->end; i++ ) memcpy( m_serialMergeQueue.push_next(), &m_serialMergeDequeue[i], sizeof( QueueItem ) );
+        held->end = uint32_t( m_serialMergeQueue.size() );
+        ++group;
     }
+    m_serialMergeDequeue.clear();
+
+    m_refTimeSerial = refSerial;
+    m_refTimeGpu = refGpu;
     return DequeueStatus::DataDequeued;
 }
 
@@ -2448,9 +3239,130 @@ bool Profiler::CommitData()
     return ret;
 }
 
+void Profiler::SetupTransport( const TransportRequestMessage& request )
+{
+    m_codec = request.codec;
+    m_codecLevel = request.level;
+    switch( m_codec )
+    {
+    case TransportCodecNone:
+        break;
+    case TransportCodecLz4Hc:
+        if( m_codecLevel <= 0 ) m_codecLevel = LZ4HC_CLEVEL_DEFAULT;
+        if( !m_streamHC ) m_streamHC = LZ4_createStreamHC();
+        LZ4_resetStreamHC_fast( (LZ4_streamHC_t*)m_streamHC, m_codecLevel );
+        break;
+#ifdef TRACY_ZSTD
+    case TransportCodecZstd:
+        static_assert( ZSTD_COMPRESSBOUND( TargetFrameSize ) <= LZ4Size, "Frame buffer too small for zstd" );
+        if( m_codecLevel == 0 ) m_codecLevel = ZSTD_CLEVEL_DEFAULT;
+        if( !m_zstdCtx ) m_zstdCtx = ZSTD_createCCtx();
+        ZSTD_CCtx_reset( (ZSTD_CCtx*)m_zstdCtx, ZSTD_reset_session_only );
+        ZSTD_CCtx_setParameter( (ZSTD_CCtx*)m_zstdCtx, ZSTD_c_compressionLevel, m_codecLevel );
+        break;
+#endif
+    default:
+        // Also the fallback for codecs which were not compiled in.
+        m_codec = TransportCodecLz4;
+        if( m_codecLevel <= 0 ) m_codecLevel = 1;
+        LZ4_resetStream( (LZ4_stream_t*)m_stream );
+        break;
+    }
+}
+
+bool Profiler::OfferShm( const TransportRequestMessage& request, WelcomeMessage& welcome )
+{
+    welcome.shmName[0] = '\0';
+#ifdef TRACY_HAS_SHM
+    if( request.shm == 0 ) return false;
+    const uint64_t key = ShmRing::RandomKey();
+    m_shm = (ShmRing*)tracy_malloc( sizeof( ShmRing ) );
+    new(m_shm) ShmRing();
+    if( !m_shm->Create( welcome.shmName, sizeof( welcome.shmName ), ShmRingSize, key ) )
+    {
+        welcome.shmName[0] = '\0';
+        CloseShm();
+        return false;
+    }
+    MemWrite( &welcome.shmKey, key );
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Profiler::AcceptShm()
+{
+#ifdef TRACY_HAS_SHM
+    // The server answers whether it was able to map the ring. If it wasn't (e.g. it runs on
+    // a different host), frames are sent through the socket.
+    uint8_t status = 0;
+    if( !m_sock->ReadRaw( &status, sizeof( status ), 2000 ) || status == 0 )
+    {
+        CloseShm();
+        return;
+    }
+    m_shm->Unlink();
+#endif
+}
+
+void Profiler::CloseShm()
+{
+#ifdef TRACY_HAS_SHM
+    if( !m_shm ) return;
+    if( m_shm->IsValid() ) m_shm->Shutdown();
+    m_shm->~ShmRing();
+    tracy_free( m_shm );
+    m_shm = nullptr;
+#endif
+}
+
+int Profiler::EncodeFrame( const char* data, size_t len, char* dst )
+{
+    switch( m_codec )
+    {
+    case TransportCodecNone:
+        memcpy( dst, data, len );
+        return int( len );
+    case TransportCodecLz4Hc:
+        return LZ4_compress_HC_continue( (LZ4_streamHC_t*)m_streamHC, data, dst, (int)len, LZ4Size );
+#ifdef TRACY_ZSTD
+    case TransportCodecZstd:
+    {
+        ZSTD_inBuffer in = { data, len, 0 };
+        ZSTD_outBuffer out = { dst, LZ4Size, 0 };
+        const auto ret = ZSTD_compressStream2( (ZSTD_CCtx*)m_zstdCtx, &out, &in, ZSTD_e_flush );
+        if( ret != 0 ) return -1;
+        return int( out.pos );
+    }
+#endif
+    default:
+        return LZ4_compress_fast_continue( (LZ4_stream_t*)m_stream, data, dst, (int)len, LZ4Size, m_codecLevel );
+    }
+}
+
 bool Profiler::SendData( const char* data, size_t len )
 {
-    const lz4sz_t lz4sz = LZ4_compress_fast_continue( (LZ4_stream_t*)m_stream, data, m_lz4Buf + sizeof( lz4sz_t ), (int)len, LZ4Size, 1 );
+#ifdef TRACY_HAS_SHM
+    if( m_shm )
+    {
+        // Frames are encoded in place, the server reads them without going through the kernel.
+        const auto maxSize = m_codec == TransportCodecNone ? uint32_t( len ) : uint32_t( LZ4Size );
+        char* dst;
+        while( !( dst = m_shm->Reserve( maxSize ) ) )
+        {
+            if( !m_shm->IsPeerAlive() ) return false;
+            m_shm->WaitSpace( 10 );
+        }
+        const auto sz = EncodeFrame( data, len, dst );
+        if( sz < 0 ) return false;
+        m_shm->Commit( uint32_t( sz ) );
+        return true;
+    }
+#endif
+    const auto sz = EncodeFrame( data, len, m_lz4Buf + sizeof( lz4sz_t ) );
+    if( sz < 0 ) return false;
+    const auto lz4sz = lz4sz_t( sz );
     memcpy( m_lz4Buf, &lz4sz, sizeof( lz4sz ) );
     return m_sock->Send( m_lz4Buf, lz4sz + sizeof( lz4sz_t ) ) != -1;
 }
@@ -2565,13 +3477,13 @@ void Profiler::SendSourceLocationPayload( uint64_t _ptr )
     AppendDataUnsafe( ptr, len );
 }
 
-void Profiler::SendCallstackPayload( uint64_t _ptr )
+void Profiler::SendCallstackPayload( uint64_t _ptr, uint32_t id )
 {
     auto ptr = (uintptr_t*)_ptr;
 
     QueueItem item;
     MemWrite( &item.hdr.type, QueueType::CallstackPayload );
-    MemWrite( &item.stringTransfer.ptr, _ptr );
+    MemWrite( &item.stringTransfer.ptr, uint64_t( id ) );
 
     const auto sz = *ptr++;
     const auto len = sz * sizeof( uint64_t );
@@ -2602,7 +3514,7 @@ void Profiler::SendCallstackPayload64( uint64_t _ptr )
 
     QueueItem item;
     MemWrite( &item.hdr.type, QueueType::CallstackPayload );
-    MemWrite( &item.stringTransfer.ptr, _ptr );
+    MemWrite( &item.stringTransfer.ptr, uint64_t( 0 ) );
 
     const auto sz = *ptr++;
     const auto len = sz * sizeof( uint64_t );
@@ -2615,6 +3527,105 @@ void Profiler::SendCallstackPayload64( uint64_t _ptr )
     AppendDataUnsafe( ptr, sizeof( uint64_t ) * sz );
 }
 
+// Callstacks not in the registry are sent and freed. Registered ones are sent once per connection, and
+// then referenced by id.
+void Profiler::SendCallstackCached( uint64_t ptr, uint32_t id )
+{
+    if( id == 0 )
+    {
+        SendCallstackPayload( ptr, 0 );
+        tracy_free( (void*)ptr );
+        return;
+    }
+#ifdef TRACY_HAS_CALLSTACK
+    auto& sent = m_callstackSent[id >> CallstackRegistryChunkBits];
+    if( !sent )
+    {
+        sent = (uint64_t*)tracy_malloc( CallstackRegistryChunkSize / 8 );
+        memset( sent, 0, CallstackRegistryChunkSize / 8 );
+    }
+    const auto bit = id & ( CallstackRegistryChunkSize - 1 );
+    const auto mask = uint64_t( 1 ) << ( bit & 63 );
+    if( sent[bit >> 6] & mask )
+    {
+        QueueItem item;
+        MemWrite( &item.hdr.type, QueueType::CallstackCached );
+        MemWrite( &item.callstackCached.id, id );
+        AppendData( &item, QueueDataSize[(int)QueueType::CallstackCached] );
+    }
+    else
+    {
+        sent[bit >> 6] |= mask;
+        SendCallstackPayload( uint64_t( CallstackTrace( id ) ), id );
+    }
+#endif
+}
+
+#ifdef TRACY_HAS_CALLSTACK
+uint32_t Profiler::RegisterCallstack( const uintptr_t* trace )
+{
+    const auto hash = HashCallstack( trace );
+    const auto size = ( 1 + trace[0] ) * sizeof( uintptr_t );
+
+    auto& cached = GetCallstackCache()[hash & ( CallstackCacheSize - 1 )];
+    if( cached.id != 0 && cached.hash == hash && memcmp( CallstackTrace( cached.id ), trace, size ) == 0 ) return cached.id;
+
+    m_callstackLock.lock();
+    if( m_callstackMapSize == 0 )
+    {
+        m_callstackMapSize = 1024;
+        m_callstackMap = AllocCallstackCache( m_callstackMapSize );
+    }
+    auto idx = hash & ( m_callstackMapSize - 1 );
+    for(;;)
+    {
+        auto& entry = m_callstackMap[idx];
+        if( entry.id == 0 ) break;
+        if( entry.hash == hash && memcmp( CallstackTrace( entry.id ), trace, size ) == 0 )
+        {
+            cached = entry;
+            m_callstackLock.unlock();
+            return cached.id;
+        }
+        idx = ( idx + 1 ) & ( m_callstackMapSize - 1 );
+    }
+
+    if( m_callstackCount == CallstackRegistryChunks * CallstackRegistryChunkSize - 1 )
+    {
+        m_callstackLock.unlock();
+        return 0;
+    }
+    const auto id = ++m_callstackCount;
+    auto& chunk = m_callstackRegistry[id >> CallstackRegistryChunkBits];
+    if( !chunk ) chunk = (uintptr_t**)tracy_malloc( CallstackRegistryChunkSize * sizeof( uintptr_t* ) );
+    auto copy = (uintptr_t*)tracy_malloc( size );
+    memcpy( copy, trace, size );
+    chunk[id & ( CallstackRegistryChunkSize - 1 )] = copy;
+    m_callstackMap[idx] = { hash, id };
+
+    if( m_callstackCount * 2 > m_callstackMapSize )
+    {
+        const auto oldMap = m_callstackMap;
+        const auto oldSize = m_callstackMapSize;
+        m_callstackMapSize *= 2;
+        m_callstackMap = AllocCallstackCache( m_callstackMapSize );
+        for( uint32_t i=0; i<oldSize; i++ )
+        {
+            const auto& entry = oldMap[i];
+            if( entry.id == 0 ) continue;
+            auto j = entry.hash & ( m_callstackMapSize - 1 );
+            while( m_callstackMap[j].id != 0 ) j = ( j + 1 ) & ( m_callstackMapSize - 1 );
+            m_callstackMap[j] = entry;
+        }
+        tracy_free( oldMap );
+    }
+    m_callstackLock.unlock();
+
+    cached = { hash, id };
+    return id;
+}
+#endif
+
 void Profiler::SendCallstackAlloc( uint64_t _ptr )
 {
     auto ptr = (const char*)_ptr;
@@ -2634,43 +3645,115 @@ void Profiler::SendCallstackAlloc( uint64_t _ptr )
     AppendDataUnsafe( ptr, len );
 }
 
-void Profiler::SendCallstackFrame( uint64_t ptr )
+void Profiler::QueueSymbolQuery( SymbolQueryType type, uint64_t ptr )
 {
 #ifdef TRACY_HAS_CALLSTACK
-    const auto frameData = DecodeCallstackPtr( ptr );
+    auto item = m_symbolStaging.push_next();
+    item->ptr = ptr;
+    item->entry = nullptr;
+    item->epoch = m_symbolEpoch;
+    item->type = type;
+#endif
+}
 
+void Profiler::SendSymbolResult( const SymbolQueueItem& item )
+{
+#ifdef TRACY_HAS_CALLSTACK
+    const auto entry = item.entry;
+    switch( item.type )
+    {
+    case SymbolQueryType::CallstackFrame:
     {
-        SendSingleString( frameData.imageName );
+        SendSingleString( entry->imageName );
 
-        QueueItem item;
-        MemWrite( &item.hdr.type, QueueType::CallstackFrameSize );
-        MemWrite( &item.callstackFrameSize.ptr, ptr );
-        MemWrite( &item.callstackFrameSize.size, frameData.size );
+        QueueItem qi;
+        MemWrite( &qi.hdr.type, QueueType::CallstackFrameSize );
+        MemWrite( &qi.callstackFrameSize.ptr, item.ptr );
+        MemWrite( &qi.callstackFrameSize.size, entry->size );
+        AppendData( &qi, QueueDataSize[(int)QueueType::CallstackFrameSize] );
 
-        AppendData( &item, QueueDataSize[(int)QueueType::CallstackFrameSize] );
+        for( uint8_t i=0; i<entry->size; i++ )
+        {
+            const auto& frame = entry->frames[i];
+
+            SendSingleString( frame.name );
+            SendSecondString( frame.file );
+
+            MemWrite( &qi.hdr.type, QueueType::CallstackFrame );
+            MemWrite( &qi.callstackFrame.line, frame.line );
+            MemWrite( &qi.callstackFrame.symAddr, frame.symAddr );
+            MemWrite( &qi.callstackFrame.symLen, frame.symLen );
+            AppendData( &qi, QueueDataSize[(int)QueueType::CallstackFrame] );
+        }
+        break;
     }
+    case SymbolQueryType::Symbol:
+    {
+        SendSingleString( entry->file );
 
-    for( uint8_t i=0; i<frameData.size; i++ )
+        QueueItem qi;
+        MemWrite( &qi.hdr.type, QueueType::SymbolInformation );
+        MemWrite( &qi.symbolInformation.line, entry->line );
+        MemWrite( &qi.symbolInformation.symAddr, item.ptr );
+        AppendData( &qi, QueueDataSize[(int)QueueType::SymbolInformation] );
+        break;
+    }
+    case SymbolQueryType::CodeLocation:
     {
-        const auto& frame = frameData.data[i];
+        SendSingleString( entry->file );
 
-        SendSingleString( frame.name );
-        SendSecondString( frame.file );
+        QueueItem qi;
+        MemWrite( &qi.hdr.type, QueueType::CodeInformation );
+        MemWrite( &qi.codeInformation.ptr, item.ptr );
+        MemWrite( &qi.codeInformation.line, entry->line );
+        AppendData( &qi, QueueDataSize[(int)QueueType::CodeInformation] );
+        break;
+    }
+    default:
+        assert( false );
+        break;
+    }
+#endif
+}
 
-        QueueItem item;
-        MemWrite( &item.hdr.type, QueueType::CallstackFrame );
-        MemWrite( &item.callstackFrame.line, frame.line );
-        MemWrite( &item.callstackFrame.symAddr, frame.symAddr );
-        MemWrite( &item.callstackFrame.symLen, frame.symLen );
+Profiler::DequeueStatus Profiler::DequeueSymbols()
+{
+#ifdef TRACY_HAS_CALLSTACK
+    // Queries received since the last call are handed over to the symbol worker in one batch.
+    if( !m_symbolStaging.empty() )
+    {
+        m_symbolLock.lock();
+        for( auto& v : m_symbolStaging ) *m_symbolQueue.push_next() = v;
+        m_symbolLock.unlock();
+        m_symbolStaging.clear();
+    }
 
-        AppendData( &item, QueueDataSize[(int)QueueType::CallstackFrame] );
+    m_symbolResultLock.lock();
+    if( !m_symbolResults.empty() ) m_symbolResults.swap( m_symbolResultDequeue );
+    m_symbolResultLock.unlock();
 
-        tracy_free( (void*)frame.name );
-        tracy_free( (void*)frame.file );
+    if( m_symbolResultDequeue.empty() ) return DequeueStatus::QueueEmpty;
+    for( auto& v : m_symbolResultDequeue )
+    {
+        if( v.epoch == m_symbolEpoch ) SendSymbolResult( v );
     }
+    m_symbolResultDequeue.clear();
+    return DequeueStatus::DataDequeued;
+#else
+    return DequeueStatus::QueueEmpty;
 #endif
 }
 
+void Profiler::ClearSymbols()
+{
+#ifdef TRACY_HAS_CALLSTACK
+    m_symbolEpoch++;
+    m_symbolStaging.clear();
+    m_symbolLock.lock();
+    m_symbolQueue.clear();
+    m_symbolLock.unlock();
+#endif
+}
 
 bool Profiler::HandleServerQuery()
 {
@@ -2708,7 +3791,7 @@ bool Profiler::HandleServerQuery()
     case ServerQueryTerminate:
         return false;
     case ServerQueryCallstackFrame:
-        SendCallstackFrame( ptr );
+        QueueSymbolQuery( SymbolQueryType::CallstackFrame, ptr );
         break;
     case ServerQueryFrameName:
         SendString( ptr, (const char*)ptr, QueueType::FrameName );
@@ -2733,7 +3816,7 @@ bool Profiler::HandleServerQuery()
         break;
 #endif
     case ServerQueryCodeLocation:
-        SendCodeLocation( ptr );
+        QueueSymbolQuery( SymbolQueryType::CodeLocation, ptr );
         break;
     case ServerQuerySourceCode:
         HandleSourceCodeQuery();
@@ -2749,6 +3832,9 @@ bool Profiler::HandleServerQuery()
         m_queryDataPtr += 12;
         AckServerQuery();
         break;
+    case ServerQueryZoneFilter:
+        HandleZoneFilter( ptr, extra != 0 );
+        break;
     default:
         assert( false );
         break;
@@ -2817,6 +3903,7 @@ void Profiler::HandleDisconnect()
     for(;;)
     {
         ClearQueues( token );
+        if( DequeueSymbols() == DequeueStatus::ConnectionLost ) return;
         if( m_sock->HasData() )
         {
             while( m_sock->HasData() )
@@ -2879,7 +3966,7 @@ void Profiler::CalibrateDelay()
     m_delay = m_resolution;
 #else
     constexpr int Events = Iterations * 2;   // start + end
-    static_assert( Events < QueuePrealloc, "Delay calibration loop will allocate memory in queue" );
+    static_assert( Iterations * ( QueueFatDataSize[(int)QueueType::ZoneBegin] + QueueFatDataSize[(int)QueueType::ZoneEnd] ) < QueuePrealloc, "Delay calibration loop will allocate memory in queue" );
 
     static const tracy::SourceLocationData __tracy_source_location { nullptr, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0 };
     const auto t0 = GetTime();
@@ -2905,9 +3992,16 @@ void Profiler::CalibrateDelay()
     int left = Events;
     while( left != 0 )
     {
-        const auto sz = GetQueue().try_dequeue_bulk_single( token, [](const uint64_t&){}, [](QueueItem* item, size_t sz){} );
+        const auto sz = GetQueue().try_dequeue_bulk_single( token, [](const uint64_t&){}, [&left](char* ptr, size_t sz)
+        {
+            auto end = ptr + sz;
+            while( ptr != end )
+            {
+                ptr += QueueFatDataSize[(uint8_t)*ptr];
+                left--;
+            }
+        } );
         assert( sz > 0 );
-        left -= (int)sz;
     }
     assert( GetQueue().size_approx() == 0 );
 #endif
@@ -3059,6 +4153,7 @@ void Profiler::SendCallstack( int depth, const char* skipBefore )
     auto ptr = Callstack( depth );
     CutCallstack( ptr, skipBefore );
     MemWrite( &item->callstackFat.ptr, (uint64_t)ptr );
+    MemWrite( &item->callstackFat.id, uint32_t( 0 ) );
     TracyLfqCommit;
 #endif
 }
@@ -3069,6 +4164,8 @@ void Profiler::CutCallstack( void* callstack, const char* skipBefore )
     auto data = (uintptr_t*)callstack;
     const auto sz = *data++;
     uintptr_t i;
+    // Called from instrumented threads and the profiler thread, while the symbol worker decodes.
+    LockCallstackDecode();
     for( i=0; i<sz; i++ )
     {
         auto name = DecodeCallstackPtrFast( uint64_t( data[i] ) );
@@ -3079,6 +4176,7 @@ void Profiler::CutCallstack( void* callstack, const char* skipBefore )
             break;
         }
     }
+    UnlockCallstackDecode();
 
     if( i != sz )
     {
@@ -3118,6 +4216,109 @@ void Profiler::HandleParameter( uint64_t payload )
     AckServerQuery();
 }
 
+static tracy_force_inline uint32_t HashZoneFilter( uint64_t srcloc )
+{
+    return uint32_t( ( ( srcloc >> 3 ) * 0x9E3779B97F4A7C15ull ) >> 32 );
+}
+
+Profiler::ZoneFilterTable* Profiler::AllocZoneFilterTable( uint32_t size )
+{
+    auto table = (ZoneFilterTable*)tracy_malloc( sizeof( ZoneFilterTable ) );
+    table->prev = nullptr;
+    table->mask = size - 1;
+    table->data = (std::atomic<uint64_t>*)tracy_malloc( sizeof( std::atomic<uint64_t> ) * size );
+    for( uint32_t i=0; i<size; i++ ) new( table->data + i ) std::atomic<uint64_t>( 0 );
+    return table;
+}
+
+// Entries hold the source location pointer, with the lowest bit set if zones are disabled. Re-enabling
+// a zone only clears the bit, the pointer is dropped when the table is grown.
+bool Profiler::IsZoneEnabledSlow( uint64_t srcloc ) const
+{
+    auto table = m_zoneFilter.load( std::memory_order_acquire );
+    auto idx = HashZoneFilter( srcloc ) & table->mask;
+    for(;;)
+    {
+        const auto v = table->data[idx].load( std::memory_order_acquire );
+        if( v == 0 ) return true;
+        if( ( v & ~uint64_t( 1 ) ) == srcloc ) return ( v & 1 ) == 0;
+        idx = ( idx + 1 ) & table->mask;
+    }
+}
+
+void Profiler::HandleZoneFilter( uint64_t srcloc, bool enabled )
+{
+    auto table = m_zoneFilter.load( std::memory_order_relaxed );
+    auto idx = HashZoneFilter( srcloc ) & table->mask;
+    for(;;)
+    {
+        const auto v = table->data[idx].load( std::memory_order_relaxed );
+        if( v == 0 )
+        {
+            if( !enabled )
+            {
+                // Keep the table at most half full, so that probing stays short.
+                if( m_zoneFilterUsed + 1 > ( table->mask + 1 ) / 2 )
+                {
+                    GrowZoneFilter();
+                    table = m_zoneFilter.load( std::memory_order_relaxed );
+                    idx = HashZoneFilter( srcloc ) & table->mask;
+                    while( table->data[idx].load( std::memory_order_relaxed ) != 0 ) idx = ( idx + 1 ) & table->mask;
+                }
+                m_zoneFilterUsed++;
+                table->data[idx].store( srcloc | 1, std::memory_order_release );
+                m_zoneFilterCount.fetch_add( 1, std::memory_order_relaxed );
+            }
+            break;
+        }
+        if( ( v & ~uint64_t( 1 ) ) == srcloc )
+        {
+            if( enabled == ( ( v & 1 ) != 0 ) )
+            {
+                table->data[idx].store( srcloc | ( enabled ? 0 : 1 ), std::memory_order_release );
+                if( enabled )
+                {
+                    m_zoneFilterCount.fetch_sub( 1, std::memory_order_relaxed );
+                }
+                else
+                {
+                    m_zoneFilterCount.fetch_add( 1, std::memory_order_relaxed );
+                }
+            }
+            break;
+        }
+        idx = ( idx + 1 ) & table->mask;
+    }
+    AckServerQuery();
+}
+
+// Only the disabled source locations are carried over to the new table.
+void Profiler::GrowZoneFilter()
+{
+    auto table = m_zoneFilter.load( std::memory_order_relaxed );
+    auto grown = AllocZoneFilterTable( ( table->mask + 1 ) * 2 );
+    grown->prev = table;
+    m_zoneFilterUsed = 0;
+    for( uint32_t i=0; i<=table->mask; i++ )
+    {
+        const auto v = table->data[i].load( std::memory_order_relaxed );
+        if( ( v & 1 ) == 0 ) continue;
+        auto idx = HashZoneFilter( v & ~uint64_t( 1 ) ) & grown->mask;
+        while( grown->data[idx].load( std::memory_order_relaxed ) != 0 ) idx = ( idx + 1 ) & grown->mask;
+        grown->data[idx].store( v, std::memory_order_relaxed );
+        m_zoneFilterUsed++;
+    }
+    m_zoneFilter.store( grown, std::memory_order_release );
+}
+
+void Profiler::ClearZoneFilter()
+{
+    m_zoneFilterCount.store( 0, std::memory_order_relaxed );
+    auto table = m_zoneFilter.load( std::memory_order_relaxed );
+    for( uint32_t i=0; i<=table->mask; i++ ) table->data[i].store( 0, std::memory_order_relaxed );
+    m_zoneFilterUsed = 0;
+}
+
 #ifdef __ANDROID__
 // Implementation helpers of EnsureReadable(address).
 // This is so far only needed on Android, where it is common for libraries to be mapped
@@ -3269,18 +4470,7 @@ void Profiler::HandleSymbolQuery( uint64_t symbol )
         return;
     }
 #endif
-    const auto sym = DecodeSymbolAddress( symbol );
-
-    SendSingleString( sym.file );
-
-    QueueItem item;
-    MemWrite( &item.hdr.type, QueueType::SymbolInformation );
-    MemWrite( &item.symbolInformation.line, sym.line );
-    MemWrite( &item.symbolInformation.symAddr, symbol );
-
-    AppendData( &item, QueueDataSize[(int)QueueType::SymbolInformation] );
-
-    if( sym.needFree ) tracy_free( (void*)sym.file );
+    QueueSymbolQuery( SymbolQueryType::Symbol, symbol );
 #endif
 }
 
@@ -3335,24 +4525,6 @@ void Profiler::HandleSourceCodeQuery()
     m_queryData = nullptr;
 }
 
-void Profiler::SendCodeLocation( uint64_t ptr )
-{
-#ifdef TRACY_HAS_CALLSTACK
-    const auto sym = DecodeCodeAddress( ptr );
-
-    SendSingleString( sym.file );
-
-    QueueItem item;
-    MemWrite( &item.hdr.type, QueueType::CodeInformation );
-    MemWrite( &item.codeInformation.ptr, ptr );
-    MemWrite( &item.codeInformation.line, sym.line );
-
-    AppendData( &item, QueueDataSize[(int)QueueType::CodeInformation] );
-
-    if( sym.needFree ) tracy_free( (void*)sym.file );
-#endif
-}
-
 #if ( defined _WIN32 || defined __CYGWIN__ ) && defined TRACY_TIMER_QPC
 int64_t Profiler::GetTimeQpc()
 {
@@ -3372,13 +4544,14 @@ TRACY_API TracyCZoneCtx ___tracy_emit_zone_begin( const struct ___tracy_source_l
 {
     ___tracy_c_zone_context ctx;
 #ifdef TRACY_ON_DEMAND
-    ctx.active = active && tracy::GetProfiler().IsConnected();
+    ctx.active = active && tracy::GetProfiler().IsConnected() && tracy::GetProfiler().IsZoneEnabled( (const tracy::SourceLocationData*)srcloc );
 #else
-    ctx.active = active;
+    ctx.active = active && tracy::GetProfiler().IsZoneEnabled( (const tracy::SourceLocationData*)srcloc );
 #endif
     if( !ctx.active ) return ctx;
     const auto id = tracy::GetProfiler().GetNextZoneId();
     ctx.id = id;
+    tracy::Profiler::FlushPendingZones();
 
 #ifndef TRACY_NO_VERIFY
     {
@@ -3400,13 +4573,14 @@ TRACY_API TracyCZoneCtx ___tracy_emit_zone_begin_callstack( const struct ___trac
 {
     ___tracy_c_zone_context ctx;
 #ifdef TRACY_ON_DEMAND
-    ctx.active = active && tracy::GetProfiler().IsConnected();
+    ctx.active = active && tracy::GetProfiler().IsConnected() && tracy::GetProfiler().IsZoneEnabled( (const tracy::SourceLocationData*)srcloc );
 #else
-    ctx.active = active;
+    ctx.active = active && tracy::GetProfiler().IsZoneEnabled( (const tracy::SourceLocationData*)srcloc );
 #endif
     if( !ctx.active ) return ctx;
     const auto id = tracy::GetProfiler().GetNextZoneId();
     ctx.id = id;
+    tracy::Profiler::FlushPendingZones();
 
 #ifndef TRACY_NO_VERIFY
     {
@@ -3440,6 +4614,7 @@ TRACY_API TracyCZoneCtx ___tracy_emit_zone_begin_alloc( uint64_t srcloc, int act
     }
     const auto id = tracy::GetProfiler().GetNextZoneId();
     ctx.id = id;
+    tracy::Profiler::FlushPendingZones();
 
 #ifndef TRACY_NO_VERIFY
     {
@@ -3472,6 +4647,7 @@ TRACY_API TracyCZoneCtx ___tracy_emit_zone_begin_alloc_callstack( uint64_t srclo
     }
     const auto id = tracy::GetProfiler().GetNextZoneId();
     ctx.id = id;
+    tracy::Profiler::FlushPendingZones();
 
 #ifndef TRACY_NO_VERIFY
     {
@@ -3511,6 +4687,7 @@ TRACY_API void ___tracy_emit_zone_text( TracyCZoneCtx ctx, const char* txt, size
 {
     assert( size < std::numeric_limits<uint16_t>::max() );
     if( !ctx.active ) return;
+    tracy::Profiler::FlushPendingZones();
     auto ptr = (char*)tracy::tracy_malloc( size );
     memcpy( ptr, txt, size );
 #ifndef TRACY_NO_VERIFY
@@ -3532,6 +4709,7 @@ TRACY_API void ___tracy_emit_zone_name( TracyCZoneCtx ctx, const char* txt, size
 {
     assert( size < std::numeric_limits<uint16_t>::max() );
     if( !ctx.active ) return;
+    tracy::Profiler::FlushPendingZones();
     auto ptr = (char*)tracy::tracy_malloc( size );
     memcpy( ptr, txt, size );
 #ifndef TRACY_NO_VERIFY
@@ -3551,6 +4729,7 @@ TRACY_API void ___tracy_emit_zone_name( TracyCZoneCtx ctx, const char* txt, size
 
 TRACY_API void ___tracy_emit_zone_color( TracyCZoneCtx ctx, uint32_t color ) {
     if( !ctx.active ) return;
+    tracy::Profiler::FlushPendingZones();
 #ifndef TRACY_NO_VERIFY
     {
         TracyLfqPrepareC( tracy::QueueType::ZoneValidation );
@@ -3570,6 +4749,7 @@ TRACY_API void ___tracy_emit_zone_color( TracyCZoneCtx ctx, uint32_t color ) {
 TRACY_API void ___tracy_emit_zone_value( TracyCZoneCtx ctx, uint64_t value )
 {
     if( !ctx.active ) return;
+    tracy::Profiler::FlushPendingZones();
 #ifndef TRACY_NO_VERIFY
     {
         TracyLfqPrepareC( tracy::QueueType::ZoneValidation );
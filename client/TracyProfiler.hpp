@@ -49,6 +49,7 @@ TRACY_API void ShutdownProfiler();
 
 class GpuCtx;
 class Profiler;
+class ShmRing;
 class Socket;
 class UdpBroadcast;
 
@@ -57,11 +58,34 @@ struct GpuCtxWrapper
     GpuCtx* ptr;
 };
 
-TRACY_API moodycamel::ConcurrentQueue<QueueItem>::ExplicitProducer* GetToken();
+// Per-thread buffer of serial memory and lock events. The lock is only contended while the profiler drains it.
+struct SerialQueue
+{
+    SerialQueue() : items( 64 ), time( 0 ), active( true ), next( nullptr ) {}
+
+    TracyMutex lock;
+    FastVector<QueueItem> items;
+    int64_t time;       // last merge time, only used by the profiler thread
+    std::atomic<bool> active;
+    SerialQueue* next;
+};
+
+struct SerialQueueWrapper
+{
+    ~SerialQueueWrapper();
+    SerialQueue* ptr;
+};
+
+struct CallstackCacheEntry;
+struct SymbolCacheEntry;
+enum { CallstackCacheMaxDepth = 62 };
+
+TRACY_API moodycamel::ConcurrentQueue<char>::ExplicitProducer* GetToken();
 TRACY_API Profiler& GetProfiler();
 TRACY_API std::atomic<uint32_t>& GetLockCounter();
 TRACY_API std::atomic<uint8_t>& GetGpuCtxCounter();
 TRACY_API GpuCtxWrapper& GetGpuCtx();
+TRACY_API SerialQueue& GetSerialQueue();
 TRACY_API uint64_t GetThreadHandle();
 TRACY_API void InitRPMallocThread();
 TRACY_API bool ProfilerAvailable();
@@ -76,6 +100,84 @@ struct SourceLocationData
     uint32_t color;
 };
 
+#ifdef TRACY_MIN_ZONE_DURATION
+// Per-thread stack of zones which were begun, but are not sent yet, because they may still turn out to be
+// shorter than the minimum duration. Zones which are already sent are not tracked, pending ones are always
+// on top of them.
+struct ZoneFilter
+{
+    enum { MaxPending = 64 };
+    enum { MaxDropped = 32 };
+    enum { DroppedReportThreshold = 1024 };
+    enum { DroppedReportInterval = 10 * 1000 * 1000 };  // ns
+
+    struct Pending
+    {
+        int64_t time;
+        uint64_t srcloc;
+#  ifdef TRACY_ON_DEMAND
+        uint64_t connectionId;
+#  endif
+    };
+
+    struct Dropped
+    {
+        uint64_t srcloc;
+        uint32_t count;
+    };
+
+    tracy_force_inline bool Begin( const SourceLocationData* srcloc, int64_t time, uint64_t connectionId )
+    {
+        if( threshold == 0 ) return false;
+        if( pending == MaxPending ) Flush();
+        auto& v = stack[pending++];
+        v.time = time;
+        v.srcloc = (uint64_t)srcloc;
+#  ifdef TRACY_ON_DEMAND
+        v.connectionId = connectionId;
+#  endif
+        return true;
+    }
+
+    // Returns true, if the zone end has to be sent.
+    tracy_force_inline bool End( int64_t time )
+    {
+        if( pending == 0 )
+        {
+            if( droppedNum != 0 ) ReportDropped();
+            return true;
+        }
+        return EndPending( time );
+    }
+
+    tracy_force_inline void FlushPending()
+    {
+        if( pending != 0 ) Flush();
+    }
+
+    TRACY_API void Flush();
+    TRACY_API bool EndPending( int64_t time );
+    TRACY_API void ReportDropped();
+
+    int64_t threshold;
+    int64_t reportInterval;
+    int64_t reportTime;
+    uint32_t pending;
+    uint32_t droppedNum;
+    uint32_t droppedTotal;
+    Pending stack[MaxPending];
+    Dropped dropped[MaxDropped];
+};
+
+struct ZoneFilterWrapper
+{
+    ~ZoneFilterWrapper();
+    ZoneFilter* ptr;
+};
+
+TRACY_API ZoneFilter& GetZoneFilter();
+#endif
+
 #ifdef TRACY_ON_DEMAND
 struct LuaZoneState
 {
@@ -85,31 +187,44 @@ struct LuaZoneState
 #endif
 
 
+// Items are packed tightly in the per-thread queues, each one taking only QueueFatDataSize bytes.
 #define TracyLfqPrepare( _type ) \
     moodycamel::ConcurrentQueueDefaultTraits::index_t __magic; \
+    const auto __type = _type; \
+    const auto __size = QueueFatDataSize[(uint8_t)__type]; \
     auto __token = GetToken(); \
     auto& __tail = __token->get_tail_index(); \
-    auto item = __token->enqueue_begin( __magic ); \
-    MemWrite( &item->hdr.type, _type );
+    auto item = (QueueItem*)__token->enqueue_begin( __magic, __size ); \
+    MemWrite( &item->hdr.type, __type );
 
 #define TracyLfqCommit \
-    __tail.store( __magic + 1, std::memory_order_release );
+    __tail.store( __magic + __size, std::memory_order_release );
 
 #define TracyLfqPrepareC( _type ) \
     tracy::moodycamel::ConcurrentQueueDefaultTraits::index_t __magic; \
+    const auto __type = _type; \
+    const auto __size = tracy::QueueFatDataSize[(uint8_t)__type]; \
     auto __token = tracy::GetToken(); \
     auto& __tail = __token->get_tail_index(); \
-    auto item = __token->enqueue_begin( __magic ); \
-    tracy::MemWrite( &item->hdr.type, _type );
+    auto item = (tracy::QueueItem*)__token->enqueue_begin( __magic, __size ); \
+    tracy::MemWrite( &item->hdr.type, __type );
 
 #define TracyLfqCommitC \
-    __tail.store( __magic + 1, std::memory_order_release );
+    __tail.store( __magic + __size, std::memory_order_release );
 
 
 typedef void(*ParameterCallback)( uint32_t idx, int32_t val );
 
 class Profiler
 {
+    // Memory or lock event together with its leading callstack and name payload items.
+    struct SerialMergeGroup
+    {
+        int64_t time;
+        uint32_t begin;
+        uint32_t end;
+    };
+
     struct FrameImageQueueItem
     {
         void* image;
@@ -120,11 +235,30 @@ class Profiler
         bool flip;
     };
 
+    // Frame images waiting for compression. Each one is a full RGBA copy.
+    enum { MaxPendingFrameImages = 4 };
+
+    enum class SymbolQueryType : uint8_t
+    {
+        CallstackFrame,
+        Symbol,
+        CodeLocation
+    };
+
+    struct SymbolQueueItem
+    {
+        uint64_t ptr;
+        const SymbolCacheEntry* entry;
+        uint32_t epoch;
+        SymbolQueryType type;
+    };
+
 public:
     Profiler();
     ~Profiler();
 
     void SpawnWorkerThreads();
+    SerialQueue* AcquireSerialQueue();
 
     static tracy_force_inline int64_t GetTime()
     {
@@ -175,7 +309,7 @@ public:
     {
         auto& p = GetProfiler();
         p.m_serialLock.lock();
-        p.SendCallstackSerial( ptr );
+        p.SendCallstackSerial( p.m_serialQueue, ptr, 0 );
         return p.m_serialQueue.prepare_next();
     }
 
@@ -186,6 +320,21 @@ public:
         p.m_serialLock.unlock();
     }
 
+    // Event time must be read before QueueSerialThreadFinish(), the merge relies on it.
+    static tracy_force_inline QueueItem* QueueSerialThread()
+    {
+        auto& queue = GetSerialQueue();
+        queue.lock.lock();
+        return queue.items.prepare_next();
+    }
+
+    static tracy_force_inline void QueueSerialThreadFinish()
+    {
+        auto& queue = GetSerialQueue();
+        queue.items.commit_next();
+        queue.lock.unlock();
+    }
+
     static tracy_force_inline void SendFrameMark( const char* name )
     {
         if( !name ) GetProfiler().m_frameCount.fetch_add( 1, std::memory_order_relaxed );
@@ -219,6 +368,9 @@ public:
 #  ifdef TRACY_ON_DEMAND
         if( !profiler.IsConnected() ) return;
 #  endif
+        // Drop the image, if the compression thread can't keep up, instead of queueing more copies.
+        if( profiler.m_fiPending.load( std::memory_order_relaxed ) >= MaxPendingFrameImages ) return;
+        profiler.m_fiPending.fetch_add( 1, std::memory_order_relaxed );
         const auto sz = size_t( w ) * size_t( h ) * 4;
         auto ptr = (char*)tracy_malloc( sz );
         memcpy( ptr, image, sz );
@@ -395,9 +547,10 @@ public:
 #endif
         const auto thread = GetThreadHandle();
 
-        GetProfiler().m_serialLock.lock();
-        SendMemAlloc( QueueType::MemAlloc, thread, ptr, size );
-        GetProfiler().m_serialLock.unlock();
+        auto& queue = GetSerialQueue();
+        queue.lock.lock();
+        SendMemAlloc( queue.items, QueueType::MemAlloc, thread, ptr, size );
+        queue.lock.unlock();
     }
 
     static tracy_force_inline void MemFree( const void* ptr, bool secure )
@@ -408,28 +561,30 @@ public:
 #endif
         const auto thread = GetThreadHandle();
 
-        GetProfiler().m_serialLock.lock();
-        SendMemFree( QueueType::MemFree, thread, ptr );
-        GetProfiler().m_serialLock.unlock();
+        auto& queue = GetSerialQueue();
+        queue.lock.lock();
+        SendMemFree( queue.items, QueueType::MemFree, thread, ptr );
+        queue.lock.unlock();
     }
 
     static tracy_force_inline void MemAllocCallstack( const void* ptr, size_t size, int depth, bool secure )
     {
         if( secure && !ProfilerAvailable() ) return;
 #ifdef TRACY_HAS_CALLSTACK
-        auto& profiler = GetProfiler();
 #  ifdef TRACY_ON_DEMAND
-        if( !profiler.IsConnected() ) return;
+        if( !GetProfiler().IsConnected() ) return;
 #  endif
         const auto thread = GetThreadHandle();
 
         InitRPMallocThread();
-        auto callstack = Callstack( depth );
-
-        profiler.m_serialLock.lock();
-        SendCallstackSerial( callstack );
-        SendMemAlloc( QueueType::MemAllocCallstack, thread, ptr, size );
-        profiler.m_serialLock.unlock();
+        uint32_t id;
+        auto callstack = CallstackCached( depth, id );
+
+        auto& queue = GetSerialQueue();
+        queue.lock.lock();
+        SendCallstackSerial( queue.items, callstack, id );
+        SendMemAlloc( queue.items, QueueType::MemAllocCallstack, thread, ptr, size );
+        queue.lock.unlock();
 #else
         MemAlloc( ptr, size, secure );
 #endif
@@ -439,19 +594,20 @@ public:
     {
         if( secure && !ProfilerAvailable() ) return;
 #ifdef TRACY_HAS_CALLSTACK
-        auto& profiler = GetProfiler();
 #  ifdef TRACY_ON_DEMAND
-        if( !profiler.IsConnected() ) return;
+        if( !GetProfiler().IsConnected() ) return;
 #  endif
         const auto thread = GetThreadHandle();
 
         InitRPMallocThread();
-        auto callstack = Callstack( depth );
-
-        profiler.m_serialLock.lock();
-        SendCallstackSerial( callstack );
-        SendMemFree( QueueType::MemFreeCallstack, thread, ptr );
-        profiler.m_serialLock.unlock();
+        uint32_t id;
+        auto callstack = CallstackCached( depth, id );
+
+        auto& queue = GetSerialQueue();
+        queue.lock.lock();
+        SendCallstackSerial( queue.items, callstack, id );
+        SendMemFree( queue.items, QueueType::MemFreeCallstack, thread, ptr );
+        queue.lock.unlock();
 #else
         MemFree( ptr, secure );
 #endif
@@ -465,10 +621,11 @@ public:
 #endif
         const auto thread = GetThreadHandle();
 
-        GetProfiler().m_serialLock.lock();
-        SendMemName( name );
-        SendMemAlloc( QueueType::MemAllocNamed, thread, ptr, size );
-        GetProfiler().m_serialLock.unlock();
+        auto& queue = GetSerialQueue();
+        queue.lock.lock();
+        SendMemName( queue.items, name );
+        SendMemAlloc( queue.items, QueueType::MemAllocNamed, thread, ptr, size );
+        queue.lock.unlock();
     }
 
     static tracy_force_inline void MemFreeNamed( const void* ptr, bool secure, const char* name )
@@ -479,30 +636,32 @@ public:
 #endif
         const auto thread = GetThreadHandle();
 
-        GetProfiler().m_serialLock.lock();
-        SendMemName( name );
-        SendMemFree( QueueType::MemFreeNamed, thread, ptr );
-        GetProfiler().m_serialLock.unlock();
+        auto& queue = GetSerialQueue();
+        queue.lock.lock();
+        SendMemName( queue.items, name );
+        SendMemFree( queue.items, QueueType::MemFreeNamed, thread, ptr );
+        queue.lock.unlock();
     }
 
     static tracy_force_inline void MemAllocCallstackNamed( const void* ptr, size_t size, int depth, bool secure, const char* name )
     {
         if( secure && !ProfilerAvailable() ) return;
 #ifdef TRACY_HAS_CALLSTACK
-        auto& profiler = GetProfiler();
 #  ifdef TRACY_ON_DEMAND
-        if( !profiler.IsConnected() ) return;
+        if( !GetProfiler().IsConnected() ) return;
 #  endif
         const auto thread = GetThreadHandle();
 
         InitRPMallocThread();
-        auto callstack = Callstack( depth );
-
-        profiler.m_serialLock.lock();
-        SendCallstackSerial( callstack );
-        SendMemName( name );
-        SendMemAlloc( QueueType::MemAllocCallstackNamed, thread, ptr, size );
-        profiler.m_serialLock.unlock();
+        uint32_t id;
+        auto callstack = CallstackCached( depth, id );
+
+        auto& queue = GetSerialQueue();
+        queue.lock.lock();
+        SendCallstackSerial( queue.items, callstack, id );
+        SendMemName( queue.items, name );
+        SendMemAlloc( queue.items, QueueType::MemAllocCallstackNamed, thread, ptr, size );
+        queue.lock.unlock();
 #else
         MemAlloc( ptr, size, secure );
 #endif
@@ -512,20 +671,21 @@ public:
     {
         if( secure && !ProfilerAvailable() ) return;
 #ifdef TRACY_HAS_CALLSTACK
-        auto& profiler = GetProfiler();
 #  ifdef TRACY_ON_DEMAND
-        if( !profiler.IsConnected() ) return;
+        if( !GetProfiler().IsConnected() ) return;
 #  endif
         const auto thread = GetThreadHandle();
 
         InitRPMallocThread();
-        auto callstack = Callstack( depth );
-
-        profiler.m_serialLock.lock();
-        SendCallstackSerial( callstack );
-        SendMemName( name );
-        SendMemFree( QueueType::MemFreeCallstackNamed, thread, ptr );
-        profiler.m_serialLock.unlock();
+        uint32_t id;
+        auto callstack = CallstackCached( depth, id );
+
+        auto& queue = GetSerialQueue();
+        queue.lock.lock();
+        SendCallstackSerial( queue.items, callstack, id );
+        SendMemName( queue.items, name );
+        SendMemFree( queue.items, QueueType::MemFreeCallstackNamed, thread, ptr );
+        queue.lock.unlock();
 #else
         MemFree( ptr, secure );
 #endif
@@ -534,13 +694,37 @@ public:
     static tracy_force_inline void SendCallstack( int depth )
     {
 #ifdef TRACY_HAS_CALLSTACK
-        auto ptr = Callstack( depth );
+        uint32_t id;
+        auto ptr = CallstackCached( depth, id );
         TracyLfqPrepare( QueueType::Callstack );
         MemWrite( &item->callstackFat.ptr, (uint64_t)ptr );
+        MemWrite( &item->callstackFat.id, id );
         TracyLfqCommit;
 #endif
     }
 
+#ifdef TRACY_HAS_CALLSTACK
+    // Callstacks seen before are identified by an id in the callstack registry, and only the first
+    // occurrence is transferred to the server. Returns allocated trace if the callstack can't be cached.
+    static tracy_force_inline void* CallstackCached( int depth, uint32_t& id )
+    {
+        if( depth > CallstackCacheMaxDepth )
+        {
+            id = 0;
+            return Callstack( depth );
+        }
+        uintptr_t trace[1+CallstackCacheMaxDepth];
+        trace[0] = CallstackCapture( trace+1, depth );
+        id = GetProfiler().RegisterCallstack( trace );
+        if( id != 0 ) return nullptr;
+        auto ptr = (uintptr_t*)tracy_malloc( ( 1 + trace[0] ) * sizeof( uintptr_t ) );
+        memcpy( ptr, trace, ( 1 + trace[0] ) * sizeof( uintptr_t ) );
+        return ptr;
+    }
+
+    uint32_t RegisterCallstack( const uintptr_t* trace );
+#endif
+
     static tracy_force_inline void ParameterRegister( ParameterCallback cb ) { GetProfiler().m_paramCallback = cb; }
     static tracy_force_inline void ParameterSetup( uint32_t idx, const char* name, bool isBool, int32_t val )
     {
@@ -567,6 +751,23 @@ public:
         return m_isConnected.load( std::memory_order_acquire );
     }
 
+    // Zones can be disabled per source location from the server. Until that happens the filter
+    // table is not looked at.
+    tracy_force_inline bool IsZoneEnabled( const SourceLocationData* srcloc ) const
+    {
+        if( m_zoneFilterCount.load( std::memory_order_relaxed ) == 0 ) return true;
+        return IsZoneEnabledSlow( (uint64_t)srcloc );
+    }
+
+    // Zone events which bypass the minimum duration filter need the pending parent zones to be sent first.
+#ifdef TRACY_MIN_ZONE_DURATION
+    static tracy_force_inline void FlushPendingZones() { GetZoneFilter().FlushPending(); }
+    int64_t GetMinZoneDuration() const { return m_minZoneDuration; }
+    double GetTimerMul() const { return m_timerMul; }
+#else
+    static tracy_force_inline void FlushPendingZones() {}
+#endif
+
 #ifdef TRACY_ON_DEMAND
     tracy_force_inline uint64_t ConnectionId() const
     {
@@ -577,7 +778,7 @@ public:
     {
         m_deferredLock.lock();
         auto dst = m_deferredQueue.push_next();
-        memcpy( dst, &item, sizeof( item ) );
+        memcpy( dst, &item, QueueFatDataSize[item.hdr.idx] );
         m_deferredLock.unlock();
     }
 #endif
@@ -649,11 +850,21 @@ private:
     void CompressWorker();
 #endif
 
+#ifdef TRACY_HAS_CALLSTACK
+    static void LaunchSymbolWorker( void* ptr ) { ((Profiler*)ptr)->SymbolWorker(); }
+    void SymbolWorker();
+    const SymbolCacheEntry* ResolveSymbol( SymbolQueryType type, uint64_t ptr );
+#endif
+
     void ClearQueues( tracy::moodycamel::ConsumerToken& token );
     void ClearSerial();
     DequeueStatus Dequeue( tracy::moodycamel::ConsumerToken& token );
     DequeueStatus DequeueContextSwitches( tracy::moodycamel::ConsumerToken& token, int64_t& timeStop );
     DequeueStatus DequeueSerial();
+    bool DequeueSerialItem( QueueItem* item, int64_t& refSerial, int64_t& refGpu );
+    void CollectSerialThreadQueues();
+    DequeueStatus DequeueSymbols();
+    void ClearSymbols();
     bool CommitData();
 
     tracy_force_inline bool AppendData( const void* data, size_t len )
@@ -663,6 +874,15 @@ private:
         return ret;
     }
 
+    tracy_force_inline bool AppendItem( const QueueItem* item, uint8_t idx )
+    {
+        const auto toff = QueueDeltaTimeOffset( idx );
+        if( toff == 0 ) return AppendData( item, QueueDataSize[idx] );
+        const auto ret = NeedDataSize( QueueDataSize[idx] + QueueDeltaTimeMaxGrowth );
+        m_bufferOffset += int( QueueEncodeDeltaTime( m_buffer + m_bufferOffset, (const char*)item, QueueDataSize[idx], toff ) );
+        return ret;
+    }
+
     tracy_force_inline bool NeedDataSize( size_t len )
     {
         assert( len <= TargetFrameSize );
@@ -680,15 +900,28 @@ private:
         m_bufferOffset += int( len );
     }
 
+    void SetupTransport( const TransportRequestMessage& request );
+    bool OfferShm( const TransportRequestMessage& request, WelcomeMessage& welcome );
+    void AcceptShm();
+    void CloseShm();
+    int EncodeFrame( const char* data, size_t len, char* dst );
     bool SendData( const char* data, size_t len );
     void SendLongString( uint64_t ptr, const char* str, size_t len, QueueType type );
     void SendSourceLocation( uint64_t ptr );
     void SendSourceLocationPayload( uint64_t ptr );
-    void SendCallstackPayload( uint64_t ptr );
+    void SendCallstackPayload( uint64_t ptr, uint32_t id );
     void SendCallstackPayload64( uint64_t ptr );
+    void SendCallstackCached( uint64_t ptr, uint32_t id );
+
+#ifdef TRACY_HAS_CALLSTACK
+    tracy_force_inline const uintptr_t* CallstackTrace( uint32_t id ) const
+    {
+        return m_callstackRegistry[id >> CallstackRegistryChunkBits][id & ( CallstackRegistryChunkSize - 1 )];
+    }
+#endif
     void SendCallstackAlloc( uint64_t ptr );
-    void SendCallstackFrame( uint64_t ptr );
-    void SendCodeLocation( uint64_t ptr );
+    void QueueSymbolQuery( SymbolQueryType type, uint64_t ptr );
+    void SendSymbolResult( const SymbolQueueItem& item );
 
     bool HandleServerQuery();
     void HandleDisconnect();
@@ -704,21 +937,22 @@ private:
     void CalibrateDelay();
     void ReportTopology();
 
-    static tracy_force_inline void SendCallstackSerial( void* ptr )
+    static tracy_force_inline void SendCallstackSerial( FastVector<QueueItem>& queue, void* ptr, uint32_t id )
     {
 #ifdef TRACY_HAS_CALLSTACK
-        auto item = GetProfiler().m_serialQueue.prepare_next();
+        auto item = queue.prepare_next();
         MemWrite( &item->hdr.type, QueueType::CallstackSerial );
         MemWrite( &item->callstackFat.ptr, (uint64_t)ptr );
-        GetProfiler().m_serialQueue.commit_next();
+        MemWrite( &item->callstackFat.id, id );
+        queue.commit_next();
 #endif
     }
 
-    static tracy_force_inline void SendMemAlloc( QueueType type, const uint64_t thread, const void* ptr, size_t size )
+    static tracy_force_inline void SendMemAlloc( FastVector<QueueItem>& queue, QueueType type, const uint64_t thread, const void* ptr, size_t size )
     {
         assert( type == QueueType::MemAlloc || type == QueueType::MemAllocCallstack || type == QueueType::MemAllocNamed || type == QueueType::MemAllocCallstackNamed );
 
-        auto item = GetProfiler().m_serialQueue.prepare_next();
+        auto item = queue.prepare_next();
         MemWrite( &item->hdr.type, type );
         MemWrite( &item->memAlloc.time, GetTime() );
         MemWrite( &item->memAlloc.thread, thread );
@@ -734,28 +968,28 @@ private:
             memcpy( &item->memAlloc.size, &size, 4 );
             memcpy( ((char*)&item->memAlloc.size)+4, ((char*)&size)+4, 2 );
         }
-        GetProfiler().m_serialQueue.commit_next();
+        queue.commit_next();
     }
 
-    static tracy_force_inline void SendMemFree( QueueType type, const uint64_t thread, const void* ptr )
+    static tracy_force_inline void SendMemFree( FastVector<QueueItem>& queue, QueueType type, const uint64_t thread, const void* ptr )
     {
         assert( type == QueueType::MemFree || type == QueueType::MemFreeCallstack || type == QueueType::MemFreeNamed || type == QueueType::MemFreeCallstackNamed );
 
-        auto item = GetProfiler().m_serialQueue.prepare_next();
+        auto item = queue.prepare_next();
         MemWrite( &item->hdr.type, type );
         MemWrite( &item->memFree.time, GetTime() );
         MemWrite( &item->memFree.thread, thread );
         MemWrite( &item->memFree.ptr, (uint64_t)ptr );
-        GetProfiler().m_serialQueue.commit_next();
+        queue.commit_next();
     }
 
-    static tracy_force_inline void SendMemName( const char* name )
+    static tracy_force_inline void SendMemName( FastVector<QueueItem>& queue, const char* name )
     {
         assert( name );
-        auto item = GetProfiler().m_serialQueue.prepare_next();
+        auto item = queue.prepare_next();
         MemWrite( &item->hdr.type, QueueType::MemNamePayload );
         MemWrite( &item->memName.name, (uint64_t)name );
-        GetProfiler().m_serialQueue.commit_next();
+        queue.commit_next();
     }
 
 #if ( defined _WIN32 || defined __CYGWIN__ ) && defined TRACY_TIMER_QPC
@@ -772,6 +1006,7 @@ private:
     std::atomic<bool> m_shutdownManual;
     std::atomic<bool> m_shutdownFinished;
     Socket* m_sock;
+    ShmRing* m_shm;     // frames go through shared memory instead of m_sock, if set
     UdpBroadcast* m_broadcast;
     bool m_noExit;
     uint32_t m_userPort;
@@ -785,6 +1020,12 @@ private:
     int64_t m_refTimeGpu;
 
     void* m_stream;     // LZ4_stream_t*
+    void* m_streamHC;   // LZ4_streamHC_t*, created on demand
+#ifdef TRACY_ZSTD
+    void* m_zstdCtx;    // ZSTD_CCtx*, created on demand
+#endif
+    TransportCodec m_codec;
+    int8_t m_codecLevel;
     char* m_buffer;
     int m_bufferOffset;
     int m_bufferStart;
@@ -794,9 +1035,62 @@ private:
     FastVector<QueueItem> m_serialQueue, m_serialDequeue;
     TracyMutex m_serialLock;
 
+    std::atomic<SerialQueue*> m_serialThreadQueues;
+    FastVector<QueueItem> m_serialMergeQueue, m_serialMergeDequeue;
+    FastVector<SerialMergeGroup> m_serialMergeGroups, m_serialMergeHeld;
+
+#ifdef TRACY_HAS_CALLSTACK
+    enum { CallstackRegistryChunkBits = 12 };
+    enum { CallstackRegistryChunkSize = 1 << CallstackRegistryChunkBits };
+    enum { CallstackRegistryChunks = 1024 };
+
+    TracyMutex m_callstackLock;
+    uint32_t m_callstackCount;
+    uintptr_t** m_callstackRegistry[CallstackRegistryChunks];   // id -> trace
+    CallstackCacheEntry* m_callstackMap;                        // trace hash -> id, open addressing
+    uint32_t m_callstackMapSize;
+    uint64_t* m_callstackSent[CallstackRegistryChunks];         // ids transferred to the current server
+
+    FastVector<SymbolQueueItem> m_symbolStaging;                // profiler thread only
+    FastVector<SymbolQueueItem> m_symbolQueue, m_symbolDequeue;
+    TracyMutex m_symbolLock;
+    FastVector<SymbolQueueItem> m_symbolResults, m_symbolResultDequeue;
+    TracyMutex m_symbolResultLock;
+    uint32_t m_symbolEpoch;                                     // bumped on disconnect, stale results are dropped
+    SymbolCacheEntry** m_symbolCache;                           // symbol worker thread only, open addressing
+    uint32_t m_symbolCacheSize;
+    uint32_t m_symbolCacheCount;
+#endif
+
 #ifndef TRACY_NO_FRAME_IMAGE
     FastVector<FrameImageQueueItem> m_fiQueue, m_fiDequeue;
     TracyMutex m_fiLock;
+    std::atomic<uint32_t> m_fiPending;
+#endif
+
+    // Open addressing table, written by the worker thread only. When it gets half full it is replaced
+    // by a larger copy. Instrumented threads may still be probing the old table, so replaced tables
+    // are kept until the profiler is destroyed.
+    struct ZoneFilterTable
+    {
+        ZoneFilterTable* prev;
+        uint32_t mask;
+        std::atomic<uint64_t>* data;
+    };
+
+    static ZoneFilterTable* AllocZoneFilterTable( uint32_t size );
+    bool IsZoneEnabledSlow( uint64_t srcloc ) const;
+    void HandleZoneFilter( uint64_t srcloc, bool enabled );
+    void GrowZoneFilter();
+    void ClearZoneFilter();
+
+    enum { ZoneFilterInitSize = 1024 };
+    std::atomic<ZoneFilterTable*> m_zoneFilter;
+    std::atomic<uint32_t> m_zoneFilterCount;                    // disabled source locations
+    uint32_t m_zoneFilterUsed;
+
+#ifdef TRACY_MIN_ZONE_DURATION
+    int64_t m_minZoneDuration;                                  // in timer ticks
 #endif
 
     std::atomic<uint64_t> m_frameCount;
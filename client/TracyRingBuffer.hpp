@@ -76,6 +76,9 @@ public:
         }
     }
 
+    uint64_t GetHead() const { return LoadHead(); }
+    uint64_t GetTail() const { return m_metadata->data_tail; }
+
     void Advance( uint64_t cnt )
     {
         StoreTail( m_metadata->data_tail + cnt );
@@ -23,14 +23,21 @@ public:
 
     tracy_force_inline ScopedZone( const SourceLocationData* srcloc, bool is_active = true )
 #ifdef TRACY_ON_DEMAND
-        : m_active( is_active && GetProfiler().IsConnected() )
+        : m_active( is_active && GetProfiler().IsConnected() && GetProfiler().IsZoneEnabled( srcloc ) )
 #else
-        : m_active( is_active )
+        : m_active( is_active && GetProfiler().IsZoneEnabled( srcloc ) )
 #endif
     {
         if( !m_active ) return;
 #ifdef TRACY_ON_DEMAND
         m_connectionId = GetProfiler().ConnectionId();
+#endif
+#ifdef TRACY_MIN_ZONE_DURATION
+#  ifdef TRACY_ON_DEMAND
+        if( GetZoneFilter().Begin( srcloc, Profiler::GetTime(), m_connectionId ) ) return;
+#  else
+        if( GetZoneFilter().Begin( srcloc, Profiler::GetTime(), 0 ) ) return;
+#  endif
 #endif
         TracyLfqPrepare( QueueType::ZoneBegin );
         MemWrite( &item->zoneBegin.time, Profiler::GetTime() );
@@ -40,15 +47,16 @@ public:
 
     tracy_force_inline ScopedZone( const SourceLocationData* srcloc, int depth, bool is_active = true )
 #ifdef TRACY_ON_DEMAND
-        : m_active( is_active && GetProfiler().IsConnected() )
+        : m_active( is_active && GetProfiler().IsConnected() && GetProfiler().IsZoneEnabled( srcloc ) )
 #else
-        : m_active( is_active )
+        : m_active( is_active && GetProfiler().IsZoneEnabled( srcloc ) )
 #endif
     {
         if( !m_active ) return;
 #ifdef TRACY_ON_DEMAND
         m_connectionId = GetProfiler().ConnectionId();
 #endif
+        Profiler::FlushPendingZones();
         GetProfiler().SendCallstack( depth );
 
         TracyLfqPrepare( QueueType::ZoneBeginCallstack );
@@ -68,6 +76,7 @@ public:
 #ifdef TRACY_ON_DEMAND
         m_connectionId = GetProfiler().ConnectionId();
 #endif
+        Profiler::FlushPendingZones();
         TracyLfqPrepare( QueueType::ZoneBeginAllocSrcLoc );
         const auto srcloc = Profiler::AllocSourceLocation( line, source, sourceSz, function, functionSz, name, nameSz );
         MemWrite( &item->zoneBegin.time, Profiler::GetTime() );
@@ -86,6 +95,7 @@ public:
 #ifdef TRACY_ON_DEMAND
         m_connectionId = GetProfiler().ConnectionId();
 #endif
+        Profiler::FlushPendingZones();
         GetProfiler().SendCallstack( depth );
 
         TracyLfqPrepare( QueueType::ZoneBeginAllocSrcLocCallstack );
@@ -98,11 +108,19 @@ public:
     tracy_force_inline ~ScopedZone()
     {
         if( !m_active ) return;
+#ifdef TRACY_MIN_ZONE_DURATION
+        const auto time = Profiler::GetTime();
+        if( !GetZoneFilter().End( time ) ) return;
+#endif
 #ifdef TRACY_ON_DEMAND
         if( GetProfiler().ConnectionId() != m_connectionId ) return;
 #endif
         TracyLfqPrepare( QueueType::ZoneEnd );
+#ifdef TRACY_MIN_ZONE_DURATION
+        MemWrite( &item->zoneEnd.time, time );
+#else
         MemWrite( &item->zoneEnd.time, Profiler::GetTime() );
+#endif
         TracyLfqCommit;
     }
 
@@ -113,6 +131,8 @@ public:
 #ifdef TRACY_ON_DEMAND
         if( GetProfiler().ConnectionId() != m_connectionId ) return;
 #endif
+        // Annotated zones are always kept.
+        Profiler::FlushPendingZones();
         auto ptr = (char*)tracy_malloc( size );
         memcpy( ptr, txt, size );
         TracyLfqPrepare( QueueType::ZoneText );
@@ -128,6 +148,7 @@ public:
 #ifdef TRACY_ON_DEMAND
         if( GetProfiler().ConnectionId() != m_connectionId ) return;
 #endif
+        Profiler::FlushPendingZones();
         auto ptr = (char*)tracy_malloc( size );
         memcpy( ptr, txt, size );
         TracyLfqPrepare( QueueType::ZoneName );
@@ -142,6 +163,7 @@ public:
 #ifdef TRACY_ON_DEMAND
         if( GetProfiler().ConnectionId() != m_connectionId ) return;
 #endif
+        Profiler::FlushPendingZones();
         TracyLfqPrepare( QueueType::ZoneColor );
         MemWrite( &item->zoneColor.r, uint8_t( ( color       ) & 0xFF ) );
         MemWrite( &item->zoneColor.g, uint8_t( ( color >> 8  ) & 0xFF ) );
@@ -155,6 +177,7 @@ public:
 #ifdef TRACY_ON_DEMAND
         if( GetProfiler().ConnectionId() != m_connectionId ) return;
 #endif
+        Profiler::FlushPendingZones();
         TracyLfqPrepare( QueueType::ZoneValue );
         MemWrite( &item->zoneValue.value, value );
         TracyLfqCommit;
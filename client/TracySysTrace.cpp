@@ -618,6 +618,7 @@ void SysTraceSendExternalName( uint64_t thread )
 namespace tracy
 {
 
+#ifdef __ANDROID__
 static const char BasePath[] = "/sys/kernel/debug/tracing/";
 static const char TracingOn[] = "tracing_on";
 static const char CurrentTracer[] = "current_tracer";
@@ -627,19 +628,177 @@ static const char SchedSwitch[] = "events/sched/sched_switch/enable";
 static const char SchedWakeup[] = "events/sched/sched_wakeup/enable";
 static const char BufferSizeKb[] = "buffer_size_kb";
 static const char TracePipe[] = "trace_pipe";
+#else
+static const char* const TracingPaths[] = { "/sys/kernel/tracing/", "/sys/kernel/debug/tracing/" };
+static const char SchedSwitchEvent[] = "events/sched/sched_switch/";
+static const char SchedWakeupEvent[] = "events/sched/sched_wakeup/";
+#endif
 
 static std::atomic<bool> traceActive { false };
-static Thread* s_threadSampling = nullptr;
 static int s_numCpus = 0;
 
 static constexpr size_t RingBufSize = 64*1024;
 static RingBuffer<RingBufSize>* s_ring = nullptr;
 
+// Each sampling thread drains the rings of a contiguous range of CPUs.
+static constexpr int SamplingCpusPerThread = 32;
+static Thread** s_threadSampling = nullptr;
+static int s_numSamplingThreads = 0;
+
 static int perf_event_open( struct perf_event_attr* hw_event, pid_t pid, int cpu, int group_fd, unsigned long flags )
 {
     return syscall( __NR_perf_event_open, hw_event, pid, cpu, group_fd, flags );
 }
 
+static int GetSamplingThreadCount( int numCpus )
+{
+    int cnt = 0;
+    const char* env = GetEnvVar( "TRACY_SAMPLING_THREADS" );
+    if( env )
+    {
+        cnt = atoi( env );
+    }
+#ifdef TRACY_SAMPLING_THREADS
+    else
+    {
+        cnt = TRACY_SAMPLING_THREADS;
+    }
+#endif
+    if( cnt <= 0 ) cnt = ( numCpus + SamplingCpusPerThread - 1 ) / SamplingCpusPerThread;
+    return std::min( cnt, numCpus );
+}
+
+static void SamplingWorker( void* ptr )
+{
+    const auto idx = int( (uintptr_t)ptr );
+    const auto cpuBegin = s_numCpus * idx / s_numSamplingThreads;
+    const auto cpuEnd = s_numCpus * ( idx + 1 ) / s_numSamplingThreads;
+
+    ThreadExitHandler threadExitHandler;
+    SetThreadName( "Tracy Sampling" );
+    sched_param sp = { 5 };
+    pthread_setschedparam( pthread_self(), SCHED_FIFO, &sp );
+    uint32_t currentPid = (uint32_t)getpid();
+#if defined TRACY_HW_TIMER && ( defined __i386 || defined _M_IX86 || defined __x86_64__ || defined _M_X64 )
+    for( int i=cpuBegin; i<cpuEnd; i++ )
+    {
+        if( !s_ring[i].CheckTscCaps() )
+        {
+            // The scheduler clock is the same for all CPUs, so only the first thread reports it.
+            if( idx == 0 )
+            {
+                const char* err = "Tracy Profiler: sampling is disabled due to non-native scheduler clock. Are you running under a VM?";
+                Profiler::MessageAppInfo( err, strlen( err ) );
+            }
+            return;
+        }
+    }
+#endif
+    for( int i=cpuBegin; i<cpuEnd; i++ ) s_ring[i].Enable();
+    for(;;)
+    {
+        bool hadData = false;
+        for( int i=cpuBegin; i<cpuEnd; i++ )
+        {
+            if( !traceActive.load( std::memory_order_relaxed ) ) break;
+            if( !s_ring[i].HasData() ) continue;
+            hadData = true;
+
+            perf_event_header hdr;
+            s_ring[i].Read( &hdr, 0, sizeof( perf_event_header ) );
+            if( hdr.type == PERF_RECORD_SAMPLE )
+            {
+                uint32_t pid, tid;
+                uint64_t t0;
+                uint64_t cnt;
+
+                auto offset = sizeof( perf_event_header );
+                s_ring[i].Read( &pid, offset, sizeof( uint32_t ) );
+                if( pid == currentPid )
+                {
+                    offset += sizeof( uint32_t );
+                    s_ring[i].Read( &tid, offset, sizeof( uint32_t ) );
+                    offset += sizeof( uint32_t );
+                    s_ring[i].Read( &t0, offset, sizeof( uint64_t ) );
+                    offset += sizeof( uint64_t );
+                    s_ring[i].Read( &cnt, offset, sizeof( uint64_t ) );
+                    offset += sizeof( uint64_t );
+
+                    if( cnt > 0 )
+                    {
+                        auto trace = (uint64_t*)tracy_malloc( ( 1 + cnt ) * sizeof( uint64_t ) );
+                        s_ring[i].Read( trace+1, offset, sizeof( uint64_t ) * cnt );
+
+#if defined __x86_64__ || defined _M_X64
+                        // remove non-canonical pointers
+                        do
+                        {
+                            const auto test = (int64_t)trace[cnt];
+                            const auto m1 = test >> 63;
+                            const auto m2 = test >> 47;
+                            if( m1 == m2 ) break;
+                        }
+                        while( --cnt > 0 );
+                        for( uint64_t j=1; j<cnt; j++ )
+                        {
+                            const auto test = (int64_t)trace[j];
+                            const auto m1 = test >> 63;
+                            const auto m2 = test >> 47;
+                            if( m1 != m2 ) trace[j] = 0;
+                        }
+#endif
+
+                        // skip kernel frames
+                        uint64_t j;
+                        for( j=0; j<cnt; j++ )
+                        {
+                            if( (int64_t)trace[j+1] >= 0 ) break;
+                        }
+                        if( j == cnt )
+                        {
+                            tracy_free( trace );
+                        }
+                        else
+                        {
+                            if( j > 0 )
+                            {
+                                cnt -= j;
+                                memmove( trace+1, trace+1+j, sizeof( uint64_t ) * cnt );
+                            }
+                            memcpy( trace, &cnt, sizeof( uint64_t ) );
+
+#if defined TRACY_HW_TIMER && ( defined __i386 || defined _M_IX86 || defined __x86_64__ || defined _M_X64 )
+                            t0 = s_ring[i].ConvertTimeToTsc( t0 );
+#endif
+
+                            TracyLfqPrepare( QueueType::CallstackSample );
+                            MemWrite( &item->callstackSampleFat.time, t0 );
+                            MemWrite( &item->callstackSampleFat.thread, (uint64_t)tid );
+                            MemWrite( &item->callstackSampleFat.ptr, (uint64_t)trace );
+                            TracyLfqCommit;
+                        }
+                    }
+                }
+            }
+            else if( hdr.type == PERF_RECORD_LOST )
+            {
+                uint64_t lost;
+                s_ring[i].Read( &lost, sizeof( perf_event_header ) + sizeof( uint64_t ), sizeof( uint64_t ) );
+
+                TracyLfqPrepare( QueueType::SamplesLost );
+                MemWrite( &item->samplesLost.count, lost );
+                TracyLfqCommit;
+            }
+            s_ring[i].Advance( hdr.size );
+        }
+        if( !traceActive.load( std::memory_order_relaxed) ) break;
+        if( !hadData )
+        {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+        }
+    }
+}
+
 static void SetupSampling( int64_t& samplingPeriod )
 {
 #ifndef CLOCK_MONOTONIC_RAW
@@ -678,129 +837,35 @@ static void SetupSampling( int64_t& samplingPeriod )
         {
             for( int j=0; j<i; j++ ) s_ring[j].~RingBuffer<RingBufSize>();
             tracy_free( s_ring );
+            s_ring = nullptr;
             return;
         }
         new( s_ring+i ) RingBuffer<RingBufSize>( fd );
     }
 
-    s_threadSampling = (Thread*)tracy_malloc( sizeof( Thread ) );
-    new(s_threadSampling) Thread( [] (void*) {
-        ThreadExitHandler threadExitHandler;
-        SetThreadName( "Tracy Sampling" );
-        sched_param sp = { 5 };
-        pthread_setschedparam( pthread_self(), SCHED_FIFO, &sp );
-        uint32_t currentPid = (uint32_t)getpid();
-#if defined TRACY_HW_TIMER && ( defined __i386 || defined _M_IX86 || defined __x86_64__ || defined _M_X64 )
-        for( int i=0; i<s_numCpus; i++ )
-        {
-            if( !s_ring[i].CheckTscCaps() )
-            {
-                for( int j=0; j<s_numCpus; j++ ) s_ring[j].~RingBuffer<RingBufSize>();
-                tracy_free( s_ring );
-                const char* err = "Tracy Profiler: sampling is disabled due to non-native scheduler clock. Are you running under a VM?";
-                Profiler::MessageAppInfo( err, strlen( err ) );
-                return;
-            }
-        }
-#endif
-        for( int i=0; i<s_numCpus; i++ ) s_ring[i].Enable();
-        for(;;)
-        {
-            bool hadData = false;
-            for( int i=0; i<s_numCpus; i++ )
-            {
-                if( !traceActive.load( std::memory_order_relaxed ) ) break;
-                if( !s_ring[i].HasData() ) continue;
-                hadData = true;
-
-                perf_event_header hdr;
-                s_ring[i].Read( &hdr, 0, sizeof( perf_event_header ) );
-                if( hdr.type == PERF_RECORD_SAMPLE )
-                {
-                    uint32_t pid, tid;
-                    uint64_t t0;
-                    uint64_t cnt;
-
-                    auto offset = sizeof( perf_event_header );
-                    s_ring[i].Read( &pid, offset, sizeof( uint32_t ) );
-                    if( pid == currentPid )
-                    {
-                        offset += sizeof( uint32_t );
-                        s_ring[i].Read( &tid, offset, sizeof( uint32_t ) );
-                        offset += sizeof( uint32_t );
-                        s_ring[i].Read( &t0, offset, sizeof( uint64_t ) );
-                        offset += sizeof( uint64_t );
-                        s_ring[i].Read( &cnt, offset, sizeof( uint64_t ) );
-                        offset += sizeof( uint64_t );
-
-                        if( cnt > 0 )
-                        {
-                            auto trace = (uint64_t*)tracy_malloc( ( 1 + cnt ) * sizeof( uint64_t ) );
-                            s_ring[i].Read( trace+1, offset, sizeof( uint64_t ) * cnt );
-
-#if defined __x86_64__ || defined _M_X64
-                            // remove non-canonical pointers
-                            do
-                            {
-                                const auto test = (int64_t)trace[cnt];
-                                const auto m1 = test >> 63;
-                                const auto m2 = test >> 47;
-                                if( m1 == m2 ) break;
-                            }
-                            while( --cnt > 0 );
-                            for( uint64_t j=1; j<cnt; j++ )
-                            {
-                                const auto test = (int64_t)trace[j];
-                                const auto m1 = test >> 63;
-                                const auto m2 = test >> 47;
-                                if( m1 != m2 ) trace[j] = 0;
-                            }
-#endif
-
-                            // skip kernel frames
-                            uint64_t j;
-                            for( j=0; j<cnt; j++ )
-                            {
-                                if( (int64_t)trace[j+1] >= 0 ) break;
-                            }
-                            if( j == cnt )
-                            {
-                                tracy_free( trace );
-                            }
-                            else
-                            {
-                                if( j > 0 )
-                                {
-                                    cnt -= j;
-                                    memmove( trace+1, trace+1+j, sizeof( uint64_t ) * cnt );
-                                }
-                                memcpy( trace, &cnt, sizeof( uint64_t ) );
-
-#if defined TRACY_HW_TIMER && ( defined __i386 || defined _M_IX86 || defined __x86_64__ || defined _M_X64 )
-                                t0 = s_ring[i].ConvertTimeToTsc( t0 );
-#endif
+    s_numSamplingThreads = GetSamplingThreadCount( s_numCpus );
+    s_threadSampling = (Thread**)tracy_malloc( sizeof( Thread* ) * s_numSamplingThreads );
+    for( int i=0; i<s_numSamplingThreads; i++ )
+    {
+        s_threadSampling[i] = (Thread*)tracy_malloc( sizeof( Thread ) );
+        new(s_threadSampling[i]) Thread( SamplingWorker, (void*)(uintptr_t)i );
+    }
+}
 
-                                TracyLfqPrepare( QueueType::CallstackSample );
-                                MemWrite( &item->callstackSampleFat.time, t0 );
-                                MemWrite( &item->callstackSampleFat.thread, (uint64_t)tid );
-                                MemWrite( &item->callstackSampleFat.ptr, (uint64_t)trace );
-                                TracyLfqCommit;
-                            }
-                        }
-                    }
-                }
-                s_ring[i].Advance( hdr.size );
-            }
-            if( !traceActive.load( std::memory_order_relaxed) ) break;
-            if( !hadData )
-            {
-                std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
-            }
-        }
+static void StopSampling()
+{
+    if( !s_threadSampling ) return;
+    for( int i=0; i<s_numSamplingThreads; i++ )
+    {
+        s_threadSampling[i]->~Thread();
+        tracy_free( s_threadSampling[i] );
+    }
+    tracy_free( s_threadSampling );
+    s_threadSampling = nullptr;
 
-        for( int i=0; i<s_numCpus; i++ ) s_ring[i].~RingBuffer<RingBufSize>();
-        tracy_free( s_ring );
-    }, nullptr );
+    for( int i=0; i<s_numCpus; i++ ) s_ring[i].~RingBuffer<RingBufSize>();
+    tracy_free( s_ring );
+    s_ring = nullptr;
 }
 
 #ifdef __ANDROID__
@@ -822,36 +887,7 @@ static bool TraceWrite( const char* path, size_t psz, const char* val, size_t vs
     sprintf( tmp, "su root sh -c 'echo \"%s\" > %s%s'", val, BasePath, path );
     return system( tmp ) == 0;
 }
-#else
-static bool TraceWrite( const char* path, size_t psz, const char* val, size_t vsz )
-{
-    char tmp[256];
-    memcpy( tmp, BasePath, sizeof( BasePath ) - 1 );
-    memcpy( tmp + sizeof( BasePath ) - 1, path, psz );
-
-    int fd = open( tmp, O_WRONLY );
-    if( fd < 0 ) return false;
-
-    for(;;)
-    {
-        ssize_t cnt = write( fd, val, vsz );
-        if( cnt == (ssize_t)vsz )
-        {
-            close( fd );
-            return true;
-        }
-        if( cnt < 0 )
-        {
-            close( fd );
-            return false;
-        }
-        vsz -= cnt;
-        val += cnt;
-    }
-}
-#endif
 
-#ifdef __ANDROID__
 void SysTraceInjectPayload()
 {
     int pipefd[2];
@@ -886,7 +922,6 @@ void SysTraceInjectPayload()
         }
     }
 }
-#endif
 
 bool SysTraceStart( int64_t& samplingPeriod )
 {
@@ -925,12 +960,9 @@ void SysTraceStop()
 {
     TraceWrite( TracingOn, sizeof( TracingOn ), "0", 2 );
     traceActive.store( false, std::memory_order_relaxed );
-    if( s_threadSampling )
-    {
-        s_threadSampling->~Thread();
-        tracy_free( s_threadSampling );
-    }
+    StopSampling();
 }
+#endif
 
 static uint64_t ReadNumber( const char*& data )
 {
@@ -948,6 +980,7 @@ static uint64_t ReadNumber( const char*& data )
     return val;
 }
 
+#ifdef __ANDROID__
 static uint8_t ReadState( char state )
 {
     switch( state )
@@ -964,6 +997,7 @@ static uint8_t ReadState( char state )
     default: return 100;
     }
 }
+#endif
 
 #if defined __ANDROID__ && defined __ANDROID_API__ && __ANDROID_API__ < 18
 /*-
@@ -1038,6 +1072,7 @@ ssize_t getline(char **buf, size_t *bufsiz, FILE *fp)
 }
 #endif
 
+#ifdef __ANDROID__
 static void HandleTraceLine( const char* line )
 {
     line += 23;
@@ -1105,7 +1140,6 @@ static void HandleTraceLine( const char* line )
     }
 }
 
-#ifdef __ANDROID__
 static void ProcessTraceLines( int fd )
 {
     // Linux pipe buffer is 64KB, additional 1KB is for unfinished lines
@@ -1207,57 +1241,390 @@ void SysTraceWorker( void* ptr )
     }
 }
 #else
-static void ProcessTraceLines( int fd )
+static constexpr size_t CtxRingBufSize = 256*1024;
+static RingBuffer<CtxRingBufSize>* s_ctxRing = nullptr;
+static int* s_ctxWakeupFd = nullptr;
+
+static uint16_t s_schedSwitchId;
+static uint16_t s_schedWakeupId;
+
+// Offsets of the tracepoint fields in the raw sample data.
+static uint32_t s_prevPidOffset;
+static uint32_t s_prevStateOffset;
+static uint32_t s_prevStateSize;
+static uint32_t s_nextPidOffset;
+static uint32_t s_wakeupPidOffset;
+
+static char* ReadEventFile( const char* event, size_t esz, const char* file, size_t fsz )
 {
-    char* buf = (char*)tracy_malloc( 64*1024 );
+    for( auto& base : TracingPaths )
+    {
+        char tmp[256];
+        const auto bsz = strlen( base );
+        memcpy( tmp, base, bsz );
+        memcpy( tmp + bsz, event, esz - 1 );
+        memcpy( tmp + bsz + esz - 1, file, fsz );
+
+        int fd = open( tmp, O_RDONLY );
+        if( fd < 0 ) continue;
+
+        size_t size = 0;
+        size_t capacity = 4096;
+        auto buf = (char*)tracy_malloc( capacity );
+        for(;;)
+        {
+            if( size + 1 == capacity )
+            {
+                capacity *= 2;
+                buf = (char*)tracy_realloc( buf, capacity );
+            }
+            const auto rd = read( fd, buf + size, capacity - size - 1 );
+            if( rd <= 0 ) break;
+            size += rd;
+        }
+        close( fd );
+        buf[size] = '\0';
+        return buf;
+    }
+    return nullptr;
+}
 
-    struct pollfd pfd;
-    pfd.fd = fd;
-    pfd.events = POLLIN | POLLERR;
+static bool ReadEventId( const char* event, size_t esz, uint16_t& id )
+{
+    auto buf = ReadEventFile( event, esz, "id", 3 );
+    if( !buf ) return false;
+    const char* ptr = buf;
+    const bool ok = *ptr >= '0' && *ptr <= '9';
+    if( ok ) id = (uint16_t)ReadNumber( ptr );
+    tracy_free( buf );
+    return ok;
+}
 
+// Field descriptions in the event format file look like this:
+//   field:pid_t prev_pid;	offset:24;	size:4;	signed:1;
+static bool ReadEventField( const char* format, const char* name, uint32_t& offset, uint32_t& size )
+{
+    const auto nsz = strlen( name );
+    auto ptr = format;
     for(;;)
     {
-        while( poll( &pfd, 1, 0 ) <= 0 )
+        ptr = strstr( ptr, name );
+        if( !ptr ) return false;
+        if( ptr > format && ( ptr[-1] == ' ' || ptr[-1] == '\t' ) && ptr[nsz] == ';' ) break;
+        ptr += nsz;
+    }
+    ptr = strstr( ptr, "offset:" );
+    if( !ptr ) return false;
+    ptr += 7;
+    offset = (uint32_t)ReadNumber( ptr );
+    ptr = strstr( ptr, "size:" );
+    if( !ptr ) return false;
+    ptr += 5;
+    size = (uint32_t)ReadNumber( ptr );
+    return true;
+}
+
+static bool ReadEventFormats()
+{
+    uint32_t prevPidSize, nextPidSize, wakeupPidSize;
+
+    auto format = ReadEventFile( SchedSwitchEvent, sizeof( SchedSwitchEvent ), "format", 7 );
+    if( !format ) return false;
+    bool ok =
+        ReadEventField( format, "prev_pid", s_prevPidOffset, prevPidSize ) &&
+        ReadEventField( format, "prev_state", s_prevStateOffset, s_prevStateSize ) &&
+        ReadEventField( format, "next_pid", s_nextPidOffset, nextPidSize );
+    tracy_free( format );
+    if( !ok ) return false;
+
+    format = ReadEventFile( SchedWakeupEvent, sizeof( SchedWakeupEvent ), "format", 7 );
+    if( !format ) return false;
+    ok = ReadEventField( format, "pid", s_wakeupPidOffset, wakeupPidSize );
+    tracy_free( format );
+    if( !ok ) return false;
+
+    return prevPidSize == 4 && nextPidSize == 4 && wakeupPidSize == 4 && ( s_prevStateSize == 4 || s_prevStateSize == 8 );
+}
+
+static void FreeContextSwitches( int num )
+{
+    for( int i=0; i<num; i++ )
+    {
+        close( s_ctxWakeupFd[i] );
+        s_ctxRing[i].~RingBuffer<CtxRingBufSize>();
+    }
+    tracy_free( s_ctxWakeupFd );
+    tracy_free( s_ctxRing );
+}
+
+static bool SetupContextSwitches()
+{
+    if( !ReadEventFormats() ) return false;
+    if( !ReadEventId( SchedSwitchEvent, sizeof( SchedSwitchEvent ), s_schedSwitchId ) ) return false;
+    if( !ReadEventId( SchedWakeupEvent, sizeof( SchedWakeupEvent ), s_schedWakeupId ) ) return false;
+
+    s_numCpus = (int)std::thread::hardware_concurrency();
+    s_ctxRing = (RingBuffer<CtxRingBufSize>*)tracy_malloc( sizeof( RingBuffer<CtxRingBufSize> ) * s_numCpus );
+    s_ctxWakeupFd = (int*)tracy_malloc( sizeof( int ) * s_numCpus );
+
+    perf_event_attr pe = {};
+
+    pe.type = PERF_TYPE_TRACEPOINT;
+    pe.size = sizeof( perf_event_attr );
+    pe.sample_period = 1;
+    pe.sample_type = PERF_SAMPLE_TIME | PERF_SAMPLE_RAW;
+    pe.disabled = 1;
+#if !defined TRACY_HW_TIMER || !( defined __i386 || defined _M_IX86 || defined __x86_64__ || defined _M_X64 )
+    pe.use_clockid = 1;
+    pe.clockid = CLOCK_MONOTONIC_RAW;
+#endif
+
+    for( int i=0; i<s_numCpus; i++ )
+    {
+        pe.config = s_schedSwitchId;
+        const int fd = perf_event_open( &pe, -1, i, -1, 0 );
+        if( fd == -1 )
         {
-            if( !traceActive.load( std::memory_order_relaxed ) ) break;
-            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+            FreeContextSwitches( i );
+            return false;
         }
+        new( s_ctxRing+i ) RingBuffer<CtxRingBufSize>( fd );
 
-        const auto rd = read( fd, buf, 64*1024 );
-        if( rd <= 0 ) break;
+        // Wakeups are written to the same ring, which keeps them ordered with the context switches on this CPU.
+        pe.config = s_schedWakeupId;
+        const int wfd = perf_event_open( &pe, -1, i, -1, 0 );
+        if( wfd == -1 || ioctl( wfd, PERF_EVENT_IOC_SET_OUTPUT, fd ) != 0 )
+        {
+            if( wfd != -1 ) close( wfd );
+            s_ctxRing[i].~RingBuffer<CtxRingBufSize>();
+            FreeContextSwitches( i );
+            return false;
+        }
+        s_ctxWakeupFd[i] = wfd;
+    }
 
-#ifdef TRACY_ON_DEMAND
-        if( !GetProfiler().IsConnected() ) continue;
+    return true;
+}
+
+bool SysTraceStart( int64_t& samplingPeriod )
+{
+#ifndef CLOCK_MONOTONIC_RAW
+    return false;
 #endif
 
-        auto line = buf;
-        const auto end = buf + rd;
-        for(;;)
+    if( !SetupContextSwitches() ) return false;
+    traceActive.store( true, std::memory_order_relaxed );
+
+    SetupSampling( samplingPeriod );
+
+    return true;
+}
+
+void SysTraceStop()
+{
+    traceActive.store( false, std::memory_order_relaxed );
+    StopSampling();
+}
+
+static uint8_t ConvertSchedState( int64_t state )
+{
+    // Task state bits, in the order the kernel prints them. No bits set means the task was preempted.
+    if( state & 0x01 ) return 104;  // S
+    if( state & 0x02 ) return 101;  // D
+    if( state & 0x04 ) return 105;  // T
+    if( state & 0x08 ) return 106;  // t
+    if( state & 0x10 ) return 108;  // X
+    if( state & 0x20 ) return 109;  // Z
+    if( state & 0x40 ) return 100;  // P
+    if( state & 0x80 ) return 102;  // I
+    return 103;                     // R
+}
+
+// Sample layout: header, time, raw data size, raw data.
+constexpr auto CtxRawOffset = sizeof( perf_event_header ) + sizeof( uint64_t ) + sizeof( uint32_t );
+
+// Skips records other than samples, up to the end position. Returns the time of the next sample, if there is one.
+static bool PeekContextSwitch( RingBuffer<CtxRingBufSize>& ring, uint64_t end, int64_t& time )
+{
+    while( ring.GetTail() < end )
+    {
+        perf_event_header hdr;
+        ring.Read( &hdr, 0, sizeof( perf_event_header ) );
+        if( hdr.type == PERF_RECORD_SAMPLE )
         {
-            auto next = (char*)memchr( line, '\n', end - line );
-            if( !next ) break;
-            HandleTraceLine( line );
-            line = ++next;
+            ring.Read( &time, sizeof( perf_event_header ), sizeof( int64_t ) );
+#if defined TRACY_HW_TIMER && ( defined __i386 || defined _M_IX86 || defined __x86_64__ || defined _M_X64 )
+            time = ring.ConvertTimeToTsc( time );
+#endif
+            return true;
         }
+        ring.Advance( hdr.size );
     }
+    return false;
+}
 
-    tracy_free( buf );
+// Used to order switches with equal timestamps on different CPUs. Returns true if the sample at the
+// tail of the first ring switches out the thread that the sample of the second ring switches in.
+static bool SwitchesOutBefore( RingBuffer<CtxRingBufSize>& out, RingBuffer<CtxRingBufSize>& in )
+{
+    uint16_t type;
+    out.Read( &type, CtxRawOffset, sizeof( uint16_t ) );
+    if( type != s_schedSwitchId ) return false;
+    in.Read( &type, CtxRawOffset, sizeof( uint16_t ) );
+    if( type != s_schedSwitchId ) return false;
+    uint32_t oldPid, newPid;
+    out.Read( &oldPid, CtxRawOffset + s_prevPidOffset, sizeof( uint32_t ) );
+    in.Read( &newPid, CtxRawOffset + s_nextPidOffset, sizeof( uint32_t ) );
+    return oldPid == newPid;
+}
+
+static void SendContextSwitch( int64_t time, uint32_t oldPid, uint32_t newPid, uint8_t cpu, uint8_t state )
+{
+    uint8_t reason = 100;
+
+    TracyLfqPrepare( QueueType::ContextSwitch );
+    MemWrite( &item->contextSwitch.time, time );
+    MemWrite( &item->contextSwitch.oldThread, (uint64_t)oldPid );
+    MemWrite( &item->contextSwitch.newThread, (uint64_t)newPid );
+    MemWrite( &item->contextSwitch.cpu, cpu );
+    MemWrite( &item->contextSwitch.reason, reason );
+    MemWrite( &item->contextSwitch.state, state );
+    TracyLfqCommit;
+}
+
+// TIME is already converted to the profiler clock. RUNNING is the thread last switched to on this CPU,
+// or -1 if not known yet.
+static void HandleContextSwitch( RingBuffer<CtxRingBufSize>& ring, uint8_t cpu, int64_t time, uint32_t& running )
+{
+    constexpr auto raw = CtxRawOffset;
+
+    uint16_t type;
+    ring.Read( &type, raw, sizeof( uint16_t ) );
+
+    if( type == s_schedSwitchId )
+    {
+        uint32_t oldPid, newPid;
+        int64_t state;
+        ring.Read( &oldPid, raw + s_prevPidOffset, sizeof( uint32_t ) );
+        ring.Read( &newPid, raw + s_nextPidOffset, sizeof( uint32_t ) );
+        if( s_prevStateSize == 8 )
+        {
+            ring.Read( &state, raw + s_prevStateOffset, sizeof( int64_t ) );
+        }
+        else
+        {
+            int32_t state32;
+            ring.Read( &state32, raw + s_prevStateOffset, sizeof( int32_t ) );
+            state = state32;
+        }
+
+        // The kernel may drop tracepoint records without reporting it. Bridge the gap, so that the
+        // server still sees each thread switched in before it is switched out.
+        if( running != uint32_t( -1 ) && running != oldPid ) SendContextSwitch( time, running, oldPid, cpu, 100 );
+        running = newPid;
+
+        SendContextSwitch( time, oldPid, newPid, cpu, ConvertSchedState( state ) );
+    }
+    else if( type == s_schedWakeupId )
+    {
+        uint32_t pid;
+        ring.Read( &pid, raw + s_wakeupPidOffset, sizeof( uint32_t ) );
+
+        TracyLfqPrepare( QueueType::ThreadWakeup );
+        MemWrite( &item->threadWakeup.time, time );
+        MemWrite( &item->threadWakeup.thread, (uint64_t)pid );
+        TracyLfqCommit;
+    }
 }
 
 void SysTraceWorker( void* ptr )
 {
     ThreadExitHandler threadExitHandler;
     SetThreadName( "Tracy SysTrace" );
-    char tmp[256];
-    memcpy( tmp, BasePath, sizeof( BasePath ) - 1 );
-    memcpy( tmp + sizeof( BasePath ) - 1, TracePipe, sizeof( TracePipe ) );
-
-    int fd = open( tmp, O_RDONLY );
-    if( fd < 0 ) return;
     sched_param sp = { 5 };
     pthread_setschedparam( pthread_self(), SCHED_FIFO, &sp );
-    ProcessTraceLines( fd );
-    close( fd );
+
+    const auto numCpus = s_numCpus;
+#if defined TRACY_HW_TIMER && ( defined __i386 || defined _M_IX86 || defined __x86_64__ || defined _M_X64 )
+    for( int i=0; i<numCpus; i++ )
+    {
+        if( !s_ctxRing[i].CheckTscCaps() )
+        {
+            FreeContextSwitches( numCpus );
+            const char* err = "Tracy Profiler: context switch capture is disabled due to non-native scheduler clock. Are you running under a VM?";
+            Profiler::MessageAppInfo( err, strlen( err ) );
+            return;
+        }
+    }
+#endif
+    for( int i=0; i<numCpus; i++ )
+    {
+        s_ctxRing[i].Enable();
+        ioctl( s_ctxWakeupFd[i], PERF_EVENT_IOC_ENABLE, 0 );
+    }
+
+    // Each pass merges the records available in the per-CPU rings by time, as the server expects
+    // context switches to arrive in order. Records written to a ring after its head was read may be
+    // older than records already sent from the other rings, so only records up to a time taken before
+    // the heads are read are sent. The rest stay in the rings for the next pass.
+    auto end = (uint64_t*)tracy_malloc( sizeof( uint64_t ) * numCpus );
+    auto time = (int64_t*)tracy_malloc( sizeof( int64_t ) * numCpus );
+    auto running = (uint32_t*)tracy_malloc( sizeof( uint32_t ) * numCpus );
+    memset( running, 0xFF, sizeof( uint32_t ) * numCpus );
+    while( traceActive.load( std::memory_order_relaxed ) )
+    {
+        const auto watermark = Profiler::GetTime();
+        int active = 0;
+        for( int i=0; i<numCpus; i++ )
+        {
+            end[i] = s_ctxRing[i].GetHead();
+            if( PeekContextSwitch( s_ctxRing[i], end[i], time[i] ) && time[i] <= watermark )
+            {
+                active++;
+            }
+            else
+            {
+                time[i] = std::numeric_limits<int64_t>::max();
+            }
+        }
+        if( active == 0 )
+        {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+            continue;
+        }
+
+#ifdef TRACY_ON_DEMAND
+        const bool connected = GetProfiler().IsConnected();
+#endif
+        while( active > 0 )
+        {
+            int sel = 0;
+            for( int i=1; i<numCpus; i++ )
+            {
+                if( time[i] < time[sel] || ( time[i] == time[sel] && time[i] != std::numeric_limits<int64_t>::max() && SwitchesOutBefore( s_ctxRing[i], s_ctxRing[sel] ) ) ) sel = i;
+            }
+            auto& ring = s_ctxRing[sel];
+#ifdef TRACY_ON_DEMAND
+            if( connected )
+#endif
+            {
+                HandleContextSwitch( ring, (uint8_t)sel, time[sel], running[sel] );
+            }
+            perf_event_header hdr;
+            ring.Read( &hdr, 0, sizeof( perf_event_header ) );
+            ring.Advance( hdr.size );
+            if( !PeekContextSwitch( ring, end[sel], time[sel] ) || time[sel] > watermark )
+            {
+                time[sel] = std::numeric_limits<int64_t>::max();
+                active--;
+            }
+        }
+    }
+    tracy_free( running );
+    tracy_free( time );
+    tracy_free( end );
+
+    FreeContextSwitches( numCpus );
 }
 #endif
 
@@ -514,9 +514,9 @@ public:
     ConcurrentQueue& operator=(ConcurrentQueue&& other) = delete;
 
 public:
-    tracy_force_inline T* enqueue_begin(producer_token_t const& token, index_t& currentTailIndex)
+    tracy_force_inline T* enqueue_begin(producer_token_t const& token, index_t& currentTailIndex, size_t count)
     {
-        return static_cast<ExplicitProducer*>(token.producer)->ConcurrentQueue::ExplicitProducer::enqueue_begin(currentTailIndex);
+        return static_cast<ExplicitProducer*>(token.producer)->ConcurrentQueue::ExplicitProducer::enqueue_begin(currentTailIndex, count);
     }
 
 	template<class NotifyThread, class ProcessData>
@@ -759,7 +759,7 @@ private:
 	struct Block
 	{
 		Block()
-			: next(nullptr), elementsCompletelyDequeued(0), freeListRefs(0), freeListNext(nullptr), shouldBeOnFreeList(false), dynamicallyAllocated(true)
+			: next(nullptr), elementsCompletelyDequeued(0), dataEnd(BLOCK_SIZE), freeListRefs(0), freeListNext(nullptr), shouldBeOnFreeList(false), dynamicallyAllocated(true)
 		{
 		}
 
@@ -877,6 +877,7 @@ private:
 		Block* next;
 		std::atomic<size_t> elementsCompletelyDequeued;
 		std::atomic<bool> emptyFlags[BLOCK_SIZE <= EXPLICIT_BLOCK_EMPTY_COUNTER_THRESHOLD ? BLOCK_SIZE : 1];
+		size_t dataEnd;		// Elements past this offset are padding left when an enqueue did not fit in the block
 	public:
 		std::atomic<std::uint32_t> freeListRefs;
 		std::atomic<Block*> freeListNext;
@@ -1059,6 +1060,8 @@ private:
                 ++pr_blockIndexSlotsUsed;
             }
 
+            this->tailBlock->dataEnd = BLOCK_SIZE;
+
             // Add block to block index
             auto& entry = blockIndex.load(std::memory_order_relaxed)->entries[pr_blockIndexFront];
             entry.base = currentTailIndex;
@@ -1067,10 +1070,17 @@ private:
             pr_blockIndexFront = (pr_blockIndexFront + 1) & (pr_blockIndexSize - 1);
         }
 
-        tracy_force_inline T* enqueue_begin(index_t& currentTailIndex)
+        // Reserves count contiguous elements. The reservation never crosses a block boundary;
+        // if it doesn't fit in the current block, the rest of the block is left as padding.
+        tracy_force_inline T* enqueue_begin(index_t& currentTailIndex, size_t count)
         {
             currentTailIndex = this->tailIndex.load(std::memory_order_relaxed);
-            if (details::cqUnlikely((currentTailIndex & static_cast<index_t>(BLOCK_SIZE - 1)) == 0)) {
+            const auto offset = static_cast<size_t>(currentTailIndex & static_cast<index_t>(BLOCK_SIZE - 1));
+            if (details::cqUnlikely(offset == 0 || offset + count > BLOCK_SIZE)) {
+                if (offset != 0) {
+                    this->tailBlock->dataEnd = offset;
+                    currentTailIndex += static_cast<index_t>(BLOCK_SIZE - offset);
+                }
                 this->enqueue_begin_alloc(currentTailIndex);
             }
             return (*this->tailBlock)[currentTailIndex];
@@ -1088,7 +1098,6 @@ private:
 			auto overcommit = this->dequeueOvercommit.load(std::memory_order_relaxed);
 			auto desiredCount = static_cast<size_t>(tail - (this->dequeueOptimisticCount.load(std::memory_order_relaxed) - overcommit));
 			if (details::circular_less_than<size_t>(0, desiredCount)) {
-				desiredCount = desiredCount < 8192 ? desiredCount : 8192;
 				std::atomic_thread_fence(std::memory_order_acquire);
 
 				auto myDequeueCount = this->dequeueOptimisticCount.fetch_add(desiredCount, std::memory_order_relaxed);
@@ -1125,9 +1134,15 @@ private:
 						endIndex = details::circular_less_than<index_t>(firstIndex + static_cast<index_t>(actualCount), endIndex) ? firstIndex + static_cast<index_t>(actualCount) : endIndex;
 						auto block = localBlockIndex->entries[indexIndex].block;
 
-						const auto sz = endIndex - index;
-						processData( (*block)[index], sz );
-						index += sz;
+						// Skip padding at the end of the block, variable size elements never straddle blocks
+						auto dataIndex = endIndex;
+						if ((endIndex & static_cast<index_t>(BLOCK_SIZE - 1)) == 0) {
+							dataIndex = (index & ~static_cast<index_t>(BLOCK_SIZE - 1)) + static_cast<index_t>(block->dataEnd);
+						}
+						if (index != dataIndex) {
+							processData( (*block)[index], static_cast<size_t>(dataIndex - index) );
+						}
+						index = endIndex;
 
 						block->ConcurrentQueue::Block::set_many_empty(firstIndexInBlock, static_cast<size_t>(endIndex - firstIndexInBlock));
 						indexIndex = (indexIndex + 1) & (localBlockIndex->size - 1);
@@ -9,7 +9,7 @@ namespace tracy
 
 constexpr unsigned Lz4CompressBound( unsigned isize ) { return isize + ( isize / 255 ) + 16; }
 
-enum : uint32_t { ProtocolVersion = 46 };
+enum : uint32_t { ProtocolVersion = 53 };
 enum : uint16_t { BroadcastVersion = 2 };
 
 using lz4sz_t = uint32_t;
@@ -31,7 +31,19 @@ enum HandshakeStatus : uint8_t
     HandshakeDropped
 };
 
+// Frame codec requested by the server. Client may fall back to LZ4, if it
+// does not support the requested codec.
+enum TransportCodec : uint8_t
+{
+    TransportCodecNone,
+    TransportCodecLz4,
+    TransportCodecLz4Hc,
+    TransportCodecZstd,
+    NumTransportCodecs
+};
+
 enum { WelcomeMessageProgramNameSize = 64 };
+enum { WelcomeMessageShmNameSize = 32 };
 enum { WelcomeMessageHostInfoSize = 1024 };
 
 #pragma pack( 1 )
@@ -54,7 +66,8 @@ enum ServerQuery : uint8_t
     ServerQueryCodeLocation,
     ServerQuerySourceCode,
     ServerQueryDataTransfer,
-    ServerQueryDataTransferPart
+    ServerQueryDataTransferPart,
+    ServerQueryZoneFilter
 };
 
 struct ServerQueryPacket
@@ -77,6 +90,16 @@ enum CpuArchitecture : uint8_t
 };
 
 
+struct TransportRequestMessage
+{
+    TransportCodec codec;
+    int8_t level;       // 0: codec default
+    uint8_t shm;        // server can map a shared memory ring of a same-host client
+};
+
+enum { TransportRequestMessageSize = sizeof( TransportRequestMessage ) };
+
+
 struct WelcomeMessage
 {
     double timerMul;
@@ -92,6 +115,10 @@ struct WelcomeMessage
     uint8_t isApple;
     uint8_t cpuArch;
     uint8_t codeTransfer;
+    uint8_t codec;
+    int8_t codecLevel;
+    uint64_t shmKey;
+    char shmName[WelcomeMessageShmNameSize];    // empty if frames are sent through the socket
     char cpuManufacturer[12];
     uint32_t cpuId;
     char programName[WelcomeMessageProgramNameSize];
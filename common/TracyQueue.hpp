@@ -1,7 +1,9 @@
 #ifndef __TRACYQUEUE_HPP__
 #define __TRACYQUEUE_HPP__
 
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 namespace tracy
 {
@@ -87,6 +89,9 @@ enum class QueueType : uint8_t
     AckServerQueryNoop,
     AckSourceCodeNotAvailable,
     CpuTopology,
+    CallstackCached,
+    SamplesLost,
+    ZonesDropped,
     SingleStringData,
     SecondStringData,
     MemNamePayload,
@@ -395,6 +400,23 @@ struct QueueMemFree
 struct QueueCallstackFat
 {
     uint64_t ptr;
+    uint32_t id;
+};
+
+struct QueueCallstackCached
+{
+    uint32_t id;
+};
+
+struct QueueSamplesLost
+{
+    uint64_t count;
+};
+
+struct QueueZonesDropped
+{
+    uint64_t srcloc;    // ptr
+    uint32_t count;
 };
 
 struct QueueCallstackAllocFat
@@ -570,6 +592,9 @@ struct QueueItem
         QueuePlotConfig plotConfig;
         QueueParamSetup paramSetup;
         QueueCpuTopology cpuTopology;
+        QueueCallstackCached callstackCached;
+        QueueSamplesLost samplesLost;
+        QueueZonesDropped zonesDropped;
     };
 };
 #pragma pack()
@@ -658,6 +683,113 @@ static constexpr size_t QueueDataSize[] = {
     sizeof( QueueHeader ),                                  // server query acknowledgement
     sizeof( QueueHeader ),                                  // source code not available
     sizeof( QueueHeader ) + sizeof( QueueCpuTopology ),
+    sizeof( QueueHeader ) + sizeof( QueueCallstackCached ),
+    sizeof( QueueHeader ) + sizeof( QueueSamplesLost ),
+    sizeof( QueueHeader ) + sizeof( QueueZonesDropped ),
+    sizeof( QueueHeader ),                                  // single string data
+    sizeof( QueueHeader ),                                  // second string data
+    sizeof( QueueHeader ) + sizeof( QueueMemNamePayload ),
+    // keep all QueueStringTransfer below
+    sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // string data
+    sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // thread name
+    sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // plot name
+    sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // allocated source location payload
+    sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // callstack payload
+    sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // callstack alloc payload
+    sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // frame name
+    sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // frame image data
+    sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // external name
+    sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // external thread name
+    sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // symbol code
+    sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // source code
+};
+
+// Size of an item as stored in the client queues. Items which carry pointers to
+// data transferred separately (strings, callstacks, images) are larger than on the wire.
+static constexpr size_t QueueFatDataSize[] = {
+    sizeof( QueueHeader ) + sizeof( QueueZoneTextFat ),     // zone text
+    sizeof( QueueHeader ) + sizeof( QueueZoneTextFat ),     // zone name
+    sizeof( QueueHeader ) + sizeof( QueueMessageFat ),
+    sizeof( QueueHeader ) + sizeof( QueueMessageColorFat ),
+    sizeof( QueueHeader ) + sizeof( QueueMessageFat ),      // callstack
+    sizeof( QueueHeader ) + sizeof( QueueMessageColorFat ), // callstack
+    sizeof( QueueHeader ) + sizeof( QueueMessageFat ),      // app info
+    sizeof( QueueHeader ) + sizeof( QueueZoneBegin ),       // allocated source location
+    sizeof( QueueHeader ) + sizeof( QueueZoneBegin ),       // allocated source location, callstack
+    sizeof( QueueHeader ) + sizeof( QueueCallstackFat ),    // callstack memory
+    sizeof( QueueHeader ) + sizeof( QueueCallstackFat ),    // callstack
+    sizeof( QueueHeader ) + sizeof( QueueCallstackAllocFat ),// callstack alloc
+    sizeof( QueueHeader ) + sizeof( QueueCallstackSampleFat ),
+    sizeof( QueueHeader ) + sizeof( QueueFrameImageFat ),
+    sizeof( QueueHeader ) + sizeof( QueueZoneBegin ),
+    sizeof( QueueHeader ) + sizeof( QueueZoneBegin ),       // callstack
+    sizeof( QueueHeader ) + sizeof( QueueZoneEnd ),
+    sizeof( QueueHeader ) + sizeof( QueueLockWait ),
+    sizeof( QueueHeader ) + sizeof( QueueLockObtain ),
+    sizeof( QueueHeader ) + sizeof( QueueLockRelease ),
+    sizeof( QueueHeader ) + sizeof( QueueLockWait ),        // shared
+    sizeof( QueueHeader ) + sizeof( QueueLockObtain ),      // shared
+    sizeof( QueueHeader ) + sizeof( QueueLockRelease ),     // shared
+    sizeof( QueueHeader ) + sizeof( QueueLockNameFat ),
+    sizeof( QueueHeader ) + sizeof( QueueMemAlloc ),
+    sizeof( QueueHeader ) + sizeof( QueueMemAlloc ),        // named
+    sizeof( QueueHeader ) + sizeof( QueueMemFree ),
+    sizeof( QueueHeader ) + sizeof( QueueMemFree ),         // named
+    sizeof( QueueHeader ) + sizeof( QueueMemAlloc ),        // callstack
+    sizeof( QueueHeader ) + sizeof( QueueMemAlloc ),        // callstack, named
+    sizeof( QueueHeader ) + sizeof( QueueMemFree ),         // callstack
+    sizeof( QueueHeader ) + sizeof( QueueMemFree ),         // callstack, named
+    sizeof( QueueHeader ) + sizeof( QueueGpuZoneBegin ),
+    sizeof( QueueHeader ) + sizeof( QueueGpuZoneBegin ),    // callstack
+    sizeof( QueueHeader ) + sizeof( QueueGpuZoneBegin ),    // allocated source location
+    sizeof( QueueHeader ) + sizeof( QueueGpuZoneBegin ),    // allocated source location, callstack
+    sizeof( QueueHeader ) + sizeof( QueueGpuZoneEnd ),
+    sizeof( QueueHeader ) + sizeof( QueueGpuZoneBegin ),    // serial
+    sizeof( QueueHeader ) + sizeof( QueueGpuZoneBegin ),    // serial, callstack
+    sizeof( QueueHeader ) + sizeof( QueueGpuZoneBegin ),    // serial, allocated source location
+    sizeof( QueueHeader ) + sizeof( QueueGpuZoneBegin ),    // serial, allocated source location, callstack
+    sizeof( QueueHeader ) + sizeof( QueueGpuZoneEnd ),      // serial
+    sizeof( QueueHeader ) + sizeof( QueuePlotData ),
+    sizeof( QueueHeader ) + sizeof( QueueContextSwitch ),
+    sizeof( QueueHeader ) + sizeof( QueueThreadWakeup ),
+    sizeof( QueueHeader ) + sizeof( QueueGpuTime ),
+    sizeof( QueueHeader ) + sizeof( QueueGpuContextNameFat ),
+    // above items must be first
+    sizeof( QueueHeader ),                                  // terminate
+    sizeof( QueueHeader ),                                  // keep alive
+    sizeof( QueueHeader ) + sizeof( QueueThreadContext ),
+    sizeof( QueueHeader ) + sizeof( QueueGpuCalibration ),
+    sizeof( QueueHeader ),                                  // crash
+    sizeof( QueueHeader ) + sizeof( QueueCrashReport ),
+    sizeof( QueueHeader ) + sizeof( QueueZoneValidation ),
+    sizeof( QueueHeader ) + sizeof( QueueZoneColor ),
+    sizeof( QueueHeader ) + sizeof( QueueZoneValue ),
+    sizeof( QueueHeader ) + sizeof( QueueFrameMark ),       // continuous frames
+    sizeof( QueueHeader ) + sizeof( QueueFrameMark ),       // start
+    sizeof( QueueHeader ) + sizeof( QueueFrameMark ),       // end
+    sizeof( QueueHeader ) + sizeof( QueueSourceLocation ),
+    sizeof( QueueHeader ) + sizeof( QueueLockAnnounce ),
+    sizeof( QueueHeader ) + sizeof( QueueLockTerminate ),
+    sizeof( QueueHeader ) + sizeof( QueueLockMark ),
+    sizeof( QueueHeader ) + sizeof( QueueMessageLiteral ),
+    sizeof( QueueHeader ) + sizeof( QueueMessageColorLiteral ),
+    sizeof( QueueHeader ) + sizeof( QueueMessageLiteral ),  // callstack
+    sizeof( QueueHeader ) + sizeof( QueueMessageColorLiteral ), // callstack
+    sizeof( QueueHeader ) + sizeof( QueueGpuNewContext ),
+    sizeof( QueueHeader ) + sizeof( QueueCallstackFrameSize ),
+    sizeof( QueueHeader ) + sizeof( QueueCallstackFrame ),
+    sizeof( QueueHeader ) + sizeof( QueueSymbolInformation ),
+    sizeof( QueueHeader ) + sizeof( QueueCodeInformation ),
+    sizeof( QueueHeader ) + sizeof( QueueSysTime ),
+    sizeof( QueueHeader ) + sizeof( QueueTidToPid ),
+    sizeof( QueueHeader ) + sizeof( QueuePlotConfig ),
+    sizeof( QueueHeader ) + sizeof( QueueParamSetup ),
+    sizeof( QueueHeader ),                                  // server query acknowledgement
+    sizeof( QueueHeader ),                                  // source code not available
+    sizeof( QueueHeader ) + sizeof( QueueCpuTopology ),
+    sizeof( QueueHeader ) + sizeof( QueueCallstackCached ),
+    sizeof( QueueHeader ) + sizeof( QueueSamplesLost ),
+    sizeof( QueueHeader ) + sizeof( QueueZonesDropped ),
     sizeof( QueueHeader ),                                  // single string data
     sizeof( QueueHeader ),                                  // second string data
     sizeof( QueueHeader ) + sizeof( QueueMemNamePayload ),
@@ -676,8 +808,82 @@ static constexpr size_t QueueDataSize[] = {
     sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // source code
 };
 
+// Timestamps of the most frequent events are transferred as zigzag varint deltas
+// instead of full int64_t fields. Returns offset of the timestamp within the wire
+// item, or 0 if the item is transferred verbatim.
+static inline size_t QueueDeltaTimeOffset( uint8_t idx )
+{
+    switch( (QueueType)idx )
+    {
+    case QueueType::ZoneBeginAllocSrcLoc:
+    case QueueType::ZoneBeginAllocSrcLocCallstack:
+    case QueueType::ZoneBegin:
+    case QueueType::ZoneBeginCallstack:
+        return sizeof( QueueHeader ) + offsetof( QueueZoneBeginLean, time );
+    case QueueType::ZoneEnd:
+        return sizeof( QueueHeader ) + offsetof( QueueZoneEnd, time );
+    case QueueType::LockWait:
+    case QueueType::LockSharedWait:
+        return sizeof( QueueHeader ) + offsetof( QueueLockWait, time );
+    case QueueType::LockObtain:
+    case QueueType::LockSharedObtain:
+        return sizeof( QueueHeader ) + offsetof( QueueLockObtain, time );
+    case QueueType::LockRelease:
+    case QueueType::LockSharedRelease:
+        return sizeof( QueueHeader ) + offsetof( QueueLockRelease, time );
+    case QueueType::PlotData:
+        return sizeof( QueueHeader ) + offsetof( QueuePlotData, time );
+    default:
+        return 0;
+    }
+}
+
+enum { QueueDeltaTimeMaxGrowth = 2 };   // 10 byte varint in place of 8 byte field
+
+// Writes item of wire size sz with the timestamp at toff varint encoded. Returns number of bytes written.
+static inline size_t QueueEncodeDeltaTime( char* dst, const char* src, size_t sz, size_t toff )
+{
+    memcpy( dst, src, toff );
+    auto out = dst + toff;
+    int64_t dt;
+    memcpy( &dt, src + toff, sizeof( dt ) );
+    uint64_t v = ( uint64_t( dt ) << 1 ) ^ uint64_t( dt >> 63 );
+    while( v >= 0x80 )
+    {
+        *out++ = char( v | 0x80 );
+        v >>= 7;
+    }
+    *out++ = char( v );
+    const auto tail = sz - toff - sizeof( dt );
+    memcpy( out, src + toff + sizeof( dt ), tail );
+    return size_t( out - dst ) + tail;
+}
+
+// Reconstructs item of wire size sz from its encoded form. Returns number of bytes consumed.
+static inline size_t QueueDecodeDeltaTime( char* dst, const char* src, size_t sz, size_t toff )
+{
+    memcpy( dst, src, toff );
+    auto in = (const uint8_t*)src + toff;
+    uint64_t v = 0;
+    int shift = 0;
+    uint8_t b;
+    do
+    {
+        b = *in++;
+        v |= uint64_t( b & 0x7F ) << shift;
+        shift += 7;
+    }
+    while( b & 0x80 );
+    const int64_t dt = int64_t( v >> 1 ) ^ -int64_t( v & 1 );
+    memcpy( dst + toff, &dt, sizeof( dt ) );
+    const auto tail = sz - toff - sizeof( dt );
+    memcpy( dst + toff + sizeof( dt ), in, tail );
+    return size_t( (const char*)in - src ) + tail;
+}
+
 static_assert( QueueItemSize == 32, "Queue item size not 32 bytes" );
 static_assert( sizeof( QueueDataSize ) / sizeof( size_t ) == (uint8_t)QueueType::NUM_TYPES, "QueueDataSize mismatch" );
+static_assert( sizeof( QueueFatDataSize ) / sizeof( size_t ) == (uint8_t)QueueType::NUM_TYPES, "QueueFatDataSize mismatch" );
 static_assert( sizeof( void* ) <= sizeof( uint64_t ), "Pointer size > 8 bytes" );
 static_assert( sizeof( void* ) == sizeof( uintptr_t ), "Pointer size != uintptr_t" );
 
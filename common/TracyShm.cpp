@@ -0,0 +1,327 @@
+#include "TracyShm.hpp"
+
+#ifdef TRACY_HAS_SHM
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <new>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+namespace tracy
+{
+
+enum { ShmHeaderSize = 4096 };
+enum : uint32_t { ShmMagic = 0x68537254 };     // 'TrSh'
+enum : uint32_t { ShmWrapMarker = 0xFFFFFFFF };
+
+struct ShmRing::Header
+{
+    uint32_t magic;
+    uint32_t size;
+    uint64_t key;
+    uint32_t clientPid;
+    uint32_t serverPid;
+    std::atomic<uint32_t> closed;
+
+    // Written by the producer.
+    alignas( 64 ) std::atomic<uint64_t> head;
+    std::atomic<uint32_t> dataSeq;
+    std::atomic<uint32_t> dataWait;
+
+    // Written by the consumer.
+    alignas( 64 ) std::atomic<uint64_t> tail;
+    std::atomic<uint32_t> spaceSeq;
+    std::atomic<uint32_t> spaceWait;
+};
+
+static_assert( sizeof( std::atomic<uint64_t> ) == sizeof( uint64_t ), "Shared memory atomics must be lock-free" );
+static_assert( sizeof( std::atomic<uint32_t> ) == sizeof( uint32_t ), "Shared memory atomics must be lock-free" );
+
+static inline uint64_t ShmAlign( uint64_t size )
+{
+    return ( size + 7 ) & ~uint64_t( 7 );
+}
+
+// The futex words live in memory shared between processes, so the private futex operations can't be used.
+static void FutexWait( std::atomic<uint32_t>* addr, uint32_t val, int timeout )
+{
+    struct timespec ts;
+    ts.tv_sec = timeout / 1000;
+    ts.tv_nsec = ( timeout % 1000 ) * 1000000;
+    syscall( SYS_futex, (uint32_t*)addr, FUTEX_WAIT, val, &ts, nullptr, 0 );
+}
+
+static void FutexWake( std::atomic<uint32_t>* addr )
+{
+    syscall( SYS_futex, (uint32_t*)addr, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0 );
+}
+
+ShmRing::ShmRing()
+    : m_hdr( nullptr )
+    , m_data( nullptr )
+    , m_mapSize( 0 )
+    , m_size( 0 )
+    , m_peerPid( 0 )
+    , m_head( 0 )
+    , m_lastTail( 0 )
+    , m_readPos( 0 )
+{
+    m_path[0] = '\0';
+}
+
+ShmRing::~ShmRing()
+{
+    Close();
+}
+
+uint64_t ShmRing::RandomKey()
+{
+    uint64_t key = 0;
+#ifdef SYS_getrandom
+    if( syscall( SYS_getrandom, &key, sizeof( key ), 0 ) == sizeof( key ) ) return key;
+#endif
+    const auto fd = open( "/dev/urandom", O_RDONLY | O_CLOEXEC );
+    if( fd >= 0 )
+    {
+        const auto rd = read( fd, &key, sizeof( key ) );
+        close( fd );
+        if( rd == sizeof( key ) ) return key;
+    }
+    // Neither source is available (old kernel in a chroot), fall back to a weak key.
+    timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ( uint64_t( ts.tv_sec ) * 1000000000ull + ts.tv_nsec ) ^ ( uint64_t( getpid() ) << 32 );
+}
+
+bool ShmRing::Create( char* name, size_t nameSize, uint32_t size, uint64_t key )
+{
+    static_assert( sizeof( Header ) <= ShmHeaderSize, "Shared memory header too big" );
+    assert( !m_hdr );
+    assert( ( size & ( size - 1 ) ) == 0 );
+
+    static std::atomic<uint32_t> counter( 0 );
+    snprintf( name, nameSize, "tracy-%u-%u", (unsigned)getpid(), counter.fetch_add( 1, std::memory_order_relaxed ) );
+    snprintf( m_path, sizeof( m_path ), "/dev/shm/%s", name );
+
+    // A leftover segment with this name can only come from a dead process with the same pid.
+    unlink( m_path );
+    const auto fd = open( m_path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600 );
+    if( fd < 0 )
+    {
+        m_path[0] = '\0';
+        return false;
+    }
+    const auto mapSize = size_t( ShmHeaderSize ) + size;
+    // Pages of a sparse tmpfs file may fail to materialize on write, which would be a SIGBUS.
+    void* ptr = MAP_FAILED;
+    if( posix_fallocate( fd, 0, mapSize ) == 0 )
+    {
+        ptr = mmap( nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    }
+    close( fd );
+    if( ptr == MAP_FAILED )
+    {
+        Unlink();
+        return false;
+    }
+
+    m_hdr = new( ptr ) Header;
+    m_hdr->magic = ShmMagic;
+    m_hdr->size = size;
+    m_hdr->key = key;
+    m_hdr->clientPid = (uint32_t)getpid();
+    m_hdr->serverPid = 0;
+    m_hdr->closed.store( 0, std::memory_order_relaxed );
+    m_hdr->head.store( 0, std::memory_order_relaxed );
+    m_hdr->dataSeq.store( 0, std::memory_order_relaxed );
+    m_hdr->dataWait.store( 0, std::memory_order_relaxed );
+    m_hdr->tail.store( 0, std::memory_order_relaxed );
+    m_hdr->spaceSeq.store( 0, std::memory_order_relaxed );
+    m_hdr->spaceWait.store( 0, std::memory_order_relaxed );
+
+    m_data = (char*)ptr + ShmHeaderSize;
+    m_mapSize = mapSize;
+    m_size = size;
+    m_head = 0;
+    m_lastTail = 0;
+    m_readPos = 0;
+    return true;
+}
+
+bool ShmRing::Open( const char* name, uint64_t key )
+{
+    assert( !m_hdr );
+
+    // The name comes from the client, don't let it point anywhere else.
+    if( strncmp( name, "tracy-", 6 ) != 0 || strchr( name, '/' ) ) return false;
+    char path[sizeof( m_path )];
+    snprintf( path, sizeof( path ), "/dev/shm/%s", name );
+
+    const auto fd = open( path, O_RDWR | O_CLOEXEC );
+    if( fd < 0 ) return false;
+    struct stat st;
+    if( fstat( fd, &st ) != 0 || st.st_size < ShmHeaderSize )
+    {
+        close( fd );
+        return false;
+    }
+    const auto mapSize = size_t( st.st_size );
+    auto ptr = mmap( nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    close( fd );
+    if( ptr == MAP_FAILED ) return false;
+
+    auto hdr = (Header*)ptr;
+    const auto size = hdr->size;
+    if( hdr->magic != ShmMagic || hdr->key != key || size == 0 || ( size & ( size - 1 ) ) != 0 || size > mapSize - ShmHeaderSize )
+    {
+        munmap( ptr, mapSize );
+        return false;
+    }
+    unlink( path );
+
+    hdr->serverPid = (uint32_t)getpid();
+    m_hdr = hdr;
+    m_data = (char*)ptr + ShmHeaderSize;
+    m_mapSize = mapSize;
+    m_size = size;
+    m_peerPid = hdr->clientPid;
+    m_readPos = hdr->tail.load( std::memory_order_acquire );
+    return true;
+}
+
+void ShmRing::Unlink()
+{
+    if( m_path[0] == '\0' ) return;
+    unlink( m_path );
+    m_path[0] = '\0';
+}
+
+void ShmRing::Close()
+{
+    Unlink();
+    if( !m_hdr ) return;
+    munmap( m_hdr, m_mapSize );
+    m_hdr = nullptr;
+    m_data = nullptr;
+    m_peerPid = 0;
+}
+
+void ShmRing::Shutdown()
+{
+    m_hdr->closed.store( 1, std::memory_order_seq_cst );
+    m_hdr->dataSeq.fetch_add( 1, std::memory_order_release );
+    m_hdr->spaceSeq.fetch_add( 1, std::memory_order_release );
+    FutexWake( &m_hdr->dataSeq );
+    FutexWake( &m_hdr->spaceSeq );
+}
+
+bool ShmRing::IsPeerAlive() const
+{
+    if( m_hdr->closed.load( std::memory_order_acquire ) != 0 ) return false;
+    // Catches the other side crashing without closing the ring.
+    if( m_peerPid == 0 ) return true;
+    return kill( (pid_t)m_peerPid, 0 ) == 0 || errno != ESRCH;
+}
+
+char* ShmRing::Reserve( uint32_t maxSize )
+{
+    const auto need = ShmAlign( sizeof( uint32_t ) + maxSize );
+    assert( need <= m_size / 2 );
+    const auto off = m_head & ( m_size - 1 );
+    const auto skip = off + need > m_size ? m_size - off : 0;
+    m_lastTail = m_hdr->tail.load( std::memory_order_acquire );
+    if( m_head + skip + need - m_lastTail > m_size ) return nullptr;
+    if( skip != 0 )
+    {
+        // Frames are 8 byte aligned, so there is always room for the marker.
+        const uint32_t marker = ShmWrapMarker;
+        memcpy( m_data + off, &marker, sizeof( marker ) );
+        m_head += skip;
+    }
+    if( m_peerPid == 0 ) m_peerPid = m_hdr->serverPid;
+    return m_data + ( m_head & ( m_size - 1 ) ) + sizeof( uint32_t );
+}
+
+void ShmRing::Commit( uint32_t size )
+{
+    memcpy( m_data + ( m_head & ( m_size - 1 ) ), &size, sizeof( size ) );
+    m_head += ShmAlign( sizeof( uint32_t ) + size );
+    m_hdr->head.store( m_head, std::memory_order_seq_cst );
+    if( m_hdr->dataWait.load( std::memory_order_seq_cst ) != 0 )
+    {
+        m_hdr->dataSeq.fetch_add( 1, std::memory_order_release );
+        FutexWake( &m_hdr->dataSeq );
+    }
+}
+
+void ShmRing::WaitSpace( int timeout )
+{
+    const auto seq = m_hdr->spaceSeq.load( std::memory_order_acquire );
+    m_hdr->spaceWait.store( 1, std::memory_order_seq_cst );
+    if( m_hdr->tail.load( std::memory_order_seq_cst ) == m_lastTail && m_hdr->closed.load( std::memory_order_relaxed ) == 0 )
+    {
+        FutexWait( &m_hdr->spaceSeq, seq, timeout );
+    }
+    m_hdr->spaceWait.store( 0, std::memory_order_relaxed );
+}
+
+const char* ShmRing::Read( uint32_t& size )
+{
+    for(;;)
+    {
+        const auto head = m_hdr->head.load( std::memory_order_acquire );
+        if( head == m_readPos ) return nullptr;
+        const auto off = m_readPos & ( m_size - 1 );
+        uint32_t sz;
+        memcpy( &sz, m_data + off, sizeof( sz ) );
+        if( sz == ShmWrapMarker )
+        {
+            m_readPos += m_size - off;
+            continue;
+        }
+        const auto need = ShmAlign( sizeof( uint32_t ) + sz );
+        if( off + need > m_size || head - m_readPos < need || head - m_readPos > m_size )
+        {
+            Shutdown();
+            return nullptr;
+        }
+        m_readPos += need;
+        size = sz;
+        return m_data + off + sizeof( uint32_t );
+    }
+}
+
+void ShmRing::Release( uint64_t pos )
+{
+    m_hdr->tail.store( pos, std::memory_order_seq_cst );
+    if( m_hdr->spaceWait.load( std::memory_order_seq_cst ) != 0 )
+    {
+        m_hdr->spaceSeq.fetch_add( 1, std::memory_order_release );
+        FutexWake( &m_hdr->spaceSeq );
+    }
+}
+
+void ShmRing::WaitData( int timeout )
+{
+    const auto seq = m_hdr->dataSeq.load( std::memory_order_acquire );
+    m_hdr->dataWait.store( 1, std::memory_order_seq_cst );
+    if( m_hdr->head.load( std::memory_order_seq_cst ) == m_readPos && m_hdr->closed.load( std::memory_order_relaxed ) == 0 )
+    {
+        FutexWait( &m_hdr->dataSeq, seq, timeout );
+    }
+    m_hdr->dataWait.store( 0, std::memory_order_relaxed );
+}
+
+}
+
+#endif
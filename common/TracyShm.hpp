@@ -0,0 +1,79 @@
+#ifndef __TRACYSHM_HPP__
+#define __TRACYSHM_HPP__
+
+#if defined __linux__ && !defined __ANDROID__ && !defined TRACY_NO_SHM
+#  define TRACY_HAS_SHM
+#endif
+
+#ifdef TRACY_HAS_SHM
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace tracy
+{
+
+enum { ShmRingSize = 16 * 1024 * 1024 };
+
+// Single producer, single consumer ring of transport frames, shared between a client and a
+// server running on the same host. Each frame is stored as a 32-bit size followed by the
+// payload. Positions only grow, the ring index is position modulo ring size.
+class ShmRing
+{
+public:
+    ShmRing();
+    ~ShmRing();
+
+    // Client side. The key is stored in the segment header and sent to the server through the
+    // socket, so that it can tell it has mapped the segment of its own connection.
+    static uint64_t RandomKey();
+    // Client side. Fills name with the segment name to be passed to the server.
+    bool Create( char* name, size_t nameSize, uint32_t size, uint64_t key );
+    // Server side. The segment name is unlinked once it is mapped.
+    bool Open( const char* name, uint64_t key );
+    void Unlink();
+    void Close();
+    bool IsValid() const { return m_hdr != nullptr; }
+
+    // Marks the ring as closed and wakes the other side.
+    void Shutdown();
+    bool IsPeerAlive() const;
+
+    // Producer. Reserve returns space for a frame of at most maxSize bytes, or nullptr if the
+    // ring is full.
+    char* Reserve( uint32_t maxSize );
+    void Commit( uint32_t size );
+    void WaitSpace( int timeout );
+
+    // Consumer. Read returns the next frame, or nullptr if there is none. Frame memory stays
+    // valid until the read position past it is released.
+    const char* Read( uint32_t& size );
+    uint64_t GetReadPos() const { return m_readPos; }
+    void Release( uint64_t pos );
+    void WaitData( int timeout );
+
+    ShmRing( const ShmRing& ) = delete;
+    ShmRing( ShmRing&& ) = delete;
+    ShmRing& operator=( const ShmRing& ) = delete;
+    ShmRing& operator=( ShmRing&& ) = delete;
+
+private:
+    struct Header;
+
+    Header* m_hdr;
+    char* m_data;
+    size_t m_mapSize;
+    uint32_t m_size;
+    uint32_t m_peerPid;
+    uint64_t m_head;
+    uint64_t m_lastTail;
+    uint64_t m_readPos;
+    char m_path[64];
+};
+
+}
+
+#endif
+
+#endif
@@ -29,6 +29,7 @@ void print_usage_exit(int e)
     fprintf(stderr, "  -c, --case        Case sensitive filtering\n");
     fprintf(stderr, "  -e, --self        Get self times\n");
     fprintf(stderr, "  -u, --unwrap      Report each zone event\n");
+    fprintf(stderr, "  -m, --paged dir   Page trace data out to scratch files in dir\n");
 
     exit(e);
 }
@@ -37,6 +38,7 @@ struct Args {
     const char* filter;
     const char* separator;
     const char* trace_file;
+    const char* paged_dir;
     bool case_sensitive;
     bool self_time;
     bool unwrap;
@@ -49,7 +51,7 @@ Args parse_args(int argc, char** argv)
         print_usage_exit(1);
     }
 
-    Args args = { "", ",", "", false, false, false };
+    Args args = { "", ",", "", nullptr, false, false, false };
 
     struct option long_opts[] = {
         { "help", no_argument, NULL, 'h' },
@@ -58,11 +60,12 @@ Args parse_args(int argc, char** argv)
         { "case", no_argument, NULL, 'c' },
         { "self", no_argument, NULL, 'e' },
         { "unwrap", no_argument, NULL, 'u' },
+        { "paged", required_argument, NULL, 'm' },
         { NULL, 0, NULL, 0 }
     };
 
     int c;
-    while ((c = getopt_long(argc, argv, "hf:s:ceu", long_opts, NULL)) != -1)
+    while ((c = getopt_long(argc, argv, "hf:s:ceum:", long_opts, NULL)) != -1)
     {
         switch (c)
         {
@@ -84,6 +87,9 @@ Args parse_args(int argc, char** argv)
         case 'u':
             args.unwrap = true;
             break;
+        case 'm':
+            args.paged_dir = optarg;
+            break;
         default:
             print_usage_exit(1);
             break;
@@ -196,9 +202,11 @@ int main(int argc, char** argv)
         return 1;
     }
 
-    auto worker = tracy::Worker(*f);
+    auto worker = tracy::Worker(*f, tracy::EventType::None, true, args.paged_dir);
 
-    while (!worker.AreSourceLocationZonesReady())
+    // Saved statistics are available right after loading, listing the zones has to wait until
+    // the zone lists are built.
+    while (args.unwrap ? !worker.AreSourceLocationZonesReady() : !worker.AreSourceLocationStatsReady())
     {
         std::this_thread::sleep_for(std::chrono::milliseconds(10));
     }
@@ -284,10 +292,10 @@ int main(int argc, char** argv)
             values[3] = std::to_string(time);
             values[4] = std::to_string(100. * time / last_time);
 
-            values[5] = std::to_string(zone_data.zones.size());
+            values[5] = std::to_string(zone_data.count);
 
             const auto avg = (args.self_time ? zone_data.selfTotal : zone_data.total)
-                / zone_data.zones.size();
+                / zone_data.count;
             values[6] = std::to_string(avg);
 
             const auto tmin = args.self_time ? zone_data.selfMin : zone_data.min;
@@ -295,7 +303,7 @@ int main(int argc, char** argv)
             values[7] = std::to_string(tmin);
             values[8] = std::to_string(tmax);
 
-            const auto sz = zone_data.zones.size();
+            const auto sz = zone_data.count;
             const auto ss = zone_data.sumSq
                 - 2. * zone_data.total * avg
                 + avg * avg * sz;
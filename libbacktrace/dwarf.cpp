@@ -650,6 +650,12 @@ struct unit
   int is_dwarf64;
   /* Address size.  */
   int addrsize;
+  /* Offset of the abbreviations in .debug_abbrev.  */
+  uint64_t abbrev_offset;
+  /* Whether the abbreviations and the attributes of the compilation
+     unit DIE below have been read: 1 if they have, 0 if this was
+     deferred to unit_load, -1 if reading them failed.  */
+  int loaded;
   /* Offset into line number information.  */
   off_t lineoff;
   /* Offset of compilation unit in .debug_str_offsets.  */
@@ -2267,8 +2273,9 @@ add_ranges (struct backtrace_state *state,
 }
 
 /* Find the address range covered by a compilation unit, reading from
-   UNIT_BUF and adding values to U.  Returns 1 if all data could be
-   read, 0 if there is some error.  */
+   UNIT_BUF and adding values to U.  If ADDRS is NULL only the
+   attributes of the compilation unit DIE are read.  Returns 1 if all
+   data could be read, 0 if there is some error.  */
 
 static int
 find_address_ranges (struct backtrace_state *state, uintptr_t base_address,
@@ -2384,6 +2391,9 @@ find_address_ranges (struct backtrace_state *state, uintptr_t base_address,
 	    return 0;
 	}
 
+      if (addrs == NULL)
+	return 1;
+
       if (abbrev->tag == DW_TAG_compile_unit
 	  || abbrev->tag == DW_TAG_subprogram)
 	{
@@ -2413,6 +2423,189 @@ find_address_ranges (struct backtrace_state *state, uintptr_t base_address,
   return 1;
 }
 
+/* Read the abbreviations and the compilation unit DIE of U, if
+   build_address_map deferred that.  Returns 1 on success, 0 on
+   failure.  */
+
+static int
+unit_load (struct backtrace_state *state, struct dwarf_data *ddata,
+	   struct unit *u, backtrace_error_callback error_callback,
+	   void *data)
+{
+  struct dwarf_buf unit_buf;
+
+  if (u->loaded != 0)
+    return u->loaded > 0;
+
+  u->loaded = -1;
+
+  if (!read_abbrevs (state, u->abbrev_offset,
+		     ddata->dwarf_sections.data[DEBUG_ABBREV],
+		     ddata->dwarf_sections.size[DEBUG_ABBREV],
+		     ddata->is_bigendian, error_callback, data, &u->abbrevs))
+    return 0;
+
+  unit_buf.name = ".debug_info";
+  unit_buf.start = ddata->dwarf_sections.data[DEBUG_INFO];
+  unit_buf.buf = u->unit_data;
+  unit_buf.left = u->unit_data_len;
+  unit_buf.is_bigendian = ddata->is_bigendian;
+  unit_buf.error_callback = error_callback;
+  unit_buf.data = data;
+  unit_buf.reported_underflow = 0;
+
+  if (!find_address_ranges (state, ddata->base_address, &unit_buf,
+			    &ddata->dwarf_sections, ddata->is_bigendian,
+			    ddata->altlink, error_callback, data, u, NULL,
+			    NULL)
+      || unit_buf.reported_underflow)
+    return 0;
+
+  u->loaded = 1;
+  return 1;
+}
+
+/* An address range read from .debug_aranges, along with the offset
+   of the compilation unit that covers it.  */
+
+struct arange
+{
+  uint64_t info_offset;
+  uint64_t low;
+  uint64_t high;
+};
+
+/* A growable vector of .debug_aranges entries.  */
+
+struct arange_vector
+{
+  /* Memory.  This is an array of struct arange.  */
+  struct backtrace_vector vec;
+  /* Number of address ranges present.  */
+  size_t count;
+};
+
+/* Compare aranges for qsort, by unit offset and then by address.  */
+
+static int
+arange_compare (const void *v1, const void *v2)
+{
+  const struct arange *a1 = (const struct arange *) v1;
+  const struct arange *a2 = (const struct arange *) v2;
+
+  if (a1->info_offset < a2->info_offset)
+    return -1;
+  if (a1->info_offset > a2->info_offset)
+    return 1;
+  if (a1->low < a2->low)
+    return -1;
+  if (a1->low > a2->low)
+    return 1;
+  return 0;
+}
+
+/* Read the .debug_aranges section into ARANGES, sorted by unit
+   offset.  Returns 1 on success, 0 if the section is missing or can't
+   be used, in which case ARANGES is left empty.  */
+
+static int
+read_aranges (struct backtrace_state *state,
+	      const struct dwarf_sections *dwarf_sections,
+	      int is_bigendian, backtrace_error_callback error_callback,
+	      void *data, struct arange_vector *aranges)
+{
+  struct dwarf_buf buf;
+
+  memset (&aranges->vec, 0, sizeof aranges->vec);
+  aranges->count = 0;
+
+  if (dwarf_sections->size[DEBUG_ARANGES] == 0)
+    return 0;
+
+  buf.name = ".debug_aranges";
+  buf.start = dwarf_sections->data[DEBUG_ARANGES];
+  buf.buf = buf.start;
+  buf.left = dwarf_sections->size[DEBUG_ARANGES];
+  buf.is_bigendian = is_bigendian;
+  buf.error_callback = error_callback;
+  buf.data = data;
+  buf.reported_underflow = 0;
+
+  while (buf.left > 0)
+    {
+      const unsigned char *set_start;
+      uint64_t len;
+      int is_dwarf64;
+      struct dwarf_buf set_buf;
+      uint64_t info_offset;
+      int addrsize;
+      size_t align;
+
+      set_start = buf.buf;
+      len = read_initial_length (&buf, &is_dwarf64);
+      set_buf = buf;
+      set_buf.left = len;
+
+      if (!advance (&buf, len))
+	goto fail;
+
+      if (read_uint16 (&set_buf) != 2)
+	goto fail;
+      info_offset = read_offset (&set_buf, is_dwarf64);
+      addrsize = read_byte (&set_buf);
+      if (read_byte (&set_buf) != 0)
+	{
+	  /* Segmented addresses are not supported.  */
+	  goto fail;
+	}
+      if (addrsize != 4 && addrsize != 8)
+	goto fail;
+
+      /* The tuples are aligned to twice the address size, counting
+	 from the start of the set.  */
+      align = (size_t) (set_buf.buf - set_start) % (2 * addrsize);
+      if (align != 0 && !advance (&set_buf, 2 * addrsize - align))
+	goto fail;
+
+      while (set_buf.left > 0)
+	{
+	  uint64_t low;
+	  uint64_t length;
+	  struct arange *pa;
+
+	  low = read_address (&set_buf, addrsize);
+	  length = read_address (&set_buf, addrsize);
+	  if (set_buf.reported_underflow)
+	    goto fail;
+	  if (low == 0 && length == 0)
+	    break;
+	  if (length == 0)
+	    continue;
+
+	  pa = ((struct arange *)
+		backtrace_vector_grow (state, sizeof (struct arange),
+				       error_callback, data, &aranges->vec));
+	  if (pa == NULL)
+	    goto fail;
+	  pa->info_offset = info_offset;
+	  pa->low = low;
+	  pa->high = low + length;
+	  ++aranges->count;
+	}
+    }
+  if (buf.reported_underflow)
+    goto fail;
+
+  backtrace_qsort (aranges->vec.base, aranges->count, sizeof (struct arange),
+		   arange_compare);
+  return 1;
+
+ fail:
+  backtrace_vector_free (state, &aranges->vec, error_callback, data);
+  aranges->count = 0;
+  return 0;
+}
+
 /* Build a mapping from address ranges to the compilation units where
    the line number information for that range can be found.  Returns 1
    on success, 0 on failure.  */
@@ -2432,15 +2625,27 @@ build_address_map (struct backtrace_state *state, uintptr_t base_address,
   struct unit **pu;
   size_t unit_offset = 0;
   struct unit_addrs *pa;
+  struct arange_vector aranges;
+  const struct arange *ar;
+  size_t arange_pos;
 
   memset (&addrs->vec, 0, sizeof addrs->vec);
   memset (&unit_vec->vec, 0, sizeof unit_vec->vec);
   addrs->count = 0;
   unit_vec->count = 0;
 
-  /* Read through the .debug_info section.  FIXME: Should we use the
-     .debug_aranges section?  gdb and addr2line don't use it, but I'm
-     not sure why.  */
+  /* Units listed in .debug_aranges get their address ranges from
+     there, and are only parsed when a PC in them is looked up.  The
+     lazy parse is not synchronized, so threaded states read every
+     unit up front.  */
+  memset (&aranges, 0, sizeof aranges);
+  if (!state->threaded)
+    read_aranges (state, dwarf_sections, is_bigendian, error_callback, data,
+		  &aranges);
+  ar = (const struct arange *) aranges.vec.base;
+  arange_pos = 0;
+
+  /* Read through the .debug_info section.  */
 
   info.name = ".debug_info";
   info.start = dwarf_sections->data[DEBUG_INFO];
@@ -2466,11 +2671,13 @@ build_address_map (struct backtrace_state *state, uintptr_t base_address,
       int addrsize;
       struct unit *u;
       enum dwarf_tag unit_tag;
+      uint64_t info_offset;
 
       if (info.reported_underflow)
 	goto fail;
 
       unit_data_start = info.buf;
+      info_offset = (uint64_t) (unit_data_start - info.start);
 
       len = read_initial_length (&info, &is_dwarf64);
       unit_buf = info;
@@ -2519,11 +2726,6 @@ build_address_map (struct backtrace_state *state, uintptr_t base_address,
 
       memset (&u->abbrevs, 0, sizeof u->abbrevs);
       abbrev_offset = read_offset (&unit_buf, is_dwarf64);
-      if (!read_abbrevs (state, abbrev_offset,
-			 dwarf_sections->data[DEBUG_ABBREV],
-			 dwarf_sections->size[DEBUG_ABBREV],
-			 is_bigendian, error_callback, data, &u->abbrevs))
-	goto fail;
 
       if (version < 5)
 	addrsize = read_byte (&unit_buf);
@@ -2550,6 +2752,8 @@ build_address_map (struct backtrace_state *state, uintptr_t base_address,
       u->version = version;
       u->is_dwarf64 = is_dwarf64;
       u->addrsize = addrsize;
+      u->abbrev_offset = abbrev_offset;
+      u->loaded = 0;
       u->filename = NULL;
       u->comp_dir = NULL;
       u->abs_filename = NULL;
@@ -2561,6 +2765,32 @@ build_address_map (struct backtrace_state *state, uintptr_t base_address,
       u->function_addrs = NULL;
       u->function_addrs_count = 0;
 
+      while (arange_pos < aranges.count
+	     && ar[arange_pos].info_offset < info_offset)
+	++arange_pos;
+      if (arange_pos < aranges.count
+	  && ar[arange_pos].info_offset == info_offset)
+	{
+	  while (arange_pos < aranges.count
+		 && ar[arange_pos].info_offset == info_offset)
+	    {
+	      if (!add_unit_addr (state, (void *) u,
+				  ar[arange_pos].low + base_address,
+				  ar[arange_pos].high + base_address,
+				  error_callback, data, (void *) addrs))
+		goto fail;
+	      ++arange_pos;
+	    }
+	  continue;
+	}
+
+      if (!read_abbrevs (state, abbrev_offset,
+			 dwarf_sections->data[DEBUG_ABBREV],
+			 dwarf_sections->size[DEBUG_ABBREV],
+			 is_bigendian, error_callback, data, &u->abbrevs))
+	goto fail;
+      u->loaded = 1;
+
       if (!find_address_ranges (state, base_address, &unit_buf, dwarf_sections,
 				is_bigendian, altlink, error_callback, data,
 				u, addrs, &unit_tag))
@@ -2583,11 +2813,14 @@ build_address_map (struct backtrace_state *state, uintptr_t base_address,
   pa->high = pa->low;
   pa->u = NULL;
 
+  backtrace_vector_free (state, &aranges.vec, error_callback, data);
+
   unit_vec->vec = units;
   unit_vec->count = units_count;
   return 1;
 
  fail:
+  backtrace_vector_free (state, &aranges.vec, error_callback, data);
   if (units_count > 0)
     {
       pu = (struct unit **) units.base;
@@ -3264,6 +3497,9 @@ read_line_info (struct backtrace_state *state, struct dwarf_data *ddata,
 
   memset (hdr, 0, sizeof *hdr);
 
+  if (!unit_load (state, ddata, u, error_callback, data))
+    goto fail;
+
   if (u->lineoff != (off_t) (size_t) u->lineoff
       || (size_t) u->lineoff >= ddata->dwarf_sections.size[DEBUG_LINE])
     {
@@ -3330,14 +3566,16 @@ read_line_info (struct backtrace_state *state, struct dwarf_data *ddata,
   return 0;
 }
 
-static const char *read_referenced_name (struct dwarf_data *, struct unit *,
+static const char *read_referenced_name (struct backtrace_state *,
+					 struct dwarf_data *, struct unit *,
 					 uint64_t, backtrace_error_callback,
 					 void *);
 
 /* Read the name of a function from a DIE referenced by ATTR with VAL.  */
 
 static const char *
-read_referenced_name_from_attr (struct dwarf_data *ddata, struct unit *u,
+read_referenced_name_from_attr (struct backtrace_state *state,
+				struct dwarf_data *ddata, struct unit *u,
 				struct attr *attr, struct attr_val *val,
 				backtrace_error_callback error_callback,
 				void *data)
@@ -3363,12 +3601,14 @@ read_referenced_name_from_attr (struct dwarf_data *ddata, struct unit *u,
 	return NULL;
 
       uint64_t offset = val->u.uint - unit->low_offset;
-      return read_referenced_name (ddata, unit, offset, error_callback, data);
+      return read_referenced_name (state, ddata, unit, offset, error_callback,
+				   data);
     }
 
   if (val->encoding == ATTR_VAL_UINT
       || val->encoding == ATTR_VAL_REF_UNIT)
-    return read_referenced_name (ddata, u, val->u.uint, error_callback, data);
+    return read_referenced_name (state, ddata, u, val->u.uint, error_callback,
+				 data);
 
   if (val->encoding == ATTR_VAL_REF_ALT_INFO)
     {
@@ -3379,7 +3619,7 @@ read_referenced_name_from_attr (struct dwarf_data *ddata, struct unit *u,
 	return NULL;
 
       uint64_t offset = val->u.uint - alt_unit->low_offset;
-      return read_referenced_name (ddata->altlink, alt_unit, offset,
+      return read_referenced_name (state, ddata->altlink, alt_unit, offset,
 				   error_callback, data);
     }
 
@@ -3391,9 +3631,9 @@ read_referenced_name_from_attr (struct dwarf_data *ddata, struct unit *u,
    the same compilation unit.  */
 
 static const char *
-read_referenced_name (struct dwarf_data *ddata, struct unit *u,
-		      uint64_t offset, backtrace_error_callback error_callback,
-		      void *data)
+read_referenced_name (struct backtrace_state *state, struct dwarf_data *ddata,
+		      struct unit *u, uint64_t offset,
+		      backtrace_error_callback error_callback, void *data)
 {
   struct dwarf_buf unit_buf;
   uint64_t code;
@@ -3401,6 +3641,10 @@ read_referenced_name (struct dwarf_data *ddata, struct unit *u,
   const char *ret;
   size_t i;
 
+  /* The referenced DIE may be in a unit that has not been read yet.  */
+  if (!unit_load (state, ddata, u, error_callback, data))
+    return NULL;
+
   /* OFFSET is from the start of the data for this compilation unit.
      U->unit_data is the data, but it starts U->unit_data_offset bytes
      from the beginning.  */
@@ -3482,8 +3726,9 @@ read_referenced_name (struct dwarf_data *ddata, struct unit *u,
 	  {
 	    const char *name;
 
-	    name = read_referenced_name_from_attr (ddata, u, &abbrev->attrs[i],
-						   &val, error_callback, data);
+	    name = read_referenced_name_from_attr (state, ddata, u,
+						   &abbrev->attrs[i], &val,
+						   error_callback, data);
 	    if (name != NULL)
 	      ret = name;
 	  }
@@ -3655,7 +3900,7 @@ read_function_entry (struct backtrace_state *state, struct dwarf_data *ddata,
 		    const char *name;
 
 		    name
-		      = read_referenced_name_from_attr (ddata, u,
+		      = read_referenced_name_from_attr (state, ddata, u,
 							&abbrev->attrs[i], &val,
 							error_callback, data);
 		    if (name != NULL)
@@ -4350,6 +4595,23 @@ backtrace_dwarf_add (struct backtrace_state *state,
   if (fileline_entry != NULL)
     *fileline_entry = fdata;
 
+  backtrace_dwarf_append (state, fdata);
+
+  *fileline_fn = dwarf_fileline;
+
+  return 1;
+}
+
+/* Append the list of DWARF modules FILELINE_DATA to STATE.  */
+
+void
+backtrace_dwarf_append (struct backtrace_state *state, void *fileline_data)
+{
+  struct dwarf_data *fdata = (struct dwarf_data *) fileline_data;
+
+  if (fdata == NULL)
+    return;
+
   if (!state->threaded)
     {
       struct dwarf_data **pp;
@@ -4384,10 +4646,6 @@ backtrace_dwarf_add (struct backtrace_state *state,
 	    break;
 	}
     }
-
-  *fileline_fn = dwarf_fileline;
-
-  return 1;
 }
 
 }
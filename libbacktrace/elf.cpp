@@ -43,9 +43,15 @@ POSSIBILITY OF SUCH DAMAGE.  */
 #include <link.h>
 #endif
 
+#include <atomic>
+#include <mutex>
+
 #include "backtrace.hpp"
 #include "internal.hpp"
 
+#include "../client/TracyThread.hpp"
+#include "../client/tracy_rpmalloc.hpp"
+
 #ifndef S_ISLNK
  #ifndef S_IFLNK
   #define S_IFLNK 0120000
@@ -356,7 +362,8 @@ static const char * const dwarf_section_names[DEBUG_MAX] =
   ".debug_addr",
   ".debug_str_offsets",
   ".debug_line_str",
-  ".debug_rnglists"
+  ".debug_rnglists",
+  ".debug_aranges"
 };
 
 /* Information we gather for the sections we care about.  */
@@ -4795,6 +4802,22 @@ elf_add (struct backtrace_state *state, const char *filename, int descriptor,
   return 0;
 }
 
+/* A module found by phdr_callback.  */
+
+struct phdr_module
+{
+  const char *filename;
+  int descriptor;
+  uintptr_t base_address;
+  /* The module is loaded into a private state, so that modules can be
+     loaded in parallel, and is then appended to the real state.  */
+  struct backtrace_state state;
+  fileline fileline_fn;
+  int found_sym;
+  int found_dwarf;
+  int ret;
+};
+
 /* Data passed to phdr_callback.  */
 
 struct phdr_data
@@ -4802,15 +4825,15 @@ struct phdr_data
   struct backtrace_state *state;
   backtrace_error_callback error_callback;
   void *data;
-  fileline *fileline_fn;
-  int *found_sym;
-  int *found_dwarf;
   const char *exe_filename;
   int exe_descriptor;
+  /* Modules to load.  This is an array of struct phdr_module.  */
+  struct backtrace_vector modules;
+  size_t modules_count;
 };
 
-/* Callback passed to dl_iterate_phdr.  Load debug info from shared
-   libraries.  */
+/* Callback passed to dl_iterate_phdr.  Collect the shared libraries
+   to load debug info from.  */
 
 static int
 #ifdef __i386__
@@ -4823,8 +4846,7 @@ phdr_callback (struct dl_phdr_info *info, size_t size ATTRIBUTE_UNUSED,
   const char *filename;
   int descriptor;
   int does_not_exist;
-  fileline elf_fileline_fn;
-  int found_dwarf;
+  struct phdr_module *m;
 
   /* There is not much we can do if we don't have the module name,
      unless executable is ET_DYN, where we expect the very first
@@ -4852,20 +4874,150 @@ phdr_callback (struct dl_phdr_info *info, size_t size ATTRIBUTE_UNUSED,
 	return 0;
     }
 
-  if (elf_add (pd->state, filename, descriptor, NULL, 0, info->dlpi_addr,
-	       pd->error_callback, pd->data, &elf_fileline_fn, pd->found_sym,
-	       &found_dwarf, NULL, 0, 0, NULL, 0))
+  m = ((struct phdr_module *)
+       backtrace_vector_grow (pd->state, sizeof (struct phdr_module),
+			      pd->error_callback, pd->data, &pd->modules));
+  if (m == NULL)
     {
-      if (found_dwarf)
-	{
-	  *pd->found_dwarf = 1;
-	  *pd->fileline_fn = elf_fileline_fn;
-	}
+      backtrace_close (descriptor, pd->error_callback, pd->data);
+      return 0;
     }
 
+  m->filename = filename;
+  m->descriptor = descriptor;
+  m->base_address = info->dlpi_addr;
+  m->state = *pd->state;
+  m->state.fileline_data = NULL;
+  m->state.syminfo_data = NULL;
+  m->fileline_fn = NULL;
+  m->found_sym = 0;
+  m->found_dwarf = 0;
+  m->ret = 0;
+  ++pd->modules_count;
+
   return 0;
 }
 
+/* Shared by the threads loading the modules collected by
+   phdr_callback.  */
+
+struct phdr_load_data
+{
+  struct phdr_module *modules;
+  size_t modules_count;
+  /* Index of the next module to load.  */
+  std::atomic<size_t> next;
+  /* Serializes calls to the error callback.  */
+  std::mutex lock;
+  backtrace_error_callback error_callback;
+  void *data;
+};
+
+/* Error callback used while loading modules in parallel.  */
+
+static void
+phdr_load_error (void *data, const char *msg, int errnum)
+{
+  struct phdr_load_data *ld = (struct phdr_load_data *) data;
+  std::lock_guard<std::mutex> guard (ld->lock);
+
+  ld->error_callback (ld->data, msg, errnum);
+}
+
+/* Load modules until there are none left.  */
+
+static void
+phdr_load_modules (void *data)
+{
+  struct phdr_load_data *ld = (struct phdr_load_data *) data;
+  size_t i;
+
+  while ((i = ld->next.fetch_add (1, std::memory_order_relaxed))
+	 < ld->modules_count)
+    {
+      struct phdr_module *m = &ld->modules[i];
+
+      m->ret = elf_add (&m->state, m->filename, m->descriptor, NULL, 0,
+			m->base_address, phdr_load_error, data,
+			&m->fileline_fn, &m->found_sym, &m->found_dwarf,
+			NULL, 0, 0, NULL, 0);
+    }
+}
+
+/* Thread entry point for phdr_load_modules.  */
+
+static void
+phdr_load_thread (void *data)
+{
+  rpmalloc_thread_initialize ();
+  phdr_load_modules (data);
+  rpmalloc_thread_finalize ();
+}
+
+/* Maximum number of threads used to load modules.  */
+
+enum { PHDR_LOAD_MAX_THREADS = 8 };
+
+/* Load the modules collected in PD, spreading them over a few threads,
+   and add them to PD->STATE in the order they were found.  */
+
+static void
+phdr_load (struct phdr_data *pd, fileline *fileline_fn, int *found_sym,
+	   int *found_dwarf)
+{
+  struct phdr_load_data ld;
+  Thread *threads[PHDR_LOAD_MAX_THREADS];
+  long ncpu;
+  size_t nthreads;
+  size_t i;
+
+  ld.modules = (struct phdr_module *) pd->modules.base;
+  ld.modules_count = pd->modules_count;
+  ld.next.store (0, std::memory_order_relaxed);
+  ld.error_callback = pd->error_callback;
+  ld.data = pd->data;
+
+  ncpu = sysconf (_SC_NPROCESSORS_ONLN);
+  nthreads = ncpu > 1 ? (size_t) ncpu - 1 : 0;
+  if (nthreads > PHDR_LOAD_MAX_THREADS)
+    nthreads = PHDR_LOAD_MAX_THREADS;
+  if (nthreads > ld.modules_count - 1)
+    nthreads = ld.modules_count - 1;
+
+  for (i = 0; i < nthreads; ++i)
+    {
+      threads[i] = (Thread *) tracy_malloc (sizeof (Thread));
+      new (threads[i]) Thread (phdr_load_thread, &ld);
+    }
+  phdr_load_modules (&ld);
+  for (i = 0; i < nthreads; ++i)
+    {
+      threads[i]->~Thread ();
+      tracy_free (threads[i]);
+    }
+
+  for (i = 0; i < ld.modules_count; ++i)
+    {
+      struct phdr_module *m = &ld.modules[i];
+
+      if (m->state.syminfo_data != NULL)
+	elf_add_syminfo_data (pd->state,
+			      (struct elf_syminfo_data *) m->state.syminfo_data);
+      backtrace_dwarf_append (pd->state, m->state.fileline_data);
+
+      if (m->ret)
+	{
+	  if (m->found_sym)
+	    *found_sym = 1;
+	  if (m->found_dwarf)
+	    {
+	      *found_dwarf = 1;
+	      *fileline_fn = m->fileline_fn;
+	    }
+	}
+    }
+}
+
 /* Initialize the backtrace data we need from an ELF executable.  At
    the ELF level, all we need to do is find the debug info
    sections.  */
@@ -4890,14 +5042,17 @@ backtrace_initialize (struct backtrace_state *state, const char *filename,
   pd.state = state;
   pd.error_callback = error_callback;
   pd.data = data;
-  pd.fileline_fn = &elf_fileline_fn;
-  pd.found_sym = &found_sym;
-  pd.found_dwarf = &found_dwarf;
   pd.exe_filename = filename;
   pd.exe_descriptor = ret < 0 ? descriptor : -1;
+  memset (&pd.modules, 0, sizeof pd.modules);
+  pd.modules_count = 0;
 
   dl_iterate_phdr (phdr_callback, (void *) &pd);
 
+  if (pd.modules_count > 0)
+    phdr_load (&pd, &elf_fileline_fn, &found_sym, &found_dwarf);
+  backtrace_vector_free (state, &pd.modules, error_callback, data);
+
   if (!state->threaded)
     {
       if (found_sym)
@@ -310,6 +310,7 @@ enum dwarf_section
   DEBUG_STR_OFFSETS,
   DEBUG_LINE_STR,
   DEBUG_RNGLISTS,
+  DEBUG_ARANGES,
 
   DEBUG_MAX
 };
@@ -337,6 +338,12 @@ extern int backtrace_dwarf_add (struct backtrace_state *state,
 				void *data, fileline *fileline_fn,
 				struct dwarf_data **fileline_entry);
 
+/* Append the DWARF modules listed in FILELINE_DATA, as set up by
+   backtrace_dwarf_add in a different state, to STATE.  */
+
+extern void backtrace_dwarf_append (struct backtrace_state *state,
+				    void *fileline_data);
+
 /* A data structure to pass to backtrace_syminfo_to_full.  */
 
 struct backtrace_call_full
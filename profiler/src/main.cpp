@@ -122,6 +122,7 @@ static std::unique_ptr<tracy::View> view;
 static tracy::BadVersionState badVer;
 static uint16_t port = 8086;
 static const char* connectTo = nullptr;
+static const char* pagedDir = nullptr;
 static char title[128];
 static std::thread loadThread, updateThread, updateNotesThread;
 static std::unique_ptr<tracy::UdpListen> broadcastListen;
@@ -344,12 +345,18 @@ int main( int argc, char** argv )
     style.Colors[ImGuiCol_HeaderActive] = ImVec4(0.26f, 0.59f, 0.98f, 0.45f);
     style.ScaleAllSizes( dpiScale );
 
+    if( argc >= 3 && strcmp( argv[1], "-m" ) == 0 )
+    {
+        pagedDir = argv[2];
+        argc -= 2;
+        argv += 2;
+    }
     if( argc == 2 )
     {
         auto f = std::unique_ptr<tracy::FileRead>( tracy::FileRead::Open( argv[1] ) );
         if( f )
         {
-            view = std::make_unique<tracy::View>( RunOnMainThread, *f, fixedWidth, smallFont, bigFont, SetWindowTitleCallback, GetMainWindowNative );
+            view = std::make_unique<tracy::View>( RunOnMainThread, *f, fixedWidth, smallFont, bigFont, SetWindowTitleCallback, GetMainWindowNative, pagedDir );
         }
     }
     else
@@ -766,7 +773,7 @@ static void DrawContents()
                         loadThread = std::thread( [f] {
                             try
                             {
-                                view = std::make_unique<tracy::View>( RunOnMainThread, *f, fixedWidth, smallFont, bigFont, SetWindowTitleCallback, GetMainWindowNative );
+                                view = std::make_unique<tracy::View>( RunOnMainThread, *f, fixedWidth, smallFont, bigFont, SetWindowTitleCallback, GetMainWindowNative, pagedDir );
                             }
                             catch( const tracy::UnsupportedVersion& e )
                             {
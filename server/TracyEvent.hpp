@@ -546,6 +546,33 @@ enum { GhostZoneSize = sizeof( GhostZone ) };
 #pragma pack()
 
 
+// Zone event queued by the ordered ingest stage. The zone itself is built when the thread
+// timeline job runs the queue.
+struct ZoneTimelineOp
+{
+    enum : int32_t { Timeline = -1, End = -2, Extra = -3 };
+
+    int64_t time;       // timer ticks since the base time, converted by the timeline job
+    int32_t child;      // zone begin: children vector of the parent zone, or Timeline
+    int32_t data;       // zone begin: source location, Extra: zone extra index
+};
+
+// Plot data point queued by the ordered ingest stage.
+struct PlotTimelineOp
+{
+    int64_t time;       // timer ticks since the base time
+    double val;
+};
+
+// Ordered stage view of a zone that has not ended yet.
+struct OpenZone
+{
+    int32_t child;
+    uint32_t extra;
+    int16_t srcloc;
+};
+
+
 struct ThreadData
 {
     uint64_t id;
@@ -555,12 +582,14 @@ struct ThreadData
     Vector<short_ptr<MessageData>> messages;
     uint32_t nextZoneId;
     Vector<uint32_t> zoneIdStack;
+    Vector<OpenZone> openZones;
 #ifndef TRACY_NO_STATISTICS
     Vector<int64_t> childTimeStack;
     Vector<GhostZone> ghostZones;
     uint64_t ghostIdx;
 #endif
     Vector<SampleData> samples;
+    Vector<ZoneTimelineOp> timelineOps;
 };
 
 struct GpuCtxThreadData
@@ -645,6 +674,7 @@ struct PlotData
     SortedVector<PlotItem, PlotItemSort> data;
     PlotType type;
     PlotValueFormatting format;
+    Vector<PlotTimelineOp> timelineOps;
 };
 
 struct MemData
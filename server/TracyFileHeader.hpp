@@ -1,6 +1,8 @@
 #ifndef __TRACYFILEHEADER_HPP__
 #define __TRACYFILEHEADER_HPP__
 
+#include <stdint.h>
+
 #include "../common/TracyForceInline.hpp"
 
 namespace tracy
@@ -9,6 +11,23 @@ namespace tracy
 static const char Lz4Header[4]  = { 't', 'l', 'Z', 4 };
 static const char ZstdHeader[4] = { 't', 'Z', 's', 't' };
 
+// Followed by BlockCompression type. Each block is compressed independently.
+static const char BlockHeader[4] = { 't', 'r', 'B', 'k' };
+
+enum class BlockCompression : uint8_t
+{
+    Lz4,
+    Zstd
+};
+
+enum { BlockSize = 64 * 1024 };
+
+// The block list is terminated by a zero sized block, followed by the file index:
+//   uint64 block count, uint64 file offset of each block,
+//   uint64 file offset of the terminator, IndexFooter.
+// Every block except the last one holds BlockSize bytes of the stream.
+static const char IndexFooter[4] = { 't', 'r', 'I', 'x' };
+
 static constexpr tracy_force_inline int FileVersion( uint8_t h5, uint8_t h6, uint8_t h7 )
 {
     return ( h5 << 16 ) | ( h6 << 8 ) | h7;
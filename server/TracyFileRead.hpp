@@ -4,12 +4,14 @@
 #include <assert.h>
 #include <atomic>
 #include <algorithm>
+#include <memory>
 #include <stdexcept>
 #include <stdio.h>
 #include <string.h>
 #include <string>
 #include <thread>
 #include <utility>
+#include <vector>
 
 #include <sys/stat.h>
 
@@ -22,6 +24,7 @@
 
 #include "TracyFileHeader.hpp"
 #include "TracyMmap.hpp"
+#include "TracyTaskDispatch.hpp"
 #include "TracyYield.hpp"
 #include "../common/tracy_lz4.hpp"
 #include "../common/TracyForceInline.hpp"
@@ -46,6 +49,12 @@ public:
     {
         m_exit.store( true, std::memory_order_relaxed );
         m_decThread.join();
+        m_td.reset();
+
+        for( int i=0; i<m_numJobs; i++ )
+        {
+            if( m_jobs[i].ctx ) ZSTD_freeDCtx( m_jobs[i].ctx );
+        }
 
         if( m_data ) munmap( m_data, m_dataSize );
         if( m_stream ) LZ4_freeStreamDecode( m_stream );
@@ -64,6 +73,31 @@ public:
         }
     }
 
+    // Reads at most size bytes and returns how many were read. Less data is returned only at the
+    // end of data, which for a file cut short is the end of its last complete block.
+    size_t ReadUpTo( void* ptr, size_t size )
+    {
+        auto dst = (char*)ptr;
+        size_t done = 0;
+        while( done < size )
+        {
+            if( m_offset == m_bufSize )
+            {
+                if( m_bufSize != BufSize ) break;
+                m_signalSwitch.store( true, std::memory_order_release );
+                while( m_signalAvailable.load( std::memory_order_acquire ) == false ) { YieldThread(); }
+                m_signalAvailable.store( false, std::memory_order_relaxed );
+                if( m_bufSize == 0 ) break;
+                m_curBlock++;
+            }
+            const auto sz = std::min( size - done, m_bufSize - m_offset );
+            memcpy( dst + done, m_buf + m_offset, sz );
+            m_offset += sz;
+            done += sz;
+        }
+        return done;
+    }
+
     tracy_force_inline void Skip( size_t size )
     {
         if( size <= BufSize - m_offset )
@@ -296,14 +330,33 @@ public:
     const std::string& GetFilename() const { return m_filename; }
 
 private:
+    enum { BufSize = 64 * 1024 };
+    enum { LZ4Size = std::max( LZ4_COMPRESSBOUND( BufSize ), ZSTD_COMPRESSBOUND( BufSize ) ) };
+    static_assert( (int)BufSize == (int)BlockSize, "Read buffer must match block size" );
+
+    struct JobData
+    {
+        const char* src;
+        uint32_t srcSize;
+        char* dst;
+        size_t dstSize;
+        ZSTD_DCtx* ctx = nullptr;
+        alignas(64) std::atomic<bool> done = true;
+    };
+
     FileRead( FILE* f, const char* fn )
         : m_stream( nullptr )
         , m_streamZstd( nullptr )
+        , m_blockMode( false )
+        , m_numJobs( 0 )
         , m_data( nullptr )
         , m_buf( m_bufData[1] )
         , m_second( m_bufData[0] )
         , m_offset( 0 )
+        , m_bufSize( 0 )
         , m_lastBlock( 0 )
+        , m_curBlock( 0 )
+        , m_seekBlock( -1 )
         , m_signalSwitch( false )
         , m_signalAvailable( false )
         , m_exit( false )
@@ -323,6 +376,17 @@ private:
         {
             m_streamZstd = ZSTD_createDStream();
         }
+        else if( memcmp( hdr, BlockHeader, sizeof( hdr ) ) == 0 )
+        {
+            uint8_t type;
+            if( fread( &type, 1, sizeof( type ), f ) != sizeof( type ) || type > (uint8_t)BlockCompression::Zstd )
+            {
+                fclose( f );
+                throw NotTracyDump();
+            }
+            m_blockMode = true;
+            m_blockComp = (BlockCompression)type;
+        }
         else
         {
             fclose( f );
@@ -347,17 +411,84 @@ private:
             throw FileReadError();
         }
         m_dataOffset = sizeof( hdr );
+        m_blocksEnd = m_dataSize;
 
-        ReadBlock( ReadBlockSize() );
-        std::swap( m_buf, m_second );
-        m_decThread = std::thread( [this] { Worker(); } );
+        if( m_blockMode )
+        {
+            m_dataOffset += sizeof( uint8_t );
+            ReadFileIndex();
+
+            // Blocks are independent and can be decompressed in parallel
+            const auto workers = std::min<int>( std::max<int>( std::thread::hardware_concurrency() - 1, 1 ), 8 );
+            if( workers > 1 ) m_td = std::make_unique<TaskDispatch>( workers );
+            m_numJobs = workers == 1 ? 1 : workers * 2;
+            m_jobs = std::make_unique<JobData[]>( m_numJobs );
+            for( int i=0; i<m_numJobs; i++ )
+            {
+                m_blockBuffers.emplace_back( std::make_unique<char[]>( BufSize ) );
+                m_jobs[i].dst = m_blockBuffers.back().get();
+                if( m_blockComp == BlockCompression::Zstd ) m_jobs[i].ctx = ZSTD_createDCtx();
+            }
+
+            JobData first;
+            first.srcSize = ReadBlockSize();
+            first.src = m_data + m_dataOffset;
+            first.dst = m_second;
+            first.ctx = m_jobs[0].ctx;
+            m_dataOffset += first.srcSize;
+            DecompressBlock( first );
+            std::swap( m_buf, m_second );
+            m_bufSize = first.dstSize;
+            m_decThread = std::thread( [this] { WorkerBlocks(); } );
+        }
+        else
+        {
+            ReadBlock( ReadBlockSize() );
+            std::swap( m_buf, m_second );
+            m_bufSize = m_lastBlock;
+            m_decThread = std::thread( [this] { Worker(); } );
+        }
     }
 
+    void ReadFileIndex()
+    {
+        const auto tail = sizeof( uint64_t ) + sizeof( IndexFooter );
+        if( m_dataSize < m_dataOffset + sizeof( uint32_t ) + tail ) return;
+        if( memcmp( m_data + m_dataSize - sizeof( IndexFooter ), IndexFooter, sizeof( IndexFooter ) ) != 0 ) return;
+
+        uint64_t end;
+        memcpy( &end, m_data + m_dataSize - tail, sizeof( end ) );
+        if( end < m_dataOffset || end + sizeof( uint32_t ) > m_dataSize - tail ) throw FileReadError();
+
+        auto ptr = m_data + end + sizeof( uint32_t );
+        auto limit = m_data + m_dataSize - tail;
+        uint64_t cnt;
+        if( ptr + sizeof( cnt ) > limit ) throw FileReadError();
+        memcpy( &cnt, ptr, sizeof( cnt ) );
+        ptr += sizeof( cnt );
+        if( cnt > uint64_t( limit - ptr ) / sizeof( uint64_t ) ) throw FileReadError();
+        m_blockOffsets.resize( cnt );
+        memcpy( m_blockOffsets.data(), ptr, sizeof( uint64_t ) * cnt );
+
+        m_blocksEnd = end;
+    }
+
+    // Returns 0 if the block does not fit in the file, e.g. when it was cut short by a killed capture.
     tracy_force_inline uint32_t ReadBlockSize()
     {
+        if( m_blocksEnd - m_dataOffset < sizeof( uint32_t ) )
+        {
+            m_dataOffset = m_blocksEnd;
+            return 0;
+        }
         uint32_t sz;
         memcpy( &sz, m_data + m_dataOffset, sizeof( sz ) );
         m_dataOffset += sizeof( sz );
+        if( sz > m_blocksEnd - m_dataOffset )
+        {
+            m_dataOffset = m_blocksEnd;
+            return 0;
+        }
         return sz;
     }
 
@@ -371,17 +502,113 @@ private:
             for(;;)
             {
                 if( m_exit.load( std::memory_order_relaxed ) == true ) return;
-                if( m_signalSwitch.load( std::memory_order_relaxed ) == true ) break;
+                if( m_signalSwitch.load( std::memory_order_acquire ) == true ) break;
                 YieldThread();
             }
             m_signalSwitch.store( false, std::memory_order_relaxed );
             std::swap( m_buf, m_second );
             m_offset = 0;
+            m_bufSize = m_lastBlock;
             m_signalAvailable.store( true, std::memory_order_release );
             if( m_lastBlock != BufSize ) return;
         }
     }
 
+    void WorkerBlocks()
+    {
+        int queued = 0;
+        while( queued < m_numJobs && QueueBlock( m_jobs[queued] ) ) queued++;
+        int idx = 0;
+        while( queued > 0 )
+        {
+            for(;;)
+            {
+                if( m_exit.load( std::memory_order_relaxed ) == true ) return;
+                if( m_signalSwitch.load( std::memory_order_acquire ) == true ) break;
+                YieldThread();
+            }
+
+            const auto seek = m_seekBlock.load( std::memory_order_relaxed );
+            if( seek >= 0 )
+            {
+                // Drop the blocks in flight and restart decoding at the requested block
+                m_seekBlock.store( -1, std::memory_order_relaxed );
+                for( int i=0; i<m_numJobs; i++ )
+                {
+                    while( m_jobs[i].done.load( std::memory_order_acquire ) == false ) { YieldThread(); }
+                }
+                m_dataOffset = m_blockOffsets[seek];
+                queued = 0;
+                idx = 0;
+                while( queued < m_numJobs && QueueBlock( m_jobs[queued] ) ) queued++;
+                assert( queued > 0 );
+            }
+
+            auto& job = m_jobs[idx];
+            for(;;)
+            {
+                if( m_exit.load( std::memory_order_relaxed ) == true ) return;
+                if( job.done.load( std::memory_order_acquire ) == true ) break;
+                YieldThread();
+            }
+            m_signalSwitch.store( false, std::memory_order_relaxed );
+            std::swap( m_buf, job.dst );
+            m_offset = 0;
+            m_bufSize = job.dstSize;
+            m_signalAvailable.store( true, std::memory_order_release );
+
+            queued--;
+            if( QueueBlock( job ) ) queued++;
+            idx = ( idx + 1 ) % m_numJobs;
+        }
+
+        // The last block may have been full, answer a read past it with an empty buffer.
+        for(;;)
+        {
+            if( m_exit.load( std::memory_order_relaxed ) == true ) return;
+            if( m_signalSwitch.load( std::memory_order_acquire ) == true ) break;
+            YieldThread();
+        }
+        m_signalSwitch.store( false, std::memory_order_relaxed );
+        m_offset = 0;
+        m_bufSize = 0;
+        m_signalAvailable.store( true, std::memory_order_release );
+    }
+
+    bool QueueBlock( JobData& job )
+    {
+        if( m_dataOffset >= m_blocksEnd ) return false;
+        job.srcSize = ReadBlockSize();
+        if( job.srcSize == 0 ) return false;
+        job.src = m_data + m_dataOffset;
+        m_dataOffset += job.srcSize;
+        job.done.store( false, std::memory_order_relaxed );
+        if( m_td )
+        {
+            m_td->Queue( [this, &job] { DecompressBlock( job ); } );
+        }
+        else
+        {
+            DecompressBlock( job );
+        }
+        return true;
+    }
+
+    void DecompressBlock( JobData& job )
+    {
+        if( m_blockComp == BlockCompression::Lz4 )
+        {
+            const auto ret = LZ4_decompress_safe( job.src, job.dst, job.srcSize, BufSize );
+            job.dstSize = ret < 0 ? 0 : (size_t)ret;
+        }
+        else
+        {
+            const auto ret = ZSTD_decompressDCtx( job.ctx, job.dst, BufSize, job.src, job.srcSize );
+            job.dstSize = ZSTD_isError( ret ) ? 0 : ret;
+        }
+        job.done.store( true, std::memory_order_release );
+    }
+
     tracy_force_inline void ReadSmall( void* ptr, size_t size )
     {
         memcpy( ptr, m_buf + m_offset, size );
@@ -399,10 +626,11 @@ private:
             {
                 sz = std::min<size_t>( size, BufSize );
 
-                m_signalSwitch.store( true, std::memory_order_relaxed );
+                m_signalSwitch.store( true, std::memory_order_release );
                 while( m_signalAvailable.load( std::memory_order_acquire ) == false ) { YieldThread(); }
                 m_signalAvailable.store( false, std::memory_order_relaxed );
                 assert( m_offset == 0 );
+                m_curBlock++;
 
                 memcpy( dst, m_buf, sz );
                 m_offset = sz;
@@ -422,13 +650,28 @@ private:
 
     void SkipBig( size_t size )
     {
+        // Jump straight to the target block, if it is past the blocks already being decoded
+        const auto pos = m_curBlock * BufSize + m_offset + size;
+        const auto target = pos / BufSize;
+        if( target > m_curBlock + m_numJobs && target < m_blockOffsets.size() )
+        {
+            m_seekBlock.store( (int64_t)target, std::memory_order_relaxed );
+            m_signalSwitch.store( true, std::memory_order_release );
+            while( m_signalAvailable.load( std::memory_order_acquire ) == false ) { YieldThread(); }
+            m_signalAvailable.store( false, std::memory_order_relaxed );
+            m_curBlock = target;
+            m_offset = pos % BufSize;
+            return;
+        }
+
         while( size > 0 )
         {
             if( m_offset == BufSize )
             {
-                m_signalSwitch.store( true, std::memory_order_relaxed );
+                m_signalSwitch.store( true, std::memory_order_release );
                 while( m_signalAvailable.load( std::memory_order_acquire ) == false ) { YieldThread(); }
                 m_signalAvailable.store( false, std::memory_order_relaxed );
+                m_curBlock++;
             }
 
             const auto sz = std::min( size, BufSize - m_offset );
@@ -441,7 +684,8 @@ private:
     {
         if( m_stream )
         {
-            m_lastBlock = (size_t)LZ4_decompress_safe_continue( m_stream, m_data + m_dataOffset, m_second, sz, BufSize );
+            const auto ret = LZ4_decompress_safe_continue( m_stream, m_data + m_dataOffset, m_second, sz, BufSize );
+            m_lastBlock = ret < 0 ? 0 : (size_t)ret;
             m_dataOffset += sz;
         }
         else
@@ -450,24 +694,31 @@ private:
             ZSTD_inBuffer in = { m_data + m_dataOffset, sz, 0 };
             m_dataOffset += sz;
             const auto ret = ZSTD_decompressStream( m_streamZstd, &out, &in );
-            assert( ret > 0 );
-            m_lastBlock = out.pos;
+            m_lastBlock = ZSTD_isError( ret ) ? 0 : out.pos;
         }
     }
 
-    enum { BufSize = 64 * 1024 };
-    enum { LZ4Size = std::max( LZ4_COMPRESSBOUND( BufSize ), ZSTD_COMPRESSBOUND( BufSize ) ) };
-
     LZ4_streamDecode_t* m_stream;
     ZSTD_DStream* m_streamZstd;
+    bool m_blockMode;
+    BlockCompression m_blockComp;
+    std::unique_ptr<TaskDispatch> m_td;
+    std::unique_ptr<JobData[]> m_jobs;
+    std::vector<std::unique_ptr<char[]>> m_blockBuffers;
+    int m_numJobs;
     char* m_data;
     uint64_t m_dataSize;
     uint64_t m_dataOffset;
+    uint64_t m_blocksEnd;
+    std::vector<uint64_t> m_blockOffsets;
     char* m_buf;
     char* m_second;
     size_t m_offset;
+    size_t m_bufSize;
     size_t m_lastBlock;
+    uint64_t m_curBlock;
 
+    std::atomic<int64_t> m_seekBlock;
     alignas(64) std::atomic<bool> m_signalSwitch;
     alignas(64) std::atomic<bool> m_signalAvailable;
     alignas(64) std::atomic<bool> m_exit;
@@ -7,11 +7,17 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <atomic>
+#include <memory>
 #include <stdio.h>
 #include <string.h>
+#include <thread>
 #include <utility>
+#include <vector>
 
 #include "TracyFileHeader.hpp"
+#include "TracyTaskDispatch.hpp"
+#include "TracyYield.hpp"
 #include "../common/tracy_lz4.hpp"
 #include "../common/tracy_lz4hc.hpp"
 #include "../common/TracyForceInline.hpp"
@@ -31,25 +37,37 @@ public:
         Zstd
     };
 
-    static FileWrite* Open( const char* fn, Compression comp = Compression::Fast, int level = 1 )
+    // Blocks are compressed independently of each other, by the given number
+    // of worker threads (or by the calling thread, if streams is 1).
+    static FileWrite* Open( const char* fn, Compression comp = Compression::Fast, int level = 1, int streams = -1 )
     {
         auto f = fopen( fn, "wb" );
-        return f ? new FileWrite( f, comp, level ) : nullptr;
+        return f ? new FileWrite( f, comp, level, streams ) : nullptr;
     }
 
     ~FileWrite()
     {
-        if( m_offset > 0 ) WriteLz4Block();
+        Finish();
         fclose( m_file );
 
-        if( m_stream ) LZ4_freeStream( m_stream );
-        if( m_streamHC ) LZ4_freeStreamHC( m_streamHC );
-        if( m_streamZstd ) ZSTD_freeCStream( m_streamZstd );
+        for( int i=0; i<m_numJobs; i++ )
+        {
+            if( m_jobs[i].ctx ) ZSTD_freeCCtx( m_jobs[i].ctx );
+        }
     }
 
     void Finish()
     {
-        if( m_offset > 0 ) WriteLz4Block();
+        if( m_finished ) return;
+        m_finished = true;
+
+        if( m_offset > 0 ) SubmitBlock();
+        if( m_td ) m_td->Sync();
+        for( int i=1; i<=m_numJobs; i++ )
+        {
+            WriteBlock( m_jobs[( m_current + i ) % m_numJobs] );
+        }
+        WriteIndex();
     }
 
     tracy_force_inline void Write( const void* ptr, size_t size )
@@ -67,47 +85,63 @@ public:
     std::pair<size_t, size_t> GetCompressionStatistics() const { return std::make_pair( m_srcBytes, m_dstBytes ); }
 
 private:
-    FileWrite( FILE* f, Compression comp, int level )
-        : m_stream( nullptr )
-        , m_streamHC( nullptr )
-        , m_streamZstd( nullptr )
-        , m_file( f )
-        , m_buf( m_bufData[0] )
-        , m_second( m_bufData[1] )
+    enum { BufSize = BlockSize };
+    enum { LZ4Size = std::max( LZ4_COMPRESSBOUND( BufSize ), ZSTD_COMPRESSBOUND( BufSize ) ) };
+
+    struct JobData
+    {
+        enum State : int { InProgress, Available, DataReady };
+        char src[BufSize];
+        char dst[LZ4Size];
+        uint32_t srcSize;
+        uint32_t dstSize;
+        ZSTD_CCtx* ctx = nullptr;
+        alignas(64) std::atomic<State> state = Available;
+    };
+
+    FileWrite( FILE* f, Compression comp, int level, int streams )
+        : m_file( f )
+        , m_comp( comp )
+        , m_level( level )
+        , m_current( 0 )
         , m_offset( 0 )
         , m_srcBytes( 0 )
         , m_dstBytes( 0 )
     {
+        if( streams <= 0 ) streams = std::min<int>( std::max<int>( std::thread::hardware_concurrency(), 1 ), 8 );
+        if( streams > 1 ) m_td = std::make_unique<TaskDispatch>( streams );
+
+        // One block is being filled, while the others are compressed
+        m_numJobs = streams == 1 ? 1 : streams * 2;
+        m_jobs = std::make_unique<JobData[]>( m_numJobs );
+        m_buf = m_jobs[0].src;
+
         switch( comp )
         {
         case Compression::Fast:
-            m_stream = LZ4_createStream();
             break;
         case Compression::Slow:
-            m_streamHC = LZ4_createStreamHC();
+            m_level = LZ4HC_CLEVEL_DEFAULT;
             break;
         case Compression::Extreme:
-            m_streamHC = LZ4_createStreamHC();
-            LZ4_resetStreamHC( m_streamHC, LZ4HC_CLEVEL_MAX );
+            m_level = LZ4HC_CLEVEL_MAX;
             break;
         case Compression::Zstd:
-            m_streamZstd = ZSTD_createCStream();
-            ZSTD_CCtx_setParameter( m_streamZstd, ZSTD_c_compressionLevel, level );
-            ZSTD_CCtx_setParameter( m_streamZstd, ZSTD_c_contentSizeFlag, 0 );
+            for( int i=0; i<m_numJobs; i++ )
+            {
+                m_jobs[i].ctx = ZSTD_createCCtx();
+                ZSTD_CCtx_setParameter( m_jobs[i].ctx, ZSTD_c_compressionLevel, level );
+                ZSTD_CCtx_setParameter( m_jobs[i].ctx, ZSTD_c_contentSizeFlag, 0 );
+            }
             break;
         default:
             assert( false );
             break;
         }
 
-        if( comp == Compression::Zstd )
-        {
-            fwrite( ZstdHeader, 1, sizeof( ZstdHeader ), m_file );
-        }
-        else
-        {
-            fwrite( Lz4Header, 1, sizeof( Lz4Header ), m_file );
-        }
+        const uint8_t type = comp == Compression::Zstd ? (uint8_t)BlockCompression::Zstd : (uint8_t)BlockCompression::Lz4;
+        fwrite( BlockHeader, 1, sizeof( BlockHeader ), m_file );
+        fwrite( &type, 1, sizeof( type ), m_file );
     }
 
     tracy_force_inline void WriteSmall( const void* ptr, size_t size )
@@ -129,54 +163,95 @@ private:
 
             if( m_offset == BufSize )
             {
-                WriteLz4Block();
+                SubmitBlock();
             }
         }
     }
 
-    void WriteLz4Block()
+    void SubmitBlock()
     {
-        char lz4[LZ4Size];
-        uint32_t sz;
-        if( m_stream )
+        auto& job = m_jobs[m_current];
+        job.srcSize = m_offset;
+        job.state.store( JobData::InProgress, std::memory_order_release );
+        if( m_td )
         {
-            sz = LZ4_compress_fast_continue( m_stream, m_buf, lz4, m_offset, LZ4Size, 1 );
+            m_td->Queue( [this, &job] { Compress( job ); } );
         }
-        else if( m_streamZstd )
+        else
         {
-            ZSTD_outBuffer out = { lz4, LZ4Size, 0 };
-            ZSTD_inBuffer in = { m_buf, m_offset, 0 };
-            const auto ret = ZSTD_compressStream2( m_streamZstd, &out, &in, ZSTD_e_flush );
-            assert( ret == 0 );
-            sz = out.pos;
+            Compress( job );
         }
-        else
+
+        // Blocks are submitted round-robin, so the next slot holds the oldest block in flight
+        m_current = ( m_current + 1 ) % m_numJobs;
+        auto& next = m_jobs[m_current];
+        while( next.state.load( std::memory_order_acquire ) == JobData::InProgress ) { YieldThread(); }
+        WriteBlock( next );
+        m_buf = next.src;
+        m_offset = 0;
+    }
+
+    void Compress( JobData& job )
+    {
+        size_t sz;
+        switch( m_comp )
         {
-            sz = LZ4_compress_HC_continue( m_streamHC, m_buf, lz4, m_offset, LZ4Size );
+        case Compression::Fast:
+            sz = LZ4_compress_fast( job.src, job.dst, job.srcSize, LZ4Size, 1 );
+            break;
+        case Compression::Zstd:
+            sz = ZSTD_compress2( job.ctx, job.dst, LZ4Size, job.src, job.srcSize );
+            assert( !ZSTD_isError( sz ) );
+            break;
+        default:
+            sz = LZ4_compress_HC( job.src, job.dst, job.srcSize, LZ4Size, m_level );
+            break;
         }
+        job.dstSize = sz;
+        job.state.store( JobData::DataReady, std::memory_order_release );
+    }
 
-        m_srcBytes += m_offset;
-        m_dstBytes += sz;
+    void WriteBlock( JobData& job )
+    {
+        if( job.state.load( std::memory_order_acquire ) != JobData::DataReady ) return;
 
-        fwrite( &sz, 1, sizeof( sz ), m_file );
-        fwrite( lz4, 1, sz, m_file );
-        m_offset = 0;
-        std::swap( m_buf, m_second );
+        m_srcBytes += job.srcSize;
+        m_dstBytes += job.dstSize;
+
+        m_blockOffsets.push_back( m_fileOffset );
+        m_fileOffset += sizeof( job.dstSize ) + job.dstSize;
+        fwrite( &job.dstSize, 1, sizeof( job.dstSize ), m_file );
+        fwrite( job.dst, 1, job.dstSize, m_file );
+        job.state.store( JobData::Available, std::memory_order_relaxed );
     }
 
-    enum { BufSize = 64 * 1024 };
-    enum { LZ4Size = std::max( LZ4_COMPRESSBOUND( BufSize ), ZSTD_COMPRESSBOUND( BufSize ) ) };
+    void WriteIndex()
+    {
+        const uint32_t terminator = 0;
+        fwrite( &terminator, 1, sizeof( terminator ), m_file );
+
+        const uint64_t blocks = m_blockOffsets.size();
+        fwrite( &blocks, 1, sizeof( blocks ), m_file );
+        fwrite( m_blockOffsets.data(), 1, sizeof( uint64_t ) * blocks, m_file );
+
+        fwrite( &m_fileOffset, 1, sizeof( m_fileOffset ), m_file );
+        fwrite( IndexFooter, 1, sizeof( IndexFooter ), m_file );
+    }
 
-    LZ4_stream_t* m_stream;
-    LZ4_streamHC_t* m_streamHC;
-    ZSTD_CStream* m_streamZstd;
     FILE* m_file;
-    char m_bufData[2][BufSize];
+    Compression m_comp;
+    int m_level;
+    std::unique_ptr<TaskDispatch> m_td;
+    std::unique_ptr<JobData[]> m_jobs;
+    int m_numJobs;
+    int m_current;
     char* m_buf;
-    char* m_second;
     size_t m_offset;
     size_t m_srcBytes;
     size_t m_dstBytes;
+    uint64_t m_fileOffset = sizeof( BlockHeader ) + 1;
+    std::vector<uint64_t> m_blockOffsets;
+    bool m_finished = false;
 };
 
 }
@@ -3,6 +3,6 @@
 namespace tracy
 {
 
-size_t memUsage = 0;
+std::atomic<int64_t> memUsage( 0 );
 
 }
@@ -1,12 +1,14 @@
 #ifndef __TRACYMEMORY_HPP__
 #define __TRACYMEMORY_HPP__
 
+#include <atomic>
+#include <stdint.h>
 #include <stdlib.h>
 
 namespace tracy
 {
 
-extern size_t memUsage;
+extern std::atomic<int64_t> memUsage;
 
 }
 
@@ -2,6 +2,9 @@
 
 #if defined _MSC_VER || defined __MINGW32__ || defined __CYGWIN__
 #  include <io.h>
+#  include <stdint.h>
+#  include <stdio.h>
+#  include <stdlib.h>
 #  include <windows.h>
 
 void* mmap( void* addr, size_t length, int prot, int flags, int fd, off_t offset )
@@ -35,4 +38,65 @@ int munmap( void* addr, size_t length )
     return UnmapViewOfFile( addr ) != 0 ? 0 : -1;
 }
 
+namespace tracy
+{
+
+void* MapScratch( const char* dir, size_t size )
+{
+    auto fn = _tempnam( dir, "tracy" );
+    if( !fn ) return nullptr;
+    auto file = CreateFileA( fn, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr );
+    free( fn );
+    if( file == INVALID_HANDLE_VALUE ) return nullptr;
+
+    void* map = nullptr;
+    if( auto hnd = CreateFileMapping( file, nullptr, PAGE_READWRITE, DWORD( uint64_t( size ) >> 32 ), DWORD( size ), nullptr ) )
+    {
+        map = MapViewOfFile( hnd, FILE_MAP_WRITE, 0, 0, size );
+        CloseHandle( hnd );
+    }
+    // The file is deleted when the view is unmapped.
+    CloseHandle( file );
+    return map;
+}
+
+void UnmapScratch( void* ptr, size_t size )
+{
+    UnmapViewOfFile( ptr );
+}
+
+}
+
+#else
+#  include <stdlib.h>
+#  include <string>
+#  include <unistd.h>
+
+namespace tracy
+{
+
+void* MapScratch( const char* dir, size_t size )
+{
+    auto fn = std::string( dir ) + "/tracy-XXXXXX";
+    const auto fd = mkstemp( fn.data() );
+    if( fd == -1 ) return nullptr;
+    unlink( fn.c_str() );
+
+    void* map = nullptr;
+    if( ftruncate( fd, size ) == 0 )
+    {
+        map = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+        if( map == MAP_FAILED ) map = nullptr;
+    }
+    close( fd );
+    return map;
+}
+
+void UnmapScratch( void* ptr, size_t size )
+{
+    munmap( ptr, size );
+}
+
+}
+
 #endif
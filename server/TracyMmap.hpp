@@ -1,6 +1,8 @@
 #ifndef __TRACYMMAP_HPP__
 #define __TRACYMMAP_HPP__
 
+#include <stddef.h>
+
 #if !defined _MSC_VER && !defined __MINGW32__ && !defined __CYGWIN__
 #  include <sys/mman.h>
 #else
@@ -16,4 +18,14 @@ int munmap( void* addr, size_t length );
 
 #endif
 
+namespace tracy
+{
+
+// Maps memory backed by an anonymous file created in the given directory. The system can page
+// such memory out to the file and back in on demand, instead of keeping it resident.
+void* MapScratch( const char* dir, size_t size );
+void UnmapScratch( void* ptr, size_t size );
+
+}
+
 #endif
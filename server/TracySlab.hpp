@@ -2,9 +2,11 @@
 #define __TRACYSLAB_HPP__
 
 #include <assert.h>
+#include <utility>
 #include <vector>
 
 #include "TracyMemory.hpp"
+#include "TracyMmap.hpp"
 
 namespace tracy
 {
@@ -29,6 +31,17 @@ public:
         {
             delete[] v;
         }
+        for( auto& v : m_mapped )
+        {
+            UnmapScratch( v.first, v.second );
+        }
+    }
+
+    // Further blocks will be mapped from scratch files in the given directory, so that the system
+    // can page them out. Falls back to regular allocations if the mapping fails.
+    void SetPaged( const char* dir )
+    {
+        m_pagedDir = dir;
     }
 
     tracy_force_inline void* AllocRaw( size_t size )
@@ -103,16 +116,20 @@ public:
         }
         else
         {
-            memUsage += size;
-            m_usage += size;
-            auto ret = new char[size];
-            m_buffer.emplace_back( ret );
-            return ret;
+            return AllocBlock( size );
         }
     }
 
     void Reset()
     {
+        for( auto& v : m_mapped )
+        {
+            memUsage -= v.second;
+            m_usage -= v.second;
+            UnmapScratch( v.first, v.second );
+        }
+        m_mapped.clear();
+        m_ptr = m_buffer[0];
         if( m_buffer.size() > 1 )
         {
             memUsage -= m_usage - BlockSize;
@@ -137,19 +154,36 @@ public:
 private:
     void* DoAlloc( uint32_t willUseBytes )
     {
-        auto ptr = new char[BlockSize];
+        auto ptr = AllocBlock( BlockSize );
         m_ptr = ptr;
         m_offset = willUseBytes;
-        m_buffer.emplace_back( m_ptr );
-        memUsage += BlockSize;
-        m_usage += BlockSize;
+        return ptr;
+    }
+
+    char* AllocBlock( size_t size )
+    {
+        memUsage += size;
+        m_usage += size;
+        if( m_pagedDir )
+        {
+            auto ptr = (char*)MapScratch( m_pagedDir, size );
+            if( ptr )
+            {
+                m_mapped.emplace_back( ptr, size );
+                return ptr;
+            }
+        }
+        auto ptr = new char[size];
+        m_buffer.emplace_back( ptr );
         return ptr;
     }
 
     char* m_ptr;
     uint32_t m_offset;
     std::vector<char*> m_buffer;
+    std::vector<std::pair<char*, size_t>> m_mapped;
     size_t m_usage;
+    const char* m_pagedDir = nullptr;
 };
 
 }
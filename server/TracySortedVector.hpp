@@ -84,6 +84,7 @@ public:
     tracy_force_inline void reserve_exact( uint32_t sz, Slab<U>& slab ) { v.reserve_exact( sz, slab ); }
 
     tracy_force_inline void clear() { v.clear(); sortedEnd = 0; }
+    tracy_force_inline T* erase( T* begin, T* end ) { assert( is_sorted() ); return v.erase( begin, end ); }
 
     tracy_force_inline void sort() { sort( CompareDefault() ); }
 
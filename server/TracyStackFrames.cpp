@@ -6,10 +6,16 @@ namespace tracy
 const char* s_tracyStackFrames_[] = {
     "tracy::Callstack",
     "tracy::Callstack(int)",
+    "tracy::CallstackCapture",
+    "tracy::CallstackCapture(unsigned long*, int)",
+    "tracy::CallstackUnwind",
+    "tracy::CallstackUnwind(unsigned long*, int)",
     "tracy::GpuCtxScope::{ctor}",
     "tracy::Profiler::SendCallstack",
     "tracy::Profiler::SendCallstack(int)",
     "tracy::Profiler::SendCallstack(int, unsigned long)",
+    "tracy::Profiler::CallstackCached",
+    "tracy::Profiler::CallstackCached(int, unsigned int&)",
     "tracy::Profiler::MemAllocCallstack",
     "tracy::Profiler::MemAllocCallstack(void const*, unsigned long, int)",
     "tracy::Profiler::MemFreeCallstack",
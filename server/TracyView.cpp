@@ -148,8 +148,8 @@ View::View( void(*cbMainThread)(std::function<void()>), const char* addr, uint16
     InitTextEditor( fixedWidth );
 }
 
-View::View( void(*cbMainThread)(std::function<void()>), FileRead& f, ImFont* fixedWidth, ImFont* smallFont, ImFont* bigFont, SetTitleCallback stcb, GetWindowCallback gwcb )
-    : m_worker( f )
+View::View( void(*cbMainThread)(std::function<void()>), FileRead& f, ImFont* fixedWidth, ImFont* smallFont, ImFont* bigFont, SetTitleCallback stcb, GetWindowCallback gwcb, const char* pagedDir )
+    : m_worker( f, EventType::All, true, pagedDir )
     , m_filename( f.GetFilename() )
     , m_staticView( true )
     , m_viewMode( ViewMode::Paused )
@@ -1404,6 +1404,14 @@ bool View::DrawConnection()
         ImGui::SameLine();
         ImGui::Text( "%6.2f Mbps", mbps / m_worker.GetCompRatio() );
         TextFocused( "Data transferred:", MemSizeToString( m_worker.GetDataTransferred() ) );
+        TextFocused( "Transport:", Worker::GetTransportCodecName( m_worker.GetTransportCodec() ) );
+        if( m_worker.IsTransportShm() )
+        {
+            ImGui::SameLine();
+            TextDisabledUnformatted( "shared memory" );
+        }
+        ImGui::SameLine();
+        ImGui::Text( "(%.0f MB/s)", m_worker.GetDecompressSpeed() );
         TextFocused( "Query backlog:", RealToString( m_worker.GetSendQueueSize() ) );
     }
 
@@ -7101,13 +7109,13 @@ void View::DrawZoneInfoWindow()
     TextFocused( "Time from start of program:", TimeToStringExact( ev.Start() ) );
     TextFocused( "Execution time:", TimeToString( ztime ) );
 #ifndef TRACY_NO_STATISTICS
-    if( m_worker.AreSourceLocationZonesReady() )
+    if( m_worker.AreSourceLocationStatsReady() )
     {
         auto& zoneData = m_worker.GetZonesForSourceLocation( ev.SrcLoc() );
         if( zoneData.total > 0 )
         {
             ImGui::SameLine();
-            ImGui::TextDisabled( "(%.2f%% of mean time)", float( ztime ) / zoneData.total * zoneData.zones.size() * 100 );
+            ImGui::TextDisabled( "(%.2f%% of mean time)", float( ztime ) / zoneData.total * zoneData.count * 100 );
         }
     }
 #endif
@@ -12094,7 +12102,7 @@ void View::DrawStatistics()
     ImGui::TextWrapped( "Collection of statistical data is disabled in this build." );
     ImGui::TextWrapped( "Rebuild without the TRACY_NO_STATISTICS macro to enable statistics view." );
 #else
-    if( !m_worker.AreSourceLocationZonesReady() && ( !m_worker.AreCallstackSamplesReady() || m_worker.GetCallstackSampleCount() == 0 ) )
+    if( !m_worker.AreSourceLocationStatsReady() && ( !m_worker.AreCallstackSamplesReady() || m_worker.GetCallstackSampleCount() == 0 ) )
     {
         ImGui::TextWrapped( "Please wait, computing data..." );
         DrawWaitingDots( s_time );
@@ -12136,7 +12144,8 @@ void View::DrawStatistics()
 
     if( m_statMode == 0 )
     {
-        if( !m_worker.AreSourceLocationZonesReady() )
+        // Limiting the time range requires the list of zones, otherwise the saved statistics are enough.
+        if( m_statRange.active ? !m_worker.AreSourceLocationZonesReady() : !m_worker.AreSourceLocationStatsReady() )
         {
             ImGui::Spacing();
             ImGui::Separator();
@@ -12250,7 +12259,7 @@ void View::DrawStatistics()
                     slzcnt++;
                     if( !filterActive )
                     {
-                        srcloc.push_back_no_space_check( SrcLocZonesSlim { it->first, it->second.zones.size(), it->second.total, it->second.selfTotal } );
+                        srcloc.push_back_no_space_check( SrcLocZonesSlim { it->first, it->second.count, it->second.total, it->second.selfTotal } );
                     }
                     else
                     {
@@ -12258,7 +12267,7 @@ void View::DrawStatistics()
                         auto name = m_worker.GetString( sl.name.active ? sl.name : sl.function );
                         if( m_statisticsFilter.PassFilter( name ) )
                         {
-                            srcloc.push_back_no_space_check( SrcLocZonesSlim { it->first, it->second.zones.size(), it->second.total, it->second.selfTotal } );
+                            srcloc.push_back_no_space_check( SrcLocZonesSlim { it->first, it->second.count, it->second.total, it->second.selfTotal } );
                         }
                     }
                 }
@@ -12496,10 +12505,24 @@ void View::DrawStatistics()
                     auto name = m_worker.GetString( srcloc.name.active ? srcloc.name : srcloc.function );
                     SmallColorBox( GetSrcLocColor( srcloc, 0 ) );
                     ImGui::SameLine();
+                    const auto captureEnabled = m_worker.IsZoneCaptureEnabled( v.srcloc );
+                    if( !captureEnabled )
+                    {
+                        TextDisabledUnformatted( ICON_FA_BAN );
+                        ImGui::SameLine();
+                    }
                     if( ImGui::Selectable( name, m_findZone.show && !m_findZone.match.empty() && m_findZone.match[m_findZone.selMatch] == v.srcloc, ImGuiSelectableFlags_SpanAllColumns ) )
                     {
                         m_findZone.ShowZone( v.srcloc, name );
                     }
+                    if( m_worker.CanFilterZone( v.srcloc ) && ImGui::BeginPopupContextItem( "##zoneFilter" ) )
+                    {
+                        if( ImGui::MenuItem( ICON_FA_SYRINGE " Capture zone", nullptr, captureEnabled ) )
+                        {
+                            m_worker.SetZoneCaptureEnabled( v.srcloc, !captureEnabled );
+                        }
+                        ImGui::EndPopup();
+                    }
                     ImGui::TableNextColumn();
                     float indentVal = 0.f;
                     if( m_statBuzzAnim.Match( v.srcloc ) )
@@ -13818,6 +13841,40 @@ void View::DrawInfo()
             }
         }
         TextFocused( "Call stack samples:", RealToString( m_worker.GetCallstackSampleCount() ) );
+        if( m_worker.GetCallstackSamplesLost() != 0 )
+        {
+            TextFocused( "Lost samples:", RealToString( m_worker.GetCallstackSamplesLost() ) );
+            if( ImGui::IsItemHovered() )
+            {
+                ImGui::BeginTooltip();
+                ImGui::TextUnformatted( "Samples dropped by the kernel, because the client didn't read them in time" );
+                ImGui::EndTooltip();
+            }
+        }
+        auto& zonesDropped = m_worker.GetZonesDropped();
+        if( !zonesDropped.empty() )
+        {
+            uint64_t dropped = 0;
+            for( auto& v : zonesDropped ) dropped += v.second;
+            TextFocused( "Dropped short zones:", RealToString( dropped ) );
+            if( ImGui::IsItemHovered() )
+            {
+                std::vector<std::pair<int16_t, uint64_t>> list;
+                list.reserve( zonesDropped.size() );
+                for( auto& v : zonesDropped ) list.emplace_back( v.first, v.second );
+                pdqsort_branchless( list.begin(), list.end(), []( const auto& lhs, const auto& rhs ) { return lhs.second > rhs.second; } );
+                ImGui::BeginTooltip();
+                ImGui::TextUnformatted( "Zones shorter than the client minimum duration, which were not sent" );
+                ImGui::Separator();
+                const auto num = std::min<size_t>( list.size(), 10 );
+                for( size_t i=0; i<num; i++ )
+                {
+                    TextFocused( m_worker.GetZoneName( m_worker.GetSourceLocation( list[i].first ) ), RealToString( list[i].second ) );
+                }
+                if( list.size() > num ) TextDisabledUnformatted( "..." );
+                ImGui::EndTooltip();
+            }
+        }
         TextFocused( "Ghost zones:", RealToString( m_worker.GetGhostZonesCount() ) );
 #ifndef TRACY_NO_STATISTICS
         TextFocused( "Child sample symbols:", RealToString( m_worker.GetChildSamplesCountSyms() ) );
@@ -17114,13 +17171,13 @@ void View::ZoneTooltip( const ZoneEvent& ev )
     ImGui::Separator();
     TextFocused( "Execution time:", TimeToString( ztime ) );
 #ifndef TRACY_NO_STATISTICS
-    if( m_worker.AreSourceLocationZonesReady() )
+    if( m_worker.AreSourceLocationStatsReady() )
     {
         auto& zoneData = m_worker.GetZonesForSourceLocation( ev.SrcLoc() );
         if( zoneData.total > 0 )
         {
             ImGui::SameLine();
-            ImGui::TextDisabled( "(%.2f%% of mean time)", float( ztime ) / zoneData.total * zoneData.zones.size() * 100 );
+            ImGui::TextDisabled( "(%.2f%% of mean time)", float( ztime ) / zoneData.total * zoneData.count * 100 );
         }
     }
 #endif
@@ -23,8 +23,10 @@
 
 #include "../common/TracyProtocol.hpp"
 #include "../common/TracySystem.hpp"
+#include "../zstd/zstd.h"
 #include "TracyFileRead.hpp"
 #include "TracyFileWrite.hpp"
+#include "TracyMemory.hpp"
 #include "TracySort.hpp"
 #include "TracyTaskDispatch.hpp"
 #include "TracyVersion.hpp"
@@ -57,10 +59,20 @@ static bool SourceFileValid( const char* fn, uint64_t olderThan )
 
 
 static const uint8_t FileHeader[8] { 't', 'r', 'a', 'c', 'y', Version::Major, Version::Minor, Version::Patch };
+// Followed by the protocol version, the welcome message and the decompressed data stream.
+static const uint8_t JournalHeader[8] { 't', 'r', 'J', 'r', 'n', Version::Major, Version::Minor, Version::Patch };
 enum { FileHeaderMagic = 5 };
 static const int CurrentVersion = FileVersion( Version::Major, Version::Minor, Version::Patch );
 static const int MinSupportedVersion = FileVersion( 0, 6, 0 );
 
+// srcloc, start, extra, children size, end
+enum { TimelineZoneSize = sizeof( int16_t ) + sizeof( int64_t ) + sizeof( uint32_t ) * 2 + sizeof( int64_t ) };
+// start, end, thread
+enum { CpuContextSwitchSize = sizeof( int64_t ) * 2 + sizeof( uint16_t ) };
+enum { ParallelTimelineSize = 1024 * 1024 };
+enum { ParallelTimelineOps = 16 * 1024 };
+enum { MaxTimelineLanes = 16 };
+
 
 static void UpdateLockCountLockable( LockMap& lockmap, size_t pos )
 {
@@ -226,6 +238,50 @@ static tracy_force_inline int64_t ReadTimeOffset( FileRead& f, int64_t& refTime
     return refTime;
 }
 
+// Reads data already loaded from a trace file, so that it can be decoded outside of the loading thread.
+class BufferRead
+{
+public:
+    BufferRead( const char* ptr ) : m_ptr( ptr ) {}
+
+    template<class T>
+    tracy_force_inline void Read( T& v )
+    {
+        memcpy( &v, m_ptr, sizeof( T ) );
+        m_ptr += sizeof( T );
+    }
+
+    template<class T, class U, class V>
+    tracy_force_inline void Read3( T& v0, U& v1, V& v2 )
+    {
+        Read( v0 );
+        Read( v1 );
+        Read( v2 );
+    }
+
+    template<class T, class U, class V, class W>
+    tracy_force_inline void Read4( T& v0, U& v1, V& v2, W& v3 )
+    {
+        Read( v0 );
+        Read( v1 );
+        Read( v2 );
+        Read( v3 );
+    }
+
+    template<class T, class U, class V, class W, class X>
+    tracy_force_inline void Read5( T& v0, U& v1, V& v2, W& v3, X& v4 )
+    {
+        Read( v0 );
+        Read( v1 );
+        Read( v2 );
+        Read( v3 );
+        Read( v4 );
+    }
+
+private:
+    const char* m_ptr;
+};
+
 static tracy_force_inline void UpdateLockRange( LockMap& lockmap, const LockEvent& ev, int64_t lt )
 {
     auto& range = lockmap.range[ev.thread];
@@ -234,14 +290,22 @@ static tracy_force_inline void UpdateLockRange( LockMap& lockmap, const LockEven
 }
 
 LoadProgress Worker::s_loadProgress;
+bool Worker::s_ingestEventTiming = false;
 
-Worker::Worker( const char* addr, uint16_t port )
+Worker::Worker( const char* addr, uint16_t port, TransportCodec codec, int codecLevel, FileWrite* journal, int64_t historyLimit, bool shm )
     : m_addr( addr )
     , m_port( port )
     , m_hasData( false )
     , m_stream( LZ4_createStreamDecode() )
+    , m_codec( codec )
+    , m_codecLevel( (int8_t)codecLevel )
     , m_buffer( new char[TargetFrameSize*3 + 1] )
     , m_bufferOffset( 0 )
+#ifdef TRACY_HAS_SHM
+    , m_shmRequest( shm )
+#endif
+    , m_journal( journal )
+    , m_historyLimit( historyLimit )
     , m_pendingStrings( 0 )
     , m_pendingThreads( 0 )
     , m_pendingExternalNames( 0 )
@@ -264,7 +328,9 @@ Worker::Worker( const char* addr, uint16_t port )
     memset( (char*)m_gpuCtxMap, 0, sizeof( m_gpuCtxMap ) );
 
 #ifndef TRACY_NO_STATISTICS
+    assert( historyLimit == 0 );
     m_data.sourceLocationZonesReady = true;
+    m_data.sourceLocationStatsReady = true;
     m_data.callstackSamplesReady = true;
     m_data.ghostZonesReady = true;
     m_data.ctxUsageReady = true;
@@ -279,6 +345,7 @@ Worker::Worker( const char* name, const char* program, const std::vector<ImportE
     : m_hasData( true )
     , m_delay( 0 )
     , m_resolution( 0 )
+    , m_timerMul( 1. )
     , m_captureName( name )
     , m_captureProgram( program )
     , m_captureTime( 0 )
@@ -286,6 +353,8 @@ Worker::Worker( const char* name, const char* program, const std::vector<ImportE
     , m_pid( 0 )
     , m_samplingPeriod( 0 )
     , m_stream( nullptr )
+    , m_codec( TransportCodecNone )
+    , m_codecLevel( 0 )
     , m_buffer( nullptr )
     , m_traceVersion( CurrentVersion )
 {
@@ -351,39 +420,24 @@ Worker::Worker( const char* name, const char* program, const std::vector<ImportE
                 key = -int16_t( it->second + 1 );
             }
 
-            auto zone = AllocZoneEvent();
-            zone->SetStartSrcLoc( v.timestamp, key );
-            zone->SetEnd( -1 );
-            zone->SetChild( -1 );
+            m_threadCtxData = NoticeThread( v.tid );
+            NewZone( v.timestamp, key, v.tid );
 
             if( !v.text.empty() )
             {
-                auto& extra = RequestZoneExtra( *zone );
+                auto& extra = RequestZoneExtra( m_threadCtxData );
                 extra.text = StringIdx( StoreString( v.text.c_str(), v.text.size() ).idx );
             }
-
-            m_threadCtxData = NoticeThread( v.tid );
-            NewZone( zone, v.tid );
         }
         else
         {
             auto td = NoticeThread( v.tid );
             td->zoneIdStack.pop_back();
-            auto& stack = td->stack;
-            auto zone = stack.back_and_pop();
-            zone->SetEnd( v.timestamp );
-
-#ifndef TRACY_NO_STATISTICS
-            ZoneThreadData ztd;
-            ztd.SetZone( zone );
-            ztd.SetThread( CompressThread( v.tid ) );
-            auto slz = GetSourceLocationZones( zone->SrcLoc() );
-            slz->zones.push_back( ztd );
-#else
-            CountZoneStatistics( zone );
-#endif
+            td->openZones.pop_back();
+            QueueTimelineOp( td, v.timestamp, ZoneTimelineOp::End, 0 );
         }
     }
+    ProcessTimelineOps();
 
     for( auto& v : messages )
     {
@@ -459,21 +513,39 @@ Worker::Worker( const char* name, const char* program, const std::vector<ImportE
 
     m_data.framesBase->frames.push_back( FrameEvent{ 0, -1, -1 } );
     m_data.framesBase->frames.push_back( FrameEvent{ 0, -1, -1 } );
+
+#ifndef TRACY_NO_STATISTICS
+    m_data.sourceLocationZonesReady = true;
+    m_data.sourceLocationStatsReady = true;
+#endif
 }
 
-Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks )
+Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks, const char* pagedDir )
     : m_hasData( true )
     , m_stream( nullptr )
     , m_buffer( nullptr )
 {
     auto loadStart = std::chrono::high_resolution_clock::now();
 
+    if( pagedDir )
+    {
+        m_pagedDir = pagedDir;
+        m_slab.SetPaged( m_pagedDir.c_str() );
+    }
+
     m_data.callstackPayload.push_back( nullptr );
 
     int fileVer = 0;
 
     uint8_t hdr[8];
     f.Read( hdr, sizeof( hdr ) );
+    if( memcmp( JournalHeader, hdr, FileHeaderMagic ) == 0 )
+    {
+        m_traceVersion = FileVersion( hdr[FileHeaderMagic], hdr[FileHeaderMagic+1], hdr[FileHeaderMagic+2] );
+        ReplayJournal( f );
+        m_loadTime = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::high_resolution_clock::now() - loadStart ).count();
+        return;
+    }
     if( memcmp( FileHeader, hdr, FileHeaderMagic ) == 0 )
     {
         fileVer = FileVersion( hdr[FileHeaderMagic], hdr[FileHeaderMagic+1], hdr[FileHeaderMagic+2] );
@@ -517,6 +589,23 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks )
         f.Read( m_data.cpuManufacturer, 12 );
         m_data.cpuManufacturer[12] = '\0';
     }
+    if( fileVer >= FileVersion( 0, 7, 9 ) )
+    {
+        f.Read( m_data.samplesLost );
+    }
+    if( fileVer >= FileVersion( 0, 7, 10 ) )
+    {
+        uint64_t sz;
+        f.Read( sz );
+        m_data.zonesDropped.reserve( sz );
+        for( uint64_t i=0; i<sz; i++ )
+        {
+            int16_t srcloc;
+            uint64_t cnt;
+            f.Read2( srcloc, cnt );
+            m_data.zonesDropped.emplace( srcloc, cnt );
+        }
+    }
 
     uint64_t sz;
     {
@@ -715,22 +804,40 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks )
     m_data.sourceLocationZones.reserve( sle + sz );
 
     f.Read( sz );
-    for( uint64_t i=0; i<sz; i++ )
+    if( fileVer >= FileVersion( 0, 7, 11 ) )
     {
-        int16_t id;
-        uint64_t cnt;
-        f.Read2( id, cnt );
-        auto status = m_data.sourceLocationZones.emplace( id, SourceLocationZones() );
-        assert( status.second );
-        status.first->second.zones.reserve( cnt );
+        for( uint64_t i=0; i<sz; i++ )
+        {
+            int16_t id;
+            f.Read( id );
+            auto status = m_data.sourceLocationZones.emplace( id, SourceLocationZones() );
+            assert( status.second );
+            auto& slz = status.first->second;
+            f.Read8( slz.count, slz.min, slz.max, slz.total, slz.sumSq, slz.selfMin, slz.selfMax, slz.selfTotal );
+            slz.zones.reserve( slz.count );
+        }
+        m_data.sourceLocationStatsReady = true;
+    }
+    else
+    {
+        for( uint64_t i=0; i<sz; i++ )
+        {
+            int16_t id;
+            uint64_t cnt;
+            f.Read2( id, cnt );
+            auto status = m_data.sourceLocationZones.emplace( id, SourceLocationZones() );
+            assert( status.second );
+            status.first->second.zones.reserve( cnt );
+        }
     }
 #else
     f.Read( sz );
+    const auto slzSize = fileVer >= FileVersion( 0, 7, 11 ) ? sizeof( uint64_t ) + 6 * sizeof( int64_t ) + sizeof( double ) : sizeof( uint64_t );
     for( uint64_t i=0; i<sz; i++ )
     {
         int16_t id;
         f.Read( id );
-        f.Skip( sizeof( uint64_t ) );
+        f.Skip( slzSize );
         m_data.sourceLocationZonesCnt.emplace( id, 0 );
     }
 #endif
@@ -879,6 +986,24 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks )
     int32_t childIdx = 0;
     f.Read( sz );
     m_data.threads.reserve_exact( sz, m_slab );
+
+    // Large thread timelines are handed over to load jobs, which decode them into their own slabs.
+    // The section table tells how much data each timeline has and how many zone children slots
+    // it uses, so that the jobs don't depend on each other.
+    std::mutex loadSlabLock;
+    std::vector<Slab<64*1024*1024>*> loadSlabFree;
+    std::vector<ThreadData*> loadThreads;
+    std::unique_ptr<TaskDispatch> loadDispatch;
+    const auto loadWorkers = std::min<int>( std::thread::hardware_concurrency() - 1, 8 );
+    if( loadWorkers > 0 ) loadDispatch = std::make_unique<TaskDispatch>( loadWorkers );
+
+    std::vector<std::pair<uint64_t, uint32_t>> timelineTable;
+    if( fileVer >= FileVersion( 0, 7, 8 ) )
+    {
+        timelineTable.resize( sz );
+        for( auto& v : timelineTable ) f.Read2( v.first, v.second );
+    }
+
     for( uint64_t i=0; i<sz; i++ )
     {
         auto td = m_slab.AllocInit<ThreadData>();
@@ -902,7 +1027,40 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks )
             f.Read( tsz );
             if( tsz != 0 )
             {
-                ReadTimeline( f, td->timeline, tsz, 0, childIdx );
+                if( loadDispatch && !timelineTable.empty() && timelineTable[i].first >= ParallelTimelineSize )
+                {
+                    auto buf = new char[timelineTable[i].first];
+                    f.Read( buf, timelineTable[i].first );
+                    loadDispatch->Queue( [this, td, tsz, buf, idx = childIdx, &loadSlabLock, &loadSlabFree] {
+                        Slab<64*1024*1024>* slab;
+                        {
+                            std::lock_guard<std::mutex> lock( loadSlabLock );
+                            if( loadSlabFree.empty() )
+                            {
+                                m_loadSlabs.emplace_back( std::make_unique<Slab<64*1024*1024>>() );
+                                if( !m_pagedDir.empty() ) m_loadSlabs.back()->SetPaged( m_pagedDir.c_str() );
+                                slab = m_loadSlabs.back().get();
+                            }
+                            else
+                            {
+                                slab = loadSlabFree.back();
+                                loadSlabFree.pop_back();
+                            }
+                        }
+                        BufferRead br( buf );
+                        int32_t ci = idx;
+                        ReadTimeline( br, td->timeline, tsz, 0, ci, *slab );
+                        delete[] buf;
+                        std::lock_guard<std::mutex> lock( loadSlabLock );
+                        loadSlabFree.emplace_back( slab );
+                    } );
+                    childIdx += timelineTable[i].second;
+                    loadThreads.emplace_back( td );
+                }
+                else
+                {
+                    ReadTimeline( f, td->timeline, tsz, 0, childIdx, m_slab );
+                }
             }
         }
         uint64_t msz;
@@ -1454,16 +1612,41 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks )
                 m_data.cpuDataCount = i+1;
                 m_data.cpuData[i].cs.reserve_exact( sz, m_slab );
                 auto ptr = m_data.cpuData[i].cs.data();
-                for( uint64_t j=0; j<sz; j++ )
+                if( loadDispatch && sz * CpuContextSwitchSize >= ParallelTimelineSize )
                 {
-                    int64_t deltaStart, deltaEnd;
-                    uint16_t thread;
-                    f.Read3( deltaStart, deltaEnd, thread );
-                    refTime += deltaStart;
-                    ptr->SetStartThread( refTime, thread );
-                    refTime += deltaEnd;
-                    ptr->SetEnd( refTime );
-                    ptr++;
+                    auto buf = new char[sz * CpuContextSwitchSize];
+                    f.Read( buf, sz * CpuContextSwitchSize );
+                    loadDispatch->Queue( [ptr, sz, buf] {
+                        BufferRead br( buf );
+                        auto p = ptr;
+                        int64_t refTime = 0;
+                        for( uint64_t j=0; j<sz; j++ )
+                        {
+                            int64_t deltaStart, deltaEnd;
+                            uint16_t thread;
+                            br.Read3( deltaStart, deltaEnd, thread );
+                            refTime += deltaStart;
+                            p->SetStartThread( refTime, thread );
+                            refTime += deltaEnd;
+                            p->SetEnd( refTime );
+                            p++;
+                        }
+                        delete[] buf;
+                    } );
+                }
+                else
+                {
+                    for( uint64_t j=0; j<sz; j++ )
+                    {
+                        int64_t deltaStart, deltaEnd;
+                        uint16_t thread;
+                        f.Read3( deltaStart, deltaEnd, thread );
+                        refTime += deltaStart;
+                        ptr->SetStartThread( refTime, thread );
+                        refTime += deltaEnd;
+                        ptr->SetEnd( refTime );
+                        ptr++;
+                    }
                 }
                 cnt += sz;
             }
@@ -1685,6 +1868,11 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks )
         }
     }
 
+    if( loadDispatch ) loadDispatch->Sync();
+#ifdef TRACY_NO_STATISTICS
+    for( auto& td : loadThreads ) CountZoneStatistics( td->timeline );
+#endif
+
     s_loadProgress.total.store( 0, std::memory_order_relaxed );
     m_loadTime = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::high_resolution_clock::now() - loadStart ).count();
 
@@ -1709,15 +1897,17 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks )
                 if( mem.second->reconstruct ) jobs.emplace_back( std::thread( [this, mem = mem.second] { ReconstructMemAllocPlot( *mem ); } ) );
             }
 
+            // Statistics loaded from the trace are kept, only the zone lists have to be built.
+            const auto zonesOnly = m_data.sourceLocationStatsReady;
             std::function<void(Vector<short_ptr<ZoneEvent>>&, uint16_t)> ProcessTimeline;
-            ProcessTimeline = [this, &ProcessTimeline] ( Vector<short_ptr<ZoneEvent>>& _vec, uint16_t thread )
+            ProcessTimeline = [this, &ProcessTimeline, zonesOnly] ( Vector<short_ptr<ZoneEvent>>& _vec, uint16_t thread )
             {
                 if( m_shutdown.load( std::memory_order_relaxed ) ) return;
                 assert( _vec.is_magic() );
                 auto& vec = *(Vector<ZoneEvent>*)( &_vec );
                 for( auto& zone : vec )
                 {
-                    if( zone.IsEndValid() ) ReconstructZoneStatistics( zone, thread );
+                    if( zone.IsEndValid() ) ReconstructZoneStatistics( zone, thread, zonesOnly );
                     if( zone.HasChildren() ) ProcessTimeline( GetZoneChildrenMutable( zone.Child() ), thread );
                 }
             };
@@ -1868,6 +2058,7 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks )
             {
                 std::lock_guard<std::mutex> lock( m_data.lock );
                 m_data.sourceLocationZonesReady = true;
+                m_data.sourceLocationStatsReady = true;
             }
 
             m_backgroundDone.store( true, std::memory_order_relaxed );
@@ -1898,7 +2089,9 @@ Worker::~Worker()
         v->stack.~Vector();
         v->messages.~Vector();
         v->zoneIdStack.~Vector();
+        v->openZones.~Vector();
         v->samples.~Vector();
+        v->timelineOps.~Vector();
 #ifndef TRACY_NO_STATISTICS
         v->childTimeStack.~Vector();
         v->ghostZones.~Vector();
@@ -2607,7 +2800,7 @@ std::vector<int16_t> Worker::GetMatchingSourceLocation( const char* query, bool
 #ifndef TRACY_NO_STATISTICS
 const Worker::SourceLocationZones& Worker::GetZonesForSourceLocation( int16_t srcloc ) const
 {
-    assert( AreSourceLocationZonesReady() );
+    assert( AreSourceLocationStatsReady() );
     static const SourceLocationZones empty;
     auto it = m_data.sourceLocationZones.find( srcloc );
     return it != m_data.sourceLocationZones.end() ? it->second : empty;
@@ -2646,6 +2839,7 @@ void Worker::Network()
 {
     auto ShouldExit = [this] { return m_shutdown.load( std::memory_order_relaxed ); };
     auto lz4buf = std::make_unique<char[]>( LZ4Size );
+    ZSTD_DCtx* zctx = nullptr;
 
     for(;;)
     {
@@ -2657,30 +2851,93 @@ void Worker::Network()
         }
 
         auto buf = m_buffer + m_bufferOffset;
+        const char* src;
         lz4sz_t lz4sz;
-        if( !m_sock.Read( &lz4sz, sizeof( lz4sz ), 10, ShouldExit ) ) goto close;
-        if( !m_sock.Read( lz4buf.get(), lz4sz, 10, ShouldExit ) ) goto close;
+        uint64_t shmRelease = 0;
+#ifdef TRACY_HAS_SHM
+        if( m_shmTransport )
+        {
+            for(;;)
+            {
+                // The client doesn't send anything through the socket now, so readable
+                // socket means it was closed.
+                const auto alive = m_shm.IsPeerAlive() && !m_sock.HasData();
+                src = m_shm.Read( lz4sz );
+                if( src ) break;
+                if( !alive || ShouldExit() ) goto close;
+                m_shm.WaitData( 10 );
+            }
+            shmRelease = m_shm.GetReadPos();
+        }
+        else
+#endif
+        {
+            if( !m_sock.Read( &lz4sz, sizeof( lz4sz ), 10, ShouldExit ) ) goto close;
+            if( !m_sock.Read( m_codec == TransportCodecNone ? buf : lz4buf.get(), lz4sz, 10, ShouldExit ) ) goto close;
+            src = m_codec == TransportCodecNone ? buf : lz4buf.get();
+        }
         auto bb = m_bytes.load( std::memory_order_relaxed );
         m_bytes.store( bb + sizeof( lz4sz ) + lz4sz, std::memory_order_relaxed );
 
-        auto sz = LZ4_decompress_safe_continue( (LZ4_streamDecode_t*)m_stream, lz4buf.get(), buf, lz4sz, TargetFrameSize );
-        assert( sz >= 0 );
+        const auto t0 = std::chrono::high_resolution_clock::now();
+        const char* data = buf;
+        int sz;
+        switch( m_codec )
+        {
+        case TransportCodecNone:
+            // Frames in shared memory are processed in place.
+            data = src;
+            sz = int( lz4sz );
+            break;
+        case TransportCodecZstd:
+        {
+            if( !zctx ) zctx = ZSTD_createDCtx();
+            ZSTD_inBuffer in = { src, lz4sz, 0 };
+            ZSTD_outBuffer out = { buf, TargetFrameSize, 0 };
+            while( in.pos < in.size )
+            {
+                const auto ret = ZSTD_decompressStream( zctx, &out, &in );
+                if( ZSTD_isError( ret ) ) goto close;
+            }
+            sz = int( out.pos );
+            break;
+        }
+        default:
+            sz = LZ4_decompress_safe_continue( (LZ4_streamDecode_t*)m_stream, src, buf, lz4sz, TargetFrameSize );
+            assert( sz >= 0 );
+            break;
+        }
+        const auto t1 = std::chrono::high_resolution_clock::now();
         bb = m_decBytes.load( std::memory_order_relaxed );
         m_decBytes.store( bb + sz, std::memory_order_relaxed );
+        bb = m_decTime.load( std::memory_order_relaxed );
+        m_decTime.store( bb + std::chrono::duration_cast<std::chrono::nanoseconds>( t1 - t0 ).count(), std::memory_order_relaxed );
+
+#ifdef TRACY_HAS_SHM
+        if( shmRelease != 0 && data != src )
+        {
+            m_shm.Release( shmRelease );
+            shmRelease = 0;
+        }
+#endif
 
         {
             std::lock_guard<std::mutex> lock( m_netReadLock );
-            m_netRead.push_back( NetBuffer { m_bufferOffset, sz } );
+            m_netRead.push_back( NetBuffer { data, sz, shmRelease } );
             m_netReadCv.notify_one();
         }
 
-        m_bufferOffset += sz;
-        if( m_bufferOffset > TargetFrameSize * 2 ) m_bufferOffset = 0;
+        if( data == buf )
+        {
+            m_bufferOffset += sz;
+            if( m_bufferOffset > TargetFrameSize * 2 ) m_bufferOffset = 0;
+        }
     }
 
 close:
+    if( zctx ) ZSTD_freeDCtx( zctx );
     std::lock_guard<std::mutex> lock( m_netReadLock );
-    m_netRead.push_back( NetBuffer { -1 } );
+    m_netRead.push_back( NetBuffer { nullptr } );
     m_netReadCv.notify_one();
 }
 
@@ -2700,6 +2957,8 @@ void Worker::Exec()
     m_sock.Send( HandshakeShibboleth, HandshakeShibbolethSize );
     uint32_t protocolVersion = ProtocolVersion;
     m_sock.Send( &protocolVersion, sizeof( protocolVersion ) );
+    TransportRequestMessage transport = { m_codec, m_codecLevel, uint8_t( m_shmRequest ? 1 : 0 ) };
+    m_sock.Send( &transport, sizeof( transport ) );
     HandshakeStatus handshake;
     if( !m_sock.Read( &handshake, sizeof( handshake ), 10, ShouldExit ) )
     {
@@ -2717,17 +2976,6 @@ void Worker::Exec()
         goto close;
     }
 
-    m_data.framesBase = m_data.frames.Retrieve( 0, [this] ( uint64_t name ) {
-        auto fd = m_slab.AllocInit<FrameData>();
-        fd->name = name;
-        fd->continuous = 1;
-        return fd;
-    }, [this] ( uint64_t name ) {
-        assert( name == 0 );
-        char tmp[6] = "Frame";
-        HandleFrameName( name, tmp, 5 );
-    } );
-
     {
         WelcomeMessage welcome;
         if( !m_sock.Read( &welcome, sizeof( welcome ), 10, ShouldExit ) )
@@ -2735,47 +2983,37 @@ void Worker::Exec()
             m_handshake.store( HandshakeDropped, std::memory_order_relaxed );
             goto close;
         }
-        m_timerMul = welcome.timerMul;
-        m_data.baseTime = welcome.initBegin;
-        const auto initEnd = TscTime( welcome.initEnd - m_data.baseTime );
-        m_data.framesBase->frames.push_back( FrameEvent{ 0, -1, -1 } );
-        m_data.framesBase->frames.push_back( FrameEvent{ initEnd, -1, -1 } );
-        m_data.lastTime = initEnd;
-        m_delay = TscTime( welcome.delay );
-        m_resolution = TscTime( welcome.resolution );
-        m_pid = welcome.pid;
-        m_samplingPeriod = welcome.samplingPeriod;
-        m_onDemand = welcome.onDemand;
-        m_captureProgram = welcome.programName;
-        m_captureTime = welcome.epoch;
-        m_executableTime = welcome.exectime;
-        m_ignoreMemFreeFaults = welcome.onDemand || welcome.isApple;
-        m_data.cpuArch = (CpuArchitecture)welcome.cpuArch;
-        m_codeTransfer = welcome.codeTransfer;
-        m_data.cpuId = welcome.cpuId;
-        memcpy( m_data.cpuManufacturer, welcome.cpuManufacturer, 12 );
-        m_data.cpuManufacturer[12] = '\0';
-
-        char dtmp[64];
-        time_t date = welcome.epoch;
-        auto lt = localtime( &date );
-        strftime( dtmp, 64, "%F %T", lt );
-        char tmp[1024];
-        sprintf( tmp, "%s @ %s", welcome.programName, dtmp );
-        m_captureName = tmp;
+        ProcessWelcome( welcome );
 
-        m_hostInfo = welcome.hostInfo;
+        if( welcome.shmName[0] != '\0' )
+        {
+            welcome.shmName[sizeof( welcome.shmName ) - 1] = '\0';
+            uint8_t status = 0;
+#ifdef TRACY_HAS_SHM
+            if( m_shm.Open( welcome.shmName, welcome.shmKey ) ) status = 1;
+#endif
+            m_shmTransport = status != 0;
+            m_sock.Send( &status, sizeof( status ) );
+        }
 
+        OnDemandPayloadMessage onDemand;
         if( welcome.onDemand != 0 )
         {
-            OnDemandPayloadMessage onDemand;
             if( !m_sock.Read( &onDemand, sizeof( onDemand ), 10, ShouldExit ) )
             {
                 m_handshake.store( HandshakeDropped, std::memory_order_relaxed );
                 goto close;
             }
-            m_data.frameOffset = onDemand.frames;
-            m_data.framesBase->frames.push_back( FrameEvent{ TscTime( onDemand.currentTime - m_data.baseTime ), -1, -1 } );
+            ProcessOnDemandPayload( onDemand );
+        }
+
+        if( m_journal )
+        {
+            m_journal->Write( JournalHeader, sizeof( JournalHeader ) );
+            uint32_t protocolVersion = ProtocolVersion;
+            m_journal->Write( &protocolVersion, sizeof( protocolVersion ) );
+            m_journal->Write( &welcome, sizeof( welcome ) );
+            if( welcome.onDemand != 0 ) m_journal->Write( &onDemand, sizeof( onDemand ) );
         }
     }
 
@@ -2807,24 +3045,51 @@ void Worker::Exec()
             netbuf = m_netRead.front();
             m_netRead.erase( m_netRead.begin() );
         }
-        if( netbuf.bufferOffset < 0 ) goto close;
+        if( !netbuf.ptr ) goto close;
 
-        const char* ptr = m_buffer + netbuf.bufferOffset;
+        const char* ptr = netbuf.ptr;
         const char* end = ptr + netbuf.size;
 
         {
             std::lock_guard<std::mutex> lock( m_data.lock );
-            while( ptr < end )
+            if( m_journal )
             {
-                auto ev = (const QueueItem*)ptr;
-                if( !DispatchProcess( *ev, ptr ) )
+                const uint32_t sz = netbuf.size;
+                m_journal->Write( &sz, sizeof( sz ) );
+                m_journal->Write( ptr, sz );
+                while( ptr < end )
                 {
-                    if( m_failure != Failure::None ) HandleFailure( ptr, end );
-                    QueryTerminate();
-                    goto close;
+                    auto ev = (const QueueItem*)ptr;
+                    DispatchJournal( *ev, ptr );
                 }
             }
+            else
+            {
+                while( ptr < end )
+                {
+                    auto ev = (const QueueItem*)ptr;
+                    if( !DispatchProcess( *ev, ptr ) )
+                    {
+                        ProcessTimelineOps();
+                        if( m_failure != Failure::None ) HandleFailure( ptr, end );
+                        QueryTerminate();
+                        goto close;
+                    }
+                }
+                ProcessTimelineOps();
+#ifdef TRACY_NO_STATISTICS
+                // Dropping in steps of a fraction of the limit keeps the amount of work per step low.
+                if( m_historyLimit != 0 && m_data.lastTime - m_historyDropTime > m_historyLimit / 8 )
+                {
+                    m_historyDropTime = m_data.lastTime;
+                    DropHistory( m_data.lastTime - m_historyLimit );
+                }
+#endif
+            }
 
+#ifdef TRACY_HAS_SHM
+            if( netbuf.shmRelease != 0 ) m_shm.Release( netbuf.shmRelease );
+#endif
             {
                 std::lock_guard<std::mutex> lock( m_netWriteLock );
                 m_netWriteCnt++;
@@ -2872,7 +3137,7 @@ void Worker::Exec()
                 bool done = true;
                 for( auto& v : m_data.threads )
                 {
-                    if( !v->stack.empty() )
+                    if( !v->openZones.empty() )
                     {
                         done = false;
                         break;
@@ -2887,16 +3152,194 @@ void Worker::Exec()
     }
 
 close:
+    if( m_journal && m_hasData.load( std::memory_order_relaxed ) )
+    {
+        const uint32_t terminator = 0;
+        m_journal->Write( &terminator, sizeof( terminator ) );
+    }
     Shutdown();
     m_netWriteCv.notify_one();
+#ifdef TRACY_HAS_SHM
+    if( m_shmTransport ) m_shm.Shutdown();
+#endif
     m_sock.Close();
     m_connected.store( false, std::memory_order_relaxed );
 }
 
+void Worker::ProcessWelcome( const WelcomeMessage& welcome )
+{
+    m_data.framesBase = m_data.frames.Retrieve( 0, [this] ( uint64_t name ) {
+        auto fd = m_slab.AllocInit<FrameData>();
+        fd->name = name;
+        fd->continuous = 1;
+        return fd;
+    }, [this] ( uint64_t name ) {
+        assert( name == 0 );
+        char tmp[6] = "Frame";
+        HandleFrameName( name, tmp, 5 );
+    } );
+
+    m_timerMul = welcome.timerMul;
+    m_data.baseTime = welcome.initBegin;
+    const auto initEnd = TscTime( welcome.initEnd - m_data.baseTime );
+    m_data.framesBase->frames.push_back( FrameEvent{ 0, -1, -1 } );
+    m_data.framesBase->frames.push_back( FrameEvent{ initEnd, -1, -1 } );
+    m_data.lastTime = initEnd;
+    m_delay = TscTime( welcome.delay );
+    m_resolution = TscTime( welcome.resolution );
+    m_pid = welcome.pid;
+    m_samplingPeriod = welcome.samplingPeriod;
+    m_onDemand = welcome.onDemand;
+    m_captureProgram = welcome.programName;
+    m_captureTime = welcome.epoch;
+    m_executableTime = welcome.exectime;
+    m_ignoreMemFreeFaults = welcome.onDemand || welcome.isApple;
+    m_data.cpuArch = (CpuArchitecture)welcome.cpuArch;
+    m_codeTransfer = welcome.codeTransfer;
+    m_codec = (TransportCodec)welcome.codec;
+    m_codecLevel = welcome.codecLevel;
+    m_data.cpuId = welcome.cpuId;
+    memcpy( m_data.cpuManufacturer, welcome.cpuManufacturer, 12 );
+    m_data.cpuManufacturer[12] = '\0';
+
+    char dtmp[64];
+    time_t date = welcome.epoch;
+    auto lt = localtime( &date );
+    strftime( dtmp, 64, "%F %T", lt );
+    char tmp[1024];
+    sprintf( tmp, "%s @ %s", welcome.programName, dtmp );
+    m_captureName = tmp;
+
+    m_hostInfo = welcome.hostInfo;
+}
+
+void Worker::ProcessOnDemandPayload( const OnDemandPayloadMessage& onDemand )
+{
+    m_data.frameOffset = onDemand.frames;
+    m_data.framesBase->frames.push_back( FrameEvent{ TscTime( onDemand.currentTime - m_data.baseTime ), -1, -1 } );
+}
+
+void Worker::ReplayJournal( FileRead& f )
+{
+    // The journal stream is only meaningful to the protocol version that produced it.
+    uint32_t protocolVersion;
+    f.Read( protocolVersion );
+    if( protocolVersion != ProtocolVersion )
+    {
+        if( m_traceVersion > CurrentVersion ) throw UnsupportedVersion( m_traceVersion );
+        throw LegacyVersion( m_traceVersion );
+    }
+
+    m_buffer = new char[TargetFrameSize];
+    m_pendingStrings = 0;
+    m_pendingThreads = 0;
+    m_pendingExternalNames = 0;
+    m_pendingSourceLocation = 0;
+    m_pendingCallstackFrames = 0;
+    m_pendingCallstackSubframes = 0;
+    m_pendingCodeInformation = 0;
+    m_callstackFrameStaging = nullptr;
+    m_serverQuerySpaceLeft = m_serverQuerySpaceBase = 0;
+
+    m_data.sourceLocationExpand.push_back( 0 );
+    m_data.localThreadCompress.InitZero();
+    m_data.zoneExtra.push_back( ZoneExtra {} );
+    m_data.symbolLocInline.push_back( std::numeric_limits<uint64_t>::max() );
+    m_data.memory = m_slab.AllocInit<MemData>();
+    m_data.memNameMap.emplace( 0, m_data.memory );
+
+    memset( (char*)m_gpuCtxMap, 0, sizeof( m_gpuCtxMap ) );
+
+#ifndef TRACY_NO_STATISTICS
+    m_data.sourceLocationZonesReady = true;
+    m_data.sourceLocationStatsReady = true;
+    m_data.callstackSamplesReady = true;
+    m_data.ghostZonesReady = true;
+    m_data.ctxUsageReady = true;
+    m_data.symbolSamplesReady = true;
+#endif
+
+    WelcomeMessage welcome;
+    f.Read( &welcome, sizeof( welcome ) );
+    ProcessWelcome( welcome );
+    if( welcome.onDemand != 0 )
+    {
+        OnDemandPayloadMessage onDemand;
+        f.Read( &onDemand, sizeof( onDemand ) );
+        ProcessOnDemandPayload( onDemand );
+    }
+
+    for(;;)
+    {
+        // The journal of a killed capture has no terminator and may end in the middle of a frame.
+        // Replay stops at the last complete frame.
+        uint32_t sz;
+        if( f.ReadUpTo( &sz, sizeof( sz ) ) != sizeof( sz ) || sz == 0 ) break;
+        if( sz > TargetFrameSize ) throw FileReadError();
+        if( f.ReadUpTo( m_buffer, sz ) != sz ) break;
+
+        const char* ptr = m_buffer;
+        const char* end = ptr + sz;
+        const auto t0 = std::chrono::high_resolution_clock::now();
+        while( ptr < end )
+        {
+            auto ev = (const QueueItem*)ptr;
+            const auto idx = ev->hdr.idx;
+            const auto evStart = ptr;
+            // Thread names may be queried on events that do not register the thread
+            if( ev->hdr.type == QueueType::ThreadName && m_data.threadNames.find( ev->stringTransfer.ptr ) == m_data.threadNames.end() )
+            {
+                uint16_t ssz;
+                memcpy( &ssz, ptr + sizeof( QueueHeader ) + sizeof( QueueStringTransfer ), sizeof( ssz ) );
+                ptr += sizeof( QueueHeader ) + sizeof( QueueStringTransfer ) + sizeof( ssz );
+                m_data.threadNames.emplace( ev->stringTransfer.ptr, StoreString( ptr, ssz ).ptr );
+                ptr += ssz;
+            }
+            else
+            {
+                bool ok;
+                if( s_ingestEventTiming )
+                {
+                    const auto e0 = std::chrono::high_resolution_clock::now();
+                    ok = DispatchProcess( *ev, ptr );
+                    const auto e1 = std::chrono::high_resolution_clock::now();
+                    m_ingestStats.time[idx] += std::chrono::duration_cast<std::chrono::nanoseconds>( e1 - e0 ).count();
+                }
+                else
+                {
+                    ok = DispatchProcess( *ev, ptr );
+                }
+                if( !ok )
+                {
+                    ProcessTimelineOps();
+                    if( m_failure != Failure::None ) HandleFailure( ptr, end );
+                    goto done;
+                }
+            }
+            m_ingestStats.count[idx]++;
+            m_ingestStats.bytes[idx] += ptr - evStart;
+        }
+        const auto t1 = std::chrono::high_resolution_clock::now();
+        ProcessTimelineOps();
+        const auto t2 = std::chrono::high_resolution_clock::now();
+        m_ingestStats.buffers++;
+        m_ingestStats.dispatchTime += std::chrono::duration_cast<std::chrono::nanoseconds>( t1 - t0 ).count();
+        m_ingestStats.timelineTime += std::chrono::duration_cast<std::chrono::nanoseconds>( t2 - t1 ).count();
+        const auto mem = memUsage.load( std::memory_order_relaxed );
+        if( m_ingestStats.peakMemory < mem ) m_ingestStats.peakMemory = mem;
+    }
+
+done:
+    const auto t0 = std::chrono::high_resolution_clock::now();
+    DoPostponedWork();
+    m_ingestStats.postponedTime = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::high_resolution_clock::now() - t0 ).count();
+}
+
 void Worker::UpdateMbps( int64_t td )
 {
     const auto bytes = m_bytes.exchange( 0, std::memory_order_relaxed );
     const auto decBytes = m_decBytes.exchange( 0, std::memory_order_relaxed );
+    const auto decTime = m_decTime.exchange( 0, std::memory_order_relaxed );
     std::lock_guard<std::shared_mutex> lock( m_mbpsData.lock );
     if( td != 0 )
     {
@@ -2904,6 +3347,7 @@ void Worker::UpdateMbps( int64_t td )
         m_mbpsData.mbps.emplace_back( bytes / ( td * 125.f ) );
     }
     m_mbpsData.compRatio = decBytes == 0 ? 1 : float( bytes ) / decBytes;
+    if( decTime != 0 ) m_mbpsData.decSpeed = decBytes * 1000.f / decTime;
     m_mbpsData.queue = m_serverQueryQueue.size();
     m_mbpsData.transferred += bytes;
 }
@@ -2944,6 +3388,7 @@ bool Worker::HasAllFailureData()
 void Worker::HandleFailure( const char* ptr, const char* end )
 {
     if( HasAllFailureData() ) return;
+    uint64_t shmRelease = 0;
     for(;;)
     {
         while( ptr < end )
@@ -2953,6 +3398,9 @@ void Worker::HandleFailure( const char* ptr, const char* end )
         }
         if( HasAllFailureData() ) return;
 
+#ifdef TRACY_HAS_SHM
+        if( shmRelease != 0 ) m_shm.Release( shmRelease );
+#endif
         {
             std::lock_guard<std::mutex> lock( m_netWriteLock );
             m_netWriteCnt++;
@@ -2983,10 +3431,11 @@ void Worker::HandleFailure( const char* ptr, const char* end )
             netbuf = m_netRead.front();
             m_netRead.erase( m_netRead.begin() );
         }
-        if( netbuf.bufferOffset < 0 ) return;
+        if( !netbuf.ptr ) return;
 
-        ptr = m_buffer + netbuf.bufferOffset;
+        ptr = netbuf.ptr;
         end = ptr + netbuf.size;
+        shmRelease = netbuf.shmRelease;
     }
 }
 
@@ -3053,6 +3502,12 @@ void Worker::DispatchFailure( const QueueItem& ev, const char*& ptr )
             ptr += sz;
             break;
         default:
+            if( QueueDeltaTimeOffset( ev.hdr.idx ) != 0 )
+            {
+                QueueItem item;
+                ptr += QueueDecodeDeltaTime( (char*)&item, ptr, QueueDataSize[ev.hdr.idx], QueueDeltaTimeOffset( ev.hdr.idx ) );
+                break;
+            }
             ptr += QueueDataSize[ev.hdr.idx];
             switch( ev.hdr.type )
             {
@@ -3082,6 +3537,9 @@ void Worker::DispatchFailure( const QueueItem& ev, const char*& ptr )
 
 void Worker::Query( ServerQuery type, uint64_t data, uint32_t extra )
 {
+    // Journal replay has no client to ask, responses are already in the stream.
+    if( !m_sock.IsValid() ) return;
+
     ServerQueryPacket query { type, data, extra };
     if( m_serverQueryQueue.empty() && m_serverQuerySpaceLeft > 0 )
     {
@@ -3154,7 +3612,7 @@ bool Worker::DispatchProcess( const QueueItem& ev, const char*& ptr )
             switch( ev.hdr.type )
             {
             case QueueType::FrameImageData:
-                AddFrameImageData( ev.stringTransfer.ptr, ptr, sz );
+                if( !m_journal ) AddFrameImageData( ev.stringTransfer.ptr, ptr, sz );
                 break;
             case QueueType::SymbolCode:
                 AddSymbolCode( ev.stringTransfer.ptr, ptr, sz );
@@ -3190,7 +3648,7 @@ bool Worker::DispatchProcess( const QueueItem& ev, const char*& ptr )
                 m_serverQuerySpaceLeft++;
                 break;
             case QueueType::SourceLocationPayload:
-                AddSourceLocationPayload( ev.stringTransfer.ptr, ptr, sz );
+                if( !m_journal ) AddSourceLocationPayload( ev.stringTransfer.ptr, ptr, sz );
                 break;
             case QueueType::CallstackPayload:
                 AddCallstackPayload( ev.stringTransfer.ptr, ptr, sz );
@@ -3237,60 +3695,278 @@ bool Worker::DispatchProcess( const QueueItem& ev, const char*& ptr )
             ptr += sz;
             return true;
         default:
+        {
+            const auto toff = QueueDeltaTimeOffset( ev.hdr.idx );
+            if( toff != 0 )
+            {
+                QueueItem item;
+                ptr += QueueDecodeDeltaTime( (char*)&item, ptr, QueueDataSize[ev.hdr.idx], toff );
+                return Process( item );
+            }
             ptr += QueueDataSize[ev.hdr.idx];
             return Process( ev );
         }
+        }
     }
 }
 
-void Worker::CheckSourceLocation( uint64_t ptr )
+// Journal capture only keeps the state needed to answer the client queries. The
+// triggers below mirror the ones in Process(), so that replay of the journal finds
+// each query response where the live worker would have expected it.
+void Worker::DispatchJournal( const QueueItem& ev, const char*& ptr )
 {
-    if( m_data.checkSrclocLast != ptr )
+    if( ev.hdr.idx >= (int)QueueType::StringData )
     {
-        m_data.checkSrclocLast = ptr;
-        if( m_data.sourceLocation.find( ptr ) == m_data.sourceLocation.end() )
-        {
-            NewSourceLocation( ptr );
-        }
+        DispatchProcess( ev, ptr );
+        return;
     }
-}
-
-void Worker::NewSourceLocation( uint64_t ptr )
-{
-    static const SourceLocation emptySourceLocation = {};
-
-    m_data.sourceLocation.emplace( ptr, emptySourceLocation );
-    m_pendingSourceLocation++;
-    m_sourceLocationQueue.push_back( ptr );
 
-    Query( ServerQuerySourceLocation, ptr );
-}
+    uint16_t sz;
+    switch( ev.hdr.type )
+    {
+    case QueueType::SingleStringData:
+    case QueueType::SecondStringData:
+        ptr += sizeof( QueueHeader );
+        memcpy( &sz, ptr, sizeof( sz ) );
+        ptr += sizeof( sz );
+        m_journalString[ev.hdr.type == QueueType::SecondStringData].assign( ptr, sz );
+        ptr += sz;
+        return;
+    default:
+        break;
+    }
 
-int16_t Worker::ShrinkSourceLocationReal( uint64_t srcloc )
-{
-    auto it = m_sourceLocationShrink.find( srcloc );
-    if( it != m_sourceLocationShrink.end() )
+    QueueItem item;
+    const auto toff = QueueDeltaTimeOffset( ev.hdr.idx );
+    if( toff != 0 )
     {
-        m_data.shrinkSrclocLast.first = srcloc;
-        m_data.shrinkSrclocLast.second = it->second;
-        return it->second;
+        ptr += QueueDecodeDeltaTime( (char*)&item, ptr, QueueDataSize[ev.hdr.idx], toff );
     }
     else
     {
-        return NewShrinkedSourceLocation( srcloc );
+        memcpy( &item, ptr, QueueDataSize[ev.hdr.idx] );
+        ptr += QueueDataSize[ev.hdr.idx];
     }
-}
 
-int16_t Worker::NewShrinkedSourceLocation( uint64_t srcloc )
-{
-    assert( m_data.sourceLocationExpand.size() < std::numeric_limits<int16_t>::max() );
-    const auto sz = int16_t( m_data.sourceLocationExpand.size() );
-    m_data.sourceLocationExpand.push_back( srcloc );
-#ifndef TRACY_NO_STATISTICS
-    auto res = m_data.sourceLocationZones.emplace( sz, SourceLocationZones() );
-    m_data.srclocZonesLast.first = sz;
-    m_data.srclocZonesLast.second = &res.first->second;
-#else
+    auto CreateFrame = [this] ( uint64_t name ) {
+        auto fd = m_slab.AllocInit<FrameData>();
+        fd->name = name;
+        return fd;
+    };
+    auto QueryFrame = [this] ( uint64_t name ) {
+        Query( ServerQueryFrameName, name );
+    };
+    auto CreatePlot = [this] ( uint64_t name ) {
+        auto plot = m_slab.AllocInit<PlotData>();
+        plot->name = name;
+        return plot;
+    };
+    auto QueryPlot = [this] ( uint64_t name ) {
+        Query( ServerQueryPlotName, name );
+    };
+
+    switch( item.hdr.type )
+    {
+    case QueueType::ThreadContext:
+        m_threadCtx = item.threadCtx.thread;
+        break;
+    case QueueType::ZoneBegin:
+    case QueueType::ZoneBeginCallstack:
+        CheckSourceLocation( item.zoneBegin.srcloc );
+        CheckThreadString( m_threadCtx );
+        break;
+    case QueueType::ZoneBeginAllocSrcLoc:
+    case QueueType::ZoneBeginAllocSrcLocCallstack:
+    case QueueType::ZoneValidation:
+    case QueueType::Message:
+    case QueueType::MessageColor:
+    case QueueType::MessageCallstack:
+    case QueueType::MessageColorCallstack:
+        CheckThreadString( m_threadCtx );
+        break;
+    case QueueType::GpuZoneBegin:
+    case QueueType::GpuZoneBeginCallstack:
+    case QueueType::GpuZoneBeginSerial:
+    case QueueType::GpuZoneBeginCallstackSerial:
+        CheckSourceLocation( item.gpuZoneBegin.srcloc );
+        break;
+    case QueueType::FrameMarkMsg:
+    case QueueType::FrameMarkMsgStart:
+    case QueueType::FrameMarkMsgEnd:
+        m_data.frames.Retrieve( item.frameMark.name, CreateFrame, QueryFrame );
+        break;
+    case QueueType::SourceLocation:
+        AddSourceLocation( item.srcloc );
+        m_serverQuerySpaceLeft++;
+        break;
+    case QueueType::LockAnnounce:
+        CheckSourceLocation( item.lockAnnounce.lckloc );
+        break;
+    case QueueType::LockMark:
+        CheckSourceLocation( item.lockMark.srcloc );
+        break;
+    case QueueType::ZonesDropped:
+        CheckSourceLocation( item.zonesDropped.srcloc );
+        break;
+    case QueueType::LockWait:
+    case QueueType::LockSharedWait:
+        CheckThreadString( item.lockWait.thread );
+        break;
+    case QueueType::LockObtain:
+    case QueueType::LockSharedObtain:
+        CheckThreadString( item.lockObtain.thread );
+        break;
+    case QueueType::LockRelease:
+    case QueueType::LockSharedRelease:
+        CheckThreadString( item.lockRelease.thread );
+        break;
+    case QueueType::PlotData:
+        if( item.plotData.type == PlotDataType::Double && !isfinite( item.plotData.data.d ) ) break;
+        if( item.plotData.type == PlotDataType::Float && !isfinite( item.plotData.data.f ) ) break;
+        m_data.plots.Retrieve( item.plotData.name, CreatePlot, QueryPlot );
+        break;
+    case QueueType::PlotConfig:
+        m_data.plots.Retrieve( item.plotConfig.name, CreatePlot, QueryPlot );
+        break;
+    case QueueType::MessageLiteral:
+    case QueueType::MessageLiteralCallstack:
+        CheckString( item.messageLiteral.text );
+        CheckThreadString( m_threadCtx );
+        break;
+    case QueueType::MessageLiteralColor:
+    case QueueType::MessageLiteralColorCallstack:
+        CheckString( item.messageColorLiteral.text );
+        CheckThreadString( m_threadCtx );
+        break;
+    case QueueType::MemNamePayload:
+        m_memNamePayload = item.memName.name;
+        break;
+    case QueueType::MemAllocNamed:
+    case QueueType::MemAllocCallstackNamed:
+        CheckString( m_memNamePayload );
+        m_memNamePayload = 0;
+        CheckThreadString( item.memAlloc.thread );
+        break;
+    case QueueType::MemAlloc:
+    case QueueType::MemAllocCallstack:
+        CheckThreadString( item.memAlloc.thread );
+        break;
+    case QueueType::MemFreeNamed:
+    case QueueType::MemFreeCallstackNamed:
+        CheckString( m_memNamePayload );
+        m_memNamePayload = 0;
+        if( item.memFree.ptr != 0 ) CheckThreadString( item.memFree.thread );
+        break;
+    case QueueType::MemFree:
+    case QueueType::MemFreeCallstack:
+        if( item.memFree.ptr != 0 ) CheckThreadString( item.memFree.thread );
+        break;
+    case QueueType::CallstackSample:
+        CheckThreadString( item.callstackSample.thread );
+        m_pendingCallstackId = 0;
+        break;
+    case QueueType::CallstackSerial:
+    case QueueType::Callstack:
+    case QueueType::CallstackAlloc:
+    case QueueType::CallstackCached:
+        m_pendingCallstackId = 0;
+        break;
+    case QueueType::CallstackFrameSize:
+        AddSingleString( m_journalString[0].data(), m_journalString[0].size() );
+        ProcessCallstackFrameSize( item.callstackFrameSize );
+        m_serverQuerySpaceLeft++;
+        break;
+    case QueueType::CallstackFrame:
+        AddSingleString( m_journalString[0].data(), m_journalString[0].size() );
+        AddSecondString( m_journalString[1].data(), m_journalString[1].size() );
+        ProcessCallstackFrame( item.callstackFrame, true );
+        break;
+    case QueueType::SymbolInformation:
+        AddSingleString( m_journalString[0].data(), m_journalString[0].size() );
+        ProcessSymbolInformation( item.symbolInformation );
+        m_serverQuerySpaceLeft++;
+        break;
+    case QueueType::CodeInformation:
+        AddSingleString( m_journalString[0].data(), m_journalString[0].size() );
+        ProcessCodeInformation( item.codeInformation );
+        m_serverQuerySpaceLeft++;
+        break;
+    case QueueType::Terminate:
+        m_terminate = true;
+        break;
+    case QueueType::Crash:
+        m_crashed = true;
+        break;
+    case QueueType::CrashReport:
+        CheckString( item.crashReport.text );
+        break;
+    case QueueType::ContextSwitch:
+        if( item.contextSwitch.newThread != 0 ) CheckExternalName( item.contextSwitch.newThread );
+        break;
+    case QueueType::ParamSetup:
+        CheckString( item.paramSetup.name );
+        break;
+    case QueueType::AckServerQueryNoop:
+        m_serverQuerySpaceLeft++;
+        break;
+    case QueueType::AckSourceCodeNotAvailable:
+        assert( !m_sourceCodeQuery.empty() );
+        m_sourceCodeQuery.erase( m_sourceCodeQuery.begin() );
+        m_serverQuerySpaceLeft++;
+        break;
+    default:
+        break;
+    }
+}
+
+void Worker::CheckSourceLocation( uint64_t ptr )
+{
+    if( m_data.checkSrclocLast != ptr )
+    {
+        m_data.checkSrclocLast = ptr;
+        if( m_data.sourceLocation.find( ptr ) == m_data.sourceLocation.end() )
+        {
+            NewSourceLocation( ptr );
+        }
+    }
+}
+
+void Worker::NewSourceLocation( uint64_t ptr )
+{
+    static const SourceLocation emptySourceLocation = {};
+
+    m_data.sourceLocation.emplace( ptr, emptySourceLocation );
+    m_pendingSourceLocation++;
+    m_sourceLocationQueue.push_back( ptr );
+
+    Query( ServerQuerySourceLocation, ptr );
+}
+
+int16_t Worker::ShrinkSourceLocationReal( uint64_t srcloc )
+{
+    auto it = m_sourceLocationShrink.find( srcloc );
+    if( it != m_sourceLocationShrink.end() )
+    {
+        m_data.shrinkSrclocLast.first = srcloc;
+        m_data.shrinkSrclocLast.second = it->second;
+        return it->second;
+    }
+    else
+    {
+        return NewShrinkedSourceLocation( srcloc );
+    }
+}
+
+int16_t Worker::NewShrinkedSourceLocation( uint64_t srcloc )
+{
+    assert( m_data.sourceLocationExpand.size() < std::numeric_limits<int16_t>::max() );
+    const auto sz = int16_t( m_data.sourceLocationExpand.size() );
+    m_data.sourceLocationExpand.push_back( srcloc );
+#ifndef TRACY_NO_STATISTICS
+    auto res = m_data.sourceLocationZones.emplace( sz, SourceLocationZones() );
+    m_data.srclocZonesLast.first = sz;
+    m_data.srclocZonesLast.second = &res.first->second;
+#else
     auto res = m_data.sourceLocationZonesCnt.emplace( sz, 0 );
     m_data.srclocCntLast.first = sz;
     m_data.srclocCntLast.second = &res.first->second;
@@ -3416,52 +4092,348 @@ ThreadData* Worker::NewThread( uint64_t thread )
     return td;
 }
 
-void Worker::NewZone( ZoneEvent* zone, uint64_t thread )
+void Worker::NewZone( int64_t start, int16_t srcloc, uint64_t thread )
 {
     m_data.zonesCnt++;
 
     auto td = m_threadCtxData;
     if( !td ) td = m_threadCtxData = NoticeThread( thread );
     td->count++;
-    const auto ssz = td->stack.size();
-    if( ssz == 0 )
+    int32_t parent = ZoneTimelineOp::Timeline;
+    const auto ssz = td->openZones.size();
+    if( ssz != 0 )
+    {
+        // The children vector slot is assigned here, so that the timeline jobs never grow zoneChildren.
+        auto& back = td->openZones.data()[ssz-1];
+        if( back.child < 0 )
+        {
+            int32_t child;
+#ifdef TRACY_NO_STATISTICS
+            if( !m_zoneChildrenPool.empty() )
+            {
+                child = m_zoneChildrenPool.back_and_pop();
+                if( m_data.zoneVectorCache.empty() )
+                {
+                    m_data.zoneChildren[child] = Vector<short_ptr<ZoneEvent>>();
+                }
+                else
+                {
+                    auto& vze = m_data.zoneChildren[child] = std::move( m_data.zoneVectorCache.back_and_pop() );
+                    assert( !vze.empty() );
+                    vze.clear();
+                }
+            }
+            else
+#endif
+            {
+                child = int32_t( m_data.zoneChildren.size() );
+                if( m_data.zoneVectorCache.empty() )
+                {
+                    m_data.zoneChildren.push_back( Vector<short_ptr<ZoneEvent>>() );
+                }
+                else
+                {
+                    Vector<short_ptr<ZoneEvent>> vze = std::move( m_data.zoneVectorCache.back_and_pop() );
+                    assert( !vze.empty() );
+                    vze.clear();
+                    m_data.zoneChildren.push_back( std::move( vze ) );
+                }
+            }
+            back.child = child;
+        }
+        parent = back.child;
+    }
+    td->openZones.push_back( OpenZone { -1, 0, srcloc } );
+    QueueTimelineOp( td, start, parent, srcloc );
+
+    td->zoneIdStack.push_back( td->nextZoneId );
+    td->nextZoneId = 0;
+}
+
+void Worker::QueueTimelineOp( ThreadData* td, int64_t time, int32_t child, int32_t data )
+{
+    if( td->timelineOps.empty() ) m_timelineThreads.push_back( td );
+    td->timelineOps.push_back( ZoneTimelineOp { time, child, data } );
+}
+
+void Worker::QueuePlotOp( PlotData* plot, int64_t time, double val )
+{
+    if( plot->timelineOps.empty() ) m_timelinePlots.push_back( plot );
+    plot->timelineOps.push_back( PlotTimelineOp { time, val } );
+}
+
+// Runs the queued zone timeline and plot operations. Each thread timeline and each plot is only
+// ever touched by one lane, and zone statistics are split between lanes by source location, so
+// the lanes don't need to synchronize with each other.
+void Worker::ProcessTimelineOps()
+{
+    if( m_timelineThreads.empty() && m_timelinePlots.empty() ) return;
+
+    if( m_timelineLanes.empty() )
     {
-        td->stack.push_back( zone );
-        td->timeline.push_back( zone );
+        const auto workers = std::min<int>( int( std::thread::hardware_concurrency() ) - 2, MaxTimelineLanes - 1 );
+        if( workers > 0 ) m_timelineDispatch = std::make_unique<TaskDispatch>( workers );
+        m_timelineLanes.resize( std::max( workers, 0 ) + 1 );
+    }
+
+    size_t ops = 0;
+    for( auto& td : m_timelineThreads ) ops += td->timelineOps.size();
+    for( auto& plot : m_timelinePlots ) ops += plot->timelineOps.size();
+    size_t lanes = 1;
+    if( m_timelineDispatch && ops >= ParallelTimelineOps ) lanes = std::min( m_timelineLanes.size(), m_timelineThreads.size() + m_timelinePlots.size() );
+
+    if( lanes > 1 )
+    {
+        // Largest threads and plots go first, each to the least loaded lane.
+        pdqsort_branchless( m_timelineThreads.begin(), m_timelineThreads.end(), [] ( const auto& l, const auto& r ) { return l->timelineOps.size() > r->timelineOps.size() || ( l->timelineOps.size() == r->timelineOps.size() && l->id < r->id ); } );
+        pdqsort_branchless( m_timelinePlots.begin(), m_timelinePlots.end(), [] ( const auto& l, const auto& r ) { return l->timelineOps.size() > r->timelineOps.size() || ( l->timelineOps.size() == r->timelineOps.size() && l->name < r->name ); } );
+    }
+    for( size_t i=0; i<lanes; i++ )
+    {
+        auto& lane = m_timelineLanes[i];
+        lane.load = 0;
+        lane.lastTime = m_data.lastTime;
+        lane.stats.resize( lanes );
+    }
+    auto LeastLoaded = [this, lanes] {
+        auto lane = &m_timelineLanes[0];
+        for( size_t i=1; i<lanes; i++ )
+        {
+            if( m_timelineLanes[i].load < lane->load ) lane = &m_timelineLanes[i];
+        }
+        return lane;
+    };
+    for( auto& td : m_timelineThreads )
+    {
+        auto lane = LeastLoaded();
+        lane->threads.emplace_back( td, CompressThread( td->id ) );
+        lane->load += td->timelineOps.size();
+    }
+    for( auto& plot : m_timelinePlots )
+    {
+        auto lane = LeastLoaded();
+        lane->plots.emplace_back( plot );
+        lane->load += plot->timelineOps.size();
+    }
+    m_timelineThreads.clear();
+    m_timelinePlots.clear();
+
+    if( lanes == 1 )
+    {
+        LinkTimelineLane( 0, 1 );
+        CountTimelineLane( 0, 1 );
     }
     else
     {
-        auto& back = td->stack.data()[ssz-1];
-        if( !back->HasChildren() )
+        for( size_t i=1; i<lanes; i++ ) m_timelineDispatch->Queue( [this, i, lanes] { LinkTimelineLane( i, lanes ); } );
+        LinkTimelineLane( 0, lanes );
+        m_timelineDispatch->Sync();
+        for( size_t i=1; i<lanes; i++ ) m_timelineDispatch->Queue( [this, i, lanes] { CountTimelineLane( i, lanes ); } );
+        CountTimelineLane( 0, lanes );
+        m_timelineDispatch->Sync();
+    }
+
+    for( size_t i=0; i<lanes; i++ )
+    {
+        auto& lane = m_timelineLanes[i];
+        lane.threads.clear();
+        lane.plots.clear();
+        for( auto& v : lane.vectorCache ) m_data.zoneVectorCache.push_back( std::move( v ) );
+        lane.vectorCache.clear();
+        if( m_data.lastTime < lane.lastTime ) m_data.lastTime = lane.lastTime;
+    }
+}
+
+void Worker::LinkTimelineLane( size_t laneIdx, size_t lanes )
+{
+    auto& lane = m_timelineLanes[laneIdx];
+    Slab<64*1024*1024>* slab = &m_slab;
+    if( laneIdx != 0 )
+    {
+        if( !lane.slab )
+        {
+            lane.slab = std::make_unique<Slab<64*1024*1024>>();
+            if( !m_pagedDir.empty() ) lane.slab->SetPaged( m_pagedDir.c_str() );
+        }
+        slab = lane.slab.get();
+    }
+#ifdef TRACY_NO_STATISTICS
+    // Each lane recycles the zones it has compacted itself.
+    auto& zonePool = laneIdx == 0 ? m_zoneEventPool : lane.zonePool;
+#endif
+
+    auto lastTime = lane.lastTime;
+    for( auto& v : lane.threads )
+    {
+        auto td = v.first;
+        for( auto& op : td->timelineOps )
         {
-            back->SetChild( int32_t( m_data.zoneChildren.size() ) );
-            if( m_data.zoneVectorCache.empty() )
+            if( op.child == ZoneTimelineOp::Extra )
             {
-                m_data.zoneChildren.push_back( Vector<short_ptr<ZoneEvent>>( zone ) );
+                td->stack.back()->extra = uint32_t( op.data );
+                continue;
+            }
+            const auto time = TscTime( op.time );
+            if( lastTime < time ) lastTime = time;
+            if( op.child != ZoneTimelineOp::End )
+            {
+                ZoneEvent* zone;
+#ifndef TRACY_NO_STATISTICS
+                zone = slab->Alloc<ZoneEvent>();
+#else
+                if( zonePool.empty() )
+                {
+                    zone = slab->Alloc<ZoneEvent>();
+                }
+                else
+                {
+                    zone = zonePool.back_and_pop();
+                }
+#endif
+                zone->SetStartSrcLoc( time, int16_t( op.data ) );
+                zone->SetEnd( -1 );
+                zone->SetChild( -1 );
+                zone->extra = 0;
+                if( op.child == ZoneTimelineOp::Timeline )
+                {
+                    td->timeline.push_back( zone );
+                }
+                else
+                {
+                    auto parent = td->stack.back();
+                    if( !parent->HasChildren() ) parent->SetChild( op.child );
+                    assert( parent->Child() == op.child );
+                    m_data.zoneChildren[op.child].push_back( zone );
+                }
+                td->stack.push_back( zone );
+#ifndef TRACY_NO_STATISTICS
+                td->childTimeStack.push_back( 0 );
+#endif
+                continue;
+            }
+
+            auto zone = td->stack.back_and_pop();
+            assert( zone->End() == -1 );
+            zone->SetEnd( time );
+            assert( time >= zone->Start() );
+
+            // Dropped history is recycled zone by zone, so the children have to stay in regular vectors.
+            if( zone->HasChildren() && m_historyLimit == 0 )
+            {
+                auto& childVec = m_data.zoneChildren[zone->Child()];
+                const auto sz = childVec.size();
+                if( sz <= 8 * 1024 )
+                {
+                    Vector<short_ptr<ZoneEvent>> fitVec;
+#ifndef TRACY_NO_STATISTICS
+                    fitVec.reserve_exact( sz, *slab );
+                    memcpy( fitVec.data(), childVec.data(), sz * sizeof( short_ptr<ZoneEvent> ) );
+#else
+                    fitVec.set_magic();
+                    auto& fv = *((Vector<ZoneEvent>*)&fitVec);
+                    fv.reserve_exact( sz, *slab );
+                    auto dst = fv.data();
+                    for( auto& ze : childVec )
+                    {
+                        ZoneEvent* src = ze;
+                        memcpy( dst++, src, sizeof( ZoneEvent ) );
+                        zonePool.push_back( src );
+                    }
+#endif
+                    fitVec.swap( childVec );
+                    lane.vectorCache.push_back( std::move( fitVec ) );
+                }
+            }
+
+#ifndef TRACY_NO_STATISTICS
+            assert( !td->childTimeStack.empty() );
+            const auto timeSpan = zone->End() - zone->Start();
+            if( timeSpan > 0 )
+            {
+                TimelineLane::ZoneStat stat;
+                stat.ztd.SetZone( zone );
+                stat.ztd.SetThread( v.second );
+                stat.timeSpan = timeSpan;
+                stat.selfSpan = timeSpan - td->childTimeStack.back_and_pop();
+                lane.stats[uint16_t( zone->SrcLoc() ) % lanes].push_back( stat );
+                if( !td->childTimeStack.empty() )
+                {
+                    td->childTimeStack.back() += timeSpan;
+                }
             }
             else
             {
-                Vector<short_ptr<ZoneEvent>> vze = std::move( m_data.zoneVectorCache.back_and_pop() );
-                assert( !vze.empty() );
-                vze.clear();
-                vze.push_back_non_empty( zone );
-                m_data.zoneChildren.push_back( std::move( vze ) );
+                td->childTimeStack.pop_back();
             }
+#else
+            lane.stats[uint16_t( zone->SrcLoc() ) % lanes].push_back( zone->SrcLoc() );
+#endif
         }
-        else
+        td->timelineOps.clear();
+    }
+
+    for( auto& plot : lane.plots )
+    {
+        for( auto& op : plot->timelineOps )
         {
-            const auto backChild = back->Child();
-            assert( !m_data.zoneChildren[backChild].empty() );
-            m_data.zoneChildren[backChild].push_back_non_empty( zone );
+            const auto time = TscTime( op.time );
+            if( lastTime < time ) lastTime = time;
+            InsertPlot( plot, time, op.val );
         }
-        td->stack.push_back_non_empty( zone );
+        plot->timelineOps.clear();
     }
+    lane.lastTime = lastTime;
+}
 
-    td->zoneIdStack.push_back( td->nextZoneId );
-    td->nextZoneId = 0;
-
+void Worker::CountTimelineLane( size_t laneIdx, size_t lanes )
+{
 #ifndef TRACY_NO_STATISTICS
-    td->childTimeStack.push_back( 0 );
+    int16_t lastSrcloc = 0;
+    SourceLocationZones* slz = nullptr;
+    for( size_t i=0; i<lanes; i++ )
+    {
+        auto& stats = m_timelineLanes[i].stats[laneIdx];
+        for( auto& v : stats )
+        {
+            const auto srcloc = v.ztd.Zone()->SrcLoc();
+            if( !slz || srcloc != lastSrcloc )
+            {
+                auto it = m_data.sourceLocationZones.find( srcloc );
+                assert( it != m_data.sourceLocationZones.end() );
+                slz = &it->second;
+                lastSrcloc = srcloc;
+            }
+            slz->zones.push_back( v.ztd );
+            slz->count++;
+            if( slz->min > v.timeSpan ) slz->min = v.timeSpan;
+            if( slz->max < v.timeSpan ) slz->max = v.timeSpan;
+            slz->total += v.timeSpan;
+            slz->sumSq += double( v.timeSpan ) * v.timeSpan;
+            if( slz->selfMin > v.selfSpan ) slz->selfMin = v.selfSpan;
+            if( slz->selfMax < v.selfSpan ) slz->selfMax = v.selfSpan;
+            slz->selfTotal += v.selfSpan;
+        }
+        stats.clear();
+    }
+#else
+    int16_t lastSrcloc = 0;
+    uint64_t* cnt = nullptr;
+    for( size_t i=0; i<lanes; i++ )
+    {
+        auto& stats = m_timelineLanes[i].stats[laneIdx];
+        for( auto& srcloc : stats )
+        {
+            if( !cnt || srcloc != lastSrcloc )
+            {
+                auto it = m_data.sourceLocationZonesCnt.find( srcloc );
+                assert( it != m_data.sourceLocationZonesCnt.end() );
+                cnt = &it->second;
+                lastSrcloc = srcloc;
+            }
+            (*cnt)++;
+        }
+        stats.clear();
+    }
 #endif
 }
 
@@ -3822,6 +4794,9 @@ void Worker::AddCallstackPayload( uint64_t ptr, const char* _data, size_t _sz )
         m_slab.Unalloc( memsize );
     }
 
+    // Client callstack registry id, referenced by later CallstackCached events.
+    if( ptr != 0 ) m_callstackCached[uint32_t( ptr )] = idx;
+
     m_pendingCallstackId = idx;
 }
 
@@ -3936,6 +4911,8 @@ void Worker::InsertPlot( PlotData* plot, int64_t time, double val )
 
 void Worker::HandlePlotName( uint64_t name, const char* str, size_t sz )
 {
+    // The queued data points have to be in place before a pending plot is merged.
+    ProcessTimelineOps();
     const auto sl = StoreString( str, sz );
     m_data.plots.StringDiscovered( name, sl, m_data.strings, [this] ( PlotData* dst, PlotData* src ) {
         for( auto& v : src->data )
@@ -4374,9 +5351,18 @@ bool Worker::Process( const QueueItem& ev )
     case QueueType::CallstackAlloc:
         ProcessCallstack();
         break;
+    case QueueType::CallstackCached:
+        ProcessCallstackCached( ev.callstackCached );
+        break;
     case QueueType::CallstackSample:
         ProcessCallstackSample( ev.callstackSample );
         break;
+    case QueueType::SamplesLost:
+        ProcessSamplesLost( ev.samplesLost );
+        break;
+    case QueueType::ZonesDropped:
+        ProcessZonesDropped( ev.zonesDropped );
+        break;
     case QueueType::CallstackFrameSize:
         ProcessCallstackFrameSize( ev.callstackFrameSize );
         m_serverQuerySpaceLeft++;
@@ -4450,89 +5436,62 @@ void Worker::ProcessThreadContext( const QueueThreadContext& ev )
     }
 }
 
-void Worker::ProcessZoneBeginImpl( ZoneEvent* zone, const QueueZoneBegin& ev )
+void Worker::ProcessZoneBeginImpl( const QueueZoneBegin& ev )
 {
     CheckSourceLocation( ev.srcloc );
 
     const auto refTime = m_refTimeThread + ev.time;
     m_refTimeThread = refTime;
-    const auto start = TscTime( refTime - m_data.baseTime );
-    zone->SetStartSrcLoc( start, ShrinkSourceLocation( ev.srcloc ) );
-    zone->SetEnd( -1 );
-    zone->SetChild( -1 );
-
-    if( m_data.lastTime < start ) m_data.lastTime = start;
 
-    NewZone( zone, m_threadCtx );
+    NewZone( refTime - m_data.baseTime, ShrinkSourceLocation( ev.srcloc ), m_threadCtx );
 }
 
-void Worker::ProcessZoneBeginAllocSrcLocImpl( ZoneEvent* zone, const QueueZoneBeginLean& ev )
+void Worker::ProcessZoneBeginAllocSrcLocImpl( const QueueZoneBeginLean& ev )
 {
     assert( m_pendingSourceLocationPayload != 0 );
 
     const auto refTime = m_refTimeThread + ev.time;
     m_refTimeThread = refTime;
-    const auto start = TscTime( refTime - m_data.baseTime );
-    zone->SetStartSrcLoc( start, m_pendingSourceLocationPayload );
-    zone->SetEnd( -1 );
-    zone->SetChild( -1 );
-
-    if( m_data.lastTime < start ) m_data.lastTime = start;
 
-    NewZone( zone, m_threadCtx );
+    NewZone( refTime - m_data.baseTime, m_pendingSourceLocationPayload, m_threadCtx );
 
     m_pendingSourceLocationPayload = 0;
 }
 
-ZoneEvent* Worker::AllocZoneEvent()
+MessageData* Worker::AllocMessageData()
 {
-    ZoneEvent* ret;
-#ifndef TRACY_NO_STATISTICS
-    ret = m_slab.Alloc<ZoneEvent>();
-#else
-    if( m_zoneEventPool.empty() )
-    {
-        ret = m_slab.Alloc<ZoneEvent>();
-    }
-    else
-    {
-        ret = m_zoneEventPool.back_and_pop();
-    }
+#ifdef TRACY_NO_STATISTICS
+    if( !m_messagePool.empty() ) return m_messagePool.back_and_pop();
 #endif
-    ret->extra = 0;
-    return ret;
+    return m_slab.Alloc<MessageData>();
 }
 
 void Worker::ProcessZoneBegin( const QueueZoneBegin& ev )
 {
-    auto zone = AllocZoneEvent();
-    ProcessZoneBeginImpl( zone, ev );
+    ProcessZoneBeginImpl( ev );
 }
 
 void Worker::ProcessZoneBeginCallstack( const QueueZoneBegin& ev )
 {
-    auto zone = AllocZoneEvent();
-    ProcessZoneBeginImpl( zone, ev );
+    ProcessZoneBeginImpl( ev );
     auto it = m_nextCallstack.find( m_threadCtx );
     assert( it != m_nextCallstack.end() );
-    auto& extra = RequestZoneExtra( *zone );
+    auto& extra = RequestZoneExtra( m_threadCtxData );
     extra.callstack.SetVal( it->second );
     it->second = 0;
 }
 
 void Worker::ProcessZoneBeginAllocSrcLoc( const QueueZoneBeginLean& ev )
 {
-    auto zone = AllocZoneEvent();
-    ProcessZoneBeginAllocSrcLocImpl( zone, ev );
+    ProcessZoneBeginAllocSrcLocImpl( ev );
 }
 
 void Worker::ProcessZoneBeginAllocSrcLocCallstack( const QueueZoneBeginLean& ev )
 {
-    auto zone = AllocZoneEvent();
-    ProcessZoneBeginAllocSrcLocImpl( zone, ev );
+    ProcessZoneBeginAllocSrcLocImpl( ev );
     auto it = m_nextCallstack.find( m_threadCtx );
     assert( it != m_nextCallstack.end() );
-    auto& extra = RequestZoneExtra( *zone );
+    auto& extra = RequestZoneExtra( m_threadCtxData );
     extra.callstack.SetVal( it->second );
     it->second = 0;
 }
@@ -4544,93 +5503,31 @@ void Worker::ProcessZoneEnd( const QueueZoneEnd& ev )
 
     if( td->zoneIdStack.empty() )
     {
+        ProcessTimelineOps();
         ZoneDoubleEndFailure( m_threadCtx, td->timeline.empty() ? nullptr : td->timeline.back() );
         return;
     }
     auto zoneId = td->zoneIdStack.back_and_pop();
     if( zoneId != td->nextZoneId )
     {
-        ZoneStackFailure( m_threadCtx, td->stack.back() );
+        ZoneStackFailure( m_threadCtx, td->openZones.back().srcloc );
         return;
     }
     td->nextZoneId = 0;
 
-    auto& stack = td->stack;
-    assert( !stack.empty() );
-    auto zone = stack.back_and_pop();
-    assert( zone->End() == -1 );
+    assert( !td->openZones.empty() );
+    td->openZones.pop_back();
     const auto refTime = m_refTimeThread + ev.time;
     m_refTimeThread = refTime;
-    const auto timeEnd = TscTime( refTime - m_data.baseTime );
-    zone->SetEnd( timeEnd );
-    assert( timeEnd >= zone->Start() );
-
-    if( m_data.lastTime < timeEnd ) m_data.lastTime = timeEnd;
-
-    if( zone->HasChildren() )
-    {
-        auto& childVec = m_data.zoneChildren[zone->Child()];
-        const auto sz = childVec.size();
-        if( sz <= 8 * 1024 )
-        {
-            Vector<short_ptr<ZoneEvent>> fitVec;
-#ifndef TRACY_NO_STATISTICS
-            fitVec.reserve_exact( sz, m_slab );
-            memcpy( fitVec.data(), childVec.data(), sz * sizeof( short_ptr<ZoneEvent> ) );
-#else
-            fitVec.set_magic();
-            auto& fv = *((Vector<ZoneEvent>*)&fitVec);
-            fv.reserve_exact( sz, m_slab );
-            auto dst = fv.data();
-            for( auto& ze : childVec )
-            {
-                ZoneEvent* src = ze;
-                memcpy( dst++, src, sizeof( ZoneEvent ) );
-                m_zoneEventPool.push_back( src );
-            }
-#endif
-            fitVec.swap( childVec );
-            m_data.zoneVectorCache.push_back( std::move( fitVec ) );
-        }
-    }
 
-#ifndef TRACY_NO_STATISTICS
-    assert( !td->childTimeStack.empty() );
-    const auto timeSpan = timeEnd - zone->Start();
-    if( timeSpan > 0 )
-    {
-        ZoneThreadData ztd;
-        ztd.SetZone( zone );
-        ztd.SetThread( CompressThread( m_threadCtx ) );
-        auto slz = GetSourceLocationZones( zone->SrcLoc() );
-        slz->zones.push_back( ztd );
-        if( slz->min > timeSpan ) slz->min = timeSpan;
-        if( slz->max < timeSpan ) slz->max = timeSpan;
-        slz->total += timeSpan;
-        slz->sumSq += double( timeSpan ) * timeSpan;
-        const auto selfSpan = timeSpan - td->childTimeStack.back_and_pop();
-        if( slz->selfMin > selfSpan ) slz->selfMin = selfSpan;
-        if( slz->selfMax < selfSpan ) slz->selfMax = selfSpan;
-        slz->selfTotal += selfSpan;
-        if( !td->childTimeStack.empty() )
-        {
-            td->childTimeStack.back() += timeSpan;
-        }
-    }
-    else
-    {
-        td->childTimeStack.pop_back();
-    }
-#else
-    CountZoneStatistics( zone );
-#endif
+    QueueTimelineOp( td, refTime - m_data.baseTime, ZoneTimelineOp::End, 0 );
 }
 
-void Worker::ZoneStackFailure( uint64_t thread, const ZoneEvent* ev )
+void Worker::ZoneStackFailure( uint64_t thread, int16_t srcloc )
 {
     m_failure = Failure::ZoneStack;
     m_failureData.thread = thread;
-    m_failureData.srcloc = ev->SrcLoc();
+    m_failureData.srcloc = srcloc;
 }
 
 void Worker::ZoneDoubleEndFailure( uint64_t thread, const ZoneEvent* ev )
@@ -4837,7 +5734,7 @@ void Worker::ProcessFrameImage( const QueueFrameImage& ev )
 void Worker::ProcessZoneText()
 {
     auto td = RetrieveThread( m_threadCtx );
-    if( !td || td->stack.empty() || td->nextZoneId != td->zoneIdStack.back() )
+    if( !td || td->openZones.empty() || td->nextZoneId != td->zoneIdStack.back() )
     {
         ZoneTextFailure( m_threadCtx );
         return;
@@ -4847,9 +5744,7 @@ void Worker::ProcessZoneText()
     const auto idx = GetSingleStringIdx();
 
     td->nextZoneId = 0;
-    auto& stack = td->stack;
-    auto zone = stack.back();
-    auto& extra = RequestZoneExtra( *zone );
+    auto& extra = RequestZoneExtra( td );
     if( !extra.text.Active() )
     {
         extra.text = StringIdx( idx );
@@ -4878,32 +5773,28 @@ void Worker::ProcessZoneText()
 void Worker::ProcessZoneName()
 {
     auto td = RetrieveThread( m_threadCtx );
-    if( !td || td->stack.empty() || td->nextZoneId != td->zoneIdStack.back() )
+    if( !td || td->openZones.empty() || td->nextZoneId != td->zoneIdStack.back() )
     {
         ZoneNameFailure( m_threadCtx );
         return;
     }
 
     td->nextZoneId = 0;
-    auto& stack = td->stack;
-    auto zone = stack.back();
-    auto& extra = RequestZoneExtra( *zone );
+    auto& extra = RequestZoneExtra( td );
     extra.name = StringIdx( GetSingleStringIdx() );
 }
 
 void Worker::ProcessZoneColor( const QueueZoneColor& ev )
 {
     auto td = RetrieveThread( m_threadCtx );
-    if( !td || td->stack.empty() || td->nextZoneId != td->zoneIdStack.back() )
+    if( !td || td->openZones.empty() || td->nextZoneId != td->zoneIdStack.back() )
     {
         ZoneColorFailure( m_threadCtx );
         return;
     }
 
     td->nextZoneId = 0;
-    auto& stack = td->stack;
-    auto zone = stack.back();
-    auto& extra = RequestZoneExtra( *zone );
+    auto& extra = RequestZoneExtra( td );
     const uint32_t color = ( ev.r << 16 ) | ( ev.g << 8 ) | ev.b;
     extra.color = color;
 }
@@ -4914,16 +5805,14 @@ void Worker::ProcessZoneValue( const QueueZoneValue& ev )
     const auto tsz = sprintf( tmp, "%" PRIu64, ev.value );
 
     auto td = RetrieveThread( m_threadCtx );
-    if( !td || td->stack.empty() || td->nextZoneId != td->zoneIdStack.back() )
+    if( !td || td->openZones.empty() || td->nextZoneId != td->zoneIdStack.back() )
     {
         ZoneTextFailure( m_threadCtx );
         return;
     }
 
     td->nextZoneId = 0;
-    auto& stack = td->stack;
-    auto zone = stack.back();
-    auto& extra = RequestZoneExtra( *zone );
+    auto& extra = RequestZoneExtra( td );
     if( !extra.text.Active() )
     {
         extra.text = StringIdx( StoreString( tmp, tsz ).idx );
@@ -5137,18 +6026,17 @@ void Worker::ProcessPlotData( const QueuePlotData& ev )
 
     const auto refTime = m_refTimeThread + ev.time;
     m_refTimeThread = refTime;
-    const auto time = TscTime( refTime - m_data.baseTime );
-    if( m_data.lastTime < time ) m_data.lastTime = time;
+    const auto time = refTime - m_data.baseTime;
     switch( ev.type )
     {
     case PlotDataType::Double:
-        InsertPlot( plot, time, ev.data.d );
+        QueuePlotOp( plot, time, ev.data.d );
         break;
     case PlotDataType::Float:
-        InsertPlot( plot, time, (double)ev.data.f );
+        QueuePlotOp( plot, time, (double)ev.data.f );
         break;
     case PlotDataType::Int:
-        InsertPlot( plot, time, (double)ev.data.i );
+        QueuePlotOp( plot, time, (double)ev.data.i );
         break;
     default:
         assert( false );
@@ -5172,7 +6060,7 @@ void Worker::ProcessPlotConfig( const QueuePlotConfig& ev )
 
 void Worker::ProcessMessage( const QueueMessage& ev )
 {
-    auto msg = m_slab.Alloc<MessageData>();
+    auto msg = AllocMessageData();
     const auto time = TscTime( ev.time - m_data.baseTime );
     msg->time = time;
     msg->ref = StringRef( StringRef::Type::Idx, GetSingleStringIdx() );
@@ -5186,7 +6074,7 @@ void Worker::ProcessMessage( const QueueMessage& ev )
 void Worker::ProcessMessageLiteral( const QueueMessageLiteral& ev )
 {
     CheckString( ev.text );
-    auto msg = m_slab.Alloc<MessageData>();
+    auto msg = AllocMessageData();
     const auto time = TscTime( ev.time - m_data.baseTime );
     msg->time = time;
     msg->ref = StringRef( StringRef::Type::Ptr, ev.text );
@@ -5199,7 +6087,7 @@ void Worker::ProcessMessageLiteral( const QueueMessageLiteral& ev )
 
 void Worker::ProcessMessageColor( const QueueMessageColor& ev )
 {
-    auto msg = m_slab.Alloc<MessageData>();
+    auto msg = AllocMessageData();
     const auto time = TscTime( ev.time - m_data.baseTime );
     msg->time = time;
     msg->ref = StringRef( StringRef::Type::Idx, GetSingleStringIdx() );
@@ -5213,7 +6101,7 @@ void Worker::ProcessMessageColor( const QueueMessageColor& ev )
 void Worker::ProcessMessageLiteralColor( const QueueMessageColorLiteral& ev )
 {
     CheckString( ev.text );
-    auto msg = m_slab.Alloc<MessageData>();
+    auto msg = AllocMessageData();
     const auto time = TscTime( ev.time - m_data.baseTime );
     msg->time = time;
     msg->ref = StringRef( StringRef::Type::Ptr, ev.text );
@@ -5742,6 +6630,14 @@ void Worker::ProcessCallstack()
     m_pendingCallstackId = 0;
 }
 
+void Worker::ProcessCallstackCached( const QueueCallstackCached& ev )
+{
+    assert( m_pendingCallstackId == 0 );
+    auto it = m_callstackCached.find( ev.id );
+    assert( it != m_callstackCached.end() );
+    m_pendingCallstackId = it->second;
+}
+
 void Worker::ProcessCallstackSample( const QueueCallstackSample& ev )
 {
     assert( m_pendingCallstackId != 0 );
@@ -5756,15 +6652,29 @@ void Worker::ProcessCallstackSample( const QueueCallstackSample& ev )
     sd.callstack.SetVal( m_pendingCallstackId );
 
     auto td = NoticeThread( ev.thread );
+    // Samples of a thread which migrated between CPUs drained by different client threads
+    // may arrive out of order.
+#ifndef TRACY_NO_STATISTICS
+    bool inOrder = true;
+#endif
     if( td->samples.empty() )
     {
         td->samples.push_back( sd );
     }
-    else
+    else if( td->samples.back().time.Val() < t )
     {
-        assert( td->samples.back().time.Val() < t );
         td->samples.push_back_non_empty( sd );
     }
+    else
+    {
+        auto it = std::upper_bound( td->samples.begin(), td->samples.end(), t, [] ( const auto& lhs, const auto& rhs ) { return lhs < rhs.time.Val(); } );
+#ifndef TRACY_NO_STATISTICS
+        inOrder = false;
+        // Ghost zones past this point are already built, so this sample won't contribute to them.
+        if( uint64_t( it - td->samples.begin() ) < td->ghostIdx ) td->ghostIdx++;
+#endif
+        td->samples.insert( it, sd );
+    }
 
 #ifndef TRACY_NO_STATISTICS
     const auto& cs = GetCallstack( m_pendingCallstackId );
@@ -5839,20 +6749,24 @@ void Worker::ProcessCallstackSample( const QueueCallstackSample& ev )
         {
             m_data.childSamples.emplace( addr, Vector<Int48>( sd.time ) );
         }
-        else
+        else if( it->second.back().Val() <= t )
         {
             it->second.push_back_non_empty( sd.time );
         }
+        else
+        {
+            auto iit = std::upper_bound( it->second.begin(), it->second.end(), t, [] ( const auto& lhs, const auto& rhs ) { return lhs < rhs.Val(); } );
+            it->second.insert( iit, sd.time );
+        }
     }
 
     const auto framesKnown = UpdateSampleStatistics( m_pendingCallstackId, 1, true );
-    assert( td->samples.size() > td->ghostIdx );
-    if( framesKnown && td->ghostIdx + 1 == td->samples.size() )
+    if( framesKnown && inOrder && td->ghostIdx + 1 == td->samples.size() )
     {
         td->ghostIdx++;
         m_data.ghostCnt += AddGhostZone( cs, &td->ghostZones, t );
     }
-    else
+    else if( td->ghostIdx != td->samples.size() )
     {
         m_data.ghostZonesPostponed = true;
     }
@@ -5860,6 +6774,17 @@ void Worker::ProcessCallstackSample( const QueueCallstackSample& ev )
     m_pendingCallstackId = 0;
 }
 
+void Worker::ProcessSamplesLost( const QueueSamplesLost& ev )
+{
+    m_data.samplesLost += ev.count;
+}
+
+void Worker::ProcessZonesDropped( const QueueZonesDropped& ev )
+{
+    CheckSourceLocation( ev.srcloc );
+    m_data.zonesDropped[ShrinkSourceLocation( ev.srcloc )] += ev.count;
+}
+
 void Worker::ProcessCallstackFrameSize( const QueueCallstackFrameSize& ev )
 {
     assert( !m_callstackFrameStaging );
@@ -6653,14 +7578,8 @@ void Worker::UpdateSampleStatisticsImpl( const CallstackFrameData** frames, uint
 }
 #endif
 
-int64_t Worker::ReadTimeline( FileRead& f, ZoneEvent* zone, int64_t refTime, int32_t& childIdx )
-{
-    uint32_t sz;
-    f.Read( sz );
-    return ReadTimelineHaveSize( f, zone, refTime, childIdx, sz );
-}
-
-int64_t Worker::ReadTimelineHaveSize( FileRead& f, ZoneEvent* zone, int64_t refTime, int32_t& childIdx, uint32_t sz )
+template<class Reader>
+int64_t Worker::ReadTimelineHaveSize( Reader& f, ZoneEvent* zone, int64_t refTime, int32_t& childIdx, uint32_t sz, Slab<64*1024*1024>& slab )
 {
     if( sz == 0 )
     {
@@ -6672,7 +7591,7 @@ int64_t Worker::ReadTimelineHaveSize( FileRead& f, ZoneEvent* zone, int64_t refT
         const auto idx = childIdx;
         childIdx++;
         zone->SetChild( idx );
-        return ReadTimeline( f, m_data.zoneChildren[idx], sz, refTime, childIdx );
+        return ReadTimeline( f, m_data.zoneChildren[idx], sz, refTime, childIdx, slab );
     }
 }
 
@@ -6716,7 +7635,7 @@ void Worker::ReadTimelineHaveSize( FileRead& f, GpuEvent* zone, int64_t& refTime
 }
 
 #ifndef TRACY_NO_STATISTICS
-void Worker::ReconstructZoneStatistics( ZoneEvent& zone, uint16_t thread )
+void Worker::ReconstructZoneStatistics( ZoneEvent& zone, uint16_t thread, bool zonesOnly )
 {
     assert( zone.IsEndValid() );
     auto timeSpan = zone.End() - zone.Start();
@@ -6729,6 +7648,8 @@ void Worker::ReconstructZoneStatistics( ZoneEvent& zone, uint16_t thread )
         ztd.SetThread( thread );
         auto& slz = it->second;
         slz.zones.push_back( ztd );
+        if( zonesOnly ) return;
+        slz.count++;
         if( slz.min > timeSpan ) slz.min = timeSpan;
         if( slz.max < timeSpan ) slz.max = timeSpan;
         slz.total += timeSpan;
@@ -6755,16 +7676,144 @@ void Worker::CountZoneStatistics( ZoneEvent* zone )
     auto cnt = GetSourceLocationZonesCnt( zone->SrcLoc() );
     (*cnt)++;
 }
+
+void Worker::CountZoneStatistics( Vector<short_ptr<ZoneEvent>>& _vec )
+{
+    auto& vec = *(Vector<ZoneEvent>*)( &_vec );
+    for( auto& zone : vec )
+    {
+        CountZoneStatistics( &zone );
+        if( zone.HasChildren() ) CountZoneStatistics( GetZoneChildrenMutable( zone.Child() ) );
+    }
+}
+
+void Worker::DropHistory( int64_t time )
+{
+    for( auto& td : m_data.threads )
+    {
+        const auto cnt = DropZones( td->timeline, time );
+        td->count -= cnt;
+        m_data.zonesCnt -= cnt;
+
+        // Dropping may have released the children vector of a zone that is still open.
+        auto& openZones = td->openZones;
+        assert( openZones.size() == td->stack.size() );
+        for( size_t i=0; i<openZones.size(); i++ )
+        {
+            auto zone = td->stack[i];
+            openZones[i].child = zone->HasChildren() ? zone->Child() : -1;
+        }
+
+        auto& msgs = td->messages;
+        auto mit = msgs.begin();
+        while( mit != msgs.end() && (*mit)->time < time ) ++mit;
+        msgs.erase( msgs.begin(), mit );
+
+        auto& samples = td->samples;
+        auto sit = samples.begin();
+        while( sit != samples.end() && sit->time.Val() < time ) ++sit;
+        m_data.samplesCnt -= sit - samples.begin();
+        samples.erase( samples.begin(), sit );
+    }
+
+    // Thread message lists hold the same messages, so they can be recycled here.
+    auto& msgs = m_data.messages;
+    auto mit = msgs.begin();
+    while( mit != msgs.end() && (*mit)->time < time ) m_messagePool.push_back( *mit++ );
+    msgs.erase( msgs.begin(), mit );
+
+    for( auto& plot : m_data.plots.Data() )
+    {
+        if( plot->type == PlotType::Memory ) continue;
+        auto& data = plot->data;
+        if( !data.is_sorted() ) data.sort();
+        auto it = std::lower_bound( data.begin(), data.end(), time, [] ( const auto& l, const auto& r ) { return l.time.Val() < r; } );
+        data.erase( data.begin(), it );
+    }
+
+    // The last context switch of each thread and CPU is kept, as it is updated by the following events.
+    for( auto& ctx : m_data.ctxSwitch )
+    {
+        auto& v = ctx.second->v;
+        if( v.size() < 2 ) continue;
+        auto it = v.begin();
+        while( it != v.end() - 1 && it->IsEndValid() && it->End() < time ) ++it;
+        v.erase( v.begin(), it );
+    }
+    for( int i=0; i<m_data.cpuDataCount; i++ )
+    {
+        auto& cs = m_data.cpuData[i].cs;
+        if( cs.size() < 2 ) continue;
+        auto it = cs.begin();
+        while( it != cs.end() - 1 && it->IsEndValid() && it->End() < time ) ++it;
+        cs.erase( cs.begin(), it );
+    }
+}
+
+uint64_t Worker::DropZones( Vector<short_ptr<ZoneEvent>>& vec, int64_t time )
+{
+    assert( !vec.is_magic() );
+    uint64_t cnt = 0;
+    auto it = vec.begin();
+    while( it != vec.end() )
+    {
+        const auto end = (*it)->End();
+        if( end < 0 || end >= time ) break;
+        cnt += RecycleZone( *it++ );
+    }
+    vec.erase( vec.begin(), it );
+
+    // Only the first remaining zone can start before the given time, and it may have finished children.
+    if( !vec.empty() )
+    {
+        auto& zone = *vec.front();
+        if( zone.HasChildren() && zone.Start() < time )
+        {
+            const auto child = zone.Child();
+            auto& children = m_data.zoneChildren[child];
+            cnt += DropZones( children, time );
+            if( children.empty() )
+            {
+                zone.SetChild( -1 );
+                m_zoneChildrenPool.push_back( child );
+            }
+        }
+    }
+    return cnt;
+}
+
+uint64_t Worker::RecycleZone( ZoneEvent* zone )
+{
+    uint64_t cnt = 1;
+    if( zone->HasChildren() )
+    {
+        const auto child = zone->Child();
+        auto& children = m_data.zoneChildren[child];
+        assert( !children.is_magic() && !children.empty() );
+        for( auto& v : children ) cnt += RecycleZone( v );
+        m_data.zoneVectorCache.push_back( std::move( children ) );
+        m_zoneChildrenPool.push_back( child );
+    }
+    if( zone->extra != 0 ) m_zoneExtraPool.push_back( zone->extra );
+    (*GetSourceLocationZonesCnt( zone->SrcLoc() ))--;
+    m_zoneEventPool.push_back( zone );
+    return cnt;
+}
 #endif
 
-int64_t Worker::ReadTimeline( FileRead& f, Vector<short_ptr<ZoneEvent>>& _vec, uint32_t size, int64_t refTime, int32_t& childIdx )
+template<class Reader>
+int64_t Worker::ReadTimeline( Reader& f, Vector<short_ptr<ZoneEvent>>& _vec, uint32_t size, int64_t refTime, int32_t& childIdx, Slab<64*1024*1024>& slab )
 {
+#ifdef TRACY_NO_STATISTICS
+    // Timelines read from a memory buffer are decoded by load jobs and are counted afterwards.
+    constexpr bool countStatistics = std::is_same<Reader, FileRead>::value;
+#endif
+
     assert( size != 0 );
-    const auto lp = s_loadProgress.subProgress.load( std::memory_order_relaxed );
-    s_loadProgress.subProgress.store( lp + size, std::memory_order_relaxed );
+    s_loadProgress.subProgress.fetch_add( size, std::memory_order_relaxed );
     auto& vec = *(Vector<ZoneEvent>*)( &_vec );
     vec.set_magic();
-    vec.reserve_exact( size, m_slab );
+    vec.reserve_exact( size, slab );
     auto zone = vec.begin();
     auto end = vec.end() - 1;
 
@@ -6778,12 +7827,12 @@ int64_t Worker::ReadTimeline( FileRead& f, Vector<short_ptr<ZoneEvent>>& _vec, u
         refTime += tstart;
         zone->SetStartSrcLoc( refTime, srcloc );
         zone->extra = extra;
-        refTime = ReadTimelineHaveSize( f, zone, refTime, childIdx, childSz );
+        refTime = ReadTimelineHaveSize( f, zone, refTime, childIdx, childSz, slab );
         f.Read5( tend, srcloc, tstart, extra, childSz );
         refTime += tend;
         zone->SetEnd( refTime );
 #ifdef TRACY_NO_STATISTICS
-        CountZoneStatistics( zone );
+        if( countStatistics ) CountZoneStatistics( zone );
 #endif
         zone++;
     }
@@ -6791,12 +7840,12 @@ int64_t Worker::ReadTimeline( FileRead& f, Vector<short_ptr<ZoneEvent>>& _vec, u
     refTime += tstart;
     zone->SetStartSrcLoc( refTime, srcloc );
     zone->extra = extra;
-    refTime = ReadTimelineHaveSize( f, zone, refTime, childIdx, childSz );
+    refTime = ReadTimelineHaveSize( f, zone, refTime, childIdx, childSz, slab );
     f.Read( tend );
     refTime += tend;
     zone->SetEnd( refTime );
 #ifdef TRACY_NO_STATISTICS
-    CountZoneStatistics( zone );
+    if( countStatistics ) CountZoneStatistics( zone );
 #endif
 
     return refTime;
@@ -6882,22 +7931,138 @@ void Worker::Disconnect()
     m_disconnect = true;
 }
 
-void Worker::Write( FileWrite& f )
+template<class T>
+static tracy_force_inline const T& TimelineAt( const Vector<short_ptr<T>>& vec, size_t idx )
+{
+    return vec.is_magic() ? ( *(const Vector<T>*)( &vec ) )[idx] : *vec[idx];
+}
+
+// Negative times mark events which haven't finished (or started) and are left as they are.
+static tracy_force_inline int64_t ClipStart( int64_t time, int64_t rangeStart ) { return time >= 0 ? std::max( time, rangeStart ) : time; }
+static tracy_force_inline int64_t ClipEnd( int64_t time, int64_t rangeEnd ) { return time >= 0 ? std::min( time, rangeEnd ) : time; }
+
+// Sibling zones don't overlap, so their start and end times are both sorted. Unfinished
+// zones have negative end time, which makes them sort last in unsigned comparison.
+static std::pair<size_t, size_t> TimelineRange( const Vector<short_ptr<ZoneEvent>>& vec, int64_t rangeStart, int64_t rangeEnd )
+{
+    size_t lo = 0;
+    size_t hi = vec.size();
+    while( lo < hi )
+    {
+        const auto mid = ( lo + hi ) / 2;
+        if( (uint64_t)TimelineAt( vec, mid ).End() < (uint64_t)rangeStart ) lo = mid + 1; else hi = mid;
+    }
+    const auto first = lo;
+    hi = vec.size();
+    while( lo < hi )
+    {
+        const auto mid = ( lo + hi ) / 2;
+        if( TimelineAt( vec, mid ).Start() <= rangeEnd ) lo = mid + 1; else hi = mid;
+    }
+    return std::make_pair( first, lo );
+}
+
+static std::pair<const short_ptr<MessageData>*, const short_ptr<MessageData>*> MessageRange( const Vector<short_ptr<MessageData>>& vec, int64_t rangeStart, int64_t rangeEnd )
+{
+    const auto first = std::lower_bound( vec.begin(), vec.end(), rangeStart, [] ( const auto& l, const auto& r ) { return l->time < r; } );
+    const auto last = std::upper_bound( first, vec.end(), rangeEnd, [] ( const auto& l, const auto& r ) { return l < r->time; } );
+    return std::make_pair( first, last );
+}
+
+// Context switches are sorted like zones, see TimelineRange().
+template<class T>
+static std::pair<const T*, const T*> ContextSwitchRange( const Vector<T>& vec, int64_t rangeStart, int64_t rangeEnd )
+{
+    const auto first = std::lower_bound( vec.begin(), vec.end(), rangeStart, [] ( const auto& l, const auto& r ) { return (uint64_t)l.End() < (uint64_t)r; } );
+    const auto last = std::upper_bound( first, vec.end(), rangeEnd, [] ( const auto& l, const auto& r ) { return l < r.Start(); } );
+    return std::make_pair( first, last );
+}
+
+static tracy_force_inline bool GpuZoneInRange( const GpuEvent& ev, int64_t rangeStart, int64_t rangeEnd )
+{
+    const auto gpu = ev.GpuStart() >= 0;
+    const auto start = gpu ? ev.GpuStart() : ev.CpuStart();
+    const auto end = gpu ? ev.GpuEnd() : ev.CpuEnd();
+    return start <= rangeEnd && ( end < 0 || end >= rangeStart );
+}
+
+// Lock state can only be rebuilt from a point where nothing holds or waits for the lock.
+static bool IsLockIdle( const LockMap& lockmap, size_t pos )
+{
+    if( pos == 0 ) return true;
+    const auto& tl = lockmap.timeline[pos-1];
+    if( tl.lockCount != 0 || tl.waitList != 0 ) return false;
+    if( lockmap.type == LockType::Lockable ) return true;
+    const auto tlp = (const LockEventShared*)(const LockEvent*)tl.ptr;
+    return tlp->waitShared == 0 && tlp->sharedList == 0;
+}
+
+void Worker::Write( FileWrite& f, int64_t rangeStart, int64_t rangeEnd )
 {
     DoPostponedWork();
 
+    assert( rangeStart >= 0 && rangeStart <= rangeEnd );
+    const bool crop = rangeStart != 0 || rangeEnd != std::numeric_limits<int64_t>::max();
+
+    // Frames are kept if they start in the range. The first base frame (initialization) is
+    // always kept, and the frame offset is adjusted, so that the frame numbers don't change.
+    std::vector<std::pair<size_t, size_t>> frameRanges;
+    frameRanges.reserve( m_data.frames.Data().size() );
+    for( auto& fd : m_data.frames.Data() )
+    {
+        auto& frames = fd->frames;
+        const auto first = std::lower_bound( frames.begin(), frames.end(), rangeStart, [] ( const auto& l, const auto& r ) { return l.start < r; } );
+        const auto last = std::upper_bound( first, frames.end(), rangeEnd, [] ( const auto& l, const auto& r ) { return l < r.start; } );
+        frameRanges.emplace_back( first - frames.begin(), last - frames.begin() );
+    }
+    auto frameOffset = m_data.frameOffset;
+    const auto baseFirst = frameRanges[0].first;
+    if( baseFirst > 1 ) frameOffset = frameOffset == 0 ? baseFirst : frameOffset + baseFirst - 1;
+
+    std::vector<int32_t> frameImageMap( m_data.frameImage.size(), -1 );
+    std::vector<const FrameImage*> frameImages;
+    for( size_t i=0; i<m_data.frames.Data().size(); i++ )
+    {
+        auto& frames = m_data.frames.Data()[i]->frames;
+        for( size_t j=frameRanges[i].first; j<frameRanges[i].second; j++ )
+        {
+            if( frames[j].frameImage >= 0 ) frameImageMap[frames[j].frameImage] = 0;
+        }
+        if( i == 0 && baseFirst > 0 && !frames.empty() && frames[0].frameImage >= 0 ) frameImageMap[frames[0].frameImage] = 0;
+    }
+    for( size_t i=0; i<frameImageMap.size(); i++ )
+    {
+        if( frameImageMap[i] < 0 ) continue;
+        frameImageMap[i] = int32_t( frameImages.size() );
+        frameImages.emplace_back( m_data.frameImage[i] );
+    }
+
+    const auto lastTime = std::min( m_data.lastTime, rangeEnd );
+    auto crashEvent = m_data.crashEvent;
+    if( crashEvent.thread != 0 && ( crashEvent.time < rangeStart || crashEvent.time > rangeEnd ) ) crashEvent = CrashEvent {};
+
     f.Write( FileHeader, sizeof( FileHeader ) );
 
     f.Write( &m_delay, sizeof( m_delay ) );
     f.Write( &m_resolution, sizeof( m_resolution ) );
     f.Write( &m_timerMul, sizeof( m_timerMul ) );
-    f.Write( &m_data.lastTime, sizeof( m_data.lastTime ) );
-    f.Write( &m_data.frameOffset, sizeof( m_data.frameOffset ) );
+    f.Write( &lastTime, sizeof( lastTime ) );
+    f.Write( &frameOffset, sizeof( frameOffset ) );
     f.Write( &m_pid, sizeof( m_pid ) );
     f.Write( &m_samplingPeriod, sizeof( m_samplingPeriod ) );
     f.Write( &m_data.cpuArch, sizeof( m_data.cpuArch ) );
     f.Write( &m_data.cpuId, sizeof( m_data.cpuId ) );
     f.Write( m_data.cpuManufacturer, 12 );
+    f.Write( &m_data.samplesLost, sizeof( m_data.samplesLost ) );
+    {
+        uint64_t sz = m_data.zonesDropped.size();
+        f.Write( &sz, sizeof( sz ) );
+        for( auto& v : m_data.zonesDropped )
+        {
+            f.Write( &v.first, sizeof( v.first ) );
+            f.Write( &v.second, sizeof( v.second ) );
+        }
+    }
 
     uint64_t sz = m_captureName.size();
     f.Write( &sz, sizeof( sz ) );
@@ -6933,34 +8098,27 @@ void Worker::Write( FileWrite& f )
         }
     }
 
-    f.Write( &m_data.crashEvent, sizeof( m_data.crashEvent ) );
+    f.Write( &crashEvent, sizeof( crashEvent ) );
 
     sz = m_data.frames.Data().size();
     f.Write( &sz, sizeof( sz ) );
-    for( auto& fd : m_data.frames.Data() )
+    for( size_t i=0; i<m_data.frames.Data().size(); i++ )
     {
+        auto& fd = m_data.frames.Data()[i];
         int64_t refTime = 0;
         f.Write( &fd->name, sizeof( fd->name ) );
         f.Write( &fd->continuous, sizeof( fd->continuous ) );
-        sz = fd->frames.size();
+        const bool keepFirst = i == 0 && baseFirst > 0 && !fd->frames.empty();
+        sz = frameRanges[i].second - frameRanges[i].first + ( keepFirst ? 1 : 0 );
         f.Write( &sz, sizeof( sz ) );
-        if( fd->continuous )
-        {
-            for( auto& fe : fd->frames )
-            {
-                WriteTimeOffset( f, refTime, fe.start );
-                f.Write( &fe.frameImage, sizeof( fe.frameImage ) );
-            }
-        }
-        else
-        {
-            for( auto& fe : fd->frames )
-            {
-                WriteTimeOffset( f, refTime, fe.start );
-                WriteTimeOffset( f, refTime, fe.end );
-                f.Write( &fe.frameImage, sizeof( fe.frameImage ) );
-            }
-        }
+        auto WriteFrame = [&f, &refTime, &frameImageMap, continuous = fd->continuous] ( const FrameEvent& fe ) {
+            WriteTimeOffset( f, refTime, fe.start );
+            if( !continuous ) WriteTimeOffset( f, refTime, fe.end );
+            const int32_t frameImage = fe.frameImage >= 0 ? frameImageMap[fe.frameImage] : fe.frameImage;
+            f.Write( &frameImage, sizeof( frameImage ) );
+        };
+        if( keepFirst ) WriteFrame( fd->frames[0] );
+        for( size_t j=frameRanges[i].first; j<frameRanges[i].second; j++ ) WriteFrame( fd->frames[j] );
     }
 
     sz = m_data.stringData.size();
@@ -7028,27 +8186,51 @@ void Worker::Write( FileWrite& f )
         f.Write( v, sizeof( SourceLocationBase ) );
     }
 
+    // Statistics kept during the capture are saved as they are. A cropped trace, or one whose
+    // statistics are not known (not collected in this build, or still being reconstructed after
+    // load), has them computed from the zones that will be written.
 #ifndef TRACY_NO_STATISTICS
-    sz = m_data.sourceLocationZones.size();
-    f.Write( &sz, sizeof( sz ) );
-    for( auto& v : m_data.sourceLocationZones )
+    const auto& srclocZones = m_data.sourceLocationZones;
+    const bool collect = crop || !m_data.sourceLocationStatsReady;
+#else
+    const auto& srclocZones = m_data.sourceLocationZonesCnt;
+    const bool collect = true;
+#endif
+    unordered_flat_map<int16_t, SourceLocationZones> srclocStats;
+    if( collect )
     {
-        int16_t id = v.first;
-        uint64_t cnt = v.second.zones.size();
-        f.Write( &id, sizeof( id ) );
-        f.Write( &cnt, sizeof( cnt ) );
+        srclocStats.reserve( srclocZones.size() );
+        for( auto& thread : m_data.threads ) CollectZoneStatistics( thread->timeline, rangeStart, rangeEnd, srclocStats );
     }
-#else
-    sz = m_data.sourceLocationZonesCnt.size();
+
+    static const SourceLocationZones emptyStats;
+    sz = srclocZones.size();
     f.Write( &sz, sizeof( sz ) );
-    for( auto& v : m_data.sourceLocationZonesCnt )
+    for( auto& v : srclocZones )
     {
         int16_t id = v.first;
-        uint64_t cnt = v.second;
+        const SourceLocationZones* slz = &emptyStats;
+        if( collect )
+        {
+            auto it = srclocStats.find( id );
+            if( it != srclocStats.end() ) slz = &it->second;
+        }
+#ifndef TRACY_NO_STATISTICS
+        else
+        {
+            slz = &v.second;
+        }
+#endif
         f.Write( &id, sizeof( id ) );
-        f.Write( &cnt, sizeof( cnt ) );
+        f.Write( &slz->count, sizeof( slz->count ) );
+        f.Write( &slz->min, sizeof( slz->min ) );
+        f.Write( &slz->max, sizeof( slz->max ) );
+        f.Write( &slz->total, sizeof( slz->total ) );
+        f.Write( &slz->sumSq, sizeof( slz->sumSq ) );
+        f.Write( &slz->selfMin, sizeof( slz->selfMin ) );
+        f.Write( &slz->selfMax, sizeof( slz->selfMax ) );
+        f.Write( &slz->selfTotal, sizeof( slz->selfTotal ) );
     }
-#endif
 
     sz = m_data.lockMap.size();
     f.Write( &sz, sizeof( sz ) );
@@ -7067,11 +8249,16 @@ void Worker::Write( FileWrite& f )
         {
             f.Write( &t, sizeof( t ) );
         }
+        auto& timeline = v.second->timeline;
+        auto first = size_t( std::lower_bound( timeline.begin(), timeline.end(), rangeStart, [] ( const auto& l, const auto& r ) { return l.ptr->Time() < r; } ) - timeline.begin() );
+        while( first < timeline.size() && !IsLockIdle( *v.second, first ) ) first++;
+        const auto last = std::max( first, size_t( std::upper_bound( timeline.begin(), timeline.end(), rangeEnd, [] ( const auto& l, const auto& r ) { return l < r.ptr->Time(); } ) - timeline.begin() ) );
         int64_t refTime = v.second->timeAnnounce;
-        sz = v.second->timeline.size();
+        sz = last - first;
         f.Write( &sz, sizeof( sz ) );
-        for( auto& lev : v.second->timeline )
+        for( size_t i=first; i<last; i++ )
         {
+            auto& lev = timeline[i];
             WriteTimeOffset( f, refTime, lev.ptr->Time() );
             const int16_t srcloc = lev.ptr->SrcLoc();
             f.Write( &srcloc, sizeof( srcloc ) );
@@ -7082,11 +8269,13 @@ void Worker::Write( FileWrite& f )
 
     {
         int64_t refTime = 0;
-        sz = m_data.messages.size();
+        const auto range = MessageRange( m_data.messages, rangeStart, rangeEnd );
+        sz = range.second - range.first;
         f.Write( &sz, sizeof( sz ) );
-        for( auto& v : m_data.messages )
+        for( auto it = range.first; it != range.second; ++it )
         {
-            const auto ptr = (uint64_t)(MessageData*)v;
+            auto& v = *it;
+            const auto ptr = (uint64_t)(const MessageData*)v;
             f.Write( &ptr, sizeof( ptr ) );
             WriteTimeOffset( f, refTime, v->time );
             f.Write( &v->ref, sizeof( v->ref ) );
@@ -7099,49 +8288,86 @@ void Worker::Write( FileWrite& f )
     f.Write( &sz, sizeof( sz ) );
     f.Write( m_data.zoneExtra.data(), sz * sizeof( ZoneExtra ) );
 
+    std::vector<std::pair<uint64_t, uint32_t>> timelineTable;
+    timelineTable.reserve( m_data.threads.size() );
     sz = 0;
-    for( auto& v : m_data.threads ) sz += v->count;
+    for( auto& thread : m_data.threads )
+    {
+        uint64_t zones = 0;
+        uint32_t children = 0;
+        CountTimeline( thread->timeline, rangeStart, rangeEnd, zones, children );
+        timelineTable.emplace_back( zones, children );
+        sz += zones;
+    }
     f.Write( &sz, sizeof( sz ) );
     sz = m_data.zoneChildren.size();
     f.Write( &sz, sizeof( sz ) );
     sz = m_data.threads.size();
     f.Write( &sz, sizeof( sz ) );
-    for( auto& thread : m_data.threads )
+    for( auto& v : timelineTable )
+    {
+        const uint64_t size = v.first * TimelineZoneSize;
+        f.Write( &size, sizeof( size ) );
+        f.Write( &v.second, sizeof( v.second ) );
+    }
+    for( size_t i=0; i<m_data.threads.size(); i++ )
     {
+        auto& thread = m_data.threads[i];
         int64_t refTime = 0;
+        const uint64_t count = timelineTable[i].first;
         f.Write( &thread->id, sizeof( thread->id ) );
-        f.Write( &thread->count, sizeof( thread->count ) );
-        WriteTimeline( f, thread->timeline, refTime );
-        sz = thread->messages.size();
+        f.Write( &count, sizeof( count ) );
+        WriteTimeline( f, thread->timeline, refTime, rangeStart, rangeEnd );
+        const auto msgRange = MessageRange( thread->messages, rangeStart, rangeEnd );
+        sz = msgRange.second - msgRange.first;
         f.Write( &sz, sizeof( sz ) );
-        for( auto& v : thread->messages )
+        for( auto it = msgRange.first; it != msgRange.second; ++it )
         {
-            auto ptr = uint64_t( (MessageData*)v );
+            auto ptr = uint64_t( (const MessageData*)*it );
             f.Write( &ptr, sizeof( ptr ) );
         }
-        sz = thread->samples.size();
+        auto& samples = thread->samples;
+        const auto sfirst = std::lower_bound( samples.begin(), samples.end(), rangeStart, [] ( const auto& l, const auto& r ) { return l.time.Val() < r; } );
+        const auto slast = std::upper_bound( sfirst, samples.end(), rangeEnd, [] ( const auto& l, const auto& r ) { return l < r.time.Val(); } );
+        sz = slast - sfirst;
         f.Write( &sz, sizeof( sz ) );
         refTime = 0;
-        for( auto& v : thread->samples )
+        for( auto it = sfirst; it != slast; ++it )
         {
-            WriteTimeOffset( f, refTime, v.time.Val() );
-            f.Write( &v.callstack, sizeof( v.callstack ) );
+            WriteTimeOffset( f, refTime, it->time.Val() );
+            f.Write( &it->callstack, sizeof( it->callstack ) );
         }
     }
 
+    std::vector<uint64_t> gpuCount;
+    gpuCount.reserve( m_data.gpuData.size() );
     sz = 0;
-    for( auto& v : m_data.gpuData ) sz += v->count;
+    for( auto& ctx : m_data.gpuData )
+    {
+        uint64_t cnt = 0;
+        if( crop )
+        {
+            for( auto& td : ctx->threadData ) cnt += CountTimeline( td.second.timeline, rangeStart, rangeEnd, true );
+        }
+        else
+        {
+            cnt = ctx->count;
+        }
+        gpuCount.emplace_back( cnt );
+        sz += cnt;
+    }
     f.Write( &sz, sizeof( sz ) );
     sz = m_data.gpuChildren.size();
     f.Write( &sz, sizeof( sz ) );
     sz = m_data.gpuData.size();
     f.Write( &sz, sizeof( sz ) );
-    for( auto& ctx : m_data.gpuData )
+    for( size_t i=0; i<m_data.gpuData.size(); i++ )
     {
+        auto& ctx = m_data.gpuData[i];
         f.Write( &ctx->thread, sizeof( ctx->thread ) );
         uint8_t calibration = ctx->hasCalibration;
         f.Write( &calibration, sizeof( calibration ) );
-        f.Write( &ctx->count, sizeof( ctx->count ) );
+        f.Write( &gpuCount[i], sizeof( gpuCount[i] ) );
         f.Write( &ctx->period, sizeof( ctx->period ) );
         f.Write( &ctx->type, sizeof( ctx->type ) );
         f.Write( &ctx->name, sizeof( ctx->name ) );
@@ -7153,7 +8379,7 @@ void Worker::Write( FileWrite& f )
             int64_t refGpuTime = 0;
             uint64_t tid = td.first;
             f.Write( &tid, sizeof( tid ) );
-            WriteTimeline( f, td.second.timeline, refTime, refGpuTime );
+            WriteTimeline( f, td.second.timeline, refTime, refGpuTime, rangeStart, rangeEnd );
         }
     }
 
@@ -7163,56 +8389,109 @@ void Worker::Write( FileWrite& f )
     for( auto& plot : m_data.plots.Data() )
     {
         if( plot->type == PlotType::Memory ) continue;
+        auto& data = plot->data;
+        const auto first = std::lower_bound( data.begin(), data.end(), rangeStart, [] ( const auto& l, const auto& r ) { return l.time.Val() < r; } );
+        const auto last = std::upper_bound( first, data.end(), rangeEnd, [] ( const auto& l, const auto& r ) { return l < r.time.Val(); } );
+        auto min = plot->min;
+        auto max = plot->max;
+        if( first != last && last - first != (ptrdiff_t)data.size() )
+        {
+            min = max = first->val;
+            for( auto it = first; it != last; ++it )
+            {
+                min = std::min( min, it->val );
+                max = std::max( max, it->val );
+            }
+        }
         f.Write( &plot->type, sizeof( plot->type ) );
         f.Write( &plot->format, sizeof( plot->format ) );
         f.Write( &plot->name, sizeof( plot->name ) );
-        f.Write( &plot->min, sizeof( plot->min ) );
-        f.Write( &plot->max, sizeof( plot->max ) );
+        f.Write( &min, sizeof( min ) );
+        f.Write( &max, sizeof( max ) );
         int64_t refTime = 0;
-        sz = plot->data.size();
+        sz = last - first;
         f.Write( &sz, sizeof( sz ) );
-        for( auto& v : plot->data )
+        for( auto it = first; it != last; ++it )
         {
-            WriteTimeOffset( f, refTime, v.time.Val() );
-            f.Write( &v.val, sizeof( v.val ) );
+            WriteTimeOffset( f, refTime, it->time.Val() );
+            f.Write( &it->val, sizeof( it->val ) );
         }
     }
 
     sz = m_data.memNameMap.size();
     f.Write( &sz, sizeof( sz ) );
+    // Allocations are kept if they were made in the range. Frees past the range end are dropped.
+    std::vector<std::pair<const MemEvent*, const MemEvent*>> memRanges;
+    memRanges.reserve( m_data.memNameMap.size() );
     sz = 0;
     for( auto& memory : m_data.memNameMap )
     {
-        sz += memory.second->data.size();
+        auto& data = memory.second->data;
+        const auto first = std::lower_bound( data.begin(), data.end(), rangeStart, [] ( const auto& l, const auto& r ) { return l.TimeAlloc() < r; } );
+        const auto last = std::upper_bound( first, data.end(), rangeEnd, [] ( const auto& l, const auto& r ) { return l < r.TimeAlloc(); } );
+        memRanges.emplace_back( first, last );
+        sz += last - first;
     }
     f.Write( &sz, sizeof( sz ) );
+    size_t memIdx = 0;
     for( auto& memory : m_data.memNameMap )
     {
         uint64_t name = memory.first;
+        auto& memdata = *memory.second;
+        const auto first = memRanges[memIdx].first;
+        const auto last = memRanges[memIdx].second;
+        memIdx++;
+
+        uint64_t activeCnt = memdata.active.size();
+        uint64_t freesCnt = memdata.frees.size();
+        auto usage = memdata.usage;
+        if( crop )
+        {
+            activeCnt = freesCnt = 0;
+            usage = 0;
+            for( auto it = first; it != last; ++it )
+            {
+                const auto timeFree = it->TimeFree();
+                if( timeFree >= 0 && timeFree <= rangeEnd )
+                {
+                    freesCnt++;
+                }
+                else
+                {
+                    activeCnt++;
+                    usage += it->Size();
+                }
+            }
+        }
         f.Write( &name, sizeof( name ) );
 
-        auto& memdata = *memory.second;
         int64_t refTime = 0;
-        sz = memdata.data.size();
-        f.Write( &sz, sizeof( sz ) );
-        sz = memdata.active.size();
+        sz = last - first;
         f.Write( &sz, sizeof( sz ) );
-        sz = memdata.frees.size();
-        f.Write( &sz, sizeof( sz ) );
-        for( auto& mem : memdata.data )
+        f.Write( &activeCnt, sizeof( activeCnt ) );
+        f.Write( &freesCnt, sizeof( freesCnt ) );
+        for( auto it = first; it != last; ++it )
         {
+            auto& mem = *it;
             const auto ptr = mem.Ptr();
             const auto size = mem.Size();
             const Int24 csAlloc = mem.CsAlloc();
-            f.Write( &ptr, sizeof( ptr ) );
-            f.Write( &size, sizeof( size ) );
-            f.Write( &csAlloc, sizeof( csAlloc ) );
-            f.Write( &mem.csFree, sizeof( mem.csFree ) );
-
             int64_t timeAlloc = mem.TimeAlloc();
             uint16_t threadAlloc = mem.ThreadAlloc();
             int64_t timeFree = mem.TimeFree();
             uint16_t threadFree = mem.ThreadFree();
+            Int24 csFree = mem.csFree;
+            if( timeFree > rangeEnd )
+            {
+                timeFree = -1;
+                threadFree = 0;
+                csFree = Int24( 0 );
+            }
+            f.Write( &ptr, sizeof( ptr ) );
+            f.Write( &size, sizeof( size ) );
+            f.Write( &csAlloc, sizeof( csAlloc ) );
+            f.Write( &csFree, sizeof( csFree ) );
+
             WriteTimeOffset( f, refTime, timeAlloc );
             int64_t freeOffset = timeFree < 0 ? timeFree : timeFree - timeAlloc;
             f.Write( &freeOffset, sizeof( freeOffset ) );
@@ -7221,7 +8500,7 @@ void Worker::Write( FileWrite& f )
         }
         f.Write( &memdata.high, sizeof( memdata.high ) );
         f.Write( &memdata.low, sizeof( memdata.low ) );
-        f.Write( &memdata.usage, sizeof( memdata.usage ) );
+        f.Write( &usage, sizeof( usage ) );
         f.Write( &memdata.name, sizeof( memdata.name ) );
     }
 
@@ -7251,9 +8530,9 @@ void Worker::Write( FileWrite& f )
 
     {
         TextureCompression texcomp;
-        sz = m_data.frameImage.size();
+        sz = frameImages.size();
         f.Write( &sz, sizeof( sz ) );
-        for( auto& fi : m_data.frameImage )
+        for( auto& fi : frameImages )
         {
             f.Write( &fi->w, sizeof( fi->w ) );
             f.Write( &fi->h, sizeof( fi->h ) );
@@ -7279,14 +8558,16 @@ void Worker::Write( FileWrite& f )
     for( auto& ctx : ctxValid )
     {
         f.Write( &ctx->first, sizeof( ctx->first ) );
-        sz = ctx->second->v.size();
+        const auto range = ContextSwitchRange( ctx->second->v, rangeStart, rangeEnd );
+        sz = range.second - range.first;
         f.Write( &sz, sizeof( sz ) );
         int64_t refTime = 0;
-        for( auto& cs : ctx->second->v )
+        for( auto it = range.first; it != range.second; ++it )
         {
-            WriteTimeOffset( f, refTime, cs.WakeupVal() );
-            WriteTimeOffset( f, refTime, cs.Start() );
-            WriteTimeOffset( f, refTime, cs.End() );
+            auto& cs = *it;
+            WriteTimeOffset( f, refTime, ClipStart( cs.WakeupVal(), rangeStart ) );
+            WriteTimeOffset( f, refTime, ClipStart( cs.Start(), rangeStart ) );
+            WriteTimeOffset( f, refTime, ClipEnd( cs.End(), rangeEnd ) );
             uint8_t cpu = cs.Cpu();
             int8_t reason = cs.Reason();
             int8_t state = cs.State();
@@ -7296,17 +8577,26 @@ void Worker::Write( FileWrite& f )
         }
     }
 
-    sz = GetContextSwitchPerCpuCount();
+    std::pair<const ContextSwitchCpu*, const ContextSwitchCpu*> cpuRanges[256];
+    sz = 0;
+    for( int i=0; i<256; i++ )
+    {
+        cpuRanges[i] = ContextSwitchRange( m_data.cpuData[i].cs, rangeStart, rangeEnd );
+        sz += cpuRanges[i].second - cpuRanges[i].first;
+    }
     f.Write( &sz, sizeof( sz ) );
     for( int i=0; i<256; i++ )
     {
-        sz = m_data.cpuData[i].cs.size();
+        const auto first = cpuRanges[i].first;
+        const auto last = cpuRanges[i].second;
+        sz = last - first;
         f.Write( &sz, sizeof( sz ) );
         int64_t refTime = 0;
-        for( auto& cx : m_data.cpuData[i].cs )
+        for( auto it = first; it != last; ++it )
         {
-            WriteTimeOffset( f, refTime, cx.Start() );
-            WriteTimeOffset( f, refTime, cx.End() );
+            auto& cx = *it;
+            WriteTimeOffset( f, refTime, ClipStart( cx.Start(), rangeStart ) );
+            WriteTimeOffset( f, refTime, ClipEnd( cx.End(), rangeEnd ) );
             uint16_t thread = cx.Thread();
             f.Write( &thread, sizeof( thread ) );
         }
@@ -7378,31 +8668,100 @@ void Worker::Write( FileWrite& f )
     }
 }
 
-void Worker::WriteTimeline( FileWrite& f, const Vector<short_ptr<ZoneEvent>>& vec, int64_t& refTime )
+void Worker::CountTimeline( const Vector<short_ptr<ZoneEvent>>& vec, int64_t rangeStart, int64_t rangeEnd, uint64_t& zones, uint32_t& children ) const
+{
+    const auto range = TimelineRange( vec, rangeStart, rangeEnd );
+    zones += range.second - range.first;
+    for( auto i=range.first; i<range.second; i++ )
+    {
+        auto& v = TimelineAt( vec, i );
+        if( v.HasChildren() )
+        {
+            auto& c = GetZoneChildren( v.Child() );
+            const auto cr = TimelineRange( c, rangeStart, rangeEnd );
+            if( cr.first != cr.second )
+            {
+                children++;
+                CountTimeline( c, rangeStart, rangeEnd, zones, children );
+            }
+        }
+    }
+}
+
+// Same rules as ReconstructZoneStatistics(), applied to zone times clipped to the saved range.
+void Worker::CollectZoneStatistics( const Vector<short_ptr<ZoneEvent>>& vec, int64_t rangeStart, int64_t rangeEnd, unordered_flat_map<int16_t, SourceLocationZones>& stats ) const
+{
+    const auto range = TimelineRange( vec, rangeStart, rangeEnd );
+    for( auto i=range.first; i<range.second; i++ )
+    {
+        auto& v = TimelineAt( vec, i );
+        const auto timeSpan = v.IsEndValid() ? ClipEnd( v.End(), rangeEnd ) - ClipStart( v.Start(), rangeStart ) : 0;
+        if( timeSpan > 0 )
+        {
+            auto selfSpan = timeSpan;
+            if( v.HasChildren() )
+            {
+                auto& c = GetZoneChildren( v.Child() );
+                const auto cr = TimelineRange( c, rangeStart, rangeEnd );
+                for( auto j=cr.first; j<cr.second; j++ )
+                {
+                    auto& cv = TimelineAt( c, j );
+                    selfSpan -= std::max( int64_t( 0 ), ClipEnd( cv.End(), rangeEnd ) - ClipStart( cv.Start(), rangeStart ) );
+                }
+            }
+            auto& slz = stats[v.SrcLoc()];
+            slz.count++;
+            if( slz.min > timeSpan ) slz.min = timeSpan;
+            if( slz.max < timeSpan ) slz.max = timeSpan;
+            slz.total += timeSpan;
+            slz.sumSq += double( timeSpan ) * timeSpan;
+            if( slz.selfMin > selfSpan ) slz.selfMin = selfSpan;
+            if( slz.selfMax < selfSpan ) slz.selfMax = selfSpan;
+            slz.selfTotal += selfSpan;
+        }
+        if( v.HasChildren() ) CollectZoneStatistics( GetZoneChildren( v.Child() ), rangeStart, rangeEnd, stats );
+    }
+}
+
+uint64_t Worker::CountTimeline( const Vector<short_ptr<GpuEvent>>& vec, int64_t rangeStart, int64_t rangeEnd, bool recursive ) const
+{
+    uint64_t cnt = 0;
+    for( size_t i=0; i<vec.size(); i++ )
+    {
+        auto& v = TimelineAt( vec, i );
+        if( !GpuZoneInRange( v, rangeStart, rangeEnd ) ) continue;
+        cnt++;
+        if( recursive && v.Child() >= 0 ) cnt += CountTimeline( GetGpuChildren( v.Child() ), rangeStart, rangeEnd, true );
+    }
+    return cnt;
+}
+
+void Worker::WriteTimeline( FileWrite& f, const Vector<short_ptr<ZoneEvent>>& vec, int64_t& refTime, int64_t rangeStart, int64_t rangeEnd )
 {
-    uint32_t sz = uint32_t( vec.size() );
+    const auto range = TimelineRange( vec, rangeStart, rangeEnd );
+    uint32_t sz = uint32_t( range.second - range.first );
     f.Write( &sz, sizeof( sz ) );
     if( vec.is_magic() )
     {
-        WriteTimelineImpl<VectorAdapterDirect<ZoneEvent>>( f, *(Vector<ZoneEvent>*)( &vec ), refTime );
+        auto& v = *(const Vector<ZoneEvent>*)( &vec );
+        WriteTimelineImpl<VectorAdapterDirect<ZoneEvent>>( f, v.begin() + range.first, v.begin() + range.second, refTime, rangeStart, rangeEnd );
     }
     else
     {
-        WriteTimelineImpl<VectorAdapterPointer<ZoneEvent>>( f, vec, refTime );
+        WriteTimelineImpl<VectorAdapterPointer<ZoneEvent>>( f, vec.begin() + range.first, vec.begin() + range.second, refTime, rangeStart, rangeEnd );
     }
 }
 
 template<typename Adapter, typename V>
-void Worker::WriteTimelineImpl( FileWrite& f, const V& vec, int64_t& refTime )
+void Worker::WriteTimelineImpl( FileWrite& f, const V* begin, const V* end, int64_t& refTime, int64_t rangeStart, int64_t rangeEnd )
 {
     Adapter a;
-    for( auto& val : vec )
+    for( auto it = begin; it != end; ++it )
     {
-        auto& v = a(val);
+        auto& v = a(*it);
         int16_t srcloc = v.SrcLoc();
         f.Write( &srcloc, sizeof( srcloc ) );
-        int64_t start = v.Start();
-        WriteTimeOffset( f, refTime, start );
+        WriteTimeOffset( f, refTime, ClipStart( v.Start(), rangeStart ) );
         f.Write( &v.extra, sizeof( v.extra ) );
         if( !v.HasChildren() )
         {
@@ -7411,35 +8770,36 @@ void Worker::WriteTimelineImpl( FileWrite& f, const V& vec, int64_t& refTime )
         }
         else
         {
-            WriteTimeline( f, GetZoneChildren( v.Child() ), refTime );
+            WriteTimeline( f, GetZoneChildren( v.Child() ), refTime, rangeStart, rangeEnd );
         }
-        WriteTimeOffset( f, refTime, v.End() );
+        WriteTimeOffset( f, refTime, ClipEnd( v.End(), rangeEnd ) );
     }
 }
 
-void Worker::WriteTimeline( FileWrite& f, const Vector<short_ptr<GpuEvent>>& vec, int64_t& refTime, int64_t& refGpuTime )
+void Worker::WriteTimeline( FileWrite& f, const Vector<short_ptr<GpuEvent>>& vec, int64_t& refTime, int64_t& refGpuTime, int64_t rangeStart, int64_t rangeEnd )
 {
-    uint64_t sz = vec.size();
+    uint64_t sz = CountTimeline( vec, rangeStart, rangeEnd, false );
     f.Write( &sz, sizeof( sz ) );
     if( vec.is_magic() )
     {
-        WriteTimelineImpl<VectorAdapterDirect<GpuEvent>>( f, *(Vector<GpuEvent>*)( &vec ), refTime, refGpuTime );
+        WriteTimelineImpl<VectorAdapterDirect<GpuEvent>>( f, *(Vector<GpuEvent>*)( &vec ), refTime, refGpuTime, rangeStart, rangeEnd );
     }
     else
     {
-        WriteTimelineImpl<VectorAdapterPointer<GpuEvent>>( f, vec, refTime, refGpuTime );
+        WriteTimelineImpl<VectorAdapterPointer<GpuEvent>>( f, vec, refTime, refGpuTime, rangeStart, rangeEnd );
     }
 }
 
 template<typename Adapter, typename V>
-void Worker::WriteTimelineImpl( FileWrite& f, const V& vec, int64_t& refTime, int64_t& refGpuTime )
+void Worker::WriteTimelineImpl( FileWrite& f, const V& vec, int64_t& refTime, int64_t& refGpuTime, int64_t rangeStart, int64_t rangeEnd )
 {
     Adapter a;
     for( auto& val : vec )
     {
         auto& v = a(val);
-        WriteTimeOffset( f, refTime, v.CpuStart() );
-        WriteTimeOffset( f, refGpuTime, v.GpuStart() );
+        if( !GpuZoneInRange( v, rangeStart, rangeEnd ) ) continue;
+        WriteTimeOffset( f, refTime, ClipStart( v.CpuStart(), rangeStart ) );
+        WriteTimeOffset( f, refGpuTime, ClipStart( v.GpuStart(), rangeStart ) );
         const int16_t srcloc = v.SrcLoc();
         f.Write( &srcloc, sizeof( srcloc ) );
         f.Write( &v.callstack, sizeof( v.callstack ) );
@@ -7453,11 +8813,11 @@ void Worker::WriteTimelineImpl( FileWrite& f, const V& vec, int64_t& refTime, in
         }
         else
         {
-            WriteTimeline( f, GetGpuChildren( v.Child() ), refTime, refGpuTime );
+            WriteTimeline( f, GetGpuChildren( v.Child() ), refTime, refGpuTime, rangeStart, rangeEnd );
         }
 
-        WriteTimeOffset( f, refTime, v.CpuEnd() );
-        WriteTimeOffset( f, refGpuTime, v.GpuEnd() );
+        WriteTimeOffset( f, refTime, ClipEnd( v.CpuEnd(), rangeEnd ) );
+        WriteTimeOffset( f, refGpuTime, ClipEnd( v.GpuEnd(), rangeEnd ) );
     }
 }
 
@@ -7482,6 +8842,21 @@ const char* Worker::GetFailureString( Worker::Failure failure )
     return s_failureReasons[(int)failure];
 }
 
+static const char* s_transportCodecNames[] = {
+    "none",
+    "lz4",
+    "lz4hc",
+    "zstd"
+};
+
+static_assert( sizeof( s_transportCodecNames ) / sizeof( *s_transportCodecNames ) == (int)NumTransportCodecs, "Missing transport codec name." );
+
+const char* Worker::GetTransportCodecName( TransportCodec codec )
+{
+    if( codec >= NumTransportCodecs ) return "unknown";
+    return s_transportCodecNames[codec];
+}
+
 void Worker::SetParameter( size_t paramIdx, int32_t val )
 {
     assert( paramIdx < m_params.size() );
@@ -7491,6 +8866,20 @@ void Worker::SetParameter( size_t paramIdx, int32_t val )
     Query( ServerQueryParameter, ( idx << 32 ) | v );
 }
 
+void Worker::SetZoneCaptureEnabled( int16_t srcloc, bool enabled )
+{
+    assert( CanFilterZone( srcloc ) );
+    if( enabled )
+    {
+        if( m_disabledZones.erase( srcloc ) == 0 ) return;
+    }
+    else
+    {
+        if( !m_disabledZones.emplace( srcloc ).second ) return;
+    }
+    Query( ServerQueryZoneFilter, m_data.sourceLocationExpand[srcloc], enabled ? 1 : 0 );
+}
+
 const Worker::CpuThreadTopology* Worker::GetThreadTopology( uint32_t cpuThread ) const
 {
     auto it = m_data.cpuTopologyMap.find( cpuThread );
@@ -7498,13 +8887,28 @@ const Worker::CpuThreadTopology* Worker::GetThreadTopology( uint32_t cpuThread )
     return &it->second;
 }
 
-ZoneExtra& Worker::AllocZoneExtra( ZoneEvent& ev )
+uint32_t Worker::NewZoneExtra()
 {
-    assert( ev.extra == 0 );
-    ev.extra = uint32_t( m_data.zoneExtra.size() );
+    uint32_t idx;
+#ifdef TRACY_NO_STATISTICS
+    if( !m_zoneExtraPool.empty() )
+    {
+        idx = m_zoneExtraPool.back_and_pop();
+        memset( (char*)&m_data.zoneExtra[idx], 0, sizeof( ZoneExtra ) );
+        return idx;
+    }
+#endif
+    idx = uint32_t( m_data.zoneExtra.size() );
     auto& extra = m_data.zoneExtra.push_next();
     memset( (char*)&extra, 0, sizeof( extra ) );
-    return extra;
+    return idx;
+}
+
+ZoneExtra& Worker::AllocZoneExtra( ZoneEvent& ev )
+{
+    assert( ev.extra == 0 );
+    ev.extra = NewZoneExtra();
+    return m_data.zoneExtra[ev.extra];
 }
 
 ZoneExtra& Worker::RequestZoneExtra( ZoneEvent& ev )
@@ -7519,8 +8923,21 @@ ZoneExtra& Worker::RequestZoneExtra( ZoneEvent& ev )
     }
 }
 
+// The zone is still being built by the timeline job, which gets the extra index through the op queue.
+ZoneExtra& Worker::RequestZoneExtra( ThreadData* td )
+{
+    auto& zone = td->openZones.back();
+    if( zone.extra == 0 )
+    {
+        zone.extra = NewZoneExtra();
+        QueueTimelineOp( td, 0, ZoneTimelineOp::Extra, int32_t( zone.extra ) );
+    }
+    return m_data.zoneExtra[zone.extra];
+}
+
 void Worker::CacheSource( const StringRef& str )
 {
+    if( m_journal ) return;
     assert( str.active );
     assert( m_checkedFileStrings.find( str ) == m_checkedFileStrings.end() );
     m_checkedFileStrings.emplace( str );
@@ -4,6 +4,7 @@
 #include <atomic>
 #include <condition_variable>
 #include <limits>
+#include <memory>
 #include <mutex>
 #include <shared_mutex>
 #include <stdexcept>
@@ -16,6 +17,7 @@
 #include "../common/TracyForceInline.hpp"
 #include "../common/TracyQueue.hpp"
 #include "../common/TracyProtocol.hpp"
+#include "../common/TracyShm.hpp"
 #include "../common/TracySocket.hpp"
 #include "tracy_robin_hood.h"
 #include "TracyEvent.hpp"
@@ -32,6 +34,7 @@ namespace tracy
 
 class FileRead;
 class FileWrite;
+class TaskDispatch;
 
 namespace EventType
 {
@@ -89,6 +92,21 @@ struct LoadProgress
     std::atomic<uint64_t> subProgress;
 };
 
+// Processing statistics of a journal replay. Times are in nanoseconds. The per event type times
+// are only collected after Worker::SetIngestEventTiming(), as reading the clock for every event
+// adds noticeably to the processing time.
+struct IngestStats
+{
+    uint64_t count[(uint8_t)QueueType::NUM_TYPES];
+    uint64_t bytes[(uint8_t)QueueType::NUM_TYPES];
+    int64_t time[(uint8_t)QueueType::NUM_TYPES];
+    uint64_t buffers;
+    int64_t dispatchTime;
+    int64_t timelineTime;
+    int64_t postponedTime;
+    int64_t peakMemory;
+};
+
 class Worker
 {
 public:
@@ -175,6 +193,7 @@ private:
         struct ZtdSort { bool operator()( const ZoneThreadData& lhs, const ZoneThreadData& rhs ) { return lhs.Zone()->Start() < rhs.Zone()->Start(); } };
 
         SortedVector<ZoneThreadData, ZtdSort> zones;
+        uint64_t count = 0;
         int64_t min = std::numeric_limits<int64_t>::max();
         int64_t max = std::numeric_limits<int64_t>::min();
         int64_t total = 0;
@@ -184,6 +203,34 @@ private:
         int64_t selfTotal = 0;
     };
 
+    // Zone timelines of a batch of threads, and the data points of a batch of plots, are built by
+    // ingest jobs, one job per lane. Statistics produced by a lane are bucketed by the lane that
+    // owns the source location.
+    struct TimelineLane
+    {
+#ifndef TRACY_NO_STATISTICS
+        struct ZoneStat
+        {
+            ZoneThreadData ztd;
+            int64_t timeSpan;
+            int64_t selfSpan;
+        };
+#endif
+
+        std::vector<std::pair<ThreadData*, uint16_t>> threads;
+        std::vector<PlotData*> plots;
+        uint64_t load;
+        int64_t lastTime;
+        std::unique_ptr<Slab<64*1024*1024>> slab;
+        Vector<Vector<short_ptr<ZoneEvent>>> vectorCache;
+#ifndef TRACY_NO_STATISTICS
+        std::vector<std::vector<ZoneStat>> stats;
+#else
+        std::vector<std::vector<int16_t>> stats;
+        Vector<ZoneEvent*> zonePool;
+#endif
+    };
+
     struct CallstackFrameIdHash
     {
         size_t operator()( const CallstackFrameId& id ) const { return id.data; }
@@ -248,6 +295,8 @@ private:
         uint64_t zonesCnt = 0;
         uint64_t gpuCnt = 0;
         uint64_t samplesCnt = 0;
+        uint64_t samplesLost = 0;
+        unordered_flat_map<int16_t, uint64_t> zonesDropped;
         uint64_t ghostCnt = 0;
         int64_t baseTime = 0;
         int64_t lastTime = 0;
@@ -269,6 +318,7 @@ private:
 #ifndef TRACY_NO_STATISTICS
         unordered_flat_map<int16_t, SourceLocationZones> sourceLocationZones;
         bool sourceLocationZonesReady = false;
+        bool sourceLocationStatsReady = false;
 #else
         unordered_flat_map<int16_t, uint64_t> sourceLocationZonesCnt;
 #endif
@@ -358,11 +408,12 @@ private:
 
     struct MbpsBlock
     {
-        MbpsBlock() : mbps( 64 ), compRatio( 1.0 ), queue( 0 ), transferred( 0 ) {}
+        MbpsBlock() : mbps( 64 ), compRatio( 1.0 ), decSpeed( 0 ), queue( 0 ), transferred( 0 ) {}
 
         std::shared_mutex lock;
         std::vector<float> mbps;
         float compRatio;
+        float decSpeed;     // MB/s of decompressed data
         size_t queue;
         uint64_t transferred;
     };
@@ -398,9 +449,16 @@ public:
         NUM_FAILURES
     };
 
-    Worker( const char* addr, uint16_t port );
+    // With a journal, the data stream is written out as received instead of being
+    // reconstructed in memory. Loading the journal replays it into a regular trace.
+    // With a history limit (in ns), zones, messages, plot points, samples and context
+    // switches older than the limit are dropped and their memory is reused. History
+    // limit is only available in builds without statistics.
+    // With shm, a client running on the same host is asked to send its data through
+    // shared memory.
+    Worker( const char* addr, uint16_t port, TransportCodec codec = TransportCodecLz4, int codecLevel = 0, FileWrite* journal = nullptr, int64_t historyLimit = 0, bool shm = true );
     Worker( const char* name, const char* program, const std::vector<ImportEventTimeline>& timeline, const std::vector<ImportEventMessages>& messages, const std::vector<ImportEventPlots>& plots, const std::unordered_map<uint64_t, std::string>& threadNames );
-    Worker( FileRead& f, EventType::Type eventMask = EventType::All, bool bgTasks = true );
+    Worker( FileRead& f, EventType::Type eventMask = EventType::All, bool bgTasks = true, const char* pagedDir = nullptr );
     ~Worker();
 
     const std::string& GetAddr() const { return m_addr; }
@@ -422,6 +480,7 @@ public:
     size_t GetFullFrameCount( const FrameData& fd ) const;
     int64_t GetLastTime() const { return m_data.lastTime; }
     uint64_t GetZoneCount() const { return m_data.zonesCnt; }
+    int64_t GetHistoryLimit() const { return m_historyLimit; }
     uint64_t GetZoneExtraCount() const { return m_data.zoneExtra.size() - 1; }
     uint64_t GetGpuZoneCount() const { return m_data.gpuCnt; }
     uint64_t GetLockCount() const;
@@ -438,6 +497,8 @@ public:
 #endif
     uint64_t GetCallstackFrameCount() const { return m_data.callstackFrameMap.size(); }
     uint64_t GetCallstackSampleCount() const { return m_data.samplesCnt; }
+    uint64_t GetCallstackSamplesLost() const { return m_data.samplesLost; }
+    const unordered_flat_map<int16_t, uint64_t>& GetZonesDropped() const { return m_data.zonesDropped; }
     uint64_t GetSymbolsCount() const { return m_data.symbolMap.size(); }
     uint64_t GetSymbolCodeCount() const { return m_data.symbolCode.size(); }
     uint64_t GetSymbolCodeSize() const { return m_data.symbolCodeSize; }
@@ -544,9 +605,13 @@ public:
     std::vector<int16_t> GetMatchingSourceLocation( const char* query, bool ignoreCase ) const;
 
 #ifndef TRACY_NO_STATISTICS
+    // Zone statistics of a source location (count, times) are valid when AreSourceLocationStatsReady(),
+    // which for saved traces is right after loading. The list of zones is complete only when
+    // AreSourceLocationZonesReady().
     const SourceLocationZones& GetZonesForSourceLocation( int16_t srcloc ) const;
     const unordered_flat_map<int16_t, SourceLocationZones>& GetSourceLocationZones() const { return m_data.sourceLocationZones; }
     bool AreSourceLocationZonesReady() const { return m_data.sourceLocationZonesReady; }
+    bool AreSourceLocationStatsReady() const { return m_data.sourceLocationStatsReady; }
     bool IsCpuUsageReady() const { return m_data.ctxUsageReady; }
 
     const unordered_flat_map<uint64_t, SymbolData>& GetSymbolMap() const { return m_data.symbolMap; }
@@ -568,6 +633,10 @@ public:
     size_t GetSendQueueSize() const { return m_mbpsData.queue; }
     size_t GetSendInFlight() const { return m_serverQuerySpaceBase - m_serverQuerySpaceLeft; }
     uint64_t GetDataTransferred() const { return m_mbpsData.transferred; }
+    float GetDecompressSpeed() const { return m_mbpsData.decSpeed; }
+    TransportCodec GetTransportCodec() const { return m_codec; }
+    int GetTransportCodecLevel() const { return m_codecLevel; }
+    bool IsTransportShm() const { return m_shmTransport; }
 
     bool HasData() const { return m_hasData.load( std::memory_order_acquire ); }
     bool IsConnected() const { return m_connected.load( std::memory_order_relaxed ); }
@@ -577,23 +646,32 @@ public:
     void Disconnect();
     bool WasDisconnectIssued() const { return m_disconnect; }
 
-    void Write( FileWrite& f );
+    void Write( FileWrite& f ) { Write( f, 0, std::numeric_limits<int64_t>::max() ); }
+    // Saves only the data in the given time range. Zones and context switches crossing the
+    // range boundaries are clipped to it.
+    void Write( FileWrite& f, int64_t rangeStart, int64_t rangeEnd );
     int GetTraceVersion() const { return m_traceVersion; }
     uint8_t GetHandshakeStatus() const { return m_handshake.load( std::memory_order_relaxed ); }
     int64_t GetSamplingPeriod() const { return m_samplingPeriod; }
 
     static const LoadProgress& GetLoadProgress() { return s_loadProgress; }
     int64_t GetLoadTime() const { return m_loadTime; }
+    const IngestStats& GetIngestStats() const { return m_ingestStats; }
+    static void SetIngestEventTiming( bool enable ) { s_ingestEventTiming = enable; }
 
     void ClearFailure() { m_failure = Failure::None; }
     Failure GetFailureType() const { return m_failure; }
     const FailureData& GetFailureData() const { return m_failureData; }
     static const char* GetFailureString( Failure failure );
+    static const char* GetTransportCodecName( TransportCodec codec );
 
     const char* UnpackFrameImage( const FrameImage& image ) { return m_texcomp.Unpack( image ); }
 
     const Vector<Parameter>& GetParameters() const { return m_params; }
     void SetParameter( size_t paramIdx, int32_t val );
+    bool IsZoneCaptureEnabled( int16_t srcloc ) const { return m_disabledZones.find( srcloc ) == m_disabledZones.end(); }
+    bool CanFilterZone( int16_t srcloc ) const { return srcloc > 0 && m_sock.IsValid() && IsConnected(); }
+    void SetZoneCaptureEnabled( int16_t srcloc, bool enabled );
 
     const decltype(DataBlock::cpuTopology)& GetCpuTopology() const { return m_data.cpuTopology; }
     const CpuThreadTopology* GetThreadTopology( uint32_t cpuThread ) const;
@@ -605,12 +683,16 @@ public:
 private:
     void Network();
     void Exec();
+    void ProcessWelcome( const WelcomeMessage& welcome );
+    void ProcessOnDemandPayload( const OnDemandPayloadMessage& onDemand );
+    void ReplayJournal( FileRead& f );
     void Query( ServerQuery type, uint64_t data, uint32_t extra = 0 );
     void QueryTerminate();
     void QuerySourceFile( const char* fn );
     void QueryDataTransfer( const void* ptr, size_t size );
 
     tracy_force_inline bool DispatchProcess( const QueueItem& ev, const char*& ptr );
+    void DispatchJournal( const QueueItem& ev, const char*& ptr );
     tracy_force_inline bool Process( const QueueItem& ev );
     tracy_force_inline void ProcessThreadContext( const QueueThreadContext& ev );
     tracy_force_inline void ProcessZoneBegin( const QueueZoneBegin& ev );
@@ -667,7 +749,10 @@ private:
     tracy_force_inline void ProcessMemFreeCallstackNamed( const QueueMemFree& ev );
     tracy_force_inline void ProcessCallstackSerial();
     tracy_force_inline void ProcessCallstack();
+    tracy_force_inline void ProcessCallstackCached( const QueueCallstackCached& ev );
     tracy_force_inline void ProcessCallstackSample( const QueueCallstackSample& ev );
+    tracy_force_inline void ProcessSamplesLost( const QueueSamplesLost& ev );
+    tracy_force_inline void ProcessZonesDropped( const QueueZonesDropped& ev );
     tracy_force_inline void ProcessCallstackFrameSize( const QueueCallstackFrameSize& ev );
     tracy_force_inline void ProcessCallstackFrame( const QueueCallstackFrame& ev, bool querySymbols );
     tracy_force_inline void ProcessSymbolInformation( const QueueSymbolInformation& ev );
@@ -681,16 +766,16 @@ private:
     tracy_force_inline void ProcessCpuTopology( const QueueCpuTopology& ev );
     tracy_force_inline void ProcessMemNamePayload( const QueueMemNamePayload& ev );
 
-    tracy_force_inline ZoneEvent* AllocZoneEvent();
-    tracy_force_inline void ProcessZoneBeginImpl( ZoneEvent* zone, const QueueZoneBegin& ev );
-    tracy_force_inline void ProcessZoneBeginAllocSrcLocImpl( ZoneEvent* zone, const QueueZoneBeginLean& ev );
+    tracy_force_inline MessageData* AllocMessageData();
+    tracy_force_inline void ProcessZoneBeginImpl( const QueueZoneBegin& ev );
+    tracy_force_inline void ProcessZoneBeginAllocSrcLocImpl( const QueueZoneBeginLean& ev );
     tracy_force_inline void ProcessGpuZoneBeginImpl( GpuEvent* zone, const QueueGpuZoneBegin& ev, bool serial );
     tracy_force_inline void ProcessGpuZoneBeginAllocSrcLocImpl( GpuEvent* zone, const QueueGpuZoneBeginLean& ev, bool serial );
     tracy_force_inline void ProcessGpuZoneBeginImplCommon( GpuEvent* zone, const QueueGpuZoneBeginLean& ev, bool serial );
     tracy_force_inline MemEvent* ProcessMemAllocImpl( uint64_t memname, MemData& memdata, const QueueMemAlloc& ev );
     tracy_force_inline MemEvent* ProcessMemFreeImpl( uint64_t memname, MemData& memdata, const QueueMemFree& ev );
 
-    void ZoneStackFailure( uint64_t thread, const ZoneEvent* ev );
+    void ZoneStackFailure( uint64_t thread, int16_t srcloc );
     void ZoneDoubleEndFailure( uint64_t thread, const ZoneEvent* ev );
     void ZoneTextFailure( uint64_t thread );
     void ZoneColorFailure( uint64_t thread );
@@ -747,7 +832,12 @@ private:
     uint64_t* GetSourceLocationZonesCntReal( uint16_t srcloc );
 #endif
 
-    tracy_force_inline void NewZone( ZoneEvent* zone, uint64_t thread );
+    tracy_force_inline void NewZone( int64_t start, int16_t srcloc, uint64_t thread );
+    tracy_force_inline void QueueTimelineOp( ThreadData* td, int64_t time, int32_t child, int32_t data );
+    tracy_force_inline void QueuePlotOp( PlotData* plot, int64_t time, double val );
+    void ProcessTimelineOps();
+    void LinkTimelineLane( size_t lane, size_t lanes );
+    void CountTimelineLane( size_t lane, size_t lanes );
 
     void InsertLockEvent( LockMap& lockmap, LockEvent* lev, uint64_t thread, int64_t time );
 
@@ -807,34 +897,45 @@ private:
     tracy_force_inline int AddGhostZone( const VarArray<CallstackFrameId>& cs, Vector<GhostZone>* vec, uint64_t t );
 #endif
 
-    tracy_force_inline int64_t ReadTimeline( FileRead& f, ZoneEvent* zone, int64_t refTime, int32_t& childIdx );
-    tracy_force_inline int64_t ReadTimelineHaveSize( FileRead& f, ZoneEvent* zone, int64_t refTime, int32_t& childIdx, uint32_t sz );
+    template<class Reader>
+    tracy_force_inline int64_t ReadTimelineHaveSize( Reader& f, ZoneEvent* zone, int64_t refTime, int32_t& childIdx, uint32_t sz, Slab<64*1024*1024>& slab );
     tracy_force_inline void ReadTimelinePre063( FileRead& f, ZoneEvent* zone, int64_t& refTime, int32_t& childIdx, int fileVer );
     tracy_force_inline void ReadTimeline( FileRead& f, GpuEvent* zone, int64_t& refTime, int64_t& refGpuTime, int32_t& childIdx );
     tracy_force_inline void ReadTimelineHaveSize( FileRead& f, GpuEvent* zone, int64_t& refTime, int64_t& refGpuTime, int32_t& childIdx, uint64_t sz );
 
 #ifndef TRACY_NO_STATISTICS
-    tracy_force_inline void ReconstructZoneStatistics( ZoneEvent& zone, uint16_t thread );
+    tracy_force_inline void ReconstructZoneStatistics( ZoneEvent& zone, uint16_t thread, bool zonesOnly );
 #else
     tracy_force_inline void CountZoneStatistics( ZoneEvent* zone );
+    void CountZoneStatistics( Vector<short_ptr<ZoneEvent>>& vec );
+
+    void DropHistory( int64_t time );
+    uint64_t DropZones( Vector<short_ptr<ZoneEvent>>& vec, int64_t time );
+    uint64_t RecycleZone( ZoneEvent* zone );
 #endif
 
     tracy_force_inline ZoneExtra& GetZoneExtraMutable( const ZoneEvent& ev ) { return m_data.zoneExtra[ev.extra]; }
+    tracy_force_inline uint32_t NewZoneExtra();
     tracy_force_inline ZoneExtra& AllocZoneExtra( ZoneEvent& ev );
     tracy_force_inline ZoneExtra& RequestZoneExtra( ZoneEvent& ev );
+    tracy_force_inline ZoneExtra& RequestZoneExtra( ThreadData* td );
 
     void UpdateMbps( int64_t td );
 
-    int64_t ReadTimeline( FileRead& f, Vector<short_ptr<ZoneEvent>>& vec, uint32_t size, int64_t refTime, int32_t& childIdx );
+    template<class Reader>
+    int64_t ReadTimeline( Reader& f, Vector<short_ptr<ZoneEvent>>& vec, uint32_t size, int64_t refTime, int32_t& childIdx, Slab<64*1024*1024>& slab );
     void ReadTimelinePre063( FileRead& f, Vector<short_ptr<ZoneEvent>>& vec, uint64_t size, int64_t& refTime, int32_t& childIdx, int fileVer );
     void ReadTimeline( FileRead& f, Vector<short_ptr<GpuEvent>>& vec, uint64_t size, int64_t& refTime, int64_t& refGpuTime, int32_t& childIdx );
 
-    tracy_force_inline void WriteTimeline( FileWrite& f, const Vector<short_ptr<ZoneEvent>>& vec, int64_t& refTime );
-    tracy_force_inline void WriteTimeline( FileWrite& f, const Vector<short_ptr<GpuEvent>>& vec, int64_t& refTime, int64_t& refGpuTime );
+    void CountTimeline( const Vector<short_ptr<ZoneEvent>>& vec, int64_t rangeStart, int64_t rangeEnd, uint64_t& zones, uint32_t& children ) const;
+    void CollectZoneStatistics( const Vector<short_ptr<ZoneEvent>>& vec, int64_t rangeStart, int64_t rangeEnd, unordered_flat_map<int16_t, SourceLocationZones>& stats ) const;
+    uint64_t CountTimeline( const Vector<short_ptr<GpuEvent>>& vec, int64_t rangeStart, int64_t rangeEnd, bool recursive ) const;
+    tracy_force_inline void WriteTimeline( FileWrite& f, const Vector<short_ptr<ZoneEvent>>& vec, int64_t& refTime, int64_t rangeStart, int64_t rangeEnd );
+    tracy_force_inline void WriteTimeline( FileWrite& f, const Vector<short_ptr<GpuEvent>>& vec, int64_t& refTime, int64_t& refGpuTime, int64_t rangeStart, int64_t rangeEnd );
     template<typename Adapter, typename V>
-    void WriteTimelineImpl( FileWrite& f, const V& vec, int64_t& refTime );
+    void WriteTimelineImpl( FileWrite& f, const V* begin, const V* end, int64_t& refTime, int64_t rangeStart, int64_t rangeEnd );
     template<typename Adapter, typename V>
-    void WriteTimelineImpl( FileWrite& f, const V& vec, int64_t& refTime, int64_t& refGpuTime );
+    void WriteTimelineImpl( FileWrite& f, const V& vec, int64_t& refTime, int64_t& refGpuTime, int64_t rangeStart, int64_t rangeEnd );
 
     int64_t TscTime( int64_t tsc ) { return int64_t( tsc * m_timerMul ); }
     int64_t TscTime( uint64_t tsc ) { return int64_t( tsc * m_timerMul ); }
@@ -860,17 +961,29 @@ private:
     uint64_t m_captureTime;
     uint64_t m_executableTime;
     std::string m_hostInfo;
+    std::string m_pagedDir;
     uint64_t m_pid;
     int64_t m_samplingPeriod;
     bool m_terminate = false;
     bool m_crashed = false;
     bool m_disconnect = false;
     void* m_stream;     // LZ4_streamDecode_t*
+    TransportCodec m_codec;
+    int8_t m_codecLevel;
     char* m_buffer;
     int m_bufferOffset;
+    bool m_shmRequest = false;
+    bool m_shmTransport = false;
+#ifdef TRACY_HAS_SHM
+    ShmRing m_shm;
+#endif
     bool m_onDemand;
     bool m_ignoreMemFreeFaults;
     bool m_codeTransfer;
+    FileWrite* m_journal = nullptr;
+    std::string m_journalString[2];
+    int64_t m_historyLimit = 0;
+    int64_t m_historyDropTime = 0;
 
     short_ptr<GpuCtxData> m_gpuCtxMap[256];
     uint32_t m_pendingCallstackId = 0;
@@ -903,6 +1016,12 @@ private:
     uint64_t m_memNamePayload = 0;
 
     Slab<64*1024*1024> m_slab;
+    std::vector<std::unique_ptr<Slab<64*1024*1024>>> m_loadSlabs;
+
+    std::vector<ThreadData*> m_timelineThreads;
+    std::vector<PlotData*> m_timelinePlots;
+    std::vector<TimelineLane> m_timelineLanes;
+    std::unique_ptr<TaskDispatch> m_timelineDispatch;
 
     DataBlock m_data;
     MbpsBlock m_mbpsData;
@@ -912,6 +1031,8 @@ private:
 
     static LoadProgress s_loadProgress;
     int64_t m_loadTime;
+    static bool s_ingestEventTiming;
+    IngestStats m_ingestStats = {};
 
     Failure m_failure = Failure::None;
     FailureData m_failureData = {};
@@ -935,11 +1056,13 @@ private:
 
     std::atomic<uint64_t> m_bytes { 0 };
     std::atomic<uint64_t> m_decBytes { 0 };
+    std::atomic<uint64_t> m_decTime { 0 };
 
     struct NetBuffer
     {
-        int bufferOffset;
+        const char* ptr;        // nullptr: connection closed
         int size;
+        uint64_t shmRelease;    // shared memory ring position to release after processing, or 0
     };
 
     std::vector<NetBuffer> m_netRead;
@@ -952,14 +1075,19 @@ private:
 
 #ifdef TRACY_NO_STATISTICS
     Vector<ZoneEvent*> m_zoneEventPool;
+    Vector<MessageData*> m_messagePool;
+    Vector<int32_t> m_zoneChildrenPool;
+    Vector<uint32_t> m_zoneExtraPool;
 #endif
 
     Vector<Parameter> m_params;
+    unordered_flat_set<int16_t> m_disabledZones;
 
     char* m_tmpBuf = nullptr;
     size_t m_tmpBufSize = 0;
 
     unordered_flat_map<uint64_t, uint32_t> m_nextCallstack;
+    unordered_flat_map<uint32_t, uint32_t> m_callstackCached;
     std::vector<const char*> m_sourceCodeQuery;
 };
 
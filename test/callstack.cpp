@@ -0,0 +1,84 @@
+// Compares the cost of frame pointer and unwind table based call stack capture.
+// Build with "make callstack", which enables TRACY_CALLSTACK_FRAMEPOINTER and
+// frame pointers.
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../client/TracyCallstack.hpp"
+
+#ifndef TRACY_HAS_FRAMEPOINTER_CALLSTACK
+
+int main()
+{
+    fprintf( stderr, "Frame pointer call stack capture is not available on this platform.\n" );
+    return 1;
+}
+
+#else
+
+enum { Iterations = 200000 };
+enum { Depth = 62 };
+
+struct Result
+{
+    double fp;
+    double unwind;
+    uintptr_t fpFrames;
+    uintptr_t unwindFrames;
+    bool match;
+};
+
+static tracy_no_inline void Measure( Result& res )
+{
+    uintptr_t fpTrace[Depth];
+    uintptr_t unwindTrace[Depth];
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for( int i=0; i<Iterations; i++ ) res.fpFrames = tracy::FramePointerTrace( fpTrace, Depth );
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for( int i=0; i<Iterations; i++ ) res.unwindFrames = tracy::CallstackUnwind( unwindTrace, Depth );
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    res.fp = std::chrono::duration_cast<std::chrono::nanoseconds>( t1 - t0 ).count() / double( Iterations );
+    res.unwind = std::chrono::duration_cast<std::chrono::nanoseconds>( t2 - t1 ).count() / double( Iterations );
+
+    // The first frame is the call site of the capture function, which differs between the two loops.
+    // The frame pointer chain ends early in system libraries built without frame pointers.
+    res.match = res.fpFrames <= res.unwindFrames;
+    for( uintptr_t i=1; res.match && i<res.fpFrames; i++ )
+    {
+        if( fpTrace[i] != unwindTrace[i] ) res.match = false;
+    }
+}
+
+static tracy_no_inline void Recurse( int level, Result& res )
+{
+    if( level == 0 )
+    {
+        Measure( res );
+    }
+    else
+    {
+        Recurse( level - 1, res );
+    }
+    // Prevent tail call optimization.
+    asm volatile( "" ::: "memory" );
+}
+
+int main()
+{
+    tracy::InitCallstack();
+
+    printf( "%6s %10s %14s %12s %12s %8s\n", "depth", "fp frames", "unwind frames", "fp [ns]", "unwind [ns]", "match" );
+    static const int levels[] = { 0, 5, 10, 20, 40, 60 };
+    for( auto level : levels )
+    {
+        Result res;
+        Recurse( level, res );
+        printf( "%6i %10i %14i %12.1f %12.1f %8s\n", level, int( res.fpFrames ), int( res.unwindFrames ), res.fp, res.unwind, res.match ? "yes" : "no" );
+    }
+    return 0;
+}
+
+#endif
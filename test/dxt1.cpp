@@ -0,0 +1,69 @@
+// Compares the throughput of the DXT1 frame image encoders. Build with "make dxt1" and run
+// in this directory, as the test image is tiled to a 1920x1080 frame.
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../client/TracyDxt1.hpp"
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_ONLY_JPEG
+#include "stb_image.h"
+
+enum { Width = 1920 };
+enum { Height = 1080 };
+enum { Iterations = 200 };
+
+int main()
+{
+    int x, y;
+    auto image = stbi_load( "image.jpg", &x, &y, nullptr, 4 );
+    if( !image )
+    {
+        fprintf( stderr, "Cannot load image.jpg.\n" );
+        return 1;
+    }
+
+    auto frame = new char[Width * Height * 4];
+    for( int i=0; i<Height; i++ )
+    {
+        for( int j=0; j<Width; j++ )
+        {
+            memcpy( frame + ( i * Width + j ) * 4, image + ( ( i % y ) * x + ( j % x ) ) * 4, 4 );
+        }
+    }
+    stbi_image_free( image );
+
+    const auto csz = Width * Height / 2;
+    auto ref = new char[csz];
+    auto dst = new char[csz];
+    tracy::CompressImageDxt1( tracy::Dxt1Encoder::Scalar, frame, ref, Width, Height );
+
+    struct { tracy::Dxt1Encoder encoder; const char* name; } encoders[] = {
+        { tracy::Dxt1Encoder::Scalar, "scalar" },
+        { tracy::Dxt1Encoder::Sse41, "SSE4.1" },
+        { tracy::Dxt1Encoder::Avx2, "AVX2" },
+        { tracy::Dxt1Encoder::Neon, "NEON" },
+    };
+
+    const auto mpix = double( Width ) * Height / 1000000 * Iterations;
+    printf( "%8s %10s %12s %8s %8s\n", "encoder", "MP/s", "ms/frame", "speedup", "match" );
+    double scalar = 0;
+    for( auto& v : encoders )
+    {
+        if( !tracy::IsDxt1EncoderAvailable( v.encoder ) ) continue;
+        memset( dst, 0, csz );
+        auto t0 = std::chrono::high_resolution_clock::now();
+        for( int i=0; i<Iterations; i++ ) tracy::CompressImageDxt1( v.encoder, frame, dst, Width, Height );
+        auto t1 = std::chrono::high_resolution_clock::now();
+        const auto s = std::chrono::duration_cast<std::chrono::nanoseconds>( t1 - t0 ).count() / 1000000000.;
+        if( v.encoder == tracy::Dxt1Encoder::Scalar ) scalar = s;
+        printf( "%8s %10.1f %12.2f %7.1fx %8s%s\n", v.name, mpix / s, s * 1000 / Iterations, scalar / s, memcmp( ref, dst, csz ) == 0 ? "yes" : "no", v.encoder == tracy::GetDxt1Encoder() ? " (selected)" : "" );
+    }
+
+    delete[] frame;
+    delete[] ref;
+    delete[] dst;
+    return 0;
+}
@@ -0,0 +1,250 @@
+// Measures how fast the server processes a recorded data stream. Record a capture journal with
+// "capture -j", build with "make ingest" and run "tracy_ingest capture.journal". The journal is
+// replayed through the same processing path as a live capture, without the network transfer.
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "../server/TracyFileRead.hpp"
+#include "../server/TracyPrint.hpp"
+#include "../server/TracyWorker.hpp"
+
+static const char* QueueTypeName[] = {
+    "ZoneText",
+    "ZoneName",
+    "Message",
+    "MessageColor",
+    "MessageCallstack",
+    "MessageColorCallstack",
+    "MessageAppInfo",
+    "ZoneBeginAllocSrcLoc",
+    "ZoneBeginAllocSrcLocCallstack",
+    "CallstackSerial",
+    "Callstack",
+    "CallstackAlloc",
+    "CallstackSample",
+    "FrameImage",
+    "ZoneBegin",
+    "ZoneBeginCallstack",
+    "ZoneEnd",
+    "LockWait",
+    "LockObtain",
+    "LockRelease",
+    "LockSharedWait",
+    "LockSharedObtain",
+    "LockSharedRelease",
+    "LockName",
+    "MemAlloc",
+    "MemAllocNamed",
+    "MemFree",
+    "MemFreeNamed",
+    "MemAllocCallstack",
+    "MemAllocCallstackNamed",
+    "MemFreeCallstack",
+    "MemFreeCallstackNamed",
+    "GpuZoneBegin",
+    "GpuZoneBeginCallstack",
+    "GpuZoneBeginAllocSrcLoc",
+    "GpuZoneBeginAllocSrcLocCallstack",
+    "GpuZoneEnd",
+    "GpuZoneBeginSerial",
+    "GpuZoneBeginCallstackSerial",
+    "GpuZoneBeginAllocSrcLocSerial",
+    "GpuZoneBeginAllocSrcLocCallstackSerial",
+    "GpuZoneEndSerial",
+    "PlotData",
+    "ContextSwitch",
+    "ThreadWakeup",
+    "GpuTime",
+    "GpuContextName",
+    "Terminate",
+    "KeepAlive",
+    "ThreadContext",
+    "GpuCalibration",
+    "Crash",
+    "CrashReport",
+    "ZoneValidation",
+    "ZoneColor",
+    "ZoneValue",
+    "FrameMarkMsg",
+    "FrameMarkMsgStart",
+    "FrameMarkMsgEnd",
+    "SourceLocation",
+    "LockAnnounce",
+    "LockTerminate",
+    "LockMark",
+    "MessageLiteral",
+    "MessageLiteralColor",
+    "MessageLiteralCallstack",
+    "MessageLiteralColorCallstack",
+    "GpuNewContext",
+    "CallstackFrameSize",
+    "CallstackFrame",
+    "SymbolInformation",
+    "CodeInformation",
+    "SysTimeReport",
+    "TidToPid",
+    "PlotConfig",
+    "ParamSetup",
+    "AckServerQueryNoop",
+    "AckSourceCodeNotAvailable",
+    "CpuTopology",
+    "CallstackCached",
+    "SamplesLost",
+    "ZonesDropped",
+    "SingleStringData",
+    "SecondStringData",
+    "MemNamePayload",
+    "StringData",
+    "ThreadName",
+    "PlotName",
+    "SourceLocationPayload",
+    "CallstackPayload",
+    "CallstackAllocPayload",
+    "FrameName",
+    "FrameImageData",
+    "ExternalName",
+    "ExternalThreadName",
+    "SymbolCode",
+    "SourceCode",
+};
+
+static_assert( sizeof( QueueTypeName ) / sizeof( *QueueTypeName ) == (uint8_t)tracy::QueueType::NUM_TYPES, "QueueTypeName mismatch" );
+
+enum { NumTypes = (uint8_t)tracy::QueueType::NUM_TYPES };
+
+static void Usage()
+{
+    printf( "Usage: tracy_ingest [options] capture.journal\n\n" );
+    printf( "  -t: measure the processing time of each event type (slows down the processing)\n" );
+    printf( "  -n runs: replay the journal multiple times and report the fastest run\n" );
+    exit( 1 );
+}
+
+int main( int argc, char** argv )
+{
+    bool eventTiming = false;
+    int runs = 1;
+    int i;
+    for( i=1; i<argc && argv[i][0] == '-'; i++ )
+    {
+        if( strcmp( argv[i], "-t" ) == 0 )
+        {
+            eventTiming = true;
+        }
+        else if( strcmp( argv[i], "-n" ) == 0 && i+1 < argc )
+        {
+            runs = atoi( argv[++i] );
+            if( runs < 1 ) Usage();
+        }
+        else
+        {
+            Usage();
+        }
+    }
+    if( argc - i != 1 ) Usage();
+    const char* input = argv[i];
+
+    tracy::Worker::SetIngestEventTiming( eventTiming );
+
+    tracy::IngestStats best;
+    int64_t bestWall = 0;
+    for( int run=0; run<runs; run++ )
+    {
+        auto f = std::unique_ptr<tracy::FileRead>( tracy::FileRead::Open( input ) );
+        if( !f )
+        {
+            fprintf( stderr, "Cannot open input file!\n" );
+            exit( 1 );
+        }
+
+        try
+        {
+            const auto t0 = std::chrono::high_resolution_clock::now();
+            tracy::Worker worker( *f, tracy::EventType::All, false );
+            const auto t1 = std::chrono::high_resolution_clock::now();
+            const auto& stats = worker.GetIngestStats();
+            if( stats.buffers == 0 )
+            {
+                fprintf( stderr, "The input file is not a capture journal.\n" );
+                exit( 1 );
+            }
+            if( run == 0 || stats.dispatchTime + stats.timelineTime < best.dispatchTime + best.timelineTime )
+            {
+                best = stats;
+                bestWall = std::chrono::duration_cast<std::chrono::nanoseconds>( t1 - t0 ).count();
+            }
+        }
+        catch( const tracy::UnsupportedVersion& e )
+        {
+            fprintf( stderr, "The journal was recorded by a future version.\n" );
+            exit( 1 );
+        }
+        catch( const tracy::LegacyVersion& e )
+        {
+            fprintf( stderr, "The journal was recorded by a different version.\n" );
+            exit( 1 );
+        }
+        catch( const tracy::FileReadError& e )
+        {
+            fprintf( stderr, "The journal cannot be read.\n" );
+            exit( 1 );
+        }
+    }
+
+    uint64_t events = 0;
+    uint64_t bytes = 0;
+    int64_t eventTime = 0;
+    for( int j=0; j<NumTypes; j++ )
+    {
+        events += best.count[j];
+        bytes += best.bytes[j];
+        eventTime += best.time[j];
+    }
+    const auto processTime = best.dispatchTime + best.timelineTime;
+    const auto sec = processTime / 1000000000.;
+
+    struct rusage usage;
+    getrusage( RUSAGE_SELF, &usage );
+
+    printf( "Events:      %s in %s (%s buffers)\n", tracy::RealToString( events ), tracy::MemSizeToString( bytes ), tracy::RealToString( best.buffers ) );
+    printf( "Processing:  %s (%s events/s, %s/s)\n", tracy::TimeToString( processTime ), tracy::RealToString( uint64_t( events / sec ) ), tracy::MemSizeToString( int64_t( bytes / sec ) ) );
+    printf( "  events:    %s\n", tracy::TimeToString( best.dispatchTime ) );
+    printf( "  timelines: %s\n", tracy::TimeToString( best.timelineTime ) );
+    printf( "Postponed:   %s\n", tracy::TimeToString( best.postponedTime ) );
+    printf( "Wall time:   %s (includes reading the journal)\n", tracy::TimeToString( bestWall ) );
+    printf( "Peak memory: %s allocated (peak RSS %s)\n", tracy::MemSizeToString( best.peakMemory ), tracy::MemSizeToString( int64_t( usage.ru_maxrss ) * 1024 ) );
+    printf( "\n" );
+
+    int order[NumTypes];
+    for( int j=0; j<NumTypes; j++ ) order[j] = j;
+    if( eventTiming )
+    {
+        std::sort( order, order+NumTypes, [&best] ( int l, int r ) { return best.time[l] > best.time[r]; } );
+        printf( "%-40s %14s %8s %12s %12s %8s %10s\n", "Event type", "Count", "Share", "Bytes", "Time", "Share", "ns/event" );
+    }
+    else
+    {
+        std::sort( order, order+NumTypes, [&best] ( int l, int r ) { return best.count[l] > best.count[r]; } );
+        printf( "%-40s %14s %8s %12s\n", "Event type", "Count", "Share", "Bytes" );
+    }
+    for( int j=0; j<NumTypes; j++ )
+    {
+        const auto t = order[j];
+        if( best.count[t] == 0 ) continue;
+        printf( "%-40s %14s %7.2f%% %12s", QueueTypeName[t], tracy::RealToString( best.count[t] ), 100. * best.count[t] / events, tracy::MemSizeToString( best.bytes[t] ) );
+        if( eventTiming )
+        {
+            printf( " %12s %7.2f%% %10.1f", tracy::TimeToString( best.time[t] ), 100. * best.time[t] / eventTime, double( best.time[t] ) / best.count[t] );
+        }
+        printf( "\n" );
+    }
+
+    return 0;
+}
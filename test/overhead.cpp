@@ -0,0 +1,379 @@
+// Measures the cost of the instrumentation macros. Build with "make overhead", which disables
+// system tracing, so that only the instrumentation is measured. Memory and CPU time are read from
+// /proc, which makes the benchmark Linux only.
+//
+// Without options nothing connects to the program and the events pile up in the client queues.
+// With -c an in-process stub connects as the server and throws the received data away, so the
+// profiler worker thread does its usual work of draining the queues and sending the data.
+
+#include <atomic>
+#include <chrono>
+#include <dirent.h>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "../Tracy.hpp"
+#include "../common/TracyProtocol.hpp"
+#include "../common/TracySocket.hpp"
+
+extern "C" void BenchCZone( int iterations );
+
+static void BenchZoneScoped( int iterations )
+{
+    for( int i=0; i<iterations; i++ )
+    {
+        ZoneScoped;
+    }
+}
+
+static void BenchZoneScopedS( int iterations )
+{
+    for( int i=0; i<iterations; i++ )
+    {
+        ZoneScopedS( 8 );
+    }
+}
+
+static void BenchPlot( int iterations )
+{
+    for( int i=0; i<iterations; i++ )
+    {
+        TracyPlot( "Benchmark plot", int64_t( i ) );
+    }
+}
+
+static void BenchMessage( int iterations )
+{
+    for( int i=0; i<iterations; i++ )
+    {
+        TracyMessage( "Benchmark message", 17 );
+    }
+}
+
+static void BenchAlloc( int iterations )
+{
+    char block[64];
+    for( int i=0; i<iterations; i++ )
+    {
+        TracyAlloc( block, sizeof( block ) );
+        TracyFree( block );
+    }
+}
+
+static void BenchMutex( int iterations )
+{
+    std::mutex lock;
+    for( int i=0; i<iterations; i++ )
+    {
+        lock.lock();
+        lock.unlock();
+    }
+}
+
+// Each thread has its own lock, so that lock contention doesn't hide the instrumentation cost.
+static void BenchLockable( int iterations )
+{
+    TracyLockable( std::mutex, lock );
+    for( int i=0; i<iterations; i++ )
+    {
+        lock.lock();
+        lock.unlock();
+    }
+}
+
+struct Benchmark
+{
+    const char* name;
+    void(*func)( int );
+};
+
+static const Benchmark Benchmarks[] = {
+    { "ZoneScoped", BenchZoneScoped },
+    { "ZoneScopedS(8)", BenchZoneScopedS },
+    { "TracyCZone + TracyCZoneEnd", BenchCZone },
+    { "TracyPlot", BenchPlot },
+    { "TracyMessage", BenchMessage },
+    { "TracyAlloc + TracyFree", BenchAlloc },
+    { "std::mutex lock + unlock", BenchMutex },
+    { "TracyLockable lock + unlock", BenchLockable },
+};
+
+
+// Minimal server side of the protocol. The data frames are counted and discarded.
+class DrainStub
+{
+public:
+    DrainStub( uint16_t port, tracy::TransportCodec codec )
+        : m_port( port )
+        , m_codec( codec )
+        , m_connected( false )
+        , m_failed( false )
+        , m_exit( false )
+        , m_bytes( 0 )
+        , m_thread( [this] { Run(); } )
+    {
+    }
+
+    ~DrainStub()
+    {
+        m_exit.store( true, std::memory_order_relaxed );
+        m_thread.join();
+    }
+
+    bool WaitConnected()
+    {
+        while( !m_connected.load( std::memory_order_acquire ) )
+        {
+            if( m_failed.load( std::memory_order_relaxed ) ) return false;
+            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+        }
+        return true;
+    }
+
+    // The client is drained when only a trickle of data arrives for a while. The profiler thread
+    // keeps sending small periodic reports (system time, keep alive), so the data flow never fully
+    // stops, and the window has to cover compression of a full frame on a loaded machine.
+    void WaitIdle()
+    {
+        auto last = m_bytes.load( std::memory_order_relaxed );
+        int idle = 0;
+        while( idle < 5 )
+        {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+            const auto bytes = m_bytes.load( std::memory_order_relaxed );
+            if( bytes - last < 1024 )
+            {
+                idle++;
+            }
+            else
+            {
+                idle = 0;
+            }
+            last = bytes;
+        }
+    }
+
+    void Terminate()
+    {
+        tracy::ServerQueryPacket query = { tracy::ServerQueryTerminate, 0, 0 };
+        m_sock.Send( &query, tracy::ServerQueryPacketSize );
+    }
+
+    uint64_t GetBytes() const { return m_bytes.load( std::memory_order_relaxed ); }
+
+private:
+    void Run()
+    {
+        auto ShouldExit = [this] { return m_exit.load( std::memory_order_relaxed ); };
+
+        while( !m_sock.Connect( "127.0.0.1", m_port ) )
+        {
+            if( ShouldExit() ) return;
+            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+        }
+
+        m_sock.Send( tracy::HandshakeShibboleth, tracy::HandshakeShibbolethSize );
+        uint32_t protocolVersion = tracy::ProtocolVersion;
+        m_sock.Send( &protocolVersion, sizeof( protocolVersion ) );
+        tracy::TransportRequestMessage transport = { m_codec, 0, 0 };
+        m_sock.Send( &transport, sizeof( transport ) );
+
+        tracy::HandshakeStatus handshake;
+        tracy::WelcomeMessage welcome;
+        if( !m_sock.Read( &handshake, sizeof( handshake ), 10, ShouldExit ) || handshake != tracy::HandshakeWelcome ||
+            !m_sock.Read( &welcome, sizeof( welcome ), 10, ShouldExit ) )
+        {
+            m_failed.store( true, std::memory_order_relaxed );
+            return;
+        }
+        if( welcome.onDemand != 0 )
+        {
+            tracy::OnDemandPayloadMessage onDemand;
+            if( !m_sock.Read( &onDemand, sizeof( onDemand ), 10, ShouldExit ) )
+            {
+                m_failed.store( true, std::memory_order_relaxed );
+                return;
+            }
+        }
+        m_connected.store( true, std::memory_order_release );
+
+        std::unique_ptr<char[]> buf( new char[tracy::LZ4Size] );
+        for(;;)
+        {
+            tracy::lz4sz_t sz;
+            if( !m_sock.Read( &sz, sizeof( sz ), 10, ShouldExit ) ) break;
+            if( sz > tracy::LZ4Size || !m_sock.Read( buf.get(), sz, 10, ShouldExit ) ) break;
+            m_bytes.fetch_add( sizeof( sz ) + sz, std::memory_order_relaxed );
+        }
+    }
+
+    uint16_t m_port;
+    tracy::TransportCodec m_codec;
+    std::atomic<bool> m_connected;
+    std::atomic<bool> m_failed;
+    std::atomic<bool> m_exit;
+    std::atomic<uint64_t> m_bytes;
+    tracy::Socket m_sock;
+    std::thread m_thread;
+};
+
+
+static int64_t GetResidentMemory()
+{
+    long pages = 0;
+    FILE* f = fopen( "/proc/self/statm", "r" );
+    if( !f ) return 0;
+    if( fscanf( f, "%*s %ld", &pages ) != 1 ) pages = 0;
+    fclose( f );
+    return int64_t( pages ) * sysconf( _SC_PAGESIZE );
+}
+
+// CPU time of the thread which sends the queued events to the server, in nanoseconds.
+static int64_t GetProfilerCpuTime()
+{
+    int64_t ret = 0;
+    auto dir = opendir( "/proc/self/task" );
+    if( !dir ) return 0;
+    while( auto ent = readdir( dir ) )
+    {
+        if( ent->d_name[0] == '.' ) continue;
+        char path[300];
+        char buf[512];
+        snprintf( path, sizeof( path ), "/proc/self/task/%s/stat", ent->d_name );
+        FILE* f = fopen( path, "r" );
+        if( !f ) continue;
+        const auto sz = fread( buf, 1, sizeof( buf ) - 1, f );
+        fclose( f );
+        buf[sz] = '\0';
+
+        // The thread name may contain spaces, fields are counted from its closing parenthesis.
+        const auto name = strchr( buf, '(' );
+        const auto nameEnd = strrchr( buf, ')' );
+        if( !name || !nameEnd || nameEnd - name - 1 != 14 || memcmp( name+1, "Tracy Profiler", 14 ) != 0 ) continue;
+        unsigned long utime, stime;
+        if( sscanf( nameEnd + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime ) == 2 )
+        {
+            ret += int64_t( utime + stime ) * 1000000000 / sysconf( _SC_CLK_TCK );
+        }
+    }
+    closedir( dir );
+    return ret;
+}
+
+static void Run( const Benchmark& bench, int threads, int iterations, DrainStub* stub )
+{
+    const auto mem0 = GetResidentMemory();
+    const auto cpu0 = GetProfilerCpuTime();
+    const auto bytes0 = stub ? stub->GetBytes() : 0;
+
+    std::atomic<int> ready( 0 );
+    std::atomic<bool> go( false );
+    std::vector<int64_t> time( threads );
+    std::vector<std::thread> workers;
+    for( int i=0; i<threads; i++ )
+    {
+        workers.emplace_back( [&, i] {
+            ready.fetch_add( 1, std::memory_order_relaxed );
+            while( !go.load( std::memory_order_acquire ) ) std::this_thread::yield();
+            const auto t0 = std::chrono::high_resolution_clock::now();
+            bench.func( iterations );
+            const auto t1 = std::chrono::high_resolution_clock::now();
+            time[i] = std::chrono::duration_cast<std::chrono::nanoseconds>( t1 - t0 ).count();
+        } );
+    }
+    while( ready.load( std::memory_order_relaxed ) != threads ) std::this_thread::yield();
+    go.store( true, std::memory_order_release );
+    for( auto& v : workers ) v.join();
+
+    const auto mem1 = GetResidentMemory();
+    if( stub ) stub->WaitIdle();
+    const auto cpu1 = GetProfilerCpuTime();
+
+    int64_t total = 0;
+    for( auto& v : time ) total += v;
+    const auto ops = double( threads ) * iterations;
+    printf( "%-30s %7i %10.1f %12.1f %12.1f", bench.name, threads, total / ops, ( mem1 - mem0 ) / ( 1024. * 1024. ), ( cpu1 - cpu0 ) / 1000000. );
+    if( stub )
+    {
+        printf( " %10.1f\n", ( stub->GetBytes() - bytes0 ) / ops );
+    }
+    else
+    {
+        printf( " %10s\n", "-" );
+    }
+    fflush( stdout );
+}
+
+static void Usage()
+{
+    printf( "Usage: tracy_overhead [options]\n\n" );
+    printf( "  -c: connect an in-process stub server which discards the data\n" );
+    printf( "  -r: request uncompressed data from the client (with -c)\n" );
+    printf( "  -t threads: number of threads in the contended runs (default: number of cores)\n" );
+    printf( "  -n iterations: number of calls per thread (default: 1000000)\n" );
+    exit( 1 );
+}
+
+int main( int argc, char** argv )
+{
+    bool consumer = false;
+    auto codec = tracy::TransportCodecLz4;
+    int threads = std::thread::hardware_concurrency();
+    int iterations = 1000000;
+    for( int i=1; i<argc; i++ )
+    {
+        if( strcmp( argv[i], "-c" ) == 0 )
+        {
+            consumer = true;
+        }
+        else if( strcmp( argv[i], "-r" ) == 0 )
+        {
+            codec = tracy::TransportCodecNone;
+        }
+        else if( strcmp( argv[i], "-t" ) == 0 && i+1 < argc )
+        {
+            threads = atoi( argv[++i] );
+            if( threads < 1 ) Usage();
+        }
+        else if( strcmp( argv[i], "-n" ) == 0 && i+1 < argc )
+        {
+            iterations = atoi( argv[++i] );
+            if( iterations < 1 ) Usage();
+        }
+        else
+        {
+            Usage();
+        }
+    }
+
+    std::unique_ptr<DrainStub> stub;
+    if( consumer )
+    {
+        const auto port = getenv( "TRACY_PORT" );
+        stub.reset( new DrainStub( port ? uint16_t( atoi( port ) ) : 8086, codec ) );
+        if( !stub->WaitConnected() )
+        {
+            fprintf( stderr, "Handshake with the profiled program failed.\n" );
+            return 1;
+        }
+        // Let the initial data go out before measuring.
+        stub->WaitIdle();
+    }
+
+    printf( "%-30s %7s %10s %12s %12s %10s\n", "Instrumentation", "Threads", "ns/call", "Memory MB", "Worker ms", "Sent B" );
+    for( auto& bench : Benchmarks )
+    {
+        Run( bench, 1, iterations, stub.get() );
+        if( threads > 1 ) Run( bench, threads, iterations, stub.get() );
+    }
+
+    if( stub ) stub->Terminate();
+    return 0;
+}
@@ -0,0 +1,12 @@
+// C API part of the instrumentation overhead benchmark, see overhead.cpp.
+
+#include "../TracyC.h"
+
+void BenchCZone( int iterations )
+{
+    for( int i=0; i<iterations; i++ )
+    {
+        TracyCZone( ctx, 1 );
+        TracyCZoneEnd( ctx );
+    }
+}
@@ -3,6 +3,7 @@
 #endif
 
 #include <chrono>
+#include <limits>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -29,9 +30,12 @@ void Usage()
     printf( "  -h: enable LZ4HC compression\n" );
     printf( "  -e: enable extreme LZ4HC compression (very slow)\n" );
     printf( "  -z level: use Zstd compression with given compression level\n" );
+    printf( "  -j streams: number of parallel compression streams (default: number of cores, up to 8)\n" );
+    printf( "  -m directory: page loaded data out to scratch files in given directory\n" );
     printf( "  -s flags: strip selected data from capture:\n" );
     printf( "      l: locks, m: messages, p: plots, M: memory, i: frame images\n" );
     printf( "      c: context switches, s: sampling data, C: symbol code, S: source cache\n" );
+    printf( "  --from ns, --to ns: save only the given time range of the capture\n" );
     exit( 1 );
 }
 
@@ -48,11 +52,30 @@ int main( int argc, char** argv )
     tracy::FileWrite::Compression clev = tracy::FileWrite::Compression::Fast;
     uint32_t events = tracy::EventType::All;
     int zstdLevel = 1;
+    int streams = -1;
+    const char* pagedDir = nullptr;
+    int64_t rangeStart = 0;
+    int64_t rangeEnd = std::numeric_limits<int64_t>::max();
+
+    struct option longOpts[] = {
+        { "from", required_argument, nullptr, 'F' },
+        { "to", required_argument, nullptr, 'T' },
+        { nullptr, 0, nullptr, 0 }
+    };
+
     int c;
-    while( ( c = getopt( argc, argv, "hez:s:" ) ) != -1 )
+    while( ( c = getopt_long( argc, argv, "hez:s:j:m:", longOpts, nullptr ) ) != -1 )
     {
         switch( c )
         {
+        case 'F':
+            rangeStart = atoll( optarg );
+            if( rangeStart < 0 ) Usage();
+            break;
+        case 'T':
+            rangeEnd = atoll( optarg );
+            if( rangeEnd < 0 ) Usage();
+            break;
         case 'h':
             clev = tracy::FileWrite::Compression::Slow;
             break;
@@ -68,6 +91,13 @@ int main( int argc, char** argv )
                 exit( 1 );
             }
             break;
+        case 'j':
+            streams = atoi( optarg );
+            if( streams < 1 ) Usage();
+            break;
+        case 'm':
+            pagedDir = optarg;
+            break;
         case 's':
         {
             auto ptr = optarg;
@@ -116,6 +146,11 @@ int main( int argc, char** argv )
         }
     }
     if( argc - optind != 2 ) Usage();
+    if( rangeStart > rangeEnd )
+    {
+        fprintf( stderr, "Time range start is past its end!\n" );
+        exit( 1 );
+    }
 
     const char* input = argv[optind];
     const char* output = argv[optind+1];
@@ -136,13 +171,13 @@ int main( int argc, char** argv )
         int inVer;
         {
             const auto t0 = std::chrono::high_resolution_clock::now();
-            tracy::Worker worker( *f, (tracy::EventType::Type)events, false );
+            tracy::Worker worker( *f, (tracy::EventType::Type)events, false, pagedDir );
 
 #ifndef TRACY_NO_STATISTICS
             while( !worker.AreSourceLocationZonesReady() ) std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
 #endif
 
-            auto w = std::unique_ptr<tracy::FileWrite>( tracy::FileWrite::Open( output, clev, zstdLevel ) );
+            auto w = std::unique_ptr<tracy::FileWrite>( tracy::FileWrite::Open( output, clev, zstdLevel, streams ) );
             if( !w )
             {
                 fprintf( stderr, "Cannot open output file!\n" );
@@ -150,7 +185,7 @@ int main( int argc, char** argv )
             }
             printf( "Saving... \r" );
             fflush( stdout );
-            worker.Write( *w );
+            worker.Write( *w, rangeStart, rangeEnd );
             w->Finish();
             const auto t1 = std::chrono::high_resolution_clock::now();
             const auto stats = w->GetCompressionStatistics();